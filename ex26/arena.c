@@ -0,0 +1,137 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdalign.h>
+#include "arena.h"
+#include "dbg.h"
+
+// every allocation starts on a boundary fit for any type
+#define ARENA_ALIGN alignof(max_align_t)
+#define ARENA_ROUND(N) (((N) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+Arena* Arena_create(size_t block_size)
+{
+	Arena* arena = calloc(1, sizeof(Arena));
+	check_mem(arena);
+
+	arena->block_size = block_size > 0 ? block_size : 64 * 1024;
+	return arena;
+
+error:
+	return NULL;
+}
+
+/* Free every allocation in the arena at once */
+void Arena_destroy(Arena* arena)
+{
+	ArenaBlock* block = NULL;
+
+	if (arena) {
+		while (arena->head != NULL) {
+			block = arena->head;
+			arena->head = block->next;
+			free(block);
+		}
+		free(arena);
+	}
+}
+
+static ArenaBlock* Arena_block(size_t size)
+{
+	ArenaBlock* block = malloc(sizeof(ArenaBlock) + size);
+
+	if (block != NULL) {
+		block->size = size;
+		block->used = 0;
+		block->next = NULL;
+	}
+	return block;
+}
+
+/* Carve size bytes out of the arena
+ * Allocations bigger than a quarter block get a block of their own,
+ * slotted in behind the current one so its free space isn't wasted.
+ *
+ * Input
+ * 		arena: where to allocate
+ * 		size: bytes wanted
+ * Output
+ * 		memory: aligned, uninitialised, NULL if out of memory
+ */
+void* Arena_alloc(Arena* arena, size_t size)
+{
+	ArenaBlock* block = arena->head;
+	size_t rounded = ARENA_ROUND(size > 0 ? size : 1);
+
+	if (block == NULL || block->size - block->used < rounded) {
+		if (block != NULL && rounded > arena->block_size / 4) {
+			ArenaBlock* own = Arena_block(rounded);
+			check_mem(own);
+			own->used = rounded;
+			own->next = block->next;
+			block->next = own;
+			// doesn't sit at the end of head, so it can't grow in place
+			arena->last = NULL;
+			return own->data;
+		}
+
+		block = Arena_block(rounded > arena->block_size ? rounded : arena->block_size);
+		check_mem(block);
+		block->next = arena->head;
+		arena->head = block;
+	}
+
+	arena->last = block->data + block->used;
+	block->used += rounded;
+	return arena->last;
+
+error:
+	return NULL;
+}
+
+/* Make an arena allocation bigger, like realloc
+ * The newest allocation grows in place when its block has room,
+ * anything else is copied and the old copy stays until the arena goes.
+ * Doubling capacity keeps the waste to at most the final size.
+ *
+ * Input
+ * 		arena: the arena old came from
+ * 		old: allocation to grow, NULL for a new one
+ * 		old_size: bytes of old to keep
+ * 		new_size: bytes wanted
+ * Output
+ * 		memory: the grown allocation, NULL if out of memory (old is untouched)
+ */
+void* Arena_grow(Arena* arena, void* old, size_t old_size, size_t new_size)
+{
+	ArenaBlock* block = arena->head;
+	void* grown = NULL;
+
+	if (old != NULL && old == arena->last) {
+		size_t start = (char*)old - block->data;
+		if (block->size - start >= ARENA_ROUND(new_size)) {
+			block->used = start + ARENA_ROUND(new_size);
+			return old;
+		}
+	}
+
+	grown = Arena_alloc(arena, new_size);
+	if (grown != NULL && old != NULL)
+		memcpy(grown, old, old_size < new_size ? old_size : new_size);
+	return grown;
+}
+
+char* Arena_strndup(Arena* arena, const char* text, size_t len)
+{
+	char* copy = Arena_alloc(arena, len + 1);
+
+	if (copy != NULL) {
+		memcpy(copy, text, len);
+		copy[len] = '\0';
+	}
+	return copy;
+}
+
+char* Arena_strdup(Arena* arena, const char* text)
+{
+	return Arena_strndup(arena, text, strlen(text));
+}
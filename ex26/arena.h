@@ -0,0 +1,30 @@
+#ifndef logfind_arena_h
+#define logfind_arena_h
+
+#include <stddef.h>
+
+// one chunk of memory allocations are carved out of
+typedef struct ArenaBlock {
+	struct ArenaBlock* next;
+	size_t size;
+	size_t used;
+	char data[];
+} ArenaBlock;
+
+// bump allocator for everything that lives as long as one run:
+// config patterns, terms and expanded paths, all freed together
+typedef struct Arena {
+	ArenaBlock* head;		// allocations come from here, newest block first
+	size_t block_size;
+	void* last;				// most recent allocation, the only one Arena_grow can extend in place
+} Arena;
+
+Arena* Arena_create(size_t block_size);
+void Arena_destroy(Arena* arena);
+
+void* Arena_alloc(Arena* arena, size_t size);
+void* Arena_grow(Arena* arena, void* old, size_t old_size, size_t new_size);
+char* Arena_strndup(Arena* arena, const char* text, size_t len);
+char* Arena_strdup(Arena* arena, const char* text);
+
+#endif
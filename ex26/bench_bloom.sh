@@ -0,0 +1,52 @@
+#!/bin/sh
+# Time searching a directory of rotated logs for terms that are mostly
+# absent: a plain search, the -b run that builds the Bloom filter
+# sidecars, and the runs after it that only read them. Every tenth file
+# gets a line the terms are in. Drops the page cache before every run
+# when allowed to (root).
+#
+# usage: ./bench_bloom.sh [files] [lines per file]
+
+FILES=${1:-200}
+LINES=${2:-20000}
+
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR" "$DIR.bloom"' EXIT
+
+./bench_corpus.sh "$DIR" "$FILES" "$LINES"
+for f in $(ls "$DIR"/*.log | awk 'NR % 10 == 1'); do
+	echo "2024-01-01T00:00:00 disk quota exceeded" >> "$f"
+done
+# rotated a while ago, so they count as settled
+touch -d '1 day ago' "$DIR"/*.log
+export LOGFIND_CONFIG="$DIR/logfind.conf"
+export LOGFIND_BLOOM="$DIR.bloom"
+
+cold="warm page cache (can't write /proc/sys/vm/drop_caches)"
+if [ -w /proc/sys/vm/drop_caches ]; then
+	cold="cold page cache"
+fi
+echo "$FILES files, $(du -sh "$DIR" | cut -f1), $cold"
+
+run() {
+	name=$1
+	shift
+	sync
+	[ -w /proc/sys/vm/drop_caches ] && echo 3 > /proc/sys/vm/drop_caches
+	start=$(date +%s.%N)
+	./logfind "$@" > "$DIR/got.out" 2>/dev/null
+	end=$(date +%s.%N)
+	if cmp -s "$DIR/expected.out" "$DIR/got.out"; then same=same; else same=DIFFERENT; fi
+	echo "$name" "$start" "$end" "$same" | awk '{ printf "%-26s %8.3f s  %s\n", $1, $3 - $2, $4 }'
+}
+
+for terms in "missing term" "quota exceeded"; do
+	rm -rf "$LOGFIND_BLOOM"
+	./logfind $terms > "$DIR/expected.out" 2>/dev/null
+	echo "'$terms': $(grep -c 'matches by' "$DIR/expected.out") of $FILES files match"
+	run plain $terms
+	run bloom,building -b $terms
+	run bloom,sidecars -b $terms
+	run bloom,sidecars,-j4 -b -j 4 $terms
+done
+echo "sidecars: $(du -sh "$LOGFIND_BLOOM" | cut -f1)"
@@ -0,0 +1,31 @@
+#!/bin/sh
+# Time searching a big gzip'd log against the same log uncompressed,
+# with decompression on the searching thread and in the two thread
+# pipeline. The pipeline only pays off with a second core to inflate on.
+#
+# usage: ./bench_compressed.sh [lines]
+
+LINES=${1:-1000000}
+
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+./bench_corpus.sh "$DIR" 1 "$LINES"
+gzip -k "$DIR/app00000.log"
+echo "$(du -h "$DIR/app00000.log" | cut -f1) log, $(du -h "$DIR/app00000.log.gz" | cut -f1) gzip'd, $(nproc) cpu(s)"
+
+run() {
+	name=$1
+	pattern=$2
+	shift 2
+	echo "$DIR/$pattern" > "$DIR/logfind.conf"
+	start=$(date +%s.%N)
+	"$@" missing term > /dev/null 2>&1
+	end=$(date +%s.%N)
+	echo "$name" "$start" "$end" | awk '{ printf "%-22s %8.3f s\n", $1, $3 - $2 }'
+}
+
+export LOGFIND_CONFIG="$DIR/logfind.conf"
+run plain app00000.log ./logfind
+run gzip,inline app00000.log.gz env LOGFIND_DECOMPRESS=inline ./logfind
+run gzip,pipeline app00000.log.gz ./logfind
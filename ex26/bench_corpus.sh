@@ -0,0 +1,25 @@
+#!/bin/sh
+# Write a corpus of generated log files for the benchmarks
+#
+# usage: ./bench_corpus.sh dir files lines
+
+DIR=$1
+FILES=$2
+LINES=$3
+
+# same word list as fastsearch_bench, so made up terms never show up
+awk -v files="$FILES" -v lines="$LINES" -v dir="$DIR" 'BEGIN {
+	split("error warning info debug request served connection closed timeout user login failed 200 404", words, " ")
+	srand(1)
+	for (f = 0; f < files; f++) {
+		path = sprintf("%s/app%05d.log", dir, f)
+		for (l = 0; l < lines; l++) {
+			line = sprintf("2024-01-01T00:00:%02d", l % 60)
+			for (w = 0; w < 8; w++)
+				line = line " " words[int(rand() * 14) + 1]
+			print line > path
+		}
+		close(path)
+	}
+}'
+echo "$DIR/*.log" > "$DIR/logfind.conf"
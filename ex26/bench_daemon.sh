@@ -0,0 +1,72 @@
+#!/bin/sh
+# Time queries answered by a running logfind --daemon against the same
+# queries run on their own: one at a time over a small tree, where
+# startup (config, walk, index) is most of the cost, and as a burst of
+# different queries at once over a bigger one, which the daemon answers
+# in shared passes over the files.
+#
+# usage: ./bench_daemon.sh [queries] [burst files] [lines per burst file]
+
+QUERIES=${1:-200}
+FILES=${2:-100}
+LINES=${3:-20000}
+
+DIR=$(mktemp -d)
+trap 'kill $DAEMON 2> /dev/null; rm -rf "$DIR"' EXIT
+
+export LOGFIND_CONFIG="$DIR/logfind.conf"
+export LOGFIND_SOCKET="$DIR/logfind.sock"
+export LOGFIND_INDEX="$DIR/logfind.idx"
+
+start_daemon() {
+	./logfind --daemon -j "$(nproc)" > /dev/null 2>&1 &
+	DAEMON=$!
+	while [ ! -S "$LOGFIND_SOCKET" ]; do sleep 0.05; done
+}
+
+stop_daemon() {
+	kill $DAEMON
+	wait $DAEMON 2> /dev/null
+}
+
+one_at_a_time() {
+	name=$1
+	start=$(date +%s.%N)
+	i=0
+	while [ $i -lt $QUERIES ]; do
+		./logfind -i missing term > /dev/null 2>&1
+		i=$((i + 1))
+	done
+	end=$(date +%s.%N)
+	echo "$name" "$start" "$end" "$QUERIES" | awk '{ printf "%-24s %8.3f ms per query\n", $1, ($3 - $2) * 1000 / $4 }'
+}
+
+burst() {
+	name=$1
+	pids=
+	start=$(date +%s.%N)
+	for term in error warning info debug request served connection closed timeout user login failed missing absent nowhere gone; do
+		./logfind "$term" quota > "$DIR/burst.$term" 2>&1 &
+		pids="$pids $!"
+	done
+	wait $pids
+	end=$(date +%s.%N)
+	echo "$name" "$start" "$end" | awk '{ printf "%-24s %8.3f s for 16 queries\n", $1, $3 - $2 }'
+}
+
+mkdir "$DIR/small" "$DIR/big"
+./bench_corpus.sh "$DIR/small" 200 20
+echo "$DIR/small/*.log" > "$LOGFIND_CONFIG"
+echo "$QUERIES queries one after another, 200 small files, -i"
+LOGFIND_SOCKET="$DIR/none.sock" one_at_a_time standalone
+start_daemon
+one_at_a_time daemon
+stop_daemon
+
+./bench_corpus.sh "$DIR/big" "$FILES" "$LINES"
+echo "$DIR/big/*.log" > "$LOGFIND_CONFIG"
+echo "16 different queries at once, $FILES files, $(du -sh "$DIR/big" | cut -f1), $(nproc) cpu(s)"
+LOGFIND_SOCKET="$DIR/none.sock" burst standalone
+start_daemon
+burst daemon
+stop_daemon
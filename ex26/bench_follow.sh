@@ -0,0 +1,43 @@
+#!/bin/sh
+# Measure how long logfind -f takes to report a write, with a lot of
+# files being followed. Appends a term to one file at a time, waits for
+# the match to be printed, and reports the average and worst latency
+# (which includes the polling here, so read it as an upper bound).
+#
+# usage: ./bench_follow.sh [files] [writes]
+
+FILES=${1:-10000}
+WRITES=${2:-50}
+
+DIR=$(mktemp -d)
+PID=
+trap '[ -n "$PID" ] && kill $PID; rm -rf "$DIR"' EXIT
+
+./bench_corpus.sh "$DIR" "$FILES" 2
+export LOGFIND_CONFIG="$DIR/logfind.conf"
+
+./logfind -f needle > "$DIR/got.out" 2>/dev/null &
+PID=$!
+# the watches go up before the files are added, so waiting for the
+# first write to show up means everything is in place
+until [ -s "$DIR/got.out" ]; do
+	echo needle >> "$DIR/app00000.log"
+	sleep 0.1
+done
+seen=$(wc -l < "$DIR/got.out")
+
+watches=$(grep -c '^inotify' /proc/$PID/fdinfo/* 2>/dev/null | awk -F: '{ n += $2 } END { print n }')
+echo "$FILES files followed with $watches inotify watch(es)"
+
+i=0
+while [ $i -lt "$WRITES" ]; do
+	file=$(printf "%s/app%05d.log" "$DIR" $(( (i * 7919) % FILES )))
+	start=$(date +%s%N)
+	echo "2024-01-01T00:00:00 needle" >> "$file"
+	seen=$((seen + 1))
+	until [ "$(wc -l < "$DIR/got.out")" -ge $seen ]; do :; done
+	end=$(date +%s%N)
+	echo $(( (end - start) / 1000 ))
+	i=$((i + 1))
+done | awk '{ sum += $1; if ($1 > max) max = $1 }
+	END { printf "%d writes: %.2f ms average, %.2f ms worst\n", NR, sum / NR / 1000, max / 1000 }'
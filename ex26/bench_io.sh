@@ -0,0 +1,48 @@
+#!/bin/sh
+# Compare how logfind reads thousands of small files: one blocking
+# open/mmap/close at a time, the io_uring queue, and the pread thread
+# fallback. Drops the page cache before every run when allowed to
+# (root), and counts syscalls with strace -c when it's installed.
+#
+# usage: ./bench_io.sh [files] [lines per file] [queue depth]
+
+FILES=${1:-5000}
+LINES=${2:-20}
+DEPTH=${3:-64}
+
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+./bench_corpus.sh "$DIR" "$FILES" "$LINES"
+export LOGFIND_CONFIG="$DIR/logfind.conf"
+
+cold="warm page cache (can't write /proc/sys/vm/drop_caches)"
+if [ -w /proc/sys/vm/drop_caches ]; then
+	cold="cold page cache"
+fi
+echo "$FILES files, $(du -sh "$DIR" | cut -f1), $cold"
+./logfind missing term > "$DIR/expected.out" 2>/dev/null
+
+run() {
+	name=$1
+	shift
+	sync
+	[ -w /proc/sys/vm/drop_caches ] && echo 3 > /proc/sys/vm/drop_caches
+	start=$(date +%s.%N)
+	"$@" missing term > "$DIR/got.out" 2>/dev/null
+	end=$(date +%s.%N)
+	if cmp -s "$DIR/expected.out" "$DIR/got.out"; then same=same; else same=DIFFERENT; fi
+
+	calls="-"
+	if command -v strace > /dev/null; then
+		# total line of the summary: calls is the 4th column
+		calls=$(strace -f -c -o "$DIR/strace.out" "$@" missing term > /dev/null 2>&1;
+			awk '/total/ { print $4 }' "$DIR/strace.out")
+	fi
+	echo "$name" "$start" "$end" "$calls" "$same" |
+		awk '{ printf "%-22s %8.3f s  %8s syscalls  output %s\n", $1, $3 - $2, $4, $5 }'
+}
+
+run blocking ./logfind
+run "io_uring,-q$DEPTH" ./logfind -q "$DEPTH"
+run "threads,-q$DEPTH" env LOGFIND_IO=threads ./logfind -q "$DEPTH"
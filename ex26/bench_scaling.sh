@@ -0,0 +1,26 @@
+#!/bin/sh
+# Time logfind -j N over a corpus of a few thousand generated log files
+# and check that every N prints exactly the same thing.
+#
+# usage: ./bench_scaling.sh [files] [lines per file] [jobs ...]
+
+FILES=${1:-4000}
+LINES=${2:-400}
+shift 2 2>/dev/null
+JOBS=${*:-"1 2 4 8"}
+
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+./bench_corpus.sh "$DIR" "$FILES" "$LINES"
+
+echo "$FILES files, $(du -sh "$DIR" | cut -f1), page cache warm after the first run"
+LOGFIND_CONFIG="$DIR/logfind.conf" ./logfind -j 1 missing term > "$DIR/expected.out" 2>/dev/null
+
+for j in $JOBS; do
+	start=$(date +%s.%N)
+	LOGFIND_CONFIG="$DIR/logfind.conf" ./logfind -j "$j" missing term > "$DIR/got.out" 2>/dev/null
+	end=$(date +%s.%N)
+	if cmp -s "$DIR/expected.out" "$DIR/got.out"; then same=same; else same=DIFFERENT; fi
+	echo "$j" "$start" "$end" "$same" | awk '{ printf "-j %-3s %8.3f s  output %s\n", $1, $3 - $2, $4 }'
+done
@@ -0,0 +1,304 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>			// time
+#include <unistd.h>			// unlink
+#include <sys/stat.h>		// stat
+#include "bloom.h"
+#include "trigram_index.h"
+#include "dbg.h"
+
+// first bytes of every sidecar, bump the digit when the layout changes
+#define BLOOM_MAGIC "LFBLOOM1"
+// about 1% false positives per trigram looked up with 7 hashes
+#define BLOOM_BITS_PER_TRIGRAM 10
+#define BLOOM_HASHES 7
+#define BLOOM_WORDS_MAX ((uint32_t)((uint64_t)TRIGRAM_SPACE * BLOOM_BITS_PER_TRIGRAM / 64 + 1))
+// files changed more recently than this are still being written to, a
+// filter for them would be stale by the next run and only cost a read
+#ifndef BLOOM_SETTLE_SECONDS
+#define BLOOM_SETTLE_SECONDS 60
+#endif
+
+void BloomFilter_destroy(BloomFilter* filter)
+{
+	if (filter) {
+		free(filter->words);
+		free(filter);
+	}
+}
+
+// splitmix64's finalizer, trigrams only differ in their low 24 bits
+static uint64_t bloom_hash(uint32_t trigram)
+{
+	uint64_t h = trigram + 0x9E3779B97F4A7C15ULL;
+	h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+	return h ^ (h >> 31);
+}
+
+/* Where the i'th hash of a trigram lands
+ * Two halves of one hash stand in for all of them, and the result is
+ * scaled into the filter with a multiply instead of a division.
+ */
+static inline uint32_t bloom_bit(BloomFilter* filter, uint64_t h, uint32_t i)
+{
+	uint32_t mixed = (uint32_t)h + i * ((uint32_t)(h >> 32) | 1);
+	return ((uint64_t)mixed * ((uint64_t)filter->word_count * 64)) >> 32;
+}
+
+static void BloomFilter_add(BloomFilter* filter, uint32_t trigram)
+{
+	uint64_t h = bloom_hash(trigram);
+	uint32_t i;
+
+	for (i = 0; i < filter->hashes; i++) {
+		uint32_t bit = bloom_bit(filter, h, i);
+		filter->words[bit >> 6] |= 1ULL << (bit & 63);
+	}
+}
+
+static int BloomFilter_has(BloomFilter* filter, uint32_t trigram)
+{
+	uint64_t h = bloom_hash(trigram);
+	uint32_t i;
+
+	for (i = 0; i < filter->hashes; i++) {
+		uint32_t bit = bloom_bit(filter, h, i);
+		if (!(filter->words[bit >> 6] & (1ULL << (bit & 63))))
+			return 0;
+	}
+	return 1;
+}
+
+/*-- SIDECARS --*/
+
+static char* bloom_sidecar_path(const char* cache_dir, struct stat* sb)
+{
+	size_t len = strlen(cache_dir) + 2 * 16 + sizeof("/-.bloom");
+	char* path = malloc(len);
+
+	if (path != NULL)
+		snprintf(path, len, "%s/%llx-%llx.bloom", cache_dir,
+				(unsigned long long)sb->st_dev, (unsigned long long)sb->st_ino);
+	return path;
+}
+
+/* Read a sidecar written by BloomFilter_save
+ *
+ * Output
+ * 		filter: the filter if it was built from the file as it is now,
+ * 			NULL if missing, stale, damaged or out of memory
+ */
+static BloomFilter* BloomFilter_load(const char* sidecar, struct stat* sb)
+{
+	char magic[sizeof(BLOOM_MAGIC) - 1];
+	BloomFilter* filter = calloc(1, sizeof(BloomFilter));
+	FILE* in = fopen(sidecar, "rb");
+
+	if (filter == NULL || in == NULL)
+		goto error;
+
+	if (fread(magic, 1, sizeof(magic), in) != sizeof(magic)
+			|| memcmp(magic, BLOOM_MAGIC, sizeof(magic)) != 0
+			|| fread(&filter->dev, sizeof(uint64_t), 1, in) != 1
+			|| fread(&filter->inode, sizeof(uint64_t), 1, in) != 1
+			|| fread(&filter->size, sizeof(int64_t), 1, in) != 1
+			|| fread(&filter->mtime_sec, sizeof(int64_t), 1, in) != 1
+			|| fread(&filter->mtime_nsec, sizeof(int64_t), 1, in) != 1
+			|| fread(&filter->hashes, sizeof(uint32_t), 1, in) != 1
+			|| fread(&filter->word_count, sizeof(uint32_t), 1, in) != 1)
+		goto error;
+
+	// same inode rewritten since, or the name was reused
+	if (filter->dev != (uint64_t)sb->st_dev || filter->inode != (uint64_t)sb->st_ino
+			|| filter->size != sb->st_size
+			|| filter->mtime_sec != sb->st_mtim.tv_sec
+			|| filter->mtime_nsec != sb->st_mtim.tv_nsec)
+		goto error;
+	if (filter->hashes == 0 || filter->hashes > 32
+			|| filter->word_count == 0 || filter->word_count > BLOOM_WORDS_MAX)
+		goto error;
+
+	filter->words = malloc(filter->word_count * sizeof(uint64_t));
+	if (filter->words == NULL || fread(filter->words, sizeof(uint64_t), filter->word_count, in) != filter->word_count)
+		goto error;
+
+	fclose(in);
+	return filter;
+
+error:
+	if (in != NULL)
+		fclose(in);
+	BloomFilter_destroy(filter);
+	return NULL;
+}
+
+/* Write the sidecar next to where it goes and rename it into place,
+ * so a reader never sees half a filter
+ *
+ * Output
+ * 		error: 0 on success, -1 on error
+ */
+static int BloomFilter_save(BloomFilter* filter, const char* sidecar)
+{
+	size_t tmp_len = strlen(sidecar) + sizeof(".tmp");
+	char* tmp_path = malloc(tmp_len);
+	FILE* out = NULL;
+	check_mem(tmp_path);
+
+	snprintf(tmp_path, tmp_len, "%s.tmp", sidecar);
+	out = fopen(tmp_path, "wb");
+	check_debug(out != NULL, "Couldn't write %s", tmp_path);
+
+	fwrite(BLOOM_MAGIC, 1, sizeof(BLOOM_MAGIC) - 1, out);
+	fwrite(&filter->dev, sizeof(uint64_t), 1, out);
+	fwrite(&filter->inode, sizeof(uint64_t), 1, out);
+	fwrite(&filter->size, sizeof(int64_t), 1, out);
+	fwrite(&filter->mtime_sec, sizeof(int64_t), 1, out);
+	fwrite(&filter->mtime_nsec, sizeof(int64_t), 1, out);
+	fwrite(&filter->hashes, sizeof(uint32_t), 1, out);
+	fwrite(&filter->word_count, sizeof(uint32_t), 1, out);
+	fwrite(filter->words, sizeof(uint64_t), filter->word_count, out);
+
+	check_debug(ferror(out) == 0, "Couldn't write %s", tmp_path);
+	check_debug(fclose(out) == 0, "Couldn't write %s", tmp_path);
+	out = NULL;
+	check_debug(rename(tmp_path, sidecar) == 0, "Couldn't replace %s", sidecar);
+
+	free(tmp_path);
+	return 0;
+
+error:
+	if (out != NULL)
+		fclose(out);
+	if (tmp_path != NULL)
+		unlink(tmp_path);
+	free(tmp_path);
+	return -1;
+}
+
+/* Read a file and put every trigram in it into a new filter
+ * seen is a TRIGRAM_SPACE bit scratch map, all clear on entry and exit.
+ *
+ * Output
+ * 		filter: NULL if the file can't be read, or changed from what sb says
+ */
+static BloomFilter* BloomFilter_build(const char* path, struct stat* sb, uint64_t* seen)
+{
+	uint32_t i;
+	uint64_t bits = 0;
+	TrigramFile file = { .path = (char*)path };
+	BloomFilter* filter = NULL;
+
+	if (TrigramFile_extract(&file, seen) != 0)
+		return NULL;
+	check_debug(file.inode == (uint64_t)sb->st_ino && file.size == sb->st_size
+			&& file.mtime_sec == sb->st_mtim.tv_sec && file.mtime_nsec == sb->st_mtim.tv_nsec,
+			"%s changed while being read", path);
+
+	filter = calloc(1, sizeof(BloomFilter));
+	check_mem(filter);
+	bits = (uint64_t)file.trigram_count * BLOOM_BITS_PER_TRIGRAM;
+	filter->word_count = bits / 64 + 1;
+	filter->hashes = BLOOM_HASHES;
+	filter->words = calloc(filter->word_count, sizeof(uint64_t));
+	check_mem(filter->words);
+
+	filter->dev = sb->st_dev;
+	filter->inode = sb->st_ino;
+	filter->size = sb->st_size;
+	filter->mtime_sec = sb->st_mtim.tv_sec;
+	filter->mtime_nsec = sb->st_mtim.tv_nsec;
+	for (i = 0; i < file.trigram_count; i++)
+		BloomFilter_add(filter, file.trigrams[i]);
+
+	free(file.trigrams);
+	return filter;
+
+error:
+	free(file.trigrams);
+	BloomFilter_destroy(filter);
+	return NULL;
+}
+
+/* Get the filter for a file, from its sidecar or by reading the file
+ * A filter is only built for a regular file nobody has written to for
+ * BLOOM_SETTLE_SECONDS, rotated logs and archives. Building reads the
+ * whole file once, and every run after that skips it for free as long
+ * as its sidecar is fresh. A sidecar that can't be written only costs
+ * building the filter again next time.
+ *
+ * Input
+ * 		cache_dir: directory the sidecars live in, must exist
+ * 		path: file about to be searched
+ * 		seen: TRIGRAM_SPACE bit scratch map, all clear
+ * 		built: set to 1 if the file was read to build the filter
+ * Output
+ * 		filter: NULL if the file has to be searched without one
+ */
+BloomFilter* BloomFilter_open(const char* cache_dir, const char* path, uint64_t* seen, int* built)
+{
+	struct stat sb;
+	char* sidecar = NULL;
+	BloomFilter* filter = NULL;
+
+	*built = 0;
+	if (stat(path, &sb) != 0 || !S_ISREG(sb.st_mode) || time(NULL) - sb.st_mtime < BLOOM_SETTLE_SECONDS)
+		return NULL;
+
+	sidecar = bloom_sidecar_path(cache_dir, &sb);
+	check_mem(sidecar);
+
+	filter = BloomFilter_load(sidecar, &sb);
+	if (filter == NULL) {
+		filter = BloomFilter_build(path, &sb, seen);
+		if (filter != NULL) {
+			*built = 1;
+			if (BloomFilter_save(filter, sidecar) != 0) {
+				debug("Couldn't save the filter for %s", path);
+			}
+		}
+	}
+
+	free(sidecar);
+	return filter;
+
+error:
+	return NULL;
+}
+
+/* Whether the filter proves the file can't match
+ * For AND one term with a trigram missing from the filter is enough,
+ * for OR every term has to be missing one. Terms shorter than a trigram
+ * are in the file as far as the filter can tell.
+ *
+ * Input
+ * 		filter: the file's filter
+ * 		terms: text every match of each term contains
+ * 		term_count: length of terms
+ * 		or_flag: 1 for OR, 0 for AND
+ * Output
+ * 		ruled_out: 1 if the file doesn't match, 0 if it has to be searched
+ */
+int BloomFilter_rules_out(BloomFilter* filter, char** terms, int term_count, int or_flag)
+{
+	int i;
+	size_t j;
+	int absent = 0;
+
+	for (i = 0; i < term_count; i++) {
+		size_t len = strlen(terms[i]);
+		int missing = 0;
+
+		for (j = 0; j + 2 < len && !missing; j++)
+			missing = !BloomFilter_has(filter, trigram_of(terms[i][j], terms[i][j + 1], terms[i][j + 2]));
+
+		if (missing)
+			absent++;
+		else if (or_flag)
+			return 0;
+	}
+
+	return or_flag ? term_count > 0 : absent > 0;
+}
@@ -0,0 +1,26 @@
+#ifndef logfind_bloom_h
+#define logfind_bloom_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+// every trigram of one file, in a sidecar file of the cache directory
+// named after the file's device and inode, so renaming a rotated log
+// keeps its filter and rewriting it in place makes the filter stale
+typedef struct BloomFilter {
+	uint64_t dev;
+	uint64_t inode;
+	int64_t size;			// the file the filter was built from
+	int64_t mtime_sec;
+	int64_t mtime_nsec;
+	uint32_t hashes;		// bits set per trigram
+	uint32_t word_count;
+	uint64_t* words;		// word_count * 64 bits
+} BloomFilter;
+
+void BloomFilter_destroy(BloomFilter* filter);
+
+BloomFilter* BloomFilter_open(const char* cache_dir, const char* path, uint64_t* seen, int* built);
+int BloomFilter_rules_out(BloomFilter* filter, char** terms, int term_count, int or_flag);
+
+#endif
@@ -0,0 +1,703 @@
+#define _GNU_SOURCE			// accept4
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>			// clock_gettime
+#include <unistd.h>			// read, write, close, unlink
+#include <sys/socket.h>
+#include <sys/un.h>			// sockaddr_un
+#include <sys/stat.h>		// chmod
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+#include "daemon.h"
+#include "dbg.h"
+
+// what a watched directory reports
+#define DAEMON_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY \
+		| IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+// changes are caught up on once the watches have been quiet this long,
+// so a burst of creates (a rotation, an untar) costs one walk
+#define DAEMON_SETTLE_MS 50
+// queries from clients still sending theirs wait this long to share a pass
+#define DAEMON_BATCH_MS 5
+// longest command line a client can send
+#define DAEMON_REQUEST_MAX (1024*1024)
+// a client that stalls this long mid request or mid answer is dropped
+#define DAEMON_CLIENT_TIMEOUT_SEC 2
+// answers are copied to the terminal in blocks this big
+#define DAEMON_BUFFER_SIZE (64*1024)
+// epoll events taken per wakeup
+#define DAEMON_EVENTS_MAX 64
+
+static int read_full(int fd, void* data, size_t size)
+{
+	size_t done = 0;
+	ssize_t got = 0;
+
+	while (done < size) {
+		got = read(fd, (char*)data + done, size - done);
+		if (got < 0 && errno == EINTR)
+			continue;
+		if (got <= 0)
+			return -1;
+		done += got;
+	}
+	return 0;
+}
+
+static int write_full(int fd, const void* data, size_t size)
+{
+	size_t done = 0;
+	ssize_t put = 0;
+
+	while (done < size) {
+		// a client that hung up mustn't kill the daemon with SIGPIPE
+		put = send(fd, (const char*)data + done, size - done, MSG_NOSIGNAL);
+		if (put < 0 && errno == EINTR)
+			continue;
+		if (put <= 0)
+			return -1;
+		done += put;
+	}
+	return 0;
+}
+
+static long now_ms()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*-- CLIENTS --*/
+
+static void DaemonQuery_free(DaemonQuery* query)
+{
+	if (query->out != NULL)
+		fclose(query->out);
+	free(query->reply);
+	free(query->request);
+	free(query->argv);
+	memset(query, 0, sizeof(DaemonQuery));
+	query->fd = -1;
+}
+
+/* Hang up on a client, whatever state it's in */
+static void Daemon_drop(Daemon* daemon, DaemonClient* client)
+{
+	// a waiting client isn't in the epoll set, that's fine
+	epoll_ctl(daemon->epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+	daemon->clients[client->fd] = NULL;
+	close(client->fd);
+	free(client->request);
+	free(client->reply);
+	free(client);
+	errno = 0;
+}
+
+/* Turn a client's whole request into a query in the batch
+ * A request is its length as a uint32_t, then each argument with its '\0'.
+ *
+ * Output
+ * 		error: 0 on success, -1 if the client is to be dropped
+ */
+static int Daemon_queue(Daemon* daemon, DaemonClient* client)
+{
+	uint32_t i;
+	int argc = 0;
+	char* request = client->request;
+	DaemonQuery query = { .fd = client->fd };
+
+	check_debug(request[client->len - 1] == '\0', "Client sent a request that doesn't end an argument");
+
+	for (i = 0; i < client->len; i++)
+		argc += request[i] == '\0';
+	query.argv = malloc((argc + 1) * sizeof(char*));
+	check_mem(query.argv);
+	for (i = 0; i < client->len; i += strlen(request + i) + 1)
+		query.argv[query.argc++] = request + i;
+	query.argv[query.argc] = NULL;
+
+	if (daemon->query_count == daemon->query_capacity) {
+		int capacity = daemon->query_capacity > 0 ? daemon->query_capacity * 2 : 16;
+		DaemonQuery* grown = realloc(daemon->queries, capacity * sizeof(DaemonQuery));
+		check_mem(grown);
+		daemon->queries = grown;
+		daemon->query_capacity = capacity;
+	}
+	if (daemon->query_count == 0)
+		daemon->batch_started = now_ms();
+	query.request = request;
+	client->request = NULL;
+	daemon->queries[daemon->query_count++] = query;
+	return 0;
+
+error:
+	free(query.argv);
+	return -1;
+}
+
+/* Read whatever a client has sent so far, without waiting for more
+ * Once the whole request is in the client leaves the epoll set, its
+ * query joins the batch and nothing more is read from it.
+ *
+ * Output
+ * 		error: 0 on success, -1 if the client is to be dropped
+ */
+static int Daemon_read(Daemon* daemon, DaemonClient* client)
+{
+	ssize_t got = 0;
+	size_t prefix = sizeof(client->len);
+
+	while (client->got < prefix + client->len) {
+		if (client->got < prefix)
+			got = read(client->fd, (char*)&client->len + client->got, prefix - client->got);
+		else
+			got = read(client->fd, client->request + client->got - prefix, prefix + client->len - client->got);
+		if (got < 0 && errno == EINTR)
+			continue;
+		if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			errno = 0;
+			return 0;
+		}
+		check_debug(got > 0, "Client hung up mid request");
+
+		client->got += got;
+		client->deadline = now_ms() + DAEMON_CLIENT_TIMEOUT_SEC * 1000;
+		if (client->got == prefix) {
+			check_debug(client->len > 0 && client->len <= DAEMON_REQUEST_MAX, "Client sent a %u byte request", client->len);
+			client->request = malloc(client->len);
+			check_mem(client->request);
+		}
+	}
+
+	check(epoll_ctl(daemon->epoll_fd, EPOLL_CTL_DEL, client->fd, NULL) == 0, "epoll_ctl failed");
+	check_debug(Daemon_queue(daemon, client) == 0, "Couldn't queue a client's query");
+	client->state = DAEMON_CLIENT_WAITING;
+	client->deadline = 0;
+	return 0;
+
+error:
+	return -1;
+}
+
+/* Send as much of a client's answer as it will take without waiting
+ * What doesn't fit goes out when epoll says the client can take more.
+ *
+ * Output
+ * 		done: 0 while there's more to send, 1 once it's all sent or the
+ * 			client went away, either way it's to be dropped
+ */
+static int Daemon_send(Daemon* daemon, DaemonClient* client)
+{
+	ssize_t put = 0;
+	struct epoll_event event = { .events = EPOLLOUT, .data.fd = client->fd };
+
+	while (client->sent < client->reply_len) {
+		// a client that hung up mustn't kill the daemon with SIGPIPE
+		put = send(client->fd, client->reply + client->sent, client->reply_len - client->sent, MSG_NOSIGNAL);
+		if (put < 0 && errno == EINTR)
+			continue;
+		if (put < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			errno = 0;
+			if (client->state != DAEMON_CLIENT_SENDING) {
+				check(epoll_ctl(daemon->epoll_fd, EPOLL_CTL_ADD, client->fd, &event) == 0, "epoll_ctl failed");
+				client->state = DAEMON_CLIENT_SENDING;
+			}
+			client->deadline = now_ms() + DAEMON_CLIENT_TIMEOUT_SEC * 1000;
+			return 0;
+		}
+		check_debug(put > 0, "Client went away before its answer was sent");
+		client->sent += put;
+	}
+
+error:	// fallthrough
+	return 1;
+}
+
+/* Take a new connection and read what it has sent already */
+static int Daemon_add_client(Daemon* daemon, int fd)
+{
+	struct epoll_event event = { .events = EPOLLIN, .data.fd = fd };
+	DaemonClient* client = NULL;
+
+	if (fd >= daemon->client_capacity) {
+		int capacity = daemon->client_capacity > 0 ? daemon->client_capacity * 2 : 64;
+		while (capacity <= fd)
+			capacity *= 2;
+		DaemonClient** grown = realloc(daemon->clients, capacity * sizeof(DaemonClient*));
+		check_mem(grown);
+		memset(grown + daemon->client_capacity, 0, (capacity - daemon->client_capacity) * sizeof(DaemonClient*));
+		daemon->clients = grown;
+		daemon->client_capacity = capacity;
+	}
+
+	client = calloc(1, sizeof(DaemonClient));
+	check_mem(client);
+	client->fd = fd;
+	client->state = DAEMON_CLIENT_READING;
+	client->arrived_at = now_ms();
+	client->deadline = client->arrived_at + DAEMON_CLIENT_TIMEOUT_SEC * 1000;
+	check(epoll_ctl(daemon->epoll_fd, EPOLL_CTL_ADD, fd, &event) == 0, "epoll_ctl failed");
+	daemon->clients[fd] = client;
+
+	if (Daemon_read(daemon, client) != 0)
+		Daemon_drop(daemon, client);
+	return 0;
+
+error:
+	free(client);
+	return -1;
+}
+
+/* Take every connection that's waiting */
+static void Daemon_accept(Daemon* daemon)
+{
+	int fd = -1;
+
+	for (;;) {
+		fd = accept4(daemon->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0 && errno == EINTR)
+			continue;
+		if (fd < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				log_warn("Couldn't accept a client");
+			errno = 0;
+			return;
+		}
+		if (Daemon_add_client(daemon, fd) != 0)
+			close(fd);
+	}
+}
+
+/* A client's socket is ready, carry on with whatever it's doing
+ * The fd may have been dropped and reused since epoll reported it, so
+ * this goes by the client's state rather than the event.
+ */
+static void Daemon_client_ready(Daemon* daemon, int fd)
+{
+	DaemonClient* client = fd < daemon->client_capacity ? daemon->clients[fd] : NULL;
+
+	if (client == NULL)
+		return;
+	if (client->state == DAEMON_CLIENT_READING && Daemon_read(daemon, client) != 0)
+		Daemon_drop(daemon, client);
+	else if (client->state == DAEMON_CLIENT_SENDING && Daemon_send(daemon, client) != 0)
+		Daemon_drop(daemon, client);
+}
+
+/* Drop clients that stalled mid request or mid answer
+ *
+ * Output
+ * 		timeout: ms until the next client would stall, -1 if none can
+ */
+static int Daemon_expire(Daemon* daemon, long now)
+{
+	int fd;
+	long next = -1;
+	DaemonClient* client = NULL;
+
+	for (fd = 0; fd < daemon->client_capacity; fd++) {
+		client = daemon->clients[fd];
+		if (client == NULL || client->deadline == 0)
+			continue;
+		if (client->deadline <= now) {
+			debug("Dropping a client that stalled");
+			Daemon_drop(daemon, client);
+		} else if (next < 0 || client->deadline - now < next) {
+			next = client->deadline - now;
+		}
+	}
+	return (int)next;
+}
+
+/* How long the batch should keep gathering
+ * Clients that connected in the last DAEMON_BATCH_MS and are still
+ * sending their requests are worth waiting for, so a burst that's still
+ * arriving shares one pass. Nobody waits longer than DAEMON_BATCH_MS
+ * after the first query is in, and a lone query doesn't wait at all.
+ *
+ * Output
+ * 		timeout: ms until the batch is due, 0 for now, -1 if it's empty
+ */
+static int Daemon_batch_due(Daemon* daemon, long now)
+{
+	int fd;
+	long due = now;
+	DaemonClient* client = NULL;
+
+	if (daemon->query_count == 0)
+		return -1;
+	for (fd = 0; fd < daemon->client_capacity; fd++) {
+		client = daemon->clients[fd];
+		if (client != NULL && client->state == DAEMON_CLIENT_READING
+				&& client->arrived_at + DAEMON_BATCH_MS > due)
+			due = client->arrived_at + DAEMON_BATCH_MS;
+	}
+	if (due > daemon->batch_started + DAEMON_BATCH_MS)
+		due = daemon->batch_started + DAEMON_BATCH_MS;
+	return due > now ? (int)(due - now) : 0;
+}
+
+/* Start sending a query its answer: the exit status as an int32_t, then
+ * the text. The status takes the place of the bytes saved for it at the
+ * front of the stream.
+ */
+static void Daemon_reply(Daemon* daemon, DaemonQuery* query)
+{
+	int32_t status = query->status;
+	DaemonClient* client = daemon->clients[query->fd];
+
+	if (query->out != NULL && fclose(query->out) != 0)
+		status = 1;
+	query->out = NULL;
+
+	if (query->reply == NULL || query->reply_len < sizeof(status)) {
+		free(query->reply);
+		query->reply = malloc(sizeof(status));
+		query->reply_len = sizeof(status);
+		status = 1;
+	}
+	if (query->reply == NULL) {
+		Daemon_drop(daemon, client);
+	} else {
+		memcpy(query->reply, &status, sizeof(status));
+		client->reply = query->reply;
+		client->reply_len = query->reply_len;
+		query->reply = NULL;
+		if (Daemon_send(daemon, client) != 0)
+			Daemon_drop(daemon, client);
+	}
+	DaemonQuery_free(query);
+}
+
+/* Answer the queries gathered so far, catching up on changes first
+ * Each query's answer is written to a memory stream the batch prints to.
+ */
+static void Daemon_answer(Daemon* daemon, Daemon_batch batch, void* context)
+{
+	int i;
+	int ready = 0;
+	int32_t status = 0;
+
+	// the batch only gets the queries that can be answered, each moved
+	// into place before its stream is opened, the stream writes back to it
+	for (i = 0; i < daemon->query_count; i++) {
+		DaemonQuery* query = &daemon->queries[ready];
+		*query = daemon->queries[i];
+		query->out = open_memstream(&query->reply, &query->reply_len);
+		if (query->out == NULL || fwrite(&status, sizeof(status), 1, query->out) != 1) {
+			query->status = 1;
+			Daemon_reply(daemon, query);
+			continue;
+		}
+		ready++;
+	}
+
+	if (batch(context, daemon->queries, ready, daemon->changes) != 0) {
+		for (i = 0; i < ready; i++) {
+			fprintf(daemon->queries[i].out, "logfind daemon: couldn't answer that\n");
+			daemon->queries[i].status = 1;
+		}
+	}
+	daemon->changes = 0;
+
+	for (i = 0; i < ready; i++)
+		Daemon_reply(daemon, &daemon->queries[i]);
+	daemon->query_count = 0;
+}
+
+/*-- WATCHES --*/
+
+/* Watch a directory for files coming, going and being written to
+ * Safe to call from several threads, and for a directory already watched.
+ *
+ * Output
+ * 		error: 0 on success, -1 if changes there will go unnoticed
+ */
+int Daemon_watch(Daemon* daemon, const char* dir)
+{
+	if (inotify_add_watch(daemon->inotify_fd, dir, DAEMON_EVENTS) < 0) {
+		debug("Couldn't watch %s: %s", dir, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+/* Read every queued inotify event and note what kind of change it is */
+static int Daemon_drain(Daemon* daemon)
+{
+	char events[16 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+	struct inotify_event* event = NULL;
+	ssize_t got = 0;
+	char* p = NULL;
+
+	for (;;) {
+		got = read(daemon->inotify_fd, events, sizeof(events));
+		if (got < 0 && errno == EINTR)
+			continue;
+		if (got < 0 && errno == EAGAIN)
+			return 0;
+		check(got > 0, "Couldn't read inotify events");
+
+		for (p = events; p < events + got; p += sizeof(struct inotify_event) + event->len) {
+			event = (struct inotify_event*)p;
+			// events were lost, anything could have happened
+			if (event->mask & IN_Q_OVERFLOW)
+				daemon->changes |= DAEMON_FILES_CHANGED | DAEMON_LIST_CHANGED;
+			if (event->mask & (IN_MODIFY | IN_CLOSE_WRITE))
+				daemon->changes |= DAEMON_FILES_CHANGED;
+			if (event->mask & (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF))
+				daemon->changes |= DAEMON_FILES_CHANGED | DAEMON_LIST_CHANGED;
+		}
+	}
+
+error:
+	return -1;
+}
+
+/*-- LIFECYCLE --*/
+
+/* Listen for clients on a Unix domain socket
+ * Only the user running the daemon can connect. A socket left behind by
+ * a daemon that died is replaced, one that still answers is not.
+ *
+ * Input
+ * 		socket_path: where the socket goes
+ * Output
+ * 		daemon: ready to watch directories and run, NULL on error
+ */
+Daemon* Daemon_create(const char* socket_path)
+{
+	sigset_t mask;
+	int probe = -1;
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	struct epoll_event event = { .events = EPOLLIN };
+	Daemon* daemon = calloc(1, sizeof(Daemon));
+	check_mem(daemon);
+
+	daemon->listen_fd = -1;
+	daemon->inotify_fd = -1;
+	daemon->signal_fd = -1;
+	daemon->epoll_fd = -1;
+	check(strlen(socket_path) < sizeof(addr.sun_path), "Socket path %s is too long", socket_path);
+	strcpy(addr.sun_path, socket_path);
+
+	daemon->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	check(daemon->listen_fd >= 0, "Couldn't make a socket");
+	if (bind(daemon->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+		check(errno == EADDRINUSE, "Couldn't bind %s", socket_path);
+		probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		check(probe >= 0, "Couldn't make a socket");
+		check(connect(probe, (struct sockaddr*)&addr, sizeof(addr)) != 0, "A daemon is already listening on %s", socket_path);
+		close(probe);
+		probe = -1;
+		unlink(socket_path);
+		check(bind(daemon->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) == 0, "Couldn't bind %s", socket_path);
+	}
+	daemon->socket_path = strdup(socket_path);
+	check_mem(daemon->socket_path);
+	// nobody can connect before listen, so nobody else gets in first
+	check(chmod(socket_path, 0600) == 0, "Couldn't make %s private", socket_path);
+	check(listen(daemon->listen_fd, SOMAXCONN) == 0, "Couldn't listen on %s", socket_path);
+	errno = 0;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+	check(sigprocmask(SIG_BLOCK, &mask, &daemon->old_mask) == 0, "Couldn't block signals");
+
+	daemon->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	daemon->signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+	daemon->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	check(daemon->inotify_fd >= 0, "Couldn't start inotify");
+	check(daemon->signal_fd >= 0, "Couldn't make a signalfd");
+	check(daemon->epoll_fd >= 0, "Couldn't make an epoll instance");
+
+	event.data.fd = daemon->inotify_fd;
+	check(epoll_ctl(daemon->epoll_fd, EPOLL_CTL_ADD, daemon->inotify_fd, &event) == 0, "epoll_ctl failed");
+	event.data.fd = daemon->signal_fd;
+	check(epoll_ctl(daemon->epoll_fd, EPOLL_CTL_ADD, daemon->signal_fd, &event) == 0, "epoll_ctl failed");
+	event.data.fd = daemon->listen_fd;
+	check(epoll_ctl(daemon->epoll_fd, EPOLL_CTL_ADD, daemon->listen_fd, &event) == 0, "epoll_ctl failed");
+
+	return daemon;
+
+error:
+	if (probe >= 0)
+		close(probe);
+	Daemon_destroy(daemon);
+	return NULL;
+}
+
+void Daemon_destroy(Daemon* daemon)
+{
+	int i;
+
+	if (daemon) {
+		for (i = 0; i < daemon->query_count; i++)
+			DaemonQuery_free(&daemon->queries[i]);
+		for (i = 0; i < daemon->client_capacity; i++) {
+			if (daemon->clients[i] != NULL)
+				Daemon_drop(daemon, daemon->clients[i]);
+		}
+		if (daemon->listen_fd >= 0)
+			close(daemon->listen_fd);
+		// only ours to remove if it was bound
+		if (daemon->socket_path != NULL)
+			unlink(daemon->socket_path);
+		if (daemon->epoll_fd >= 0)
+			close(daemon->epoll_fd);
+		if (daemon->signal_fd >= 0) {
+			close(daemon->signal_fd);
+			sigprocmask(SIG_SETMASK, &daemon->old_mask, NULL);
+		}
+		if (daemon->inotify_fd >= 0)
+			close(daemon->inotify_fd);
+		free(daemon->socket_path);
+		free(daemon->queries);
+		free(daemon->clients);
+		free(daemon);
+	}
+}
+
+/* Answer clients until SIGINT or SIGTERM
+ * One thread, one epoll loop, and no client can hold it up: requests are
+ * read and answers written as far as each socket allows, and a client
+ * that stalls for DAEMON_CLIENT_TIMEOUT_SEC is dropped. Every query that
+ * is in when the loop wakes up goes into the same batch, along with
+ * those from clients still sending theirs for up to DAEMON_BATCH_MS, so
+ * queries that arrive while a batch is being answered share the next
+ * one. Changes the watches report are handed to the batch before the
+ * queries that follow them, or on their own once things have settled
+ * for DAEMON_SETTLE_MS.
+ *
+ * Input
+ * 		daemon: listening and watching
+ * 		batch: answers queries and catches up on changes
+ * 		context: passed to batch
+ * Output
+ * 		error: 0 when stopped by a signal, -1 on error
+ */
+int Daemon_run(Daemon* daemon, Daemon_batch batch, void* context)
+{
+	int i, n;
+	int timeout = -1;
+	int wait = -1;
+	long now = 0;
+	long settled_at = 0;
+	struct epoll_event events[DAEMON_EVENTS_MAX];
+	struct signalfd_siginfo info;
+
+	debug("Listening on %s", daemon->socket_path);
+
+	for (;;) {
+		now = now_ms();
+		timeout = Daemon_expire(daemon, now);
+		wait = Daemon_batch_due(daemon, now);
+		if (wait >= 0 && (timeout < 0 || wait < timeout))
+			timeout = wait;
+		if (daemon->changes) {
+			wait = settled_at > now ? (int)(settled_at - now) : 0;
+			if (timeout < 0 || wait < timeout)
+				timeout = wait;
+		}
+		n = epoll_wait(daemon->epoll_fd, events, DAEMON_EVENTS_MAX, timeout);
+		if (n < 0 && errno == EINTR)
+			continue;
+		check(n >= 0, "epoll_wait failed");
+
+		for (i = 0; i < n; i++) {
+			if (events[i].data.fd == daemon->signal_fd) {
+				if (read(daemon->signal_fd, &info, sizeof(info)) == sizeof(info)) {
+					debug("Stopping on signal %u", info.ssi_signo);
+				}
+				return 0;
+			} else if (events[i].data.fd == daemon->inotify_fd) {
+				check(Daemon_drain(daemon) == 0, "Lost the inotify queue");
+				settled_at = now_ms() + DAEMON_SETTLE_MS;
+			} else if (events[i].data.fd == daemon->listen_fd) {
+				Daemon_accept(daemon);
+			} else {
+				Daemon_client_ready(daemon, events[i].data.fd);
+			}
+		}
+
+		now = now_ms();
+		if (Daemon_batch_due(daemon, now) == 0 || (daemon->query_count == 0 && daemon->changes && now >= settled_at))
+			Daemon_answer(daemon, batch, context);
+	}
+
+error:
+	return -1;
+}
+
+/* Ask a running daemon to search, the client side of --daemon
+ * Sends the command line as it is and copies the answer to stdout,
+ * or to stderr if the daemon says the query failed.
+ *
+ * Input
+ * 		socket_path: where the daemon listens
+ * 		argc, argv: the command line, argv[0] included
+ * Output
+ * 		status: the exit status to use, -1 if no daemon answered and the
+ * 			search has to be done here
+ */
+int Daemon_query(const char* socket_path, int argc, char* argv[])
+{
+	int i;
+	int fd = -1;
+	int32_t status = -1;
+	uint32_t len = 0;
+	size_t pos = 0;
+	ssize_t got = 0;
+	char* request = NULL;
+	char* buffer = NULL;
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+	if (strlen(socket_path) >= sizeof(addr.sun_path))
+		return -1;
+	strcpy(addr.sun_path, socket_path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+		goto error;
+
+	for (i = 0; i < argc; i++)
+		len += strlen(argv[i]) + 1;
+	request = malloc(sizeof(len) + len);
+	check_mem(request);
+	memcpy(request, &len, sizeof(len));
+	pos = sizeof(len);
+	for (i = 0; i < argc; i++) {
+		memcpy(request + pos, argv[i], strlen(argv[i]) + 1);
+		pos += strlen(argv[i]) + 1;
+	}
+	check_debug(write_full(fd, request, pos) == 0, "Daemon went away before taking the query");
+	// nothing came back, it died or was stopped, the search can still be done here
+	check_debug(read_full(fd, &status, sizeof(status)) == 0, "Daemon went away before answering");
+
+	buffer = malloc(DAEMON_BUFFER_SIZE);
+	check_mem(buffer);
+	while ((got = read(fd, buffer, DAEMON_BUFFER_SIZE)) > 0 || (got < 0 && errno == EINTR)) {
+		if (got > 0)
+			fwrite(buffer, 1, got, status == 0 ? stdout : stderr);
+	}
+	if (got < 0)
+		log_warn("Lost the daemon halfway through its answer");
+
+	free(buffer);
+	free(request);
+	close(fd);
+	return got < 0 && status == 0 ? 1 : status;
+
+error:
+	free(buffer);
+	free(request);
+	if (fd >= 0)
+		close(fd);
+	return -1;
+}
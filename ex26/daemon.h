@@ -0,0 +1,70 @@
+#ifndef logfind_daemon_h
+#define logfind_daemon_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <signal.h>
+
+// what the watches saw since the last batch
+#define DAEMON_FILES_CHANGED 1		// something was written to, indexes are stale
+#define DAEMON_LIST_CHANGED 2		// something was created, removed or renamed, the patterns need walking again
+
+// one client's command line, and the answer going back to it
+typedef struct DaemonQuery {
+	int fd;					// the client's, it stays open after the query is freed
+	char* request;			// the arguments, each ending in '\0'
+	char** argv;
+	int argc;
+	FILE* out;				// write the answer here
+	char* reply;			// what was written to out, once it's closed
+	size_t reply_len;
+	int status;				// exit status for the client, 0 unless set
+} DaemonQuery;
+
+// where a connection is between its first byte in and its last byte out
+#define DAEMON_CLIENT_READING 0		// its request is still coming in
+#define DAEMON_CLIENT_WAITING 1		// its query is in the batch being gathered or answered
+#define DAEMON_CLIENT_SENDING 2		// its answer is going out
+
+// one connection, read and written without blocking the loop
+typedef struct DaemonClient {
+	int fd;
+	int state;				// DAEMON_CLIENT_*
+	long arrived_at;		// ms, when it connected
+	long deadline;			// ms, it's dropped if it hasn't moved on by then, 0 while waiting
+	uint32_t len;			// request length, once the prefix is in
+	size_t got;				// bytes of the prefix and request read so far
+	char* request;
+	char* reply;			// the status then the answer
+	size_t reply_len;
+	size_t sent;
+} DaemonClient;
+
+// answers every query that came in together, count is 0 when there are only changes to catch up on
+typedef int (*Daemon_batch)(void* context, DaemonQuery* queries, int count, int changes);
+
+typedef struct Daemon {
+	char* socket_path;
+	int listen_fd;
+	int inotify_fd;
+	int signal_fd;
+	int epoll_fd;
+	sigset_t old_mask;
+	int changes;			// DAEMON_* seen since the last batch
+	DaemonClient** clients;	// indexed by fd
+	int client_capacity;
+	DaemonQuery* queries;	// the batch being gathered
+	int query_count;
+	int query_capacity;
+	long batch_started;		// ms, when the first query of the batch was in
+} Daemon;
+
+Daemon* Daemon_create(const char* socket_path);
+void Daemon_destroy(Daemon* daemon);
+
+int Daemon_watch(Daemon* daemon, const char* dir);
+int Daemon_run(Daemon* daemon, Daemon_batch batch, void* context);
+
+int Daemon_query(const char* socket_path, int argc, char* argv[]);
+
+#endif
@@ -0,0 +1,427 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>			// open
+#include <unistd.h>			// read, pread
+#include <dlfcn.h>			// dlopen
+#include <pthread.h>
+#include <zlib.h>
+#include "decompress.h"
+#include "dbg.h"
+
+// decompressed data is handed on in blocks this big
+#define DECOMPRESS_BLOCK (256*1024)
+// blocks the decompressing thread may get ahead of the matcher by
+#define DECOMPRESS_BUFFERS 4
+// compressed input smaller than this is decompressed without a second thread
+#define DECOMPRESS_INLINE_MAX (256*1024)
+
+Codec Codec_detect(const char* data, size_t size)
+{
+	const unsigned char* magic = (const unsigned char*)data;
+
+	// gzip's magic is followed by the method, always deflate
+	if (size >= 3 && magic[0] == 0x1f && magic[1] == 0x8b && magic[2] == 0x08)
+		return CODEC_GZIP;
+	if (size >= 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd)
+		return CODEC_ZSTD;
+	return CODEC_NONE;
+}
+
+/* Read the first bytes of a file and tell what it's compressed with
+ *
+ * Output
+ * 		codec: CODEC_NONE also if the file can't be read
+ */
+Codec Codec_sniff(const char* path)
+{
+	char magic[4];
+	ssize_t got = 0;
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+	if (fd < 0)
+		return CODEC_NONE;
+	got = pread(fd, magic, sizeof(magic), 0);
+	close(fd);
+	return got > 0 ? Codec_detect(magic, got) : CODEC_NONE;
+}
+
+const char* Codec_name(Codec codec)
+{
+	switch (codec) {
+		case CODEC_GZIP:
+			return "gzip";
+		case CODEC_ZSTD:
+			return "zstd";
+		default:
+			return "none";
+	}
+}
+
+/*-- ZSTD --*/
+
+// libzstd is loaded when the first zstd file turns up, so it isn't
+// needed to build logfind or to run it on anything else
+typedef struct ZstdInBuffer {
+	const void* src;
+	size_t size;
+	size_t pos;
+} ZstdInBuffer;
+
+typedef struct ZstdOutBuffer {
+	void* dst;
+	size_t size;
+	size_t pos;
+} ZstdOutBuffer;
+
+typedef struct ZstdApi {
+	void* (*create)(void);
+	size_t (*free)(void* stream);
+	size_t (*init)(void* stream);
+	size_t (*decompress)(void* stream, ZstdOutBuffer* out, ZstdInBuffer* in);
+	unsigned (*is_error)(size_t code);
+	const char* (*error_name)(size_t code);
+} ZstdApi;
+
+static ZstdApi zstd;
+static int zstd_loaded = 0;
+static pthread_once_t zstd_once = PTHREAD_ONCE_INIT;
+
+static void Zstd_load(void)
+{
+	void* lib = dlopen("libzstd.so.1", RTLD_NOW | RTLD_LOCAL);
+
+	if (lib == NULL)
+		return;
+	zstd.create = dlsym(lib, "ZSTD_createDStream");
+	zstd.free = dlsym(lib, "ZSTD_freeDStream");
+	zstd.init = dlsym(lib, "ZSTD_initDStream");
+	zstd.decompress = dlsym(lib, "ZSTD_decompressStream");
+	zstd.is_error = dlsym(lib, "ZSTD_isError");
+	zstd.error_name = dlsym(lib, "ZSTD_getErrorName");
+	zstd_loaded = zstd.create && zstd.free && zstd.init && zstd.decompress
+		&& zstd.is_error && zstd.error_name;
+}
+
+/*-- DECODER --*/
+
+typedef struct Decoder {
+	Codec codec;
+	int fd;					// read once the data handed in runs out, -1 for none
+	char* in;				// buffer for reads from fd
+	const unsigned char* next;
+	size_t avail;			// input not decompressed yet, starting at next
+	int eof;				// no input left to read
+	int frame_end;			// the last gzip member or zstd frame is complete
+	int finished;
+	z_stream z;
+	void* zds;
+} Decoder;
+
+static int Decoder_init(Decoder* decoder, Codec codec, const char* data, size_t size, int fd)
+{
+	memset(decoder, 0, sizeof(Decoder));
+	decoder->codec = codec;
+	decoder->fd = fd;
+	decoder->next = (const unsigned char*)data;
+	decoder->avail = size;
+	decoder->eof = fd < 0;
+
+	if (fd >= 0) {
+		decoder->in = malloc(DECOMPRESS_BLOCK);
+		check_mem(decoder->in);
+	}
+
+	if (codec == CODEC_GZIP) {
+		// 16 + window bits: gzip header and trailer, no zlib or raw deflate
+		check(inflateInit2(&decoder->z, 16 + MAX_WBITS) == Z_OK, "Couldn't start inflate");
+	} else {
+		pthread_once(&zstd_once, Zstd_load);
+		check(zstd_loaded, "zstd files need libzstd.so.1");
+		decoder->zds = zstd.create();
+		check_mem(decoder->zds);
+		check(!zstd.is_error(zstd.init(decoder->zds)), "Couldn't start zstd");
+	}
+	return 0;
+
+error:
+	free(decoder->in);
+	decoder->in = NULL;
+	return -1;
+}
+
+static void Decoder_free(Decoder* decoder)
+{
+	if (decoder->codec == CODEC_GZIP)
+		inflateEnd(&decoder->z);
+	else if (decoder->zds != NULL)
+		zstd.free(decoder->zds);
+	free(decoder->in);
+}
+
+static int Decoder_refill(Decoder* decoder)
+{
+	ssize_t got = 0;
+
+	if (decoder->avail > 0 || decoder->eof)
+		return 0;
+	do {
+		got = read(decoder->fd, decoder->in, DECOMPRESS_BLOCK);
+	} while (got < 0 && errno == EINTR);
+	check(got >= 0, "Failed reading compressed data");
+
+	decoder->next = (const unsigned char*)decoder->in;
+	decoder->avail = got;
+	decoder->eof = got == 0;
+	return 0;
+
+error:
+	return -1;
+}
+
+/* Decompress up to capacity bytes into out
+ * gzip files can be several members one after the other (cat a.gz b.gz),
+ * each is decompressed in turn. Anything after the last member that
+ * isn't another member is ignored, like gzip -d does; zstd handles its
+ * own concatenated frames.
+ *
+ * Output
+ * 		finished: 1 when the input is used up, 0 if there's more, -1 on error
+ */
+static int Decoder_fill(Decoder* decoder, char* out, size_t capacity, size_t* length)
+{
+	size_t produced = 0;
+	size_t consumed = 0;
+	int moved = 0;
+	int rc = 0;
+
+	while (produced < capacity && !decoder->finished) {
+		check(Decoder_refill(decoder) == 0, "Couldn't read input");
+
+		if (decoder->codec == CODEC_GZIP && decoder->frame_end) {
+			if (decoder->avail >= 3 && Codec_detect((const char*)decoder->next, decoder->avail) == CODEC_GZIP) {
+				inflateReset(&decoder->z);
+				decoder->frame_end = 0;
+			} else {
+				decoder->finished = 1;
+				break;
+			}
+		}
+
+		if (decoder->codec == CODEC_GZIP) {
+			decoder->z.next_in = (unsigned char*)decoder->next;
+			decoder->z.avail_in = decoder->avail;
+			decoder->z.next_out = (unsigned char*)out + produced;
+			decoder->z.avail_out = capacity - produced;
+			rc = inflate(&decoder->z, Z_NO_FLUSH);
+			check(rc == Z_OK || rc == Z_STREAM_END || rc == Z_BUF_ERROR,
+					"Corrupt gzip data: %s", decoder->z.msg ? decoder->z.msg : "unknown error");
+			consumed = decoder->avail - decoder->z.avail_in;
+			moved = consumed > 0 || decoder->z.avail_out < capacity - produced;
+			produced = capacity - decoder->z.avail_out;
+			decoder->frame_end = rc == Z_STREAM_END;
+		} else {
+			ZstdInBuffer in = { decoder->next, decoder->avail, 0 };
+			ZstdOutBuffer zout = { out + produced, capacity - produced, 0 };
+			size_t ret = zstd.decompress(decoder->zds, &zout, &in);
+			check(!zstd.is_error(ret), "Corrupt zstd data: %s", zstd.error_name(ret));
+			consumed = in.pos;
+			moved = consumed > 0 || zout.pos > 0;
+			produced += zout.pos;
+			decoder->frame_end = ret == 0;
+		}
+		decoder->next += consumed;
+		decoder->avail -= consumed;
+
+		if (!moved && decoder->avail == 0 && decoder->eof) {
+			check(decoder->frame_end, "Compressed data is truncated");
+			decoder->finished = 1;
+		} else {
+			check(moved || decoder->avail == 0, "Compressed data stopped making progress");
+		}
+		// a zstd stream ends on a frame boundary with nothing left to read
+		if (decoder->codec == CODEC_ZSTD && decoder->frame_end && decoder->avail == 0 && decoder->eof)
+			decoder->finished = 1;
+	}
+
+	*length = produced;
+	return decoder->finished;
+
+error:
+	*length = produced;
+	return -1;
+}
+
+/*-- PIPELINE --*/
+
+// the decompressing thread fills buffers, the calling thread matches them
+typedef struct Pipeline {
+	Decoder* decoder;
+	char* buffers[DECOMPRESS_BUFFERS];
+	size_t lengths[DECOMPRESS_BUFFERS];
+	size_t produced;		// buffers filled so far
+	size_t consumed;		// buffers handed on so far
+	int finished;
+	int error;
+	int stop;				// the consumer doesn't want any more
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+} Pipeline;
+
+static void* Pipeline_produce(void* context)
+{
+	Pipeline* pipeline = context;
+	size_t slot = 0;
+	size_t length = 0;
+	int rc = 0;
+
+	for (;;) {
+		pthread_mutex_lock(&pipeline->lock);
+		while (!pipeline->stop && pipeline->produced - pipeline->consumed == DECOMPRESS_BUFFERS)
+			pthread_cond_wait(&pipeline->changed, &pipeline->lock);
+		slot = pipeline->produced % DECOMPRESS_BUFFERS;
+		if (pipeline->stop) {
+			pthread_mutex_unlock(&pipeline->lock);
+			return NULL;
+		}
+		pthread_mutex_unlock(&pipeline->lock);
+
+		rc = Decoder_fill(pipeline->decoder, pipeline->buffers[slot], DECOMPRESS_BLOCK, &length);
+
+		pthread_mutex_lock(&pipeline->lock);
+		// what was decompressed before an error still gets searched
+		pipeline->lengths[slot] = length;
+		pipeline->produced++;
+		pipeline->finished = rc != 0;
+		pipeline->error = rc < 0;
+		pthread_cond_broadcast(&pipeline->changed);
+		pthread_mutex_unlock(&pipeline->lock);
+
+		if (rc != 0)
+			return NULL;
+	}
+}
+
+/* Decompress on a second thread while the caller matches
+ * The decompressing thread stays up to DECOMPRESS_BUFFERS blocks ahead,
+ * so inflating the next block overlaps with searching this one.
+ *
+ * Output
+ * 		error: 0 on success, -1 on error, 1 if no thread could be started
+ */
+static int Decompress_pipeline(Decoder* decoder, Decompress_block on_block, void* context)
+{
+	int i;
+	int stop = 0;
+	int rc = -1;
+	size_t slot = 0;
+	pthread_t producer;
+	Pipeline pipeline = { .decoder = decoder, .lock = PTHREAD_MUTEX_INITIALIZER,
+		.changed = PTHREAD_COND_INITIALIZER };
+
+	for (i = 0; i < DECOMPRESS_BUFFERS; i++) {
+		pipeline.buffers[i] = malloc(DECOMPRESS_BLOCK);
+		check_mem(pipeline.buffers[i]);
+	}
+	if (pthread_create(&producer, NULL, Pipeline_produce, &pipeline) != 0) {
+		rc = 1;
+		goto error;
+	}
+
+	for (;;) {
+		pthread_mutex_lock(&pipeline.lock);
+		while (pipeline.consumed == pipeline.produced && !pipeline.finished)
+			pthread_cond_wait(&pipeline.changed, &pipeline.lock);
+		if (pipeline.consumed == pipeline.produced) {
+			pthread_mutex_unlock(&pipeline.lock);
+			break;
+		}
+		slot = pipeline.consumed % DECOMPRESS_BUFFERS;
+		pthread_mutex_unlock(&pipeline.lock);
+
+		if (pipeline.lengths[slot] > 0)
+			stop = on_block(context, pipeline.buffers[slot], pipeline.lengths[slot]);
+
+		pthread_mutex_lock(&pipeline.lock);
+		pipeline.consumed++;
+		pipeline.stop = stop;
+		pthread_cond_broadcast(&pipeline.changed);
+		pthread_mutex_unlock(&pipeline.lock);
+		if (stop)
+			break;
+	}
+
+	pthread_join(producer, NULL);
+	rc = stop || !pipeline.error ? 0 : -1;
+
+error:	// fallthrough
+	for (i = 0; i < DECOMPRESS_BUFFERS; i++)
+		free(pipeline.buffers[i]);
+	pthread_mutex_destroy(&pipeline.lock);
+	pthread_cond_destroy(&pipeline.changed);
+	return rc;
+}
+
+/* Decompress on the calling thread, one block at a time */
+static int Decompress_inline(Decoder* decoder, Decompress_block on_block, void* context)
+{
+	int rc = 0;
+	size_t length = 0;
+	char* buffer = malloc(DECOMPRESS_BLOCK);
+	check_mem(buffer);
+
+	do {
+		rc = Decoder_fill(decoder, buffer, DECOMPRESS_BLOCK, &length);
+		if (length > 0 && on_block(context, buffer, length)) {
+			rc = 1;
+			break;
+		}
+	} while (rc == 0);
+
+	free(buffer);
+	return rc < 0 ? -1 : 0;
+
+error:
+	return -1;
+}
+
+/* Stream compressed data through on_block without writing it anywhere
+ * The data handed in comes first, then whatever can be read from fd, so
+ * a mapped file is passed as data with no fd and a pipe as the block
+ * already read from it plus the fd. Small inputs are decompressed on
+ * the calling thread, bigger ones through a two thread pipeline.
+ * LOGFIND_DECOMPRESS=inline turns the pipeline off.
+ *
+ * Input
+ * 		codec: what the data is compressed with, from Codec_detect
+ * 		data: compressed data read so far
+ * 		size: length of data
+ * 		fd: where the rest of the compressed data is read from, -1 if none
+ * 		on_block: called with each decompressed block, returns 1 to stop
+ * 		context: passed to on_block
+ * Output
+ * 		error: 0 on success or when on_block stopped it, -1 on error
+ */
+int Decompress_run(Codec codec, const char* data, size_t size, int fd,
+		Decompress_block on_block, void* context)
+{
+	int rc = -1;
+	Decoder decoder;
+	const char* forced = getenv("LOGFIND_DECOMPRESS");
+
+	check(codec == CODEC_GZIP || codec == CODEC_ZSTD, "Not compressed");
+	check(Decoder_init(&decoder, codec, data, size, fd) == 0, "Couldn't start %s", Codec_name(codec));
+
+	rc = 1;
+	if ((fd >= 0 || size >= DECOMPRESS_INLINE_MAX) && !(forced && strcmp(forced, "inline") == 0))
+		rc = Decompress_pipeline(&decoder, on_block, context);
+	// no second thread to be had, do it all here
+	if (rc == 1)
+		rc = Decompress_inline(&decoder, on_block, context);
+
+	Decoder_free(&decoder);
+	return rc;
+
+error:
+	return -1;
+}
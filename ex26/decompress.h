@@ -0,0 +1,23 @@
+#ifndef logfind_decompress_h
+#define logfind_decompress_h
+
+#include <stddef.h>
+
+// compression formats told apart by their magic bytes
+typedef enum Codec {
+	CODEC_NONE = 0,
+	CODEC_GZIP,
+	CODEC_ZSTD
+} Codec;
+
+// handed each block of decompressed data in order, returns 1 to stop early
+typedef int (*Decompress_block)(void* context, const char* data, size_t size);
+
+Codec Codec_detect(const char* data, size_t size);
+Codec Codec_sniff(const char* path);
+const char* Codec_name(Codec codec);
+
+int Decompress_run(Codec codec, const char* data, size_t size, int fd,
+		Decompress_block on_block, void* context);
+
+#endif
@@ -0,0 +1,218 @@
+#include <stdlib.h>
+#include <string.h>
+#include "fastsearch.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FS_X86 1
+#endif
+
+/*-- SCALAR --*/
+
+static const char* fs_memmem_scalar(const char* hay, size_t hay_len, const char* needle, size_t needle_len)
+{
+	const char* p = hay;
+	const char* end = NULL;
+	char last = needle[needle_len - 1];
+
+	if (needle_len > hay_len)
+		return NULL;
+
+	// one past the last position a match could start at
+	end = hay + hay_len - needle_len + 1;
+	while (p < end) {
+		p = memchr(p, needle[0], end - p);
+		if (p == NULL)
+			return NULL;
+		// last byte first, it rules out most false starts cheaply
+		if (p[needle_len - 1] == last && memcmp(p + 1, needle + 1, needle_len - 2) == 0)
+			return p;
+		p++;
+	}
+
+	return NULL;
+}
+
+static const char* fs_find_any_scalar(const char* hay, size_t hay_len, const unsigned char* set, int set_len)
+{
+	const unsigned char* p = (const unsigned char*)hay;
+	const unsigned char* end = p + hay_len;
+	int i;
+
+	for (; p < end; p++) {
+		for (i = 0; i < set_len; i++) {
+			if (*p == set[i])
+				return (const char*)p;
+		}
+	}
+
+	return NULL;
+}
+
+#ifdef FS_X86
+
+/*-- SSE2 --*/
+
+/* Generic SIMD substring search
+ * Compare 16 candidate start positions at once against the needle's first
+ * byte, and the same positions shifted by needle_len - 1 against its last
+ * byte. Only positions where both agree get a full memcmp.
+ */
+static const char* fs_memmem_sse2(const char* hay, size_t hay_len, const char* needle, size_t needle_len)
+{
+	const __m128i first = _mm_set1_epi8(needle[0]);
+	const __m128i last = _mm_set1_epi8(needle[needle_len - 1]);
+	size_t i = 0;
+
+	for (; i + needle_len - 1 + 16 <= hay_len; i += 16) {
+		__m128i block_first = _mm_loadu_si128((const __m128i*)(hay + i));
+		__m128i block_last = _mm_loadu_si128((const __m128i*)(hay + i + needle_len - 1));
+		unsigned mask = _mm_movemask_epi8(_mm_and_si128(
+					_mm_cmpeq_epi8(first, block_first), _mm_cmpeq_epi8(last, block_last)));
+
+		while (mask != 0) {
+			int bit = __builtin_ctz(mask);
+			if (memcmp(hay + i + bit + 1, needle + 1, needle_len - 2) == 0)
+				return hay + i + bit;
+			mask &= mask - 1;
+		}
+	}
+
+	// fewer than a block of candidates left
+	return i < hay_len ? fs_memmem_scalar(hay + i, hay_len - i, needle, needle_len) : NULL;
+}
+
+static const char* fs_find_any_sse2(const char* hay, size_t hay_len, const unsigned char* set, int set_len)
+{
+	__m128i wanted[FS_SET_MAX];
+	size_t i = 0;
+	int s;
+
+	for (s = 0; s < set_len; s++)
+		wanted[s] = _mm_set1_epi8(set[s]);
+
+	for (; i + 16 <= hay_len; i += 16) {
+		__m128i block = _mm_loadu_si128((const __m128i*)(hay + i));
+		__m128i any = _mm_cmpeq_epi8(block, wanted[0]);
+		for (s = 1; s < set_len; s++)
+			any = _mm_or_si128(any, _mm_cmpeq_epi8(block, wanted[s]));
+
+		unsigned mask = _mm_movemask_epi8(any);
+		if (mask != 0)
+			return hay + i + __builtin_ctz(mask);
+	}
+
+	return fs_find_any_scalar(hay + i, hay_len - i, set, set_len);
+}
+
+/*-- AVX2 --*/
+
+__attribute__((target("avx2")))
+static const char* fs_memmem_avx2(const char* hay, size_t hay_len, const char* needle, size_t needle_len)
+{
+	const __m256i first = _mm256_set1_epi8(needle[0]);
+	const __m256i last = _mm256_set1_epi8(needle[needle_len - 1]);
+	size_t i = 0;
+
+	for (; i + needle_len - 1 + 32 <= hay_len; i += 32) {
+		__m256i block_first = _mm256_loadu_si256((const __m256i*)(hay + i));
+		__m256i block_last = _mm256_loadu_si256((const __m256i*)(hay + i + needle_len - 1));
+		unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(
+					_mm256_cmpeq_epi8(first, block_first), _mm256_cmpeq_epi8(last, block_last)));
+
+		while (mask != 0) {
+			int bit = __builtin_ctz(mask);
+			if (memcmp(hay + i + bit + 1, needle + 1, needle_len - 2) == 0)
+				return hay + i + bit;
+			mask &= mask - 1;
+		}
+	}
+
+	return i < hay_len ? fs_memmem_sse2(hay + i, hay_len - i, needle, needle_len) : NULL;
+}
+
+__attribute__((target("avx2")))
+static const char* fs_find_any_avx2(const char* hay, size_t hay_len, const unsigned char* set, int set_len)
+{
+	__m256i wanted[FS_SET_MAX];
+	size_t i = 0;
+	int s;
+
+	for (s = 0; s < set_len; s++)
+		wanted[s] = _mm256_set1_epi8(set[s]);
+
+	for (; i + 32 <= hay_len; i += 32) {
+		__m256i block = _mm256_loadu_si256((const __m256i*)(hay + i));
+		__m256i any = _mm256_cmpeq_epi8(block, wanted[0]);
+		for (s = 1; s < set_len; s++)
+			any = _mm256_or_si256(any, _mm256_cmpeq_epi8(block, wanted[s]));
+
+		unsigned mask = _mm256_movemask_epi8(any);
+		if (mask != 0)
+			return hay + i + __builtin_ctz(mask);
+	}
+
+	return fs_find_any_sse2(hay + i, hay_len - i, set, set_len);
+}
+
+#endif
+
+/*-- DISPATCH --*/
+
+typedef const char* (*fs_memmem_fn)(const char*, size_t, const char*, size_t);
+typedef const char* (*fs_find_any_fn)(const char*, size_t, const unsigned char*, int);
+
+static fs_memmem_fn memmem_kernel = fs_memmem_scalar;
+static fs_find_any_fn find_any_kernel = fs_find_any_scalar;
+static const char* kernel_name = "scalar";
+
+/* Pick the widest kernel this CPU has, once, before main runs
+ * Set LOGFIND_KERNEL=scalar|sse2|avx2 to force a narrower one.
+ */
+__attribute__((constructor))
+static void fs_init()
+{
+#ifdef FS_X86
+	const char* forced = getenv("LOGFIND_KERNEL");
+
+	__builtin_cpu_init();
+	if (forced != NULL && strcmp(forced, "scalar") == 0)
+		return;
+
+	if (__builtin_cpu_supports("sse2")) {
+		memmem_kernel = fs_memmem_sse2;
+		find_any_kernel = fs_find_any_sse2;
+		kernel_name = "sse2";
+	}
+	if (__builtin_cpu_supports("avx2") && (forced == NULL || strcmp(forced, "sse2") != 0)) {
+		memmem_kernel = fs_memmem_avx2;
+		find_any_kernel = fs_find_any_avx2;
+		kernel_name = "avx2";
+	}
+#endif
+}
+
+const char* fs_kernel_name()
+{
+	return kernel_name;
+}
+
+const char* fs_memmem(const char* hay, size_t hay_len, const char* needle, size_t needle_len)
+{
+	if (needle_len == 0)
+		return hay;
+	if (needle_len > hay_len)
+		return NULL;
+	if (needle_len == 1)
+		return memchr(hay, needle[0], hay_len);
+
+	return memmem_kernel(hay, hay_len, needle, needle_len);
+}
+
+const char* fs_find_any(const char* hay, size_t hay_len, const unsigned char* set, int set_len)
+{
+	if (set_len == 1)
+		return memchr(hay, set[0], hay_len);
+
+	return find_any_kernel(hay, hay_len, set, set_len);
+}
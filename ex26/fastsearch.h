@@ -0,0 +1,19 @@
+#ifndef logfind_fastsearch_h
+#define logfind_fastsearch_h
+
+#include <stddef.h>
+
+// most distinct bytes fs_find_any can look for at once
+#define FS_SET_MAX 4
+
+// which kernel fs_memmem ended up using, for benchmarks and debug output
+const char* fs_kernel_name();
+
+// like memmem: first occurrence of needle in hay, NULL if there is none
+// works on arbitrary bytes, neither side needs to be NUL terminated
+const char* fs_memmem(const char* hay, size_t hay_len, const char* needle, size_t needle_len);
+
+// first byte in [hay, hay + hay_len) equal to any of set[0 .. set_len - 1]
+const char* fs_find_any(const char* hay, size_t hay_len, const unsigned char* set, int set_len);
+
+#endif
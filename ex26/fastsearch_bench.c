@@ -0,0 +1,107 @@
+#define _GNU_SOURCE			// memmem
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "fastsearch.h"
+
+// size of the text searched per run
+#define BENCH_SIZE (64*1024*1024)
+// searches per needle length, the best one is reported
+#define BENCH_ROUNDS 5
+
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Fill buf with something that looks like a log: lowercase words, spaces, newlines */
+static void fill_text(char* buf, size_t size)
+{
+	const char* words[] = { "error", "warning", "info", "debug", "request", "served",
+		"connection", "closed", "timeout", "user", "login", "failed", "200", "404" };
+	size_t pos = 0;
+
+	while (pos < size) {
+		const char* word = words[rand() % (sizeof(words) / sizeof(words[0]))];
+		size_t len = strlen(word);
+		if (pos + len + 1 >= size)
+			break;
+		memcpy(buf + pos, word, len);
+		pos += len;
+		buf[pos++] = rand() % 12 == 0 ? '\n' : ' ';
+	}
+	memset(buf + pos, ' ', size - pos);
+	buf[size - 1] = '\0';
+}
+
+typedef const char* (*search_fn)(const char*, size_t, const char*, size_t);
+
+static const char* run_fs_memmem(const char* hay, size_t n, const char* needle, size_t m)
+{
+	return fs_memmem(hay, n, needle, m);
+}
+
+static const char* run_memmem(const char* hay, size_t n, const char* needle, size_t m)
+{
+	return memmem(hay, n, needle, m);
+}
+
+static const char* run_strstr(const char* hay, size_t n, const char* needle, size_t m)
+{
+	return strstr(hay, needle);
+}
+
+static double best_gbps(search_fn fn, const char* hay, size_t n, const char* needle, size_t m)
+{
+	double best = 0;
+	int i;
+
+	for (i = 0; i < BENCH_ROUNDS; i++) {
+		double start = now();
+		const char* found = fn(hay, n, needle, m);
+		double elapsed = now() - start;
+		if (found != NULL)
+			fprintf(stderr, "needle unexpectedly found\n");
+		if (n / elapsed / 1e9 > best)
+			best = n / elapsed / 1e9;
+	}
+
+	return best;
+}
+
+int main(int argc, char* argv[])
+{
+	size_t lengths[] = { 2, 3, 4, 6, 8, 12, 16, 24, 32, 64 };
+	char needle[65];
+	size_t i;
+	char* text = malloc(BENCH_SIZE);
+
+	if (text == NULL)
+		return 1;
+
+	srand(1);
+	fill_text(text, BENCH_SIZE);
+
+	printf("fs_memmem kernel: %s, %d MB of text, needle absent\n", fs_kernel_name(), BENCH_SIZE >> 20);
+	printf("%6s %12s %12s %12s\n", "needle", "fs_memmem", "memmem", "strstr");
+
+	for (i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+		size_t m = lengths[i];
+		// a real prefix from the text with a last byte that never occurs,
+		// so first-byte filters see plenty of candidates
+		memcpy(needle, text + 1000, m);
+		needle[m - 1] = 'Z';
+		needle[m] = '\0';
+
+		printf("%6zu %9.2f GB/s %7.2f GB/s %7.2f GB/s\n", m,
+				best_gbps(run_fs_memmem, text, BENCH_SIZE - 1, needle, m),
+				best_gbps(run_memmem, text, BENCH_SIZE - 1, needle, m),
+				best_gbps(run_strstr, text, BENCH_SIZE - 1, needle, m));
+	}
+
+	free(text);
+	return 0;
+}
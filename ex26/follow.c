@@ -0,0 +1,541 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>			// open
+#include <unistd.h>			// pread, close
+#include <sys/stat.h>		// fstat
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+#include "follow.h"
+#include "decompress.h"
+#include "dbg.h"
+
+// new data is read in blocks this big
+#define FOLLOW_BUFFER_SIZE (64*1024)
+// what a watched directory reports
+#define FOLLOW_EVENTS (IN_CREATE | IN_MODIFY | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_ONLYDIR)
+
+/*-- FILES --*/
+
+static uint64_t hash_path(const char* path)
+{
+	// FNV-1a
+	uint64_t hash = 14695981039346656037ULL;
+	for (; *path; path++)
+		hash = (hash ^ (unsigned char)*path) * 1099511628211ULL;
+	return hash;
+}
+
+static FollowFile** Follower_slot(Follower* follower, const char* path)
+{
+	FollowFile** slot = &follower->buckets[hash_path(path) & (follower->bucket_count - 1)];
+
+	while (*slot != NULL && strcmp((*slot)->path, path) != 0)
+		slot = &(*slot)->next;
+	return slot;
+}
+
+/* Double the buckets once there are more files than buckets */
+static int Follower_grow(Follower* follower)
+{
+	size_t i;
+	size_t count = follower->bucket_count * 2;
+	FollowFile** buckets = calloc(count, sizeof(FollowFile*));
+	check_mem(buckets);
+
+	for (i = 0; i < follower->bucket_count; i++) {
+		FollowFile* file = follower->buckets[i];
+		while (file != NULL) {
+			FollowFile* next = file->next;
+			size_t bucket = hash_path(file->path) & (count - 1);
+			file->next = buckets[bucket];
+			buckets[bucket] = file;
+			file = next;
+		}
+	}
+
+	free(follower->buckets);
+	follower->buckets = buckets;
+	follower->bucket_count = count;
+	return 0;
+
+error:
+	return -1;
+}
+
+static void FollowFile_destroy(FollowFile* file)
+{
+	if (file) {
+		MatchState_free(&file->ms);
+		free(file->path);
+		free(file);
+	}
+}
+
+/* Start following a file
+ * Files there at startup are followed from their current end, so only
+ * data written from now on is searched. Files that show up later are
+ * new, and searched from the start.
+ *
+ * Input
+ * 		follower: follower to add to
+ * 		path: file to follow, ignored if it's already followed
+ * 		from_end: 1 to skip what's in the file now
+ * Output
+ * 		error: 0 on success, -1 on error
+ */
+int Follower_add(Follower* follower, const char* path, int from_end)
+{
+	struct stat sb;
+	FollowFile** slot = Follower_slot(follower, path);
+	FollowFile* file = NULL;
+
+	if (*slot != NULL)
+		return 0;
+
+	file = calloc(1, sizeof(FollowFile));
+	check_mem(file);
+	file->path = strdup(path);
+	check_mem(file->path);
+	check(MatchState_init(follower->matcher, &file->ms) == 0, "Couldn't set up %s", path);
+
+	if (stat(path, &sb) == 0) {
+		file->inode = sb.st_ino;
+		file->offset = from_end ? sb.st_size : 0;
+	}
+
+	*slot = file;
+	follower->file_count++;
+	if (follower->file_count > follower->bucket_count && Follower_grow(follower) != 0)
+		log_warn("Couldn't grow the file table, lookups will get slower");
+	return 0;
+
+error:
+	if (file)
+		free(file->path);
+	free(file);
+	return -1;
+}
+
+static void Follower_remove(Follower* follower, const char* path)
+{
+	FollowFile** slot = Follower_slot(follower, path);
+	FollowFile* file = *slot;
+
+	if (file != NULL) {
+		*slot = file->next;
+		FollowFile_destroy(file);
+		follower->file_count--;
+	}
+}
+
+/* Search whatever was written to a file since it was last looked at
+ * A new inode means the file was replaced (rotated) and a shorter file
+ * means it was truncated, either way it's searched from the start.
+ * Matching carries on across writes, so a term split over two writes
+ * is still found. Once a match is reported the search starts over with
+ * the next write, so each report is about data written after the last.
+ */
+static void Follower_update(Follower* follower, FollowFile* file)
+{
+	struct stat sb;
+	ssize_t got = 0;
+	int reported = 0;
+	int fd = open(file->path, O_RDONLY | O_CLOEXEC);
+
+	// gone already, the delete event is on its way
+	if (fd < 0)
+		return;
+
+	if (fstat(fd, &sb) == 0) {
+		if ((uint64_t)sb.st_ino != file->inode || sb.st_size < file->offset) {
+			file->inode = sb.st_ino;
+			file->offset = 0;
+			MatchState_reset(follower->matcher, &file->ms);
+		}
+	}
+
+	while ((got = pread(fd, follower->buffer, FOLLOW_BUFFER_SIZE, file->offset)) > 0) {
+		// rotated logs being compressed only make sense once whole, search them without -f
+		if (file->offset == 0)
+			file->compressed = Codec_detect(follower->buffer, got) != CODEC_NONE;
+		if (file->compressed) {
+			file->offset = sb.st_size > file->offset ? sb.st_size : file->offset + got;
+			continue;
+		}
+		file->offset += got;
+		if (!reported && Matcher_scan(follower->matcher, &file->ms, follower->buffer, got, follower->or_flag)) {
+			printf("%s matches by %s!\n", file->path, follower->or_flag ? "OR" : "AND");
+			fflush(stdout);
+			reported = 1;
+		}
+	}
+	close(fd);
+
+	if (reported)
+		MatchState_reset(follower->matcher, &file->ms);
+}
+
+/*-- WATCHES --*/
+
+static FollowWatch* Follower_watch(Follower* follower, int wd)
+{
+	int i;
+
+	for (i = 0; i < follower->watch_count; i++) {
+		if (follower->watches[i].wd == wd)
+			return &follower->watches[i];
+	}
+	return NULL;
+}
+
+/* Join a directory and a file name the way the walk prints them */
+static char* join_path(const char* dir, const char* name)
+{
+	size_t dir_len = strlen(dir);
+	size_t len = dir_len + strlen(name) + 2;
+	char* path = malloc(len);
+
+	if (path == NULL)
+		return NULL;
+	if (dir_len == 0)
+		snprintf(path, len, "%s", name);
+	else if (dir[dir_len - 1] == '/')
+		snprintf(path, len, "%s%s", dir, name);
+	else
+		snprintf(path, len, "%s/%s", dir, name);
+	return path;
+}
+
+/* Watch a directory files matching the patterns can show up in
+ * Called by the walk's workers as they list directories, so the table
+ * is only touched under watch_lock. A directory reached by two paths
+ * is one watch, under the first path.
+ */
+static void Follower_watch_dir(Follower* follower, const char* dir)
+{
+	int wd = inotify_add_watch(follower->inotify_fd, dir[0] != '\0' ? dir : ".", FOLLOW_EVENTS);
+
+	if (wd < 0) {
+		log_warn("Can't watch %s", dir[0] != '\0' ? dir : ".");
+		return;
+	}
+
+	pthread_mutex_lock(&follower->watch_lock);
+	if (Follower_watch(follower, wd) == NULL) {
+		if (follower->watch_count == follower->watch_capacity) {
+			int capacity = follower->watch_capacity > 0 ? follower->watch_capacity * 2 : 16;
+			FollowWatch* grown = realloc(follower->watches, capacity * sizeof(FollowWatch));
+			check_mem(grown);
+			follower->watches = grown;
+			follower->watch_capacity = capacity;
+		}
+		FollowWatch* watch = &follower->watches[follower->watch_count];
+		watch->wd = wd;
+		watch->dir = strdup(dir);
+		check_mem(watch->dir);
+		follower->watch_count++;
+	}
+
+error:	// fallthrough
+	pthread_mutex_unlock(&follower->watch_lock);
+}
+
+/* Walker visit: watch every directory the walk lists */
+static void follower_visit(void* context, const char* dir)
+{
+	Follower_watch_dir(context, dir);
+}
+
+/* The directory behind a watch is gone, inotify already dropped it */
+static void Follower_unwatch(Follower* follower, FollowWatch* watch)
+{
+	free(watch->dir);
+	*watch = follower->watches[--follower->watch_count];
+}
+
+/* Walk the patterns, watching every directory they lead into
+ * and following every file they match. Files already followed are left
+ * as they are, so this is also how files in a new directory get
+ * picked up. New files are searched right away when from_end is 0.
+ *
+ * Input
+ * 		follower: follower to add to
+ * 		from_end: 1 to skip what's in new files now, 0 to search them whole
+ * Output
+ * 		error: 0 on success, -1 on error
+ */
+int Follower_walk(Follower* follower, int from_end)
+{
+	int i;
+	int count = 0;
+	char** paths = NULL;
+	Arena* arena = Arena_create(0);
+	check_mem(arena);
+
+	count = Walker_find_files(follower->patterns, follower->pattern_count, follower->walk_threads,
+			follower_visit, follower, arena, &paths);
+	check(count >= 0, "Couldn't expand glob patterns");
+	for (i = 0; i < count; i++) {
+		if (*Follower_slot(follower, paths[i]) != NULL)
+			continue;
+		check(Follower_add(follower, paths[i], from_end) == 0, "Couldn't follow %s", paths[i]);
+		// written before its directory was watched, no event is coming for it
+		if (!from_end)
+			Follower_update(follower, *Follower_slot(follower, paths[i]));
+	}
+
+	Arena_destroy(arena);
+	return 0;
+
+error:
+	Arena_destroy(arena);
+	return -1;
+}
+
+/* The inotify queue overflowed and events were lost
+ * Walk again to pick up files and directories that were created while
+ * nobody was listening, then look at every followed file.
+ */
+static void Follower_rescan(Follower* follower)
+{
+	size_t j;
+
+	log_warn("inotify queue overflowed, rescanning");
+	if (Follower_walk(follower, 0) != 0)
+		log_warn("Couldn't walk the patterns again, new files may be missed");
+
+	for (j = 0; j < follower->bucket_count; j++) {
+		FollowFile* file;
+		for (file = follower->buckets[j]; file != NULL; file = file->next)
+			Follower_update(follower, file);
+	}
+}
+
+/* Act on one inotify event in a watched directory
+ * Paths are matched against the patterns the way the walk matches
+ * them. A new directory the patterns lead into (under a ** or a
+ * wildcard directory) means walking again, which watches it and follows
+ * whatever was written to it before the watch went up.
+ */
+static void Follower_event(Follower* follower, struct inotify_event* event)
+{
+	char* path = NULL;
+	FollowFile* file = NULL;
+	FollowWatch* watch = NULL;
+
+	if (event->mask & IN_Q_OVERFLOW) {
+		Follower_rescan(follower);
+		return;
+	}
+	watch = Follower_watch(follower, event->wd);
+	if (watch == NULL)
+		return;
+	if (event->mask & IN_IGNORED) {
+		Follower_unwatch(follower, watch);
+		return;
+	}
+	if (event->len == 0)
+		return;
+
+	path = join_path(watch->dir, event->name);
+	if (path == NULL)
+		return;
+
+	if (event->mask & IN_ISDIR) {
+		if ((event->mask & (IN_CREATE | IN_MOVED_TO))
+				&& Walker_match(follower->walk_patterns, follower->pattern_count, path, 1)
+				&& Follower_walk(follower, 0) != 0)
+			log_warn("Couldn't walk into %s, new files in it may be missed", path);
+	} else if (Walker_match(follower->walk_patterns, follower->pattern_count, path, 0)) {
+		if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+			Follower_remove(follower, path);
+		} else {
+			// created, moved in, or written to before we knew about it: all of it is new
+			if (*Follower_slot(follower, path) == NULL)
+				Follower_add(follower, path, 0);
+			file = *Follower_slot(follower, path);
+			if (file != NULL)
+				Follower_update(follower, file);
+		}
+	}
+	free(path);
+}
+
+/* Read every queued inotify event and act on it */
+static int Follower_drain(Follower* follower)
+{
+	char events[16 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+	ssize_t got = 0;
+	char* p = NULL;
+
+	for (;;) {
+		got = read(follower->inotify_fd, events, sizeof(events));
+		if (got < 0 && errno == EINTR)
+			continue;
+		if (got < 0 && errno == EAGAIN)
+			return 0;
+		check(got > 0, "Couldn't read inotify events");
+
+		for (p = events; p < events + got; p += sizeof(struct inotify_event) + ((struct inotify_event*)p)->len)
+			Follower_event(follower, (struct inotify_event*)p);
+	}
+
+error:
+	return -1;
+}
+
+/*-- LIFECYCLE --*/
+
+/* Set up inotify and signals for following the glob patterns
+ * Directories are watched rather than files, so following 10k files in
+ * a handful of directories costs a handful of watches, and new files
+ * that match a pattern show up as events in the same place. The
+ * directories are the ones Follower_walk lists, a plain path's
+ * directory is watched here. SIGINT and SIGTERM come in through a
+ * signalfd so Follower_run can stop cleanly.
+ *
+ * Input
+ * 		patterns: glob patterns from the config, kept until destroyed
+ * 		pattern_count: length of patterns
+ * 		walk_threads: threads for each walk of the patterns
+ * 		matcher: compiled search terms
+ * 		or_flag: 1 reports a file as soon as any term shows up, 0 once all have
+ * Output
+ * 		follower: ready to walk and run, NULL on error
+ */
+Follower* Follower_create(char** patterns, int pattern_count, int walk_threads, Matcher* matcher, int or_flag)
+{
+	int i;
+	sigset_t mask;
+	struct epoll_event event = { .events = EPOLLIN };
+	Follower* follower = calloc(1, sizeof(Follower));
+	check_mem(follower);
+
+	follower->matcher = matcher;
+	follower->or_flag = or_flag;
+	follower->patterns = patterns;
+	follower->pattern_count = pattern_count;
+	follower->walk_threads = walk_threads;
+	pthread_mutex_init(&follower->watch_lock, NULL);
+	follower->inotify_fd = -1;
+	follower->signal_fd = -1;
+	follower->epoll_fd = -1;
+	follower->bucket_count = 1024;
+	follower->buckets = calloc(follower->bucket_count, sizeof(FollowFile*));
+	follower->buffer = malloc(FOLLOW_BUFFER_SIZE);
+	check_mem(follower->buckets);
+	check_mem(follower->buffer);
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+	check(sigprocmask(SIG_BLOCK, &mask, &follower->old_mask) == 0, "Couldn't block signals");
+
+	follower->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	follower->signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+	follower->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	check(follower->inotify_fd >= 0, "Couldn't start inotify");
+	check(follower->signal_fd >= 0, "Couldn't make a signalfd");
+	check(follower->epoll_fd >= 0, "Couldn't make an epoll instance");
+
+	event.data.fd = follower->inotify_fd;
+	check(epoll_ctl(follower->epoll_fd, EPOLL_CTL_ADD, follower->inotify_fd, &event) == 0, "epoll_ctl failed");
+	event.data.fd = follower->signal_fd;
+	check(epoll_ctl(follower->epoll_fd, EPOLL_CTL_ADD, follower->signal_fd, &event) == 0, "epoll_ctl failed");
+
+	follower->arena = Arena_create(0);
+	check_mem(follower->arena);
+	follower->walk_patterns = Walker_compile(patterns, pattern_count, follower->arena);
+	check(follower->walk_patterns != NULL, "Couldn't take apart the glob patterns");
+
+	// the walk doesn't list a plain path's directory, but the file can come and go
+	for (i = 0; i < pattern_count; i++) {
+		WalkPattern* pat = &follower->walk_patterns[i];
+		if (pat->root != NULL && pat->part_count == 0) {
+			char* slash = strrchr(pat->root, '/');
+			char* dir = slash == NULL ? strdup("") : slash == pat->root ? strdup("/")
+					: strndup(pat->root, slash - pat->root);
+			check_mem(dir);
+			Follower_watch_dir(follower, dir);
+			free(dir);
+		}
+	}
+
+	return follower;
+
+error:
+	Follower_destroy(follower);
+	return NULL;
+}
+
+void Follower_destroy(Follower* follower)
+{
+	int i;
+	size_t j;
+
+	if (follower) {
+		for (j = 0; follower->buckets != NULL && j < follower->bucket_count; j++) {
+			FollowFile* file = follower->buckets[j];
+			while (file != NULL) {
+				FollowFile* next = file->next;
+				FollowFile_destroy(file);
+				file = next;
+			}
+		}
+		for (i = 0; i < follower->watch_count; i++)
+			free(follower->watches[i].dir);
+		if (follower->epoll_fd >= 0)
+			close(follower->epoll_fd);
+		if (follower->signal_fd >= 0) {
+			close(follower->signal_fd);
+			sigprocmask(SIG_SETMASK, &follower->old_mask, NULL);
+		}
+		if (follower->inotify_fd >= 0)
+			close(follower->inotify_fd);
+		free(follower->watches);
+		pthread_mutex_destroy(&follower->watch_lock);
+		Arena_destroy(follower->arena);
+		free(follower->buckets);
+		free(follower->buffer);
+		free(follower);
+	}
+}
+
+/* Wait for writes and search them as they happen
+ * One thread, one epoll loop: inotify events are handled as they
+ * arrive, and a SIGINT or SIGTERM ends the loop.
+ *
+ * Output
+ * 		error: 0 when stopped by a signal, -1 on error
+ */
+int Follower_run(Follower* follower)
+{
+	int i, n;
+	struct epoll_event events[2];
+	struct signalfd_siginfo info;
+
+	debug("Following %zu files in %d directories", follower->file_count, follower->watch_count);
+
+	for (;;) {
+		n = epoll_wait(follower->epoll_fd, events, 2, -1);
+		if (n < 0 && errno == EINTR)
+			continue;
+		check(n >= 0, "epoll_wait failed");
+
+		for (i = 0; i < n; i++) {
+			if (events[i].data.fd == follower->signal_fd) {
+				if (read(follower->signal_fd, &info, sizeof(info)) == sizeof(info)) {
+					debug("Stopping on signal %u", info.ssi_signo);
+				}
+				return 0;
+			}
+			check(Follower_drain(follower) == 0, "Lost the inotify queue");
+		}
+	}
+
+error:
+	return -1;
+}
@@ -0,0 +1,56 @@
+#ifndef logfind_follow_h
+#define logfind_follow_h
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <signal.h>
+#include "matcher.h"
+#include "walker.h"
+
+// a file being followed, found by path through the hash chains
+typedef struct FollowFile {
+	char* path;
+	uint64_t inode;
+	off_t offset;				// everything before this has been searched
+	MatchState ms;				// carried across writes until a match is reported
+	int compressed;				// gzip or zstd, not searched while following
+	struct FollowFile* next;
+} FollowFile;
+
+// one inotify watch on a directory the walk listed
+typedef struct FollowWatch {
+	int wd;
+	char* dir;					// as the walk prints it, "" for the current directory
+} FollowWatch;
+
+typedef struct Follower {
+	Matcher* matcher;
+	int or_flag;
+	char** patterns;			// glob patterns from the config, walked again when directories appear
+	WalkPattern* walk_patterns;	// the same, cut up to match paths from events
+	int pattern_count;
+	int walk_threads;
+	Arena* arena;				// walk_patterns
+	int inotify_fd;
+	int signal_fd;
+	int epoll_fd;
+	sigset_t old_mask;
+	pthread_mutex_t watch_lock;	// the walk's workers add watches while it runs
+	FollowWatch* watches;
+	int watch_count;
+	int watch_capacity;
+	FollowFile** buckets;
+	size_t bucket_count;		// always a power of two
+	size_t file_count;
+	char* buffer;
+} Follower;
+
+Follower* Follower_create(char** patterns, int pattern_count, int walk_threads, Matcher* matcher, int or_flag);
+void Follower_destroy(Follower* follower);
+
+int Follower_walk(Follower* follower, int from_end);
+int Follower_add(Follower* follower, const char* path, int from_end);
+int Follower_run(Follower* follower);
+
+#endif
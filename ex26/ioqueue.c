@@ -0,0 +1,405 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>			// AT_FDCWD, O_RDONLY
+#include <unistd.h>			// syscall, pread
+#include <sys/mman.h>		// mmap
+#include <sys/syscall.h>	// __NR_io_uring_*
+#include <linux/io_uring.h>
+#include "ioqueue.h"
+#include "workpool.h"
+#include "dbg.h"
+
+static const char* backend_name = "none";
+
+const char* IOQueue_backend()
+{
+	return backend_name;
+}
+
+/*-- IO_URING --*/
+
+// what a slot is waiting on
+enum { SLOT_IDLE, SLOT_OPEN, SLOT_READ, SLOT_CLOSE };
+
+typedef struct UringSlot {
+	int stage;
+	size_t index;
+	int fd;
+	int error;
+	off_t offset;
+	char* buffer;
+} UringSlot;
+
+// the rings shared with the kernel, see io_uring_setup(2)
+typedef struct Uring {
+	int fd;
+	unsigned* sq_tail;
+	unsigned* sq_mask;
+	unsigned* sq_array;
+	unsigned* cq_head;
+	unsigned* cq_tail;
+	unsigned* cq_mask;
+	struct io_uring_sqe* sqes;
+	struct io_uring_cqe* cqes;
+	void* sq_ring;
+	size_t sq_ring_size;
+	void* cq_ring;
+	size_t cq_ring_size;
+	size_t sqes_size;
+	unsigned to_submit;
+} Uring;
+
+static void Uring_teardown(Uring* ring)
+{
+	if (ring->sqes != NULL && ring->sqes != MAP_FAILED)
+		munmap(ring->sqes, ring->sqes_size);
+	if (ring->cq_ring != NULL && ring->cq_ring != MAP_FAILED && ring->cq_ring != ring->sq_ring)
+		munmap(ring->cq_ring, ring->cq_ring_size);
+	if (ring->sq_ring != NULL && ring->sq_ring != MAP_FAILED)
+		munmap(ring->sq_ring, ring->sq_ring_size);
+	if (ring->fd >= 0)
+		close(ring->fd);
+}
+
+/* Check the kernel can do every operation we need, openat and close are 5.6+ */
+static int Uring_supported(Uring* ring)
+{
+	int ok = 0;
+	size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+	struct io_uring_probe* probe = calloc(1, size);
+
+	if (probe == NULL)
+		return 0;
+
+	if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PROBE, probe, 256) == 0) {
+		ok = probe->last_op >= IORING_OP_READ
+			&& (probe->ops[IORING_OP_OPENAT].flags & IO_URING_OP_SUPPORTED)
+			&& (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED)
+			&& (probe->ops[IORING_OP_CLOSE].flags & IO_URING_OP_SUPPORTED);
+	}
+
+	free(probe);
+	return ok;
+}
+
+/* Create a ring with room for entries requests and map it
+ *
+ * Output
+ * 		error: 0 on success, -1 if io_uring isn't there or won't do
+ */
+static int Uring_setup(Uring* ring, unsigned entries)
+{
+	struct io_uring_params params;
+
+	memset(ring, 0, sizeof(Uring));
+	memset(&params, 0, sizeof(params));
+
+	ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+	if (ring->fd < 0) {
+		debug("io_uring_setup failed: %s", strerror(errno));
+		return -1;
+	}
+
+	ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	// newer kernels put both rings in one mapping
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		if (ring->cq_ring_size > ring->sq_ring_size)
+			ring->sq_ring_size = ring->cq_ring_size;
+		ring->cq_ring_size = ring->sq_ring_size;
+	}
+
+	ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	check(ring->sq_ring != MAP_FAILED, "Couldn't map the submission ring");
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		ring->cq_ring = ring->sq_ring;
+	} else {
+		ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+		check(ring->cq_ring != MAP_FAILED, "Couldn't map the completion ring");
+	}
+	ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	check(ring->sqes != MAP_FAILED, "Couldn't map the submission entries");
+
+	ring->sq_tail = (unsigned*)((char*)ring->sq_ring + params.sq_off.tail);
+	ring->sq_mask = (unsigned*)((char*)ring->sq_ring + params.sq_off.ring_mask);
+	ring->sq_array = (unsigned*)((char*)ring->sq_ring + params.sq_off.array);
+	ring->cq_head = (unsigned*)((char*)ring->cq_ring + params.cq_off.head);
+	ring->cq_tail = (unsigned*)((char*)ring->cq_ring + params.cq_off.tail);
+	ring->cq_mask = (unsigned*)((char*)ring->cq_ring + params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe*)((char*)ring->cq_ring + params.cq_off.cqes);
+
+	check(Uring_supported(ring), "io_uring can't open, read and close here");
+	return 0;
+
+error:
+	Uring_teardown(ring);
+	return -1;
+}
+
+/* Queue one request for slot, it goes to the kernel with the next Uring_enter
+ * Each slot has at most one request out, so the ring never fills up.
+ */
+static void Uring_push(Uring* ring, int slot, int opcode, int fd, const void* addr, unsigned len, off_t offset)
+{
+	unsigned tail = *ring->sq_tail;
+	unsigned index = tail & *ring->sq_mask;
+	struct io_uring_sqe* sqe = &ring->sqes[index];
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = opcode;
+	sqe->fd = fd;
+	sqe->addr = (unsigned long)addr;
+	sqe->len = len;
+	sqe->off = offset;
+	sqe->user_data = slot;
+	if (opcode == IORING_OP_OPENAT)
+		sqe->open_flags = O_RDONLY | O_CLOEXEC;
+
+	ring->sq_array[index] = index;
+	// the kernel must see the entry before it sees the new tail
+	__atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	ring->to_submit++;
+}
+
+/* Submit everything queued and wait for at least one completion */
+static int Uring_enter(Uring* ring)
+{
+	int rc;
+
+	do {
+		rc = syscall(__NR_io_uring_enter, ring->fd, ring->to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+	} while (rc < 0 && errno == EINTR);
+
+	if (rc >= 0)
+		ring->to_submit -= rc;
+	return rc < 0 ? -1 : 0;
+}
+
+typedef struct UringRun {
+	Uring ring;
+	UringSlot* slots;
+	char** paths;
+	size_t count;
+	size_t next;			// next file to hand to an idle slot
+	int active;				// slots with a request out
+	IOQueue_data on_data;
+	IOQueue_done on_done;
+	void* context;
+} UringRun;
+
+/* Give the slot the next file, or leave it idle when there are none left */
+static void UringRun_start(UringRun* run, int slot)
+{
+	UringSlot* s = &run->slots[slot];
+
+	if (run->next >= run->count) {
+		s->stage = SLOT_IDLE;
+		run->active--;
+		return;
+	}
+
+	s->index = run->next++;
+	s->fd = -1;
+	s->error = 0;
+	s->offset = 0;
+	s->stage = SLOT_OPEN;
+	Uring_push(&run->ring, slot, IORING_OP_OPENAT, AT_FDCWD, run->paths[s->index], 0, 0);
+}
+
+/* Move a slot to its next step once its request completes
+ * open -> read ... read -> close -> open the next file
+ */
+static void UringRun_complete(UringRun* run, int slot, int res)
+{
+	UringSlot* s = &run->slots[slot];
+
+	switch (s->stage) {
+		case SLOT_OPEN:
+			if (res < 0) {
+				run->on_done(run->context, slot, s->index, -res);
+				UringRun_start(run, slot);
+				return;
+			}
+			s->fd = res;
+			s->stage = SLOT_READ;
+			Uring_push(&run->ring, slot, IORING_OP_READ, s->fd, s->buffer, IOQUEUE_BLOCK, 0);
+			return;
+
+		case SLOT_READ:
+			if (res > 0 && !run->on_data(run->context, slot, s->buffer, res)) {
+				s->offset += res;
+				Uring_push(&run->ring, slot, IORING_OP_READ, s->fd, s->buffer, IOQUEUE_BLOCK, s->offset);
+				return;
+			}
+			// end of file, an error, or the caller has seen enough
+			if (res < 0)
+				s->error = -res;
+			s->stage = SLOT_CLOSE;
+			Uring_push(&run->ring, slot, IORING_OP_CLOSE, s->fd, NULL, 0, 0);
+			return;
+
+		case SLOT_CLOSE:
+			run->on_done(run->context, slot, s->index, s->error);
+			UringRun_start(run, slot);
+			return;
+	}
+}
+
+/* Keep depth files in flight on one io_uring from one thread
+ * Opens, reads and closes are all requests on the ring, and every
+ * io_uring_enter hands the kernel whatever the last batch of
+ * completions queued up, so the syscall count no longer grows with
+ * the number of files times the calls per file.
+ */
+static int IOQueue_uring(char** paths, size_t count, int depth,
+		IOQueue_data on_data, IOQueue_done on_done, void* context)
+{
+	int i;
+	UringRun run = { .paths = paths, .count = count, .on_data = on_data,
+		.on_done = on_done, .context = context };
+	char* buffers = NULL;
+
+	if (Uring_setup(&run.ring, depth) != 0)
+		return -1;
+
+	run.slots = calloc(depth, sizeof(UringSlot));
+	buffers = malloc((size_t)depth * IOQUEUE_BLOCK);
+	check_mem(run.slots);
+	check_mem(buffers);
+
+	run.active = depth;
+	for (i = 0; i < depth; i++) {
+		run.slots[i].buffer = buffers + (size_t)i * IOQUEUE_BLOCK;
+		UringRun_start(&run, i);
+	}
+
+	while (run.active > 0) {
+		check(Uring_enter(&run.ring) == 0, "io_uring_enter failed");
+
+		unsigned head = *run.ring.cq_head;
+		unsigned tail = __atomic_load_n(run.ring.cq_tail, __ATOMIC_ACQUIRE);
+		for (; head != tail; head++) {
+			struct io_uring_cqe* cqe = &run.ring.cqes[head & *run.ring.cq_mask];
+			UringRun_complete(&run, (int)cqe->user_data, cqe->res);
+		}
+		__atomic_store_n(run.ring.cq_head, head, __ATOMIC_RELEASE);
+	}
+
+	free(buffers);
+	free(run.slots);
+	Uring_teardown(&run.ring);
+	return 0;
+
+error:
+	// the ring is in an unknown state, give up on it and let the caller fall back
+	free(buffers);
+	free(run.slots);
+	Uring_teardown(&run.ring);
+	return -2;
+}
+
+/*-- THREADS --*/
+
+typedef struct ThreadRun {
+	char** paths;
+	char* buffers;
+	IOQueue_data on_data;
+	IOQueue_done on_done;
+	void* context;
+} ThreadRun;
+
+/* Worker pool task: open, pread and close one file the blocking way */
+static void IOQueue_thread_file(void* context, int worker, size_t index)
+{
+	ThreadRun* run = context;
+	char* buffer = run->buffers + (size_t)worker * IOQUEUE_BLOCK;
+	off_t offset = 0;
+	ssize_t got = 0;
+	int error = 0;
+	int fd = open(run->paths[index], O_RDONLY | O_CLOEXEC);
+
+	if (fd < 0) {
+		run->on_done(run->context, worker, index, errno);
+		return;
+	}
+
+	while ((got = pread(fd, buffer, IOQUEUE_BLOCK, offset)) > 0) {
+		offset += got;
+		if (run->on_data(run->context, worker, buffer, got))
+			break;
+	}
+	if (got < 0)
+		error = errno;
+
+	close(fd);
+	run->on_done(run->context, worker, index, error);
+}
+
+/* Keep depth files in flight with depth blocking threads */
+static int IOQueue_threads(char** paths, size_t count, int depth,
+		IOQueue_data on_data, IOQueue_done on_done, void* context)
+{
+	int rc = -1;
+	ThreadRun run = { .paths = paths, .on_data = on_data, .on_done = on_done, .context = context };
+
+	run.buffers = malloc((size_t)depth * IOQUEUE_BLOCK);
+	check_mem(run.buffers);
+
+	rc = WorkPool_run(count, depth, IOQueue_thread_file, &run);
+
+error:	// fallthrough
+	free(run.buffers);
+	return rc;
+}
+
+/* Read every file in paths with up to depth opens and reads in flight
+ * Uses io_uring when the kernel has it, otherwise a pool of depth
+ * threads doing blocking pread. Set LOGFIND_IO=threads to skip io_uring.
+ * Each file in flight has a slot, 0 .. depth - 1, and every callback
+ * for that file gets the same slot, so per-file state can live in an
+ * array indexed by slot. With io_uring all callbacks come from the
+ * calling thread; with threads, callbacks for different slots run at
+ * the same time.
+ *
+ * Input
+ * 		paths: files to read
+ * 		count: length of paths
+ * 		depth: most files in flight at once
+ * 		on_data: called with each block read
+ * 		on_done: called once per file when it's finished
+ * 		context: passed to every callback
+ * Output
+ * 		error: 0 on success, -1 on error
+ */
+int IOQueue_read_files(char** paths, size_t count, int depth,
+		IOQueue_data on_data, IOQueue_done on_done, void* context)
+{
+	const char* forced = getenv("LOGFIND_IO");
+
+	if ((size_t)depth > count)
+		depth = count;
+	if (depth < 1)
+		return 0;
+
+	if (forced == NULL || strcmp(forced, "threads") != 0) {
+		int rc = IOQueue_uring(paths, count, depth, on_data, on_done, context);
+		if (rc == 0) {
+			backend_name = "io_uring";
+			return 0;
+		}
+		// a ring that broke halfway may have already finished some files
+		check(rc == -1, "io_uring failed partway through");
+		debug("io_uring unavailable, using threads");
+	}
+
+	backend_name = "threads";
+	return IOQueue_threads(paths, count, depth, on_data, on_done, context);
+
+error:
+	return -1;
+}
@@ -0,0 +1,22 @@
+#ifndef logfind_ioqueue_h
+#define logfind_ioqueue_h
+
+#include <stddef.h>
+
+// bytes asked for per read, every slot owns one buffer this big
+#define IOQUEUE_BLOCK (64*1024)
+
+// the next block of the file in slot has been read, blocks of a file arrive in order
+// return 1 if the rest of the file isn't needed
+typedef int (*IOQueue_data)(void* context, int slot, const char* data, size_t size);
+// file index is finished, error is 0 or the errno that stopped it
+// this is the last call for the file, the slot is reused after it returns
+typedef void (*IOQueue_done)(void* context, int slot, size_t index, int error);
+
+// name of the backend the last IOQueue_read_files used
+const char* IOQueue_backend();
+
+int IOQueue_read_files(char** paths, size_t count, int depth,
+		IOQueue_data on_data, IOQueue_done on_done, void* context);
+
+#endif
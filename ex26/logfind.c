@@ -1,71 +1,176 @@
 #include <stdio.h>
 #include <stdlib.h>			// getenv
-#include <string.h>			// strtok, strncpy, strstr
-#include <glob.h>			// glob
+#include <string.h>			// memchr, strerror
 #include <unistd.h>			// getopt
+#include <getopt.h>			// getopt_long
+#include <fcntl.h>			// open
+#include <sys/mman.h>		// mmap, madvise
+#include <sys/stat.h>		// fstat
+#include <pthread.h>		// pthread_mutex_t
+#include <errno.h>			// EEXIST
 #include <linux/limits.h>	// PATH_MAX
 #include "dbg.h"			// debug, check, log_err
+#include "matcher.h"		// Matcher, MatchState
+#include "workpool.h"		// WorkPool_run
+#include "ioqueue.h"		// IOQueue_read_files
+#include "trigram_index.h"	// TrigramIndex
+#include "scanstate.h"		// ScanState
+#include "follow.h"			// Follower
+#include "decompress.h"		// Decompress_run
+#include "arena.h"			// Arena
+#include "walker.h"			// Walker_find_files
+#include "bloom.h"			// BloomFilter
+#include "daemon.h"			// Daemon, Daemon_query
 
-// an upper limit on glob patterns makes things easier for me
-#define GLOB_MAX 10
-// lines can only be LINE_LENGTH characters long before getting truncated
-#define LINE_LENGTH 512
-// an upper limit on the number of terms that can be searched
-#define SEARCH_TERMS_MAX 5
+// files that can't be mapped are read in blocks this big
+#define READ_BUFFER_SIZE (64*1024)
+// a file whose result hasn't been filled in by a worker yet
+#define RESULT_PENDING -2
+// directories are listed by up to this many threads when -j asks for fewer
+#define WALK_THREADS_MAX 8
+// regular files bigger than this are split into chunks searched in parallel
+#ifndef SCAN_CHUNK_SIZE
+#define SCAN_CHUNK_SIZE ((off_t)64*1024*1024)
+#endif
 
-int load_config(const char*, char**);
-int build_cli(int, char*[], int*, char***);
-void search_files(char**, int, char**, int, int);
+// everything the command line can change about a search
+typedef struct SearchOptions {
+	int or_flag;			// -o: 1 for OR, 0 for AND
+	int jobs;				// -j: files or chunks searched at once
+	int depth;				// -q: files in flight on the IO queue, 0 to read them in the workers
+	int use_index;			// -i: rule files out with the trigram index first
+	const char* index_path;	// where the trigram index lives
+	int use_bloom;			// -b: rule settled files out with their Bloom filter sidecars first
+	const char* bloom_dir;	// where the sidecars live
+	int since_last;			// --since-last: only search what was appended since the last run
+	const char* state_path;	// where --since-last keeps its offsets
+	int follow;				// -f: keep watching and search data as it's written
+	char** regexes;			// -e: extended regular expressions, searched a line at a time
+	int regex_count;
+	int daemon;				// --daemon: keep everything warm and answer queries over a socket
+	const char* socket_path;	// where the daemon listens
+} SearchOptions;
+
+// one file from the glob patterns and what's been found in it so far
+typedef struct SearchFile {
+	char* path;
+	int found;				// final found count, -1 unreadable, RESULT_PENDING until known
+	int chunks_left;		// chunks still being searched, 0 if searched whole
+	int merged;				// terms seen by the chunks finished so far
+	char* seen;				// chunked files, and every file when keeping seen: the terms found
+	int failed;				// a chunk couldn't read the file
+	int ranged;				// searched as chunks of [from, to) instead of whole
+	off_t from;
+	off_t to;
+	uint64_t dev;			// --since-last: device and inode when planned
+	uint64_t inode;
+	int compressed;			// --since-last: changed and compressed, searched whole
+} SearchFile;
+
+// one unit of work: a whole file, or a byte range of a big one
+typedef struct SearchItem {
+	SearchFile* file;
+	off_t start;
+	off_t end;				// 0 for a whole file
+} SearchItem;
+
+// everything the workers share during one search
+typedef struct Search {
+	SearchFile* files;		// every file from every glob, in output order
+	size_t file_count;
+	SearchItem* items;		// files and chunks of files, in file order
+	size_t item_count;
+	Matcher* matcher;
+	int or_flag;
+	MatchState* states;		// one per worker
+	MatchState* slots;		// one per file in flight on the IO queue
+	size_t* slot_items;		// IO queue file index -> item
+	size_t* slot_read;		// bytes the IO queue has read of each slot's file
+	char* slot_compressed;	// the slot's file turned out compressed, the workers get it
+	size_t printed;			// files before this one have been printed
+	FILE* out;				// results go here as they're ready, NULL to only keep them
+	int keep_seen;			// remember which terms each file had, not just how many
+	pthread_mutex_t output_lock;
+} Search;
+
+// one query's terms and the files it still has to look at
+typedef struct SearchQuery {
+	Matcher* matcher;
+	int or_flag;
+	char* candidates;		// one per file, cleared once the file is ruled out
+} SearchQuery;
+
+int load_config(const char*, Arena*, char***);
+int build_cli(int, char*[], SearchOptions*, Arena*, char***);
+int scan_compressed(Codec, const char*, size_t, int, Matcher*, MatchState*, int);
+int scan_stream(int, Matcher*, MatchState*, int);
+int scan_file(const char*, Matcher*, MatchState*, int);
+int scan_range(const char*, off_t, off_t, off_t, off_t, Matcher*, MatchState*, int);
+int collect_files(char**, int, SearchOptions*, Walker_visit, void*, Arena*, char***);
+void search_files(char**, int, Matcher*, SearchOptions*, Arena*);
+int follow_files(char**, int, Matcher*, SearchOptions*);
+int serve_files(char**, int, SearchOptions*);
 
 
 /* Load a configuration file from ~/.logfind
  * The file should contain globs of files to search
- * (e.g. *.c, Makefile, lib.h)
+ * (e.g. *.c, Makefile, lib.h), one per line, as many and as
+ * long as you like
  *
  * Input
  *		config: A file path to read from
- *		globs: Pointer to a list of globs
+ *		arena: where the globs and the list of them are kept
+ *		globs_addr: address to store the list of globs in
  * Output
  * 		count: Number of lines found in config file
  */
-int load_config(const char* config_path, char** globs)
+int load_config(const char* config_path, Arena* arena, char*** globs_addr)
 {
 	int count = 0;
+	int capacity = 16;
 	FILE* logfind = NULL;
-	char* resolved_path	= malloc(PATH_MAX*sizeof(char));
-	char* buffer = malloc(LINE_LENGTH*sizeof(char));
-	char* tokenized;
+	char* resolved_path = NULL;
+	char* line = NULL;
+	size_t line_size = 0;
+	ssize_t len = 0;
+	char** globs = Arena_alloc(arena, capacity * sizeof(char*));
+	check_mem(globs);
 
-	// resolve an absolute path to our config and open it for reading	
-	realpath(config_path, resolved_path);
-	logfind = fopen(resolved_path, "r");
+	// resolve an absolute path to our config and open it for reading
+	resolved_path = realpath(config_path, NULL);
+	logfind = fopen(resolved_path ? resolved_path : config_path, "r");
 	check(logfind != NULL, "Couldn't open .logfind");
 
-	// begin reading
-	while (fgets(buffer, LINE_LENGTH - 1, logfind) != NULL) {
-		check(count < GLOB_MAX, "Maximum number of patterns exceeded. %d >= %d", count, GLOB_MAX);
+	// begin reading, getline grows line to fit
+	while ((len = getline(&line, &line_size, logfind)) != -1) {
 		// remove \n characters from string
-		tokenized = strtok(buffer, "\n");
-		if (tokenized == NULL || tokenized[0] == '\0')
+		if (len > 0 && line[len - 1] == '\n')
+			line[--len] = '\0';
+		if (len == 0)
 			continue;
-		// allocate size of tokenized - up to max line length
-		globs[count] = malloc(strnlen(tokenized, LINE_LENGTH)*sizeof(char));
-		// leave space for a null byte just in case
-		strncpy(globs[count], tokenized, strnlen(tokenized, LINE_LENGTH-1));
-		globs[count][LINE_LENGTH-1] = '\0';
+
+		if (count == capacity) {
+			char** grown = Arena_grow(arena, globs, capacity * sizeof(char*), capacity * 2 * sizeof(char*));
+			check_mem(grown);
+			globs = grown;
+			capacity *= 2;
+		}
+		globs[count] = Arena_strndup(arena, line, len);
+		check_mem(globs[count]);
 		count++;
 	}
 
 	// clean up
-	free(buffer);
+	free(line);
 	free(resolved_path);
 	fclose(logfind);
 
 	// return the number of globs found in the config file
+	*globs_addr = globs;
 	return count;
 
 error:
-	free(buffer);
+	free(line);
 	free(resolved_path);
 	if (logfind != NULL)
 		fclose(logfind);
@@ -80,35 +185,74 @@ error:
  * Input
  * 		argc: same as in main
  * 		argv: same as in main
- *		or_flag: address to store OR flag value in (1 for OR, 0 for AND)
+ *		options: flags are stored here (-o OR, -j jobs, -q depth, -i index, --since-last, -e regex)
+ *		arena: where the terms and the list of them are kept
  *		terms_addr: address to store terms string array in
  *	Output
  *		error: any errors returned. 0 means the function ran successfully
  */
-int build_cli(int argc, char* argv[], int* or_flag, char*** terms_addr)
+int build_cli(int argc, char* argv[], SearchOptions* options, Arena* arena, char*** terms_addr)
 {
 	if (argc < 2)
 		return -1;
 
 	int count = 0;
-	char** terms = malloc(SEARCH_TERMS_MAX*sizeof(char**));
+	// there can't be more terms than arguments
+	char** terms = Arena_alloc(arena, argc * sizeof(char*));
 	int opt;
-	int opt_len = 0;
+	check_mem(terms);
+	static struct option long_options[] = {
+		{ "since-last", no_argument, NULL, 'S' },
+		{ "daemon", no_argument, NULL, 'D' },
+		{ NULL, 0, NULL, 0 }
+	};
 
 	// examine each argument looking for our "OR" flag
-	while((opt = getopt(argc, argv, "-o")) != -1) {
+	while((opt = getopt_long(argc, argv, "-oj:q:ibfe:", long_options, NULL)) != -1) {
 		switch(opt) {
+			case 'e':
+				// each -e is one more term, matched as a regex
+				if (options->regexes == NULL)
+					options->regexes = Arena_alloc(arena, argc * sizeof(char*));
+				check_mem(options->regexes);
+				options->regexes[options->regex_count] = Arena_strdup(arena, optarg);
+				check_mem(options->regexes[options->regex_count]);
+				options->regex_count++;
+				break;
 			case 'o':
-				*or_flag = 1;
+				options->or_flag = 1;
+				break;
+			case 'j':
+				options->jobs = atoi(optarg);
+				if (options->jobs < 1)
+					options->jobs = 1;
+				break;
+			case 'q':
+				options->depth = atoi(optarg);
+				if (options->depth < 0)
+					options->depth = 0;
+				break;
+			case 'i':
+				options->use_index = 1;
+				break;
+			case 'b':
+				options->use_bloom = 1;
+				break;
+			case 'S':
+				options->since_last = 1;
+				break;
+			case 'f':
+				options->follow = 1;
+				break;
+			case 'D':
+				options->daemon = 1;
+				break;
+			case '?':
 				break;
 			// treat any non-flag argument as a term to search
 			default:
-				if (count >= SEARCH_TERMS_MAX)
-					break;
-				opt_len = strnlen(optarg, LINE_LENGTH)-1;
-				terms[count] = malloc(strnlen(optarg, LINE_LENGTH)*sizeof(char));
-				strncpy(terms[count], optarg, opt_len);
-				terms[count][opt_len] = '\0';
+				terms[count] = Arena_strdup(arena, optarg);
+				check_mem(terms[count]);
 				count++;
 				break;
 		}
@@ -116,123 +260,1390 @@ int build_cli(int argc, char* argv[], int* or_flag, char*** terms_addr)
 
 	*terms_addr = terms;
 	return count;
+
+error:
+	return -1;
 }
 
-/* Search all files matching glob patterns for search term(s)
- * Number of terms is variable, and we need to search for each one
+// where the decompressor's blocks go
+typedef struct ScanContext {
+	Matcher* matcher;
+	MatchState* ms;
+	int or_flag;
+} ScanContext;
+
+static int scan_block(void* context, const char* data, size_t size)
+{
+	ScanContext* scan = context;
+
+	return Matcher_scan(scan->matcher, scan->ms, data, size, scan->or_flag);
+}
+
+/* Search gzip or zstd data as it's decompressed, without temp files
+ * The matcher carries its state across decompressed blocks just like it
+ * does across reads, and decompression stops once the answer is known.
+ *
+ * Input
+ * 		codec: what the data is compressed with
+ * 		data: compressed data, all of it if fd is -1
+ * 		size: length of data
+ * 		fd: where the rest of the compressed data comes from, -1 if none
+ * 		matcher: compiled search terms
+ * 		ms: search progress for this file
+ * 		or_flag: 1 stops at the first term found
+ * Output
+ * 		found: number of terms found, -1 if the data couldn't be decompressed
+ */
+int scan_compressed(Codec codec, const char* data, size_t size, int fd,
+		Matcher* matcher, MatchState* ms, int or_flag)
+{
+	ScanContext scan = { .matcher = matcher, .ms = ms, .or_flag = or_flag };
+
+	if (Decompress_run(codec, data, size, fd, scan_block, &scan) != 0)
+		return -1;
+	Matcher_finish(matcher, ms, or_flag);
+	return ms->found;
+}
+
+/* Search a file descriptor that can't be mapped (pipes, special files)
+ * Reads it once, feeding every block through the matcher, which carries
+ * its state across blocks, so there is no rewinding and no line limit.
+ * A stream that starts with gzip or zstd magic is decompressed on the way in.
+ *
+ * Input
+ * 		fd: open file descriptor, closed before returning
+ * 		matcher: compiled search terms
+ * 		ms: search progress for this file
+ * 		or_flag: 1 stops at the first term found
+ * Output
+ * 		found: number of terms found, -1 on error
+ */
+int scan_stream(int fd, Matcher* matcher, MatchState* ms, int or_flag)
+{
+	ssize_t got = 0;
+	Codec codec = CODEC_NONE;
+	char* buffer = malloc(READ_BUFFER_SIZE);
+	check_mem(buffer);
+
+	// the first block says whether the rest needs decompressing
+	got = read(fd, buffer, READ_BUFFER_SIZE);
+	codec = got > 0 ? Codec_detect(buffer, got) : CODEC_NONE;
+	if (codec != CODEC_NONE) {
+		check(scan_compressed(codec, buffer, got, fd, matcher, ms, or_flag) >= 0,
+				"Failed decompressing file descriptor %d", fd);
+		got = 0;
+	}
+
+	// stop reading as soon as the answer can't change
+	while (got > 0 && !Matcher_scan(matcher, ms, buffer, got, or_flag))
+		got = read(fd, buffer, READ_BUFFER_SIZE);
+	check(got >= 0, "Failed reading file descriptor %d", fd);
+	if (codec == CODEC_NONE)
+		Matcher_finish(matcher, ms, or_flag);
+
+	free(buffer);
+	close(fd);
+	return ms->found;
+
+error:
+	free(buffer);
+	close(fd);
+	return -1;
+}
+
+/* Search one file for search term(s)
+ * Regular files are mapped and searched in place with a sequential
+ * read-ahead hint, so there is no per-line copying and no stdio.
+ * Anything that can't be mapped falls back to buffered reads.
+ * Every term is looked for in the same single pass over the file.
+ * gzip and zstd files are recognised by their magic bytes and searched
+ * decompressed.
+ *
+ * Input
+ * 		path: file to search
+ * 		matcher: compiled search terms
+ * 		ms: search progress, reset here for this file
+ * 		or_flag: 1 stops at the first term found
+ * Output
+ * 		found: number of terms found, -1 if the file couldn't be read
+ */
+int scan_file(const char* path, Matcher* matcher, MatchState* ms, int or_flag)
+{
+	struct stat sb;
+	int fd = open(path, O_RDONLY);
+
+	MatchState_reset(matcher, ms);
+
+	if (fd < 0) {
+		perror(path);
+		return -1;
+	}
+
+	// empty regular files are also how /proc and /sys files look, read those
+	if (fstat(fd, &sb) == 0 && S_ISREG(sb.st_mode) && sb.st_size > 0) {
+		char* data = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data != MAP_FAILED) {
+			int found = 0;
+			Codec codec = Codec_detect(data, sb.st_size);
+			madvise(data, sb.st_size, MADV_SEQUENTIAL);
+			if (codec != CODEC_NONE) {
+				found = scan_compressed(codec, data, sb.st_size, -1, matcher, ms, or_flag);
+				if (found < 0)
+					fprintf(stderr, "%s: couldn't decompress %s data\n", path, Codec_name(codec));
+			} else {
+				if (!Matcher_scan(matcher, ms, data, sb.st_size, or_flag))
+					Matcher_finish(matcher, ms, or_flag);
+				found = ms->found;
+			}
+			munmap(data, sb.st_size);
+			close(fd);
+			return found;
+		}
+		debug("mmap failed for %s, reading instead", path);
+	}
+
+	return scan_stream(fd, matcher, ms, or_flag);
+}
+
+/* Search the lines that start inside one byte range of a file
+ * The file is searched as ranges of [from, to), and each range is
+ * widened to whole lines: it owns every line whose first byte falls in
+ * [start, end), so neighbouring ranges cover [from, to) exactly once.
+ * The scan runs on past the last line by max_len - 1 bytes so a term
+ * containing a newline that starts here is still found, which makes the
+ * union of all ranges the same as one scan of [from, to). When from is
+ * partway into the file, the bytes just before it are fed to the matcher
+ * first, so a term that started before from and ends after it counts.
+ * Regexes only ever see whole lines, since every range starts on one.
+ *
+ * Input
+ * 		path: file to search
+ * 		start: first byte of the range
+ * 		end: one past the last byte of the range
+ * 		from: where the first range starts, taken exactly rather than at a line
+ * 		to: where the last range ends, nothing past it is looked at
+ * 		matcher: compiled search terms
+ * 		ms: search progress, reset here, ms->seen holds the terms found
+ * 		or_flag: 1 stops at the first term found
+ * Output
+ * 		found: number of terms found in the range, -1 if the file couldn't be read
+ */
+int scan_range(const char* path, off_t start, off_t end, off_t from, off_t to,
+		Matcher* matcher, MatchState* ms, int or_flag)
+{
+	struct stat sb;
+	char* data = MAP_FAILED;
+	const char* newline = NULL;
+	off_t limit = 0;
+	off_t first = 0;
+	off_t last = 0;
+	off_t scan_end = 0;
+	off_t overlap = 0;
+	off_t lookback = 0;
+	int fd = open(path, O_RDONLY);
+
+	MatchState_reset(matcher, ms);
+
+	if (fd < 0) {
+		perror(path);
+		return -1;
+	}
+	check(fstat(fd, &sb) == 0, "Couldn't stat %s", path);
+
+	// the file shrank since it was split up, the lines are someone else's now
+	limit = to < sb.st_size ? to : sb.st_size;
+	if (start >= limit) {
+		close(fd);
+		return ms->found;
+	}
+
+	// the whole file is mapped, only the range plus a line or so gets touched
+	data = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	check(data != MAP_FAILED, "Couldn't map %s", path);
+
+	// the first line that starts at or after start
+	first = start;
+	if (start > from) {
+		newline = memchr(data + start - 1, '\n', limit - start + 1);
+		first = newline ? newline - data + 1 : limit;
+	}
+	// and the first one that starts at or after end, which belongs to the next range
+	last = limit;
+	if (end < limit) {
+		newline = memchr(data + end - 1, '\n', limit - end + 1);
+		last = newline ? newline - data + 1 : limit;
+	}
+
+	if (first < last) {
+		// no literals at all leaves max_len at 0
+		overlap = matcher->max_len > 0 ? (off_t)matcher->max_len - 1 : 0;
+		scan_end = last + overlap;
+		if (scan_end > limit)
+			scan_end = limit;
+		if (first == from && from > 0) {
+			// regexes need the byte before to tell whether from starts a line
+			lookback = matcher->regex_count > 0 && overlap < 1 ? 1 : overlap;
+			if (lookback > from)
+				lookback = from;
+			Matcher_prime(matcher, ms, data + from - lookback, lookback);
+		}
+		madvise(data, sb.st_size, MADV_SEQUENTIAL);
+		// the last line of the file may be waiting on its end to match
+		if (!Matcher_scan(matcher, ms, data + first, scan_end - first, or_flag) && scan_end == sb.st_size)
+			Matcher_finish(matcher, ms, or_flag);
+	}
+
+	munmap(data, sb.st_size);
+	close(fd);
+	return ms->found;
+
+error:
+	if (data != MAP_FAILED)
+		munmap(data, sb.st_size);
+	close(fd);
+	return -1;
+}
+
+/* Threads to walk the glob patterns with, see collect_files */
+static int walk_threads(SearchOptions* options)
+{
+	// listing directories is all syscalls, it's worth a few threads even at -j 1
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int threads = cpus < 1 ? 1 : cpus > WALK_THREADS_MAX ? WALK_THREADS_MAX : cpus;
+
+	if (options->jobs > threads)
+		threads = options->jobs;
+	return threads;
+}
+
+/* Expand every glob pattern into one list of files
+ * The patterns are matched in one parallel walk of the directories
+ * they point into, see Walker_find_files. Files come out in pattern
+ * order, sorted by path within a pattern, which is the order results get
+ * printed in, and a file two patterns match is only listed once.
  *
  * Input
  * 		patterns: strings that match file pattern globs
  * 		pattern_count: length of patterns array
- * 		terms: array of search terms
- * 		term_count: length of terms array
- * 		or_flag: determines how to analyze search results. 1 == OR. 0 == AND
+ * 		options: -j, the walk uses at least that many threads
+ * 		visit: called with every directory the walk lists, can be NULL
+ * 		context: passed to visit
+ * 		arena: where the paths and the list of them are kept
+ * 		files_addr: address to store the list of file paths in
+ * Output
+ * 		count: number of files found, -1 on error
+ */
+int collect_files(char** patterns, int pattern_count, SearchOptions* options,
+		Walker_visit visit, void* context, Arena* arena, char*** files_addr)
+{
+	return Walker_find_files(patterns, pattern_count, walk_threads(options), visit, context, arena, files_addr);
+}
+
+/* Print whether one file matches, given how many of the terms it had */
+static void print_result(FILE* out, const char* file, int match, int term_count, int or_flag)
+{
+	if (or_flag == 1 && match > 0)
+		fprintf(out, "%s matches by OR!\n", file);
+	else if (or_flag == 0 && match >= term_count)
+		fprintf(out, "%s matches by AND!\n", file);
+	else
+		fprintf(out, "%s does not match!\n", file);
+}
+
+/* Print every finished result that is next in line
+ * Workers finish files in any order, results only go out once all the
+ * files before them are done, so the output doesn't depend on -j.
+ * Caller holds output_lock.
  */
-void search_files(char** patterns, int pattern_count, char** terms, int term_count, int or_flag)
+static void search_print_ready(Search* search)
 {
-	int i, j, k;
+	if (search->out == NULL)
+		return;
+
+	while (search->printed < search->file_count && search->files[search->printed].found != RESULT_PENDING) {
+		SearchFile* file = &search->files[search->printed];
+		search->printed++;
+
+		if (file->found >= 0)
+			print_result(search->out, file->path, file->found, search->matcher->term_count, search->or_flag);
+	}
+}
+
+/* Fold one chunk's terms into its file, finishing the file with the last chunk
+ * Caller holds output_lock.
+ */
+static void search_merge_chunk(Search* search, SearchFile* file, MatchState* ms, int found)
+{
+	int i;
+
+	if (found < 0) {
+		file->failed = 1;
+	} else if (ms != NULL) {
+		for (i = 0; i < search->matcher->term_count; i++) {
+			if (ms->seen[i] && !file->seen[i]) {
+				file->seen[i] = 1;
+				file->merged++;
+			}
+		}
+	}
+
+	if (--file->chunks_left == 0)
+		file->found = file->failed ? -1 : file->merged;
+}
+
+/* Worker pool task: search one file or chunk and hand the result to the output */
+static void search_one(void* context, int worker, size_t index)
+{
+	Search* search = context;
+	SearchItem* item = &search->items[index];
+	SearchFile* file = item->file;
+	MatchState* ms = &search->states[worker];
 	int match = 0;
-	// current line number we are searching
-	int line_no = 0;
-	// result of glob()
-	int result;
-	FILE* fp;
-	// do NOT malloc here
-	// We'll assign a char* later instead of copying into a char[] and freeing the memory
-	char* current_file;
-	char* current_pattern;
-	// malloc here b/c we are copying into a char[] and checking its contents
-	char* buffer = malloc(LINE_LENGTH*sizeof(char));
-	glob_t current_glob;
-
-	// work on each glob pattern
-	for(i = 0; i < pattern_count; i++) {
-		current_pattern = patterns[i];
-		result = glob(current_pattern, GLOB_TILDE_CHECK | GLOB_ERR, NULL, &current_glob);
-		if (result == GLOB_NOMATCH) {
-			perror(current_pattern);
+	int settled = 0;
+
+	if (item->end == 0) {
+		// already read through the IO queue
+		if (file->found != RESULT_PENDING)
+			return;
+		match = scan_file(file->path, search->matcher, ms, search->or_flag);
+		if (search->keep_seen && match >= 0)
+			memcpy(file->seen, ms->seen, search->matcher->term_count);
+		pthread_mutex_lock(&search->output_lock);
+		file->found = match;
+	} else {
+		// another chunk may already have settled the answer for this file
+		pthread_mutex_lock(&search->output_lock);
+		settled = file->failed || (search->or_flag == 1 ? file->merged > 0
+				: file->merged == search->matcher->term_count);
+		pthread_mutex_unlock(&search->output_lock);
+
+		if (!settled)
+			match = scan_range(file->path, item->start, item->end, file->from, file->to,
+					search->matcher, ms, search->or_flag);
+
+		pthread_mutex_lock(&search->output_lock);
+		search_merge_chunk(search, file, settled ? NULL : ms, match);
+	}
+	search_print_ready(search);
+	pthread_mutex_unlock(&search->output_lock);
+}
+
+/* IO queue callback: run the next block of a file through its slot's matcher
+ * A compressed file is dropped after its first block and left pending,
+ * so a worker decompresses it and the queue isn't held up by it.
+ */
+static int search_queue_data(void* context, int slot, const char* data, size_t size)
+{
+	Search* search = context;
+
+	if (search->slot_read[slot] == 0 && Codec_detect(data, size) != CODEC_NONE) {
+		search->slot_compressed[slot] = 1;
+		return 1;
+	}
+	search->slot_read[slot] += size;
+	return Matcher_scan(search->matcher, &search->slots[slot], data, size, search->or_flag);
+}
+
+/* IO queue callback: a file has been read, hand its result to the output */
+static void search_queue_done(void* context, int slot, size_t index, int error)
+{
+	Search* search = context;
+	SearchFile* file = search->items[search->slot_items[index]].file;
+	MatchState* ms = &search->slots[slot];
+
+	if (error != 0)
+		fprintf(stderr, "%s: %s\n", file->path, strerror(error));
+
+	if (error == 0 && !search->slot_compressed[slot]) {
+		Matcher_finish(search->matcher, ms, search->or_flag);
+		if (search->keep_seen)
+			memcpy(file->seen, ms->seen, search->matcher->term_count);
+	}
+
+	pthread_mutex_lock(&search->output_lock);
+	if (!search->slot_compressed[slot])
+		file->found = error != 0 ? -1 : ms->found;
+	search_print_ready(search);
+	pthread_mutex_unlock(&search->output_lock);
+
+	// ready for the next file this slot gets
+	MatchState_reset(search->matcher, ms);
+	search->slot_read[slot] = 0;
+	search->slot_compressed[slot] = 0;
+}
+
+/* Read every whole-file item through the IO queue
+ * Small files cost more in open/read/close calls than in matching, the
+ * queue keeps depth of them in flight at once instead of one at a time.
+ * Chunks of big files are left to the worker pool. Anything the queue
+ * didn't finish is still pending afterwards and the pool picks it up.
+ *
+ * Input
+ * 		search: planned search
+ * 		depth: most files in flight at once
+ * Output
+ * 		error: 0 on success, -1 on error
+ */
+static int search_queue(Search* search, int depth)
+{
+	size_t i;
+	size_t count = 0;
+	int ready = 0;
+	int rc = -1;
+	char** paths = malloc((search->item_count > 0 ? search->item_count : 1) * sizeof(char*));
+
+	search->slot_items = malloc((search->item_count > 0 ? search->item_count : 1) * sizeof(size_t));
+	search->slots = calloc(depth, sizeof(MatchState));
+	search->slot_read = calloc(depth, sizeof(size_t));
+	search->slot_compressed = calloc(depth, sizeof(char));
+	check_mem(paths);
+	check_mem(search->slot_items);
+	check_mem(search->slots);
+	check_mem(search->slot_read);
+	check_mem(search->slot_compressed);
+
+	for (i = 0; i < search->item_count; i++) {
+		if (search->items[i].end == 0) {
+			paths[count] = search->items[i].file->path;
+			search->slot_items[count++] = i;
+		}
+	}
+
+	for (ready = 0; ready < depth; ready++)
+		check(MatchState_init(search->matcher, &search->slots[ready]) == 0, "Couldn't set up the search");
+
+	rc = IOQueue_read_files(paths, count, depth, search_queue_data, search_queue_done, search);
+	debug("Read %zu files through %s", count, IOQueue_backend());
+
+error:	// fallthrough
+	for (i = 0; i < (size_t)ready; i++)
+		MatchState_free(&search->slots[i]);
+	free(search->slots);
+	free(search->slot_items);
+	free(search->slot_read);
+	free(search->slot_compressed);
+	search->slots = NULL;
+	search->slot_items = NULL;
+	search->slot_read = NULL;
+	search->slot_compressed = NULL;
+	free(paths);
+	return rc;
+}
+
+/* Bring the trigram index up to date with the files about to be searched
+ * Only files whose size, mtime or inode changed are re-read, and the
+ * index is saved again if anything did.
+ *
+ * Input
+ * 		search: files filled in
+ * 		index_addr: index to update, replaced with the new one
+ * 		index_path: where the index is saved
+ * Output
+ * 		error: 0 on success, -1 on error
+ */
+static int search_index_update(Search* search, TrigramIndex** index_addr, const char* index_path)
+{
+	size_t i;
+	int changed = 0;
+	char** paths = malloc((search->file_count > 0 ? search->file_count : 1) * sizeof(char*));
+	check_mem(paths);
+
+	for (i = 0; i < search->file_count; i++)
+		paths[i] = search->files[i].path;
+	changed = TrigramIndex_update(index_addr, paths, search->file_count);
+	check(changed >= 0, "Couldn't update index %s", index_path);
+	if (changed > 0 && TrigramIndex_save(*index_addr, index_path) != 0)
+		log_warn("Couldn't save index %s, it will be rebuilt next time", index_path);
+	debug("Index re-read %d files", changed);
+
+	free(paths);
+	return 0;
+
+error:
+	free(paths);
+	return -1;
+}
+
+/* Rule out the files an up to date trigram index proves can't match
+ * a query, so a ruled out file is settled as not matching exactly as a
+ * full scan would have found it
+ *
+ * Input
+ * 		search: files filled in
+ * 		index: brought up to date with the files
+ * 		query: terms to rule files out by, candidates cleared for them
+ * Output
+ * 		error: 0 on success, -1 if the query's files all stay candidates
+ */
+static int search_index_query(Search* search, TrigramIndex* index, SearchQuery* query)
+{
+	size_t i;
+	int id;
+	size_t ruled_out = 0;
+	char* candidates = malloc(index->file_count > 0 ? index->file_count : 1);
+	check_mem(candidates);
+
+	// a regex can only match where its required literal is
+	check(TrigramIndex_query(index, query->matcher->required, query->matcher->term_count,
+				query->or_flag, candidates) == 0, "Couldn't query the index");
+
+	// files the index doesn't know about are searched as usual
+	for (i = 0; i < search->file_count; i++) {
+		id = TrigramIndex_find(index, search->files[i].path);
+		if (id >= 0 && !candidates[id] && query->candidates[i]) {
+			query->candidates[i] = 0;
+			ruled_out++;
+		}
+	}
+	debug("Index ruled out %zu of %zu", ruled_out, search->file_count);
+
+	free(candidates);
+	return 0;
+
+error:
+	free(candidates);
+	return -1;
+}
+
+/* Rule out files the trigram index proves can't match
+ * The index is brought up to date first, see search_index_update.
+ *
+ * Input
+ * 		search: files filled in
+ * 		query: the search's terms, candidates cleared for ruled out files
+ * 		index_path: index file, created if it doesn't exist
+ * Output
+ * 		error: 0 on success, -1 if every file still has to be searched
+ */
+static int search_index(Search* search, SearchQuery* query, const char* index_path)
+{
+	int rc = -1;
+	TrigramIndex* index = TrigramIndex_load(index_path);
+	check(index != NULL, "Couldn't load index %s", index_path);
+
+	if (search_index_update(search, &index, index_path) == 0)
+		rc = search_index_query(search, index, query);
+
+error:	// fallthrough
+	TrigramIndex_destroy(index);
+	return rc;
+}
+
+// the per-file Bloom filter pass, shared by the workers
+typedef struct BloomSearch {
+	Search* search;
+	SearchQuery** queries;	// whose candidates the filters rule files out of
+	int query_count;
+	const char* cache_dir;
+	uint64_t** seen;		// one TRIGRAM_SPACE bit scratch map per worker, made on first use
+	size_t ruled_out;		// files no query needs any more
+	size_t built;
+	size_t filtered;		// files that had a filter at all
+} BloomSearch;
+
+/* Worker pool task: rule one file out of every query its filter can */
+static void search_bloom_one(void* context, int worker, size_t index)
+{
+	BloomSearch* bloom = context;
+	SearchFile* file = &bloom->search->files[index];
+	BloomFilter* filter = NULL;
+	int built = 0;
+	int needed = 0;
+	int q;
+
+	// already settled by having nothing new
+	if (file->found != RESULT_PENDING)
+		return;
+	for (q = 0; q < bloom->query_count; q++)
+		needed += bloom->queries[q]->candidates[index];
+	if (needed == 0)
+		return;
+	if (bloom->seen[worker] == NULL)
+		bloom->seen[worker] = calloc(TRIGRAM_SPACE / 64, sizeof(uint64_t));
+	if (bloom->seen[worker] == NULL)
+		return;
+
+	filter = BloomFilter_open(bloom->cache_dir, file->path, bloom->seen[worker], &built);
+	if (filter == NULL)
+		return;
+
+	for (q = 0; q < bloom->query_count; q++) {
+		SearchQuery* query = bloom->queries[q];
+		// a regex can only match where its required literal is
+		if (query->candidates[index]
+				&& BloomFilter_rules_out(filter, query->matcher->required, query->matcher->term_count, query->or_flag)) {
+			query->candidates[index] = 0;
+			needed--;
+		}
+	}
+	if (needed == 0)
+		__atomic_fetch_add(&bloom->ruled_out, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&bloom->built, built, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&bloom->filtered, 1, __ATOMIC_RELAXED);
+	BloomFilter_destroy(filter);
+}
+
+/* Rule out files whose Bloom filter proves a term is missing
+ * Only files left alone for a while get a filter, the way rotated logs
+ * are; the first run reads them to build one and later runs only read
+ * the sidecar. A filter never says a term is missing when it's there,
+ * so a ruled out file is settled exactly as a full scan would settle it.
+ * Each file's filter is read once for all the queries.
+ *
+ * Input
+ * 		search: files filled in
+ * 		queries: candidates cleared for the files ruled out of each
+ * 		query_count: length of queries
+ * 		cache_dir: sidecar directory, created if it doesn't exist
+ * 		jobs: files checked at once
+ * Output
+ * 		error: 0 on success, -1 if every file still has to be searched
+ */
+static int search_bloom(Search* search, SearchQuery** queries, int query_count, const char* cache_dir, int jobs)
+{
+	int i;
+	int rc = -1;
+	BloomSearch bloom = { .search = search, .queries = queries, .query_count = query_count, .cache_dir = cache_dir };
+
+	check(mkdir(cache_dir, 0700) == 0 || errno == EEXIST, "Couldn't create %s", cache_dir);
+	errno = 0;
+
+	if ((size_t)jobs > search->file_count)
+		jobs = search->file_count > 0 ? search->file_count : 1;
+	bloom.seen = calloc(jobs, sizeof(uint64_t*));
+	check_mem(bloom.seen);
+
+	rc = WorkPool_run(search->file_count, jobs, search_bloom_one, &bloom);
+	debug("Bloom filters ruled out %zu of %zu files, %zu had a filter, %zu were built",
+			bloom.ruled_out, search->file_count, bloom.filtered, bloom.built);
+
+	for (i = 0; i < jobs; i++)
+		free(bloom.seen[i]);
+
+error:	// fallthrough
+	free(bloom.seen);
+	return rc;
+}
+
+/* Settle every file no query is a candidate for as not matching
+ *
+ * Input
+ * 		search: files filled in, settled ones get found = 0
+ * 		queries: what each query still has to look at
+ * 		query_count: length of queries
+ */
+static void search_settle(Search* search, SearchQuery** queries, int query_count)
+{
+	size_t i;
+	int q;
+
+	for (i = 0; i < search->file_count; i++) {
+		if (search->files[i].found != RESULT_PENDING)
 			continue;
+		for (q = 0; q < query_count && !queries[q]->candidates[i]; q++)
+			;
+		if (q == query_count)
+			search->files[i].found = 0;
+	}
+}
+
+/* --since-last: work out where each file left off
+ * A file picks up at the offset the last run stored for it. It's found
+ * by device and inode as well as by path, so a log rotated to a new
+ * name carries on where it was instead of being searched again, while
+ * a new file under a stored path starts from the beginning. One that
+ * shrank since (truncated) is searched from the start. Files with nothing new
+ * are settled as not matching without being opened. A compressed file
+ * that changed is searched whole, since its offsets can't be resumed.
+ *
+ * Input
+ * 		search: files filled in, regular files become ranged here
+ * 		state: offsets from the last run
+ */
+static void search_since(Search* search, ScanState* state)
+{
+	size_t i;
+	int t;
+	int empty_terms = 0;
+	struct stat sb;
+
+	// what an empty stretch of file settles to, empty terms are in everything
+	for (t = 0; t < search->matcher->term_count; t++)
+		empty_terms += Matcher_always(search->matcher, t);
+
+	for (i = 0; i < search->file_count; i++) {
+		SearchFile* file = &search->files[i];
+		ScanStateEntry* entry = NULL;
+
+		// pipes and friends have no offsets to come back to
+		if (stat(file->path, &sb) != 0 || !S_ISREG(sb.st_mode))
+			continue;
+
+		// entries from before devices were stored have 0 for one
+		entry = ScanState_find(state, file->path);
+		if (entry == NULL || entry->inode != (uint64_t)sb.st_ino
+				|| (entry->dev != 0 && entry->dev != (uint64_t)sb.st_dev))
+			entry = ScanState_find_inode(state, sb.st_dev, sb.st_ino);
+		// a log only grows, a smaller one was truncated or is a new file that reused the inode
+		if (entry != NULL && entry->size > sb.st_size) {
+			debug("%s was truncated, searching it all", file->path);
+			entry = NULL;
+		}
+
+		file->ranged = 1;
+		file->dev = sb.st_dev;
+		file->inode = sb.st_ino;
+		file->to = sb.st_size;
+		file->from = entry != NULL ? entry->offset : 0;
+
+		if (file->from == file->to) {
+			file->found = empty_terms;
+		} else if (Codec_sniff(file->path) != CODEC_NONE) {
+			// offsets into compressed data mean nothing, a changed file is searched again in full
+			file->ranged = 0;
+			file->compressed = 1;
 		}
-		check(result != GLOB_NOSPACE, "glob() ran out of memory!");
-		check(result != GLOB_ABORTED, "glob() experienced a read error!");
-		// work on each file now
-		for (j = 0; j < current_glob.gl_pathc; j++) {
-			current_file = current_glob.gl_pathv[j];
-			fp = fopen(current_file, "r");
-			if (fp == NULL) {
-				perror(current_file);
-				continue;
+	}
+}
+
+/* --since-last: store how far this run got in every file
+ * Files that couldn't be read keep the offset they had, so the same
+ * bytes are tried again next time.
+ *
+ * Input
+ * 		search: finished search
+ * 		old: offsets this run started from
+ * 		path: state file
+ * Output
+ * 		error: 0 on success, -1 on error
+ */
+static int search_save_state(Search* search, ScanState* old, const char* path)
+{
+	size_t i;
+	int rc = -1;
+	ScanState* state = ScanState_create();
+	check_mem(state);
+
+	for (i = 0; i < search->file_count; i++) {
+		SearchFile* file = &search->files[i];
+		ScanStateEntry* entry = ScanState_find(old, file->path);
+
+		if ((file->ranged || file->compressed) && file->found >= 0)
+			rc = ScanState_add(state, file->path, file->dev, file->inode, file->to, file->to);
+		else if (entry != NULL)
+			rc = ScanState_add(state, entry->path, entry->dev, entry->inode, entry->size, entry->offset);
+		else
+			continue;
+		check(rc == 0, "Couldn't record %s", file->path);
+	}
+
+	rc = ScanState_save(state, path);
+
+error:	// fallthrough
+	ScanState_destroy(state);
+	return rc;
+}
+
+/* Turn the file list into work items, splitting big regular files
+ * and files only searched from an offset into SCAN_CHUNK_SIZE ranges,
+ * so several workers can share one file
+ *
+ * Input
+ * 		search: files and file_count filled in, items are set here
+ * Output
+ * 		error: 0 on success, -1 if out of memory
+ */
+static int search_plan(Search* search)
+{
+	size_t i;
+	int t;
+	off_t offset;
+	off_t chunk_count;
+	struct stat sb;
+	size_t capacity = search->file_count > 0 ? search->file_count : 1;
+	int term_count = search->matcher->term_count;
+
+	search->items = malloc(capacity * sizeof(SearchItem));
+	check_mem(search->items);
+
+	for (i = 0; i < search->file_count; i++) {
+		SearchFile* file = &search->files[i];
+
+		// already settled by the index or by having nothing new
+		if (file->found != RESULT_PENDING)
+			continue;
+
+		// compressed files can only be read from the start, they aren't split
+		if (!file->ranged && !file->compressed && stat(file->path, &sb) == 0 && S_ISREG(sb.st_mode)
+				&& sb.st_size > SCAN_CHUNK_SIZE && Codec_sniff(file->path) == CODEC_NONE) {
+			file->ranged = 1;
+			file->from = 0;
+			file->to = sb.st_size;
+		}
+		chunk_count = file->ranged ? (file->to - file->from + SCAN_CHUNK_SIZE - 1) / SCAN_CHUNK_SIZE : 1;
+
+		if (search->item_count + chunk_count > capacity) {
+			while (search->item_count + chunk_count > capacity)
+				capacity *= 2;
+			SearchItem* grown = realloc(search->items, capacity * sizeof(SearchItem));
+			check_mem(grown);
+			search->items = grown;
+		}
+
+		if (!file->ranged) {
+			if (search->keep_seen) {
+				file->seen = calloc(term_count > 0 ? term_count : 1, sizeof(char));
+				check_mem(file->seen);
 			}
-			// begin searching file
-			for (k = 0; k < term_count; k++) {
-				while (fgets(buffer, LINE_LENGTH - 1, fp) != NULL) {
-					line_no++;
-					if (strstr(buffer, terms[k]) != NULL) {
-						match++;
-						break;
-					}
-				}
-				// MUST rewind so every term after the first can read the file
-				rewind(fp);
+			search->items[search->item_count++] = (SearchItem){ .file = file };
+			continue;
+		}
+
+		file->seen = calloc(term_count > 0 ? term_count : 1, sizeof(char));
+		check_mem(file->seen);
+		// empty terms are in every chunk, count them once up front
+		for (t = 0; t < term_count; t++) {
+			if (Matcher_always(search->matcher, t)) {
+				file->seen[t] = 1;
+				file->merged++;
 			}
+		}
+		file->chunks_left = chunk_count;
+		for (offset = file->from; offset < file->to; offset += SCAN_CHUNK_SIZE) {
+			off_t end = offset + SCAN_CHUNK_SIZE < file->to ? offset + SCAN_CHUNK_SIZE : file->to;
+			search->items[search->item_count++] = (SearchItem){ .file = file, .start = offset, .end = end };
+		}
+	}
+
+	return 0;
+
+error:
+	return -1;
+}
+
+/* Search every file that isn't settled yet and print the results
+ * Big files are split into chunks (see search_plan), small ones go
+ * through the IO queue first when depth asks for it, and whatever is
+ * left is shared out to jobs workers.
+ *
+ * Input
+ * 		search: files filled in, settled ones already have their result
+ * 		jobs: files or chunks searched at once
+ * 		depth: files in flight on the IO queue, 0 to read them in the workers
+ * Output
+ * 		error: 0 on success, -1 on error
+ */
+static int search_run(Search* search, int jobs, int depth)
+{
+	int i;
+	int ready = 0;
+	int rc = -1;
+
+	check(search_plan(search) == 0, "Couldn't plan the search");
+
+	// whatever this doesn't get to, the workers below still search
+	if (depth > 0 && search_queue(search, depth) != 0)
+		log_warn("IO queue failed, searching the rest in the workers");
+
+	if ((size_t)jobs > search->item_count)
+		jobs = search->item_count > 0 ? search->item_count : 1;
+	search->states = calloc(jobs, sizeof(MatchState));
+	check_mem(search->states);
+	for (ready = 0; ready < jobs; ready++)
+		check(MatchState_init(search->matcher, &search->states[ready]) == 0, "Couldn't set up the search");
+
+	check(WorkPool_run(search->item_count, jobs, search_one, search) == 0, "Couldn't start the search");
+
+	// files ruled out after the last one searched are still waiting to be printed
+	pthread_mutex_lock(&search->output_lock);
+	search_print_ready(search);
+	pthread_mutex_unlock(&search->output_lock);
+	rc = 0;
+
+error:	// fallthrough
+	for (i = 0; i < ready; i++)
+		MatchState_free(&search->states[i]);
+	free(search->states);
+	search->states = NULL;
+	return rc;
+}
+
+/* Search all files matching glob patterns for search term(s)
+ * Number of terms is variable, but they are all compiled into one matcher.
+ * The globs are expanded up front and the files handed to a pool of
+ * worker threads, each with its own search state. Files too big to
+ * leave to one thread are split into line aligned chunks, and the terms
+ * each chunk found are merged before the AND/OR decision is made.
+ *
+ * Input
+ * 		patterns: strings that match file pattern globs
+ * 		pattern_count: length of patterns array
+ * 		matcher: compiled search terms
+ * 		options: AND/OR, threads, IO queue depth, index, filters and --since-last from the command line
+ * 		arena: where the expanded paths are kept
+ */
+void search_files(char** patterns, int pattern_count, Matcher* matcher, SearchOptions* options, Arena* arena)
+{
+	int i;
+	int count = 0;
+	char** paths = NULL;
+	ScanState* state = NULL;
+	SearchQuery query = { .matcher = matcher, .or_flag = options->or_flag };
+	SearchQuery* queries[] = { &query };
+	Search search = { .matcher = matcher, .or_flag = options->or_flag, .out = stdout,
+		.output_lock = PTHREAD_MUTEX_INITIALIZER };
+
+	count = collect_files(patterns, pattern_count, options, NULL, NULL, arena, &paths);
+	check(count >= 0, "Couldn't expand glob patterns");
+
+	search.files = calloc(count > 0 ? count : 1, sizeof(SearchFile));
+	query.candidates = malloc(count > 0 ? count : 1);
+	check_mem(search.files);
+	check_mem(query.candidates);
+	search.file_count = count;
+	for (i = 0; i < count; i++) {
+		search.files[i].path = paths[i];
+		search.files[i].found = RESULT_PENDING;
+		query.candidates[i] = 1;
+	}
+	if (options->since_last) {
+		state = ScanState_load(options->state_path);
+		check(state != NULL, "Couldn't load %s", options->state_path);
+		search_since(&search, state);
+	}
+	if (options->use_index && search_index(&search, &query, options->index_path) != 0)
+		log_warn("Index unavailable, searching every file");
+	if (options->use_bloom && search_bloom(&search, queries, 1, options->bloom_dir, options->jobs) != 0)
+		log_warn("Bloom filters unavailable, searching every file");
+	search_settle(&search, queries, 1);
+
+	check(search_run(&search, options->jobs, options->depth) == 0, "Search failed");
+
+	if (options->since_last && search_save_state(&search, state, options->state_path) != 0)
+		log_warn("Couldn't save %s, the next run will search these bytes again", options->state_path);
+
+error:	// fallthrough
+	ScanState_destroy(state);
+	pthread_mutex_destroy(&search.output_lock);
+	for (i = 0; i < count; i++) {
+		if (search.files)
+			free(search.files[i].seen);
+	}
+	free(query.candidates);
+	free(search.files);
+	free(search.items);
+	return;
+}
+
+/* Follow the files from the glob patterns until SIGINT or SIGTERM
+ * Files that match now are followed from their current end, like
+ * tail -f; files that start matching later are searched from the start.
+ *
+ * Input
+ * 		patterns: strings that match file pattern globs
+ * 		pattern_count: length of patterns array
+ * 		matcher: compiled search terms
+ * 		options: AND/OR and -j from the command line
+ * Output
+ * 		error: 0 when stopped by a signal, -1 on error
+ */
+int follow_files(char** patterns, int pattern_count, Matcher* matcher, SearchOptions* options)
+{
+	int rc = -1;
+	Follower* follower = Follower_create(patterns, pattern_count, walk_threads(options), matcher, options->or_flag);
+	check(follower != NULL, "Couldn't start following");
+
+	// each directory is watched as the walk opens it, before it's listed,
+	// so nothing created in between is missed
+	check(Follower_walk(follower, 1) == 0, "Couldn't expand glob patterns");
+
+	rc = Follower_run(follower);
+
+error:	// fallthrough
+	Follower_destroy(follower);
+	return rc;
+}
+
+// what --daemon keeps between queries
+typedef struct Resident {
+	char** patterns;
+	int pattern_count;
+	SearchOptions* options;		// the daemon's own: -j, -q and where the index and sidecars are
+	Daemon* daemon;
+	Arena* arena;				// the file list below, replaced by every walk
+	char** files;
+	int file_count;
+	TrigramIndex* index;		// loaded by the first -i query, NULL until then
+	int index_stale;			// files changed since the index was brought up to date
+} Resident;
+
+// one client's query in a batch
+typedef struct BatchQuery {
+	DaemonQuery* client;
+	SearchOptions options;
+	char** terms;
+	int term_count;
+	SearchQuery query;			// matcher NULL if the query couldn't be compiled
+	int literal_base;			// where its terms start among the batch's literals
+	int regex_base;				// and among its regexes
+} BatchQuery;
+
+/* Walker visit: watch every directory the walk lists */
+static void resident_visit(void* context, const char* dir)
+{
+	Daemon_watch(context, dir[0] != '\0' ? dir : ".");
+}
+
+/* Expand the patterns again, watching every directory they lead to
+ * The old list stays if the walk fails.
+ *
+ * Output
+ * 		error: 0 on success, -1 on error
+ */
+static int resident_walk(Resident* resident)
+{
+	int i;
+	int count = 0;
+	char** files = NULL;
+	const char* last = NULL;
+	Arena* arena = Arena_create(0);
+	check_mem(arena);
+
+	count = collect_files(resident->patterns, resident->pattern_count, resident->options,
+			resident_visit, resident->daemon, arena, &files);
+	check(count >= 0, "Couldn't expand glob patterns");
+
+	// plain paths in the patterns are found without listing their directory
+	for (i = 0; i < count; i++) {
+		const char* slash = strrchr(files[i], '/');
+		char* dir = slash == NULL ? "." : slash == files[i] ? "/" : Arena_strndup(arena, files[i], slash - files[i]);
+		check_mem(dir);
+		if (last == NULL || strcmp(last, dir) != 0)
+			Daemon_watch(resident->daemon, dir);
+		last = dir;
+	}
+
+	Arena_destroy(resident->arena);
+	resident->arena = arena;
+	resident->files = files;
+	resident->file_count = count;
+	resident->index_stale = 1;
+	debug("Walk found %d files", count);
+	return 0;
+
+error:
+	Arena_destroy(arena);
+	return -1;
+}
+
+/* Parse one client's command line and compile its terms
+ *
+ * Output
+ * 		error: 0 if the query can be answered, -1 if the client has been told why not
+ */
+static int batch_parse(BatchQuery* batch, DaemonQuery* client, Arena* arena, size_t file_count)
+{
+	batch->client = client;
+	// every command line is parsed from the start
+	optind = 0;
+	batch->term_count = build_cli(client->argc, client->argv, &batch->options, arena, &batch->terms);
+	if (batch->term_count < 0 || batch->term_count + batch->options.regex_count == 0
+			|| batch->options.follow || batch->options.since_last || batch->options.daemon) {
+		fprintf(client->out, "The daemon only answers plain searches: [-o] [-i] [-b] [-e regex]... <term1> <term2> ...\n");
+		client->status = 1;
+		return -1;
+	}
+
+	batch->query.matcher = Matcher_create(batch->terms, batch->term_count,
+			batch->options.regexes, batch->options.regex_count);
+	if (batch->query.matcher == NULL) {
+		fprintf(client->out, "Couldn't compile search terms!\n");
+		client->status = 1;
+		return -1;
+	}
+	batch->query.or_flag = batch->options.or_flag;
+	batch->query.candidates = malloc(file_count > 0 ? file_count : 1);
+	check_mem(batch->query.candidates);
+	memset(batch->query.candidates, 1, file_count);
+	return 0;
+
+error:
+	client->status = 1;
+	return -1;
+}
+
+/* Print one query's results from the terms each file turned up */
+static void batch_print(BatchQuery* batch, Search* search)
+{
+	size_t i;
+	int t;
+	int term_count = batch->query.matcher->term_count;
 
-			if (or_flag == 1 && match > 0)
-				printf("%s matches by OR!\n", current_file);
-			else if (or_flag == 0 && match >= term_count)
-				printf("%s matches by AND!\n", current_file);
+	for (i = 0; i < search->file_count; i++) {
+		SearchFile* file = &search->files[i];
+		int match = 0;
+
+		if (file->found < 0)
+			continue;
+		for (t = 0; batch->query.candidates[i] && file->seen != NULL && t < term_count; t++) {
+			// the batch matcher numbers literals first, then regexes
+			if (t < batch->term_count)
+				match += file->seen[batch->literal_base + t];
 			else
-				printf("%s does not match!\n", current_file);
+				match += file->seen[search->matcher->literal_count + batch->regex_base + t - batch->term_count];
+		}
+		print_result(batch->client->out, file->path, match, term_count, batch->query.or_flag);
+	}
+}
+
+/* Answer a batch of queries with one pass over the files
+ * Every query's terms go into one matcher, so a file several queries
+ * need is read once for all of them. Files are ruled out per query with
+ * the resident index (-i) and the sidecars (-b), and a file is only read
+ * if some query still needs it. What each query gets back is worked out
+ * from the terms the file turned up.
+ *
+ * Input
+ * 		resident: file list and index
+ * 		clients: the queries, answers are printed to their out
+ * 		count: length of clients
+ * Output
+ * 		error: 0 on success, -1 if the batch couldn't be answered
+ */
+static int resident_answer(Resident* resident, DaemonQuery* clients, int count)
+{
+	int i, t;
+	int rc = -1;
+	int live = 0;
+	int pruned = 0;
+	int literal_count = 0;
+	int regex_count = 0;
+	int use_index = 0;
+	char** literals = NULL;
+	char** regexes = NULL;
+	Matcher* matcher = NULL;
+	BatchQuery* batch = calloc(count, sizeof(BatchQuery));
+	SearchQuery** queries = calloc(count, sizeof(SearchQuery*));
+	SearchQuery** bloom_queries = calloc(count, sizeof(SearchQuery*));
+	Arena* arena = Arena_create(0);
+	Search search = { .keep_seen = 1, .output_lock = PTHREAD_MUTEX_INITIALIZER };
+	check_mem(batch);
+	check_mem(queries);
+	check_mem(bloom_queries);
+	check_mem(arena);
+
+	for (i = 0; i < count; i++) {
+		BatchQuery* b = &batch[i];
+		if (batch_parse(b, &clients[i], arena, resident->file_count) != 0)
+			continue;
+		b->literal_base = literal_count;
+		b->regex_base = regex_count;
+		literal_count += b->term_count;
+		regex_count += b->options.regex_count;
+		use_index |= b->options.use_index;
+		if (b->options.use_bloom)
+			bloom_queries[pruned++] = &b->query;
+		queries[live++] = &b->query;
+	}
+	if (live == 0) {
+		rc = 0;
+		goto error;
+	}
+
+	search.files = calloc(resident->file_count > 0 ? resident->file_count : 1, sizeof(SearchFile));
+	check_mem(search.files);
+	search.file_count = resident->file_count;
+	for (i = 0; i < resident->file_count; i++) {
+		search.files[i].path = resident->files[i];
+		search.files[i].found = RESULT_PENDING;
+	}
 
-			// reset for the next file
-			k = 0;
-			match = 0;
-			fclose(fp);
+	if (use_index && resident->index == NULL) {
+		resident->index = TrigramIndex_load(resident->options->index_path);
+		resident->index_stale = 1;
+	}
+	if (use_index && resident->index != NULL && resident->index_stale
+			&& search_index_update(&search, &resident->index, resident->options->index_path) == 0)
+		resident->index_stale = 0;
+	for (i = 0; i < count; i++) {
+		if (batch[i].query.matcher == NULL || !batch[i].options.use_index)
+			continue;
+		if (resident->index == NULL || resident->index_stale
+				|| search_index_query(&search, resident->index, &batch[i].query) != 0)
+			log_warn("Index unavailable, searching every file");
+	}
+	if (pruned > 0 && search_bloom(&search, bloom_queries, pruned, resident->options->bloom_dir, resident->options->jobs) != 0)
+		log_warn("Bloom filters unavailable, searching every file");
+	search_settle(&search, queries, live);
+
+	if (live == 1) {
+		// nothing to share, the query's own matcher can stop as early as it likes
+		search.matcher = queries[0]->matcher;
+		search.or_flag = queries[0]->or_flag;
+	} else {
+		// the whole batch in one matcher, each file read until it has every term or ends
+		literals = Arena_alloc(arena, (literal_count > 0 ? literal_count : 1) * sizeof(char*));
+		regexes = Arena_alloc(arena, (regex_count > 0 ? regex_count : 1) * sizeof(char*));
+		check_mem(literals);
+		check_mem(regexes);
+		for (i = 0; i < count; i++) {
+			for (t = 0; batch[i].query.matcher != NULL && t < batch[i].term_count; t++)
+				literals[batch[i].literal_base + t] = batch[i].terms[t];
+			for (t = 0; batch[i].query.matcher != NULL && t < batch[i].options.regex_count; t++)
+				regexes[batch[i].regex_base + t] = batch[i].options.regexes[t];
 		}
-		globfree(&current_glob);
+		matcher = Matcher_create(literals, literal_count, regexes, regex_count);
+		check(matcher != NULL, "Couldn't compile the batch's terms");
+		search.matcher = matcher;
+	}
+	debug("Answering %d queries with %d terms over %zu files", live, literal_count + regex_count, search.file_count);
+
+	check(search_run(&search, resident->options->jobs, resident->options->depth) == 0, "Search failed");
+	for (i = 0; i < count; i++) {
+		if (batch[i].query.matcher != NULL)
+			batch_print(&batch[i], &search);
 	}
+	rc = 0;
 
 error:	// fallthrough
-	free(buffer);
-	return;
+	for (i = 0; batch != NULL && i < count; i++) {
+		Matcher_destroy(batch[i].query.matcher);
+		free(batch[i].query.candidates);
+	}
+	for (i = 0; search.files != NULL && (size_t)i < search.file_count; i++)
+		free(search.files[i].seen);
+	pthread_mutex_destroy(&search.output_lock);
+	Matcher_destroy(matcher);
+	free(search.files);
+	free(search.items);
+	free(bloom_queries);
+	free(queries);
+	free(batch);
+	Arena_destroy(arena);
+	return rc;
+}
+
+/* Daemon batch: catch up on what the watches saw, then answer */
+static int resident_batch(void* context, DaemonQuery* clients, int count, int changes)
+{
+	Resident* resident = context;
+
+	if ((changes & DAEMON_LIST_CHANGED) && resident_walk(resident) != 0)
+		log_warn("Keeping the file list from the last walk");
+	// the index catches up the next time a query wants it
+	if (changes)
+		resident->index_stale = 1;
+
+	return count > 0 ? resident_answer(resident, clients, count) : 0;
+}
+
+/* --daemon: keep the files the patterns expand to, and the index, warm
+ * and answer searches sent over a Unix domain socket until SIGINT or
+ * SIGTERM. Every directory the walk lists is watched with inotify; files
+ * coming and going mean another walk, writes mean the index is brought
+ * up to date before it's next used. Relative patterns are relative to
+ * where the daemon was started.
+ *
+ * Input
+ * 		patterns: strings that match file pattern globs
+ * 		pattern_count: length of patterns array
+ * 		options: -j, -q, and where the socket, index and sidecars are
+ * Output
+ * 		error: 0 when stopped by a signal, -1 on error
+ */
+int serve_files(char** patterns, int pattern_count, SearchOptions* options)
+{
+	int rc = -1;
+	Resident resident = { .patterns = patterns, .pattern_count = pattern_count, .options = options };
+
+	// watches go up as the walk lists directories, so nothing created in between is missed
+	resident.daemon = Daemon_create(options->socket_path);
+	check(resident.daemon != NULL, "Couldn't start the daemon");
+	check(resident_walk(&resident) == 0, "Couldn't expand glob patterns");
+
+	rc = Daemon_run(resident.daemon, resident_batch, &resident);
+
+error:	// fallthrough
+	Daemon_destroy(resident.daemon);
+	TrigramIndex_destroy(resident.index);
+	Arena_destroy(resident.arena);
+	return rc;
 }
 
 int main(int argc, char *argv[])
 {
-	int i = 0;
 	int term_count = 0;
 	int pattern_count = 0;
-	int or_flag = 0;
-	const char* config_path = "/home/thomas/.logfind";
-	char** patterns = malloc(GLOB_MAX*sizeof(char*));
-	char** terms = malloc(SEARCH_TERMS_MAX*sizeof(char**));
+	SearchOptions options = { .jobs = 1 };
+	Matcher* matcher = NULL;
+	const char* config_path = getenv("LOGFIND_CONFIG") ? getenv("LOGFIND_CONFIG") : "/home/thomas/.logfind";
+	char index_path[PATH_MAX];
+	char state_path[PATH_MAX];
+	char bloom_dir[PATH_MAX];
+	char socket_path[PATH_MAX];
+	int status = 0;
+	char** patterns = NULL;
+	char** terms = NULL;
+	// patterns, terms and paths all live until the end of the run, and go together
+	Arena* arena = Arena_create(0);
+	check_mem(arena);
+
+	term_count = build_cli(argc, argv, &options, arena, &terms);
+	check(term_count >= 0 && (options.daemon || term_count + options.regex_count > 0),
+			"Usage: %s [-o] [-i] [-b] [-f] [-j jobs] [-q depth] [--since-last] [--daemon] [-e regex]... <term1> <term2> ...", argv[0]);
 
-	term_count = build_cli(argc, argv, &or_flag, &terms);
-	check(term_count > 0, "Usage: %s <term1> <term2> ...", argv[0]);
+	// the index, state and socket sit next to the config unless told otherwise
+	snprintf(index_path, sizeof(index_path), "%s.idx", config_path);
+	options.index_path = getenv("LOGFIND_INDEX") ? getenv("LOGFIND_INDEX") : index_path;
+	snprintf(bloom_dir, sizeof(bloom_dir), "%s.bloom", config_path);
+	options.bloom_dir = getenv("LOGFIND_BLOOM") ? getenv("LOGFIND_BLOOM") : bloom_dir;
+	snprintf(state_path, sizeof(state_path), "%s.state", config_path);
+	options.state_path = getenv("LOGFIND_STATE") ? getenv("LOGFIND_STATE") : state_path;
+	snprintf(socket_path, sizeof(socket_path), "%s.sock", config_path);
+	options.socket_path = getenv("LOGFIND_SOCKET") ? getenv("LOGFIND_SOCKET") : socket_path;
 
-	pattern_count = load_config(config_path, patterns);
+	// a running daemon already has the files and indexes, plain searches go to it
+	if (!options.daemon && !options.follow && !options.since_last) {
+		status = Daemon_query(options.socket_path, argc, argv);
+		if (status >= 0) {
+			Arena_destroy(arena);
+			return status;
+		}
+	}
+
+	pattern_count = load_config(config_path, arena, &patterns);
 	check(pattern_count > 0, "No glob patterns loaded!");
 
 	// summary
-	debug("%s flag set", (or_flag == 1) ? "OR" : "AND");		// ternary, bitches
+	debug("%s flag set", (options.or_flag == 1) ? "OR" : "AND");		// ternary, bitches
 	debug("Found %d patterns in %s", pattern_count, config_path);
-	debug("Found %d terms", term_count);
+	debug("Found %d terms and %d regexes", term_count, options.regex_count);
+	debug("Searching with %d thread(s)", options.jobs);
+
+	if (options.daemon) {
+		status = serve_files(patterns, pattern_count, &options) == 0 ? 0 : 1;
+		Arena_destroy(arena);
+		return status;
+	}
+
+	// compile every term into one matcher so each file is read once
+	matcher = Matcher_create(terms, term_count, options.regexes, options.regex_count);
+	check(matcher != NULL, "Couldn't compile search terms!");
 
 	// perform search
-	search_files(patterns, pattern_count, terms, term_count, or_flag);
+	if (options.follow)
+		follow_files(patterns, pattern_count, matcher, &options);
+	else
+		search_files(patterns, pattern_count, matcher, &options, arena);
 
 	// clean up
-	for (i = 0; i < pattern_count; i++)
-		if (patterns[i]) free(patterns[i]);
-	for (i = 0; i < term_count; i++)
-		if (terms[i]) free(terms[i]);
+	Matcher_destroy(matcher);
+	Arena_destroy(arena);
 
 	return 0;
 
 error:
-	for (i = 0; i < pattern_count; i++)
-		if (patterns[i]) free(patterns[i]);
-	for (i = 0; i < term_count; i++)
-		if (terms[i]) free(terms[i]);
+	Arena_destroy(arena);
 
 	return 1;
 }
@@ -0,0 +1,430 @@
+#include <stdlib.h>
+#include <string.h>
+#include "matcher.h"
+#include "dbg.h"
+
+/* Compile search terms into an Aho-Corasick automaton
+ * Terms go into a trie, then a breadth first pass fills in failure
+ * transitions so every state knows where to go on every byte. Regexes
+ * are compiled on their own and run after the literals.
+ *
+ * Input
+ * 		terms: array of literal search terms, must outlive the matcher
+ * 		literal_count: length of terms array
+ * 		regexes: extended regular expressions from -e
+ * 		regex_count: length of regexes array
+ * Output
+ * 		matcher: compiled automaton, NULL on error
+ */
+Matcher* Matcher_create(char** terms, int literal_count, char** regexes, int regex_count)
+{
+	int i, c;
+	int max_states = 1;
+	int term_count = literal_count + regex_count;
+	int* fail = NULL;
+	int* queue = NULL;
+	const char* problem = NULL;
+	Matcher* matcher = calloc(1, sizeof(Matcher));
+	check_mem(matcher);
+
+	for (i = 0; i < literal_count; i++) {
+		size_t len = strlen(terms[i]);
+		max_states += len;
+		if (len > matcher->max_len)
+			matcher->max_len = len;
+	}
+
+	matcher->terms = terms;
+	matcher->literal_count = literal_count;
+	matcher->term_count = term_count;
+	matcher->regexes = calloc(regex_count > 0 ? regex_count : 1, sizeof(Regexp*));
+	matcher->required = malloc((term_count > 0 ? term_count : 1) * sizeof(char*));
+	check_mem(matcher->regexes);
+	check_mem(matcher->required);
+
+	for (i = 0; i < regex_count; i++) {
+		matcher->regexes[i] = Regexp_compile(regexes[i], &problem);
+		check(matcher->regexes[i] != NULL, "Bad pattern %s: %s", regexes[i], problem);
+		matcher->regex_count++;
+		matcher->required[literal_count + i] = matcher->regexes[i]->literal;
+	}
+
+	matcher->next = malloc(max_states * 256 * sizeof(int));
+	matcher->out = malloc(max_states * sizeof(int));
+	matcher->out_link = malloc(max_states * sizeof(int));
+	matcher->hit = calloc(max_states, sizeof(char));
+	matcher->term_next = malloc((term_count > 0 ? term_count : 1) * sizeof(int));
+	fail = calloc(max_states, sizeof(int));
+	queue = malloc(max_states * sizeof(int));
+	check_mem(matcher->next);
+	check_mem(matcher->out);
+	check_mem(matcher->out_link);
+	check_mem(matcher->hit);
+	check_mem(matcher->term_next);
+	check_mem(fail);
+	check_mem(queue);
+
+	// -1 marks a missing trie edge until the failure pass fills it in
+	memset(matcher->next, -1, max_states * 256 * sizeof(int));
+	memset(matcher->out, -1, max_states * sizeof(int));
+	memset(matcher->out_link, -1, max_states * sizeof(int));
+	matcher->state_count = 1;
+
+	// build the trie, empty terms match anywhere and are handled by MatchState_reset
+	for (i = 0; i < literal_count; i++) {
+		const unsigned char* p = (const unsigned char*)terms[i];
+		int state = 0;
+
+		matcher->required[i] = terms[i];
+		matcher->term_next[i] = -1;
+		if (*p == '\0')
+			continue;
+
+		for (; *p; p++) {
+			int* edge = &matcher->next[state * 256 + *p];
+			if (*edge == -1)
+				*edge = matcher->state_count++;
+			state = *edge;
+		}
+		// duplicate terms share a state, chain them so each one gets counted
+		matcher->term_next[i] = matcher->out[state];
+		matcher->out[state] = i;
+		matcher->hit[state] = 1;
+	}
+
+	// breadth first over the trie, resolving every missing edge through the failure link
+	int head = 0;
+	int tail = 0;
+	for (c = 0; c < 256; c++) {
+		int* edge = &matcher->next[c];
+		if (*edge == -1) {
+			*edge = 0;
+		} else {
+			fail[*edge] = 0;
+			queue[tail++] = *edge;
+		}
+	}
+
+	while (head < tail) {
+		int state = queue[head++];
+		for (c = 0; c < 256; c++) {
+			int* edge = &matcher->next[state * 256 + c];
+			int fallback = matcher->next[fail[state] * 256 + c];
+			if (*edge == -1) {
+				*edge = fallback;
+			} else {
+				int child = *edge;
+				fail[child] = fallback;
+				matcher->out_link[child] = matcher->out[fallback] != -1 ? fallback : matcher->out_link[fallback];
+				matcher->hit[child] |= matcher->hit[fallback];
+				queue[tail++] = child;
+			}
+		}
+	}
+
+	// distinct first bytes, lets the scan jump straight to the next possible start
+	for (i = 0; i < literal_count; i++) {
+		unsigned char first = terms[i][0];
+		if (first == '\0' || memchr(matcher->start_set, first, matcher->start_count) != NULL)
+			continue;
+		if (matcher->start_count == FS_SET_MAX) {
+			matcher->start_count = 0;
+			break;
+		}
+		matcher->start_set[matcher->start_count++] = first;
+	}
+
+	// a single term doesn't need the automaton at all
+	if (literal_count == 1 && terms[0][0] != '\0') {
+		matcher->single = terms[0];
+		matcher->single_len = strlen(terms[0]);
+	}
+
+	// give back the rows we reserved for states we never needed
+	int* shrunk = realloc(matcher->next, matcher->state_count * 256 * sizeof(int));
+	if (shrunk != NULL)
+		matcher->next = shrunk;
+
+	free(queue);
+	free(fail);
+	return matcher;
+
+error:
+	free(queue);
+	free(fail);
+	Matcher_destroy(matcher);
+	return NULL;
+}
+
+void Matcher_destroy(Matcher* matcher)
+{
+	if (matcher) {
+		free(matcher->next);
+		free(matcher->out);
+		free(matcher->out_link);
+		free(matcher->term_next);
+		free(matcher->hit);
+		for (int i = 0; i < matcher->regex_count; i++)
+			Regexp_destroy(matcher->regexes[i]);
+		free(matcher->regexes);
+		free(matcher->required);
+		free(matcher);
+	}
+}
+
+int MatchState_init(Matcher* matcher, MatchState* ms)
+{
+	int i;
+
+	ms->carry = NULL;
+	ms->regex_states = NULL;
+	ms->caches = NULL;
+	ms->cache_count = 0;
+	ms->seen = malloc(matcher->term_count > 0 ? matcher->term_count : 1);
+	check_mem(ms->seen);
+	if (matcher->single) {
+		// the last len - 1 bytes of one buffer plus the first len - 1 of the next
+		ms->carry = malloc(matcher->single_len * 2);
+		check_mem(ms->carry);
+	}
+	if (matcher->regex_count > 0) {
+		ms->regex_states = malloc(matcher->regex_count * sizeof(int));
+		ms->caches = calloc(matcher->regex_count, sizeof(RegexpCache*));
+		check_mem(ms->regex_states);
+		check_mem(ms->caches);
+		for (i = 0; i < matcher->regex_count; i++) {
+			ms->caches[i] = RegexpCache_create(matcher->regexes[i]);
+			check_mem(ms->caches[i]);
+			ms->cache_count++;
+		}
+	}
+	MatchState_reset(matcher, ms);
+	return 0;
+
+error:
+	MatchState_free(ms);
+	return -1;
+}
+
+/* Start a new search, e.g. for the next file */
+void MatchState_reset(Matcher* matcher, MatchState* ms)
+{
+	int i;
+
+	ms->state = 0;
+	ms->found = 0;
+	ms->literal_found = 0;
+	ms->carry_len = 0;
+	for (i = 0; i < matcher->term_count; i++) {
+		// empty terms never made it into the trie, they're in every file
+		ms->seen[i] = Matcher_always(matcher, i);
+		ms->found += ms->seen[i];
+		if (i < matcher->literal_count)
+			ms->literal_found += ms->seen[i];
+	}
+	for (i = 0; i < matcher->regex_count; i++)
+		ms->regex_states[i] = REGEXP_LINE_START;
+}
+
+void MatchState_free(MatchState* ms)
+{
+	int i;
+
+	for (i = 0; i < ms->cache_count; i++)
+		RegexpCache_destroy(ms->caches[i]);
+	free(ms->caches);
+	free(ms->regex_states);
+	free(ms->seen);
+	free(ms->carry);
+	ms->caches = NULL;
+	ms->cache_count = 0;
+	ms->regex_states = NULL;
+	ms->seen = NULL;
+	ms->carry = NULL;
+}
+
+static void Matcher_mark(MatchState* ms, int term, int literal)
+{
+	if (!ms->seen[term]) {
+		ms->seen[term] = 1;
+		ms->found++;
+		ms->literal_found += literal;
+	}
+}
+
+/* Mark every term that ends at state or at one of its suffixes */
+static void Matcher_report(Matcher* matcher, MatchState* ms, int state)
+{
+	int term;
+
+	if (matcher->out[state] == -1)
+		state = matcher->out_link[state];
+
+	while (state != -1) {
+		for (term = matcher->out[state]; term != -1; term = matcher->term_next[term])
+			Matcher_mark(ms, term, 1);
+		state = matcher->out_link[state];
+	}
+}
+
+/* Search for the only term with the SIMD kernel
+ * The last len - 1 bytes of each buffer are carried over so a match
+ * split across two buffers is still found.
+ */
+static void Matcher_scan_single(Matcher* matcher, MatchState* ms, const char* data, size_t size)
+{
+	size_t keep = matcher->single_len - 1;
+
+	if (ms->carry_len > 0) {
+		// check the seam between the previous buffer and this one
+		size_t take = size < keep ? size : keep;
+		memcpy(ms->carry + ms->carry_len, data, take);
+		if (fs_memmem(ms->carry, ms->carry_len + take, matcher->single, matcher->single_len)) {
+			Matcher_mark(ms, 0, 1);
+			return;
+		}
+	}
+
+	if (fs_memmem(data, size, matcher->single, matcher->single_len)) {
+		Matcher_mark(ms, 0, 1);
+		return;
+	}
+
+	// remember the tail for the next seam
+	if (size >= keep) {
+		memcpy(ms->carry, data + size - keep, keep);
+		ms->carry_len = keep;
+	} else {
+		size_t total = ms->carry_len + size;
+		size_t drop = total > keep ? total - keep : 0;
+		memmove(ms->carry, ms->carry + drop, ms->carry_len - drop);
+		memcpy(ms->carry + ms->carry_len - drop, data, size);
+		ms->carry_len = total - drop;
+	}
+}
+
+/* Feed a block of bytes through the automaton
+ * State is kept in ms, so a file can be fed in pieces and terms that
+ * straddle two pieces are still found. While the automaton sits in its
+ * root state it jumps ahead with the SIMD kernel to the next byte that
+ * could start a term. Each regex not seen yet then gets the block too.
+ *
+ * Input
+ * 		matcher: compiled terms
+ * 		ms: search progress, updated in place
+ * 		data: bytes to search, need not be NUL terminated
+ * 		size: length of data
+ * 		or_flag: 1 stops at the first term found, 0 once all are found
+ * Output
+ * 		done: 1 if the result is settled and the rest can be skipped
+ */
+int Matcher_scan(Matcher* matcher, MatchState* ms, const char* data, size_t size, int or_flag)
+{
+	const unsigned char* p = (const unsigned char*)data;
+	const unsigned char* end = p + size;
+	const int* next = matcher->next;
+	const char* hit = matcher->hit;
+	int state = ms->state;
+
+	int i;
+
+	if (Matcher_done(matcher, ms, or_flag))
+		return 1;
+
+	// once every literal is in, the automaton has nothing left to find
+	if (ms->literal_found == matcher->literal_count)
+		p = end;
+	else if (matcher->single) {
+		Matcher_scan_single(matcher, ms, data, size);
+		p = end;
+	}
+
+	while (p < end) {
+		if (state == 0 && matcher->start_count > 0) {
+			// nothing can match until one of the start bytes shows up
+			p = (const unsigned char*)fs_find_any((const char*)p, end - p,
+					matcher->start_set, matcher->start_count);
+			if (p == NULL)
+				break;
+		}
+		state = next[state * 256 + *p++];
+		if (hit[state]) {
+			Matcher_report(matcher, ms, state);
+			if (Matcher_done(matcher, ms, or_flag) || ms->literal_found == matcher->literal_count)
+				break;
+		}
+	}
+	ms->state = state;
+
+	for (i = 0; i < matcher->regex_count && !Matcher_done(matcher, ms, or_flag); i++) {
+		int term = matcher->literal_count + i;
+		if (!ms->seen[term] && Regexp_scan(matcher->regexes[i], ms->caches[i], &ms->regex_states[i], data, size))
+			Matcher_mark(ms, term, 0);
+	}
+
+	return Matcher_done(matcher, ms, or_flag);
+}
+
+/* Feed bytes that come before the part to search without reporting them
+ * Afterwards a match that starts in data and ends in the next scanned
+ * block is found, but nothing that lies entirely in data is. Used to
+ * resume a search partway through a file; data only needs to be the
+ * max_len - 1 bytes before where the scan picks up. Regexes take a line
+ * with no newline in data as having started before it, so ^ won't match.
+ *
+ * Input
+ * 		matcher: compiled terms
+ * 		ms: search progress, freshly reset
+ * 		data: bytes just before the next scan
+ * 		size: length of data
+ */
+void Matcher_prime(Matcher* matcher, MatchState* ms, const char* data, size_t size)
+{
+	const unsigned char* p = (const unsigned char*)data;
+	const unsigned char* end = p + size;
+	int state = ms->state;
+	int i;
+
+	// regexes pick up from the start of the line data ends in
+	for (i = 0; i < matcher->regex_count; i++)
+		Regexp_prime(matcher->regexes[i], ms->caches[i], &ms->regex_states[i], data, size);
+
+	if (matcher->single) {
+		// the seam check only needs the last len - 1 bytes
+		size_t keep = matcher->single_len - 1;
+		if (size > keep) {
+			data += size - keep;
+			size = keep;
+		}
+		memcpy(ms->carry, data, size);
+		ms->carry_len = size;
+		return;
+	}
+
+	while (p < end)
+		state = matcher->next[state * 256 + *p++];
+	ms->state = state;
+}
+
+/* The input has ended, settle regexes waiting on the end of the last line
+ * Only needed when the data didn't end in a newline, for patterns like
+ * "error$" that need to see where the line stops.
+ *
+ * Input
+ * 		matcher: compiled terms
+ * 		ms: search progress after the last block was scanned
+ * 		or_flag: 1 stops at the first term found, 0 once all are found
+ * Output
+ * 		done: 1 if the search is settled
+ */
+int Matcher_finish(Matcher* matcher, MatchState* ms, int or_flag)
+{
+	int i;
+
+	for (i = 0; i < matcher->regex_count && !Matcher_done(matcher, ms, or_flag); i++) {
+		int term = matcher->literal_count + i;
+		if (!ms->seen[term] && Regexp_finish(matcher->regexes[i], ms->caches[i], &ms->regex_states[i]))
+			Matcher_mark(ms, term, 0);
+	}
+	return Matcher_done(matcher, ms, or_flag);
+}
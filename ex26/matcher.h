@@ -0,0 +1,62 @@
+#ifndef logfind_matcher_h
+#define logfind_matcher_h
+
+#include <stddef.h>
+#include "fastsearch.h"
+#include "regexp.h"
+
+// Aho-Corasick automaton over all literal search terms, plus -e regexes
+// every state has a full 256 entry transition row, so scanning is one
+// table lookup per byte no matter how many terms there are
+// terms are numbered literals first, then regexes
+typedef struct Matcher {
+	char** terms;		// literal terms, not owned, must outlive the matcher
+	int literal_count;
+	int term_count;		// literals plus regexes
+	Regexp** regexes;	// term literal_count + i is regexes[i]
+	int regex_count;
+	char** required;	// text every match of each term contains, "" if none
+	size_t max_len;		// longest term, a match never spans more bytes than this
+	int state_count;
+	int* next;			// state_count rows of 256 transitions
+	int* out;			// first term ending at a state, -1 for none
+	int* out_link;		// nearest proper suffix state that ends a term, -1 for none
+	int* term_next;		// next term with the same text, -1 for none
+	char* hit;			// 1 if a term ends at the state or any of its suffixes
+	unsigned char start_set[FS_SET_MAX];	// distinct first bytes of the terms
+	int start_count;	// 0 if there are too many to skip ahead on
+	const char* single;	// set when there is just one term, searched with fs_memmem
+	size_t single_len;
+} Matcher;
+
+// progress of one search, carried from buffer to buffer
+typedef struct MatchState {
+	int state;			// automaton state after the last byte scanned
+	int found;			// number of terms seen so far
+	int literal_found;	// how many of those are literals
+	char* seen;			// 1 for each term that has been seen
+	char* carry;		// single term only: tail of the last buffer, then room for the seam
+	size_t carry_len;
+	int* regex_states;	// where each regex's DFA is, see Regexp_scan
+	RegexpCache** caches;	// each regex's DFA states, per search so threads don't share them
+	int cache_count;
+} MatchState;
+
+Matcher* Matcher_create(char** terms, int literal_count, char** regexes, int regex_count);
+void Matcher_destroy(Matcher* matcher);
+
+int MatchState_init(Matcher* matcher, MatchState* ms);
+void MatchState_reset(Matcher* matcher, MatchState* ms);
+void MatchState_free(MatchState* ms);
+
+// 1 if term t is in every file without looking, like an empty term
+#define Matcher_always(M, T) ((T) < (M)->literal_count ? (M)->terms[T][0] == '\0' \
+		: (M)->regexes[(T) - (M)->literal_count]->always)
+
+#define Matcher_done(M, S, O) ((O) == 1 ? (S)->found > 0 : (S)->found == (M)->term_count)
+
+int Matcher_scan(Matcher* matcher, MatchState* ms, const char* data, size_t size, int or_flag);
+void Matcher_prime(Matcher* matcher, MatchState* ms, const char* data, size_t size);
+int Matcher_finish(Matcher* matcher, MatchState* ms, int or_flag);
+
+#endif
@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <regex.h>
+#include "regexp.h"
+
+// size of the text searched per run
+#define BENCH_SIZE (64*1024*1024)
+// searches per pattern, the best one is reported
+#define BENCH_ROUNDS 3
+
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Fill buf with something that looks like a log: lowercase words, spaces, newlines */
+static void fill_text(char* buf, size_t size)
+{
+	const char* words[] = { "error", "warning", "info", "debug", "request", "served",
+		"connection", "closed", "timeout", "user", "login", "failed", "200", "404" };
+	size_t pos = 0;
+
+	while (pos < size) {
+		const char* word = words[rand() % (sizeof(words) / sizeof(words[0]))];
+		size_t len = strlen(word);
+		if (pos + len + 1 >= size)
+			break;
+		memcpy(buf + pos, word, len);
+		pos += len;
+		buf[pos++] = rand() % 12 == 0 ? '\n' : ' ';
+	}
+	memset(buf + pos, ' ', size - pos);
+	buf[size - 1] = '\0';
+}
+
+/* Time the lazy DFA over the text in the 64K blocks logfind reads */
+static double bench_lazy_dfa(Regexp* re, const char* text, size_t n, int* matched)
+{
+	double best = 0;
+	size_t pos;
+	int i;
+
+	for (i = 0; i < BENCH_ROUNDS; i++) {
+		// a fresh cache each round, so building the DFA is part of the cost
+		RegexpCache* cache = RegexpCache_create(re);
+		int state = REGEXP_LINE_START;
+		double start = now();
+
+		*matched = 0;
+		for (pos = 0; pos < n && !*matched; pos += 64 * 1024) {
+			size_t size = n - pos < 64 * 1024 ? n - pos : 64 * 1024;
+			*matched = Regexp_scan(re, cache, &state, text + pos, size);
+		}
+		if (!*matched)
+			*matched = Regexp_finish(re, cache, &state);
+
+		double elapsed = now() - start;
+		if (n / elapsed / 1e6 > best)
+			best = n / elapsed / 1e6;
+		RegexpCache_destroy(cache);
+	}
+
+	return best;
+}
+
+static double bench_regexec(regex_t* rx, const char* text, size_t n, int* matched)
+{
+	double best = 0;
+	int i;
+
+	for (i = 0; i < BENCH_ROUNDS; i++) {
+		double start = now();
+		*matched = regexec(rx, text, 0, NULL, 0) == 0;
+		double elapsed = now() - start;
+		if (n / elapsed / 1e6 > best)
+			best = n / elapsed / 1e6;
+	}
+
+	return best;
+}
+
+int main(int argc, char* argv[])
+{
+	// none of these occur in the text, so every byte has to be looked at
+	const char* patterns[] = {
+		"login failed for",
+		"(error|warning): [a-z]+",
+		"^request [0-9]+ timeout 5",
+		"[0-9]{4}",
+		"user .* (denied|refused)",
+		"(e|ee)*Q",
+		"(r+r+)+Q"
+	};
+	char* text = malloc(BENCH_SIZE);
+	size_t i;
+
+	if (text == NULL)
+		return 1;
+
+	srand(1);
+	fill_text(text, BENCH_SIZE);
+
+	printf("%d MB of text, pattern absent\n", BENCH_SIZE >> 20);
+	printf("%-28s %-18s %12s %12s\n", "pattern", "literal", "lazy DFA", "regexec");
+
+	for (i = 0; i < sizeof(patterns) / sizeof(patterns[0]); i++) {
+		const char* error = NULL;
+		int dfa_matched = 0;
+		int rx_matched = 0;
+		regex_t rx;
+		Regexp* re = Regexp_compile(patterns[i], &error);
+
+		if (re == NULL) {
+			fprintf(stderr, "%s: %s\n", patterns[i], error);
+			return 1;
+		}
+		if (regcomp(&rx, patterns[i], REG_EXTENDED | REG_NEWLINE | REG_NOSUB) != 0) {
+			fprintf(stderr, "%s: regcomp failed\n", patterns[i]);
+			return 1;
+		}
+
+		double dfa = bench_lazy_dfa(re, text, BENCH_SIZE - 1, &dfa_matched);
+		double posix = bench_regexec(&rx, text, BENCH_SIZE - 1, &rx_matched);
+		printf("%-28s %-18s %7.0f MB/s %7.0f MB/s\n", patterns[i], re->literal, dfa, posix);
+		if (dfa_matched != rx_matched)
+			fprintf(stderr, "%s: lazy DFA says %d, regexec says %d\n", patterns[i], dfa_matched, rx_matched);
+
+		regfree(&rx);
+		Regexp_destroy(re);
+	}
+
+	free(text);
+	return 0;
+}
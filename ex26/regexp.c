@@ -0,0 +1,1180 @@
+#define _GNU_SOURCE			// memrchr
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "regexp.h"
+#include "fastsearch.h"
+#include "dbg.h"
+
+// limits that keep a pattern from blowing up the NFA
+#define REGEXP_MAX_LENGTH 4096
+#define REGEXP_MAX_NODES 100000
+#define REGEXP_MAX_REPEAT 1000
+// the DFA cache is flushed and rebuilt past either of these
+#define REGEXP_CACHE_STATES 4096
+#define REGEXP_CACHE_POOL (1024*1024)
+// shorter literals turn up too often to be worth skipping ahead on
+#define REGEXP_LITERAL_MIN 2
+
+enum { NODE_SET, NODE_SPLIT, NODE_BOL, NODE_EOL, NODE_MATCH };
+enum { AST_SET, AST_CAT, AST_ALT, AST_REPEAT, AST_BOL, AST_EOL, AST_EMPTY };
+
+// DFA state flags
+#define STATE_MATCH 1		// a match ends at the byte just consumed
+#define STATE_EOL_MATCH 2	// a match ends here if the line does
+// states every cache starts with
+#define STATE_MATCHED 0		// a match was found, nothing left to do on this line
+#define STATE_DEAD 1		// nothing can match on this line anymore
+
+#define SET_ADD(S, C) ((S)[(C) >> 6] |= 1ULL << ((C) & 63))
+#define SET_HAS(S, C) (((S)[(C) >> 6] >> ((C) & 63)) & 1)
+
+/*-- PARSER --*/
+
+typedef struct Ast {
+	int type;
+	int left;
+	int right;
+	int min;
+	int max;				// -1 for no upper bound
+	int set;
+} Ast;
+
+typedef struct Parser {
+	const char* p;
+	const char* error;
+	Ast* ast;
+	int ast_count;
+	int ast_capacity;
+	Regexp* re;
+} Parser;
+
+static int Regexp_new_set(Regexp* re)
+{
+	uint64_t (*grown)[4] = realloc(re->sets, (re->set_count + 1) * sizeof(*re->sets));
+
+	if (grown == NULL)
+		return -1;
+	re->sets = grown;
+	memset(re->sets[re->set_count], 0, sizeof(*re->sets));
+	return re->set_count++;
+}
+
+static int Parser_node(Parser* parser, int type, int left, int right)
+{
+	Ast* node = NULL;
+
+	if (parser->ast_count == parser->ast_capacity) {
+		int capacity = parser->ast_capacity > 0 ? parser->ast_capacity * 2 : 64;
+		Ast* grown = realloc(parser->ast, capacity * sizeof(Ast));
+		if (grown == NULL) {
+			parser->error = "out of memory";
+			return -1;
+		}
+		parser->ast = grown;
+		parser->ast_capacity = capacity;
+	}
+
+	node = &parser->ast[parser->ast_count];
+	node->type = type;
+	node->left = left;
+	node->right = right;
+	node->min = 0;
+	node->max = 0;
+	node->set = -1;
+	return parser->ast_count++;
+}
+
+/* A node that consumes one byte from a new, empty set, filled in by the caller */
+static int Parser_set(Parser* parser)
+{
+	int node = Parser_node(parser, AST_SET, -1, -1);
+
+	if (node < 0)
+		return -1;
+	parser->ast[node].set = Regexp_new_set(parser->re);
+	if (parser->ast[node].set < 0) {
+		parser->error = "out of memory";
+		return -1;
+	}
+	return node;
+}
+
+/* \d \w \s and their negations, 0 if c isn't one of them */
+static int add_escape_class(uint64_t* set, char c)
+{
+	int i;
+	int negate = isupper((unsigned char)c);
+	uint64_t class[4] = { 0 };
+
+	switch (tolower((unsigned char)c)) {
+		case 'd':
+			for (i = '0'; i <= '9'; i++)
+				SET_ADD(class, i);
+			break;
+		case 'w':
+			for (i = 0; i < 128; i++)
+				if (isalnum(i) || i == '_')
+					SET_ADD(class, i);
+			break;
+		case 's':
+			for (i = 0; i < 128; i++)
+				if (isspace(i))
+					SET_ADD(class, i);
+			break;
+		default:
+			return 0;
+	}
+
+	for (i = 0; i < 4; i++)
+		set[i] |= negate ? ~class[i] : class[i];
+	return 1;
+}
+
+/* [:name:] inside brackets, 0 if the name is unknown */
+static int add_named_class(uint64_t* set, const char* name, size_t len)
+{
+	static const struct { const char* name; int (*test)(int); } classes[] = {
+		{ "alpha", isalpha }, { "digit", isdigit }, { "alnum", isalnum }, { "upper", isupper },
+		{ "lower", islower }, { "space", isspace }, { "blank", isblank }, { "punct", ispunct },
+		{ "print", isprint }, { "graph", isgraph }, { "cntrl", iscntrl }, { "xdigit", isxdigit }
+	};
+	size_t i;
+	int c;
+
+	for (i = 0; i < sizeof(classes) / sizeof(classes[0]); i++) {
+		if (strlen(classes[i].name) == len && strncmp(classes[i].name, name, len) == 0) {
+			// ASCII only, so the answer doesn't depend on the locale
+			for (c = 0; c < 128; c++)
+				if (classes[i].test(c))
+					SET_ADD(set, c);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* Bracket expression: [abc] [^a-z] [[:digit:]_] [\d.] */
+static int parse_class(Parser* parser)
+{
+	int i;
+	int lo, hi;
+	int negate = 0;
+	int first = 1;
+	int node = Parser_set(parser);
+	uint64_t* set = NULL;
+
+	if (node < 0)
+		return -1;
+	set = parser->re->sets[parser->ast[node].set];
+
+	parser->p++;
+	if (*parser->p == '^') {
+		negate = 1;
+		parser->p++;
+	}
+
+	// a ] right after the opening bracket is a literal
+	while (*parser->p != '\0' && (*parser->p != ']' || first)) {
+		first = 0;
+		if (parser->p[0] == '[' && parser->p[1] == ':') {
+			const char* name = parser->p + 2;
+			const char* close = strstr(name, ":]");
+			if (close == NULL || !add_named_class(set, name, close - name)) {
+				parser->error = "unknown character class";
+				return -1;
+			}
+			parser->p = close + 2;
+			continue;
+		}
+		if (parser->p[0] == '\\' && parser->p[1] != '\0') {
+			if (add_escape_class(set, parser->p[1])) {
+				parser->p += 2;
+				continue;
+			}
+			parser->p++;
+		}
+		lo = (unsigned char)*parser->p++;
+		hi = lo;
+		if (parser->p[0] == '-' && parser->p[1] != '\0' && parser->p[1] != ']') {
+			parser->p++;
+			if (parser->p[0] == '\\' && parser->p[1] != '\0')
+				parser->p++;
+			hi = (unsigned char)*parser->p++;
+			if (hi < lo) {
+				parser->error = "invalid range";
+				return -1;
+			}
+		}
+		for (i = lo; i <= hi; i++)
+			SET_ADD(set, i);
+	}
+	if (*parser->p != ']') {
+		parser->error = "missing ]";
+		return -1;
+	}
+	parser->p++;
+
+	if (negate) {
+		for (i = 0; i < 4; i++)
+			set[i] = ~set[i];
+	}
+	return node;
+}
+
+static int parse_alt(Parser* parser);
+
+static int parse_atom(Parser* parser)
+{
+	int i;
+	int node = -1;
+	char c = *parser->p;
+
+	switch (c) {
+		case '(':
+			parser->p++;
+			node = parse_alt(parser);
+			if (node < 0)
+				return -1;
+			if (*parser->p != ')') {
+				parser->error = "missing )";
+				return -1;
+			}
+			parser->p++;
+			return node;
+		case '*':
+		case '+':
+		case '?':
+			parser->error = "nothing to repeat";
+			return -1;
+		case '^':
+			parser->p++;
+			return Parser_node(parser, AST_BOL, -1, -1);
+		case '$':
+			parser->p++;
+			return Parser_node(parser, AST_EOL, -1, -1);
+		case '[':
+			return parse_class(parser);
+	}
+
+	node = Parser_set(parser);
+	if (node < 0)
+		return -1;
+	uint64_t* set = parser->re->sets[parser->ast[node].set];
+
+	if (c == '.') {
+		for (i = 0; i < 4; i++)
+			set[i] = ~0ULL;
+	} else if (c == '\\') {
+		c = *++parser->p;
+		if (c == '\0') {
+			parser->error = "trailing backslash";
+			return -1;
+		}
+		if (!add_escape_class(set, c))
+			SET_ADD(set, (unsigned char)(c == 't' ? '\t' : c == 'n' ? '\n' : c));
+	} else {
+		SET_ADD(set, (unsigned char)c);
+	}
+	parser->p++;
+	return node;
+}
+
+/* {n} {n,} {n,m} after an atom
+ * Output
+ * 		parsed: 1 if it was a bound, 0 if the { is just a literal, -1 on error
+ */
+static int parse_bounds(Parser* parser, int* min, int* max)
+{
+	char* end = NULL;
+	const char* p = parser->p + 1;
+	long lo = 0;
+	long hi = 0;
+
+	if (!isdigit((unsigned char)*p))
+		return 0;
+	lo = strtol(p, &end, 10);
+	p = end;
+	hi = lo;
+	if (*p == ',') {
+		p++;
+		hi = -1;
+		if (isdigit((unsigned char)*p)) {
+			hi = strtol(p, &end, 10);
+			p = end;
+		}
+	}
+	if (*p != '}')
+		return 0;
+
+	if (lo > REGEXP_MAX_REPEAT || hi > REGEXP_MAX_REPEAT) {
+		parser->error = "repetition count too big";
+		return -1;
+	}
+	if (hi != -1 && hi < lo) {
+		parser->error = "invalid repetition count";
+		return -1;
+	}
+	*min = lo;
+	*max = hi;
+	parser->p = p + 1;
+	return 1;
+}
+
+static int parse_repeat(Parser* parser)
+{
+	int min = 0;
+	int max = 0;
+	int bounds = 0;
+	int node = parse_atom(parser);
+
+	while (node >= 0) {
+		char c = *parser->p;
+		if (c == '*' || c == '+' || c == '?') {
+			min = c == '+';
+			max = c == '?' ? 1 : -1;
+			parser->p++;
+		} else if (c == '{' && (bounds = parse_bounds(parser, &min, &max)) != 0) {
+			if (bounds < 0)
+				return -1;
+		} else {
+			break;
+		}
+		node = Parser_node(parser, AST_REPEAT, node, -1);
+		if (node >= 0) {
+			parser->ast[node].min = min;
+			parser->ast[node].max = max;
+		}
+	}
+	return node;
+}
+
+static int parse_concat(Parser* parser)
+{
+	int node = -1;
+	int right = -1;
+
+	while (*parser->p != '\0' && *parser->p != '|' && *parser->p != ')') {
+		right = parse_repeat(parser);
+		if (right < 0)
+			return -1;
+		node = node < 0 ? right : Parser_node(parser, AST_CAT, node, right);
+		if (node < 0)
+			return -1;
+	}
+	return node >= 0 ? node : Parser_node(parser, AST_EMPTY, -1, -1);
+}
+
+static int parse_alt(Parser* parser)
+{
+	int right = -1;
+	int node = parse_concat(parser);
+
+	while (node >= 0 && *parser->p == '|') {
+		parser->p++;
+		right = parse_concat(parser);
+		if (right < 0)
+			return -1;
+		node = Parser_node(parser, AST_ALT, node, right);
+	}
+	return node;
+}
+
+/*-- LITERALS --*/
+
+// what every match of a piece of the pattern has to contain
+typedef struct LiteralInfo {
+	int exact;				// every match is exactly prefix, which is then also suffix and inner
+	char prefix[REGEXP_LITERAL_MAX];
+	size_t prefix_len;
+	char suffix[REGEXP_LITERAL_MAX];
+	size_t suffix_len;
+	char inner[REGEXP_LITERAL_MAX];		// somewhere in every match
+	size_t inner_len;
+} LiteralInfo;
+
+static void literal_exact(LiteralInfo* info, const char* text, size_t len)
+{
+	info->exact = 1;
+	memcpy(info->prefix, text, len);
+	memcpy(info->suffix, text, len);
+	memcpy(info->inner, text, len);
+	info->prefix_len = info->suffix_len = info->inner_len = len;
+}
+
+/* Join a + b into out, keeping the start or the end if it's too long */
+static size_t literal_join(char* out, const char* a, size_t a_len, const char* b, size_t b_len, int keep_end)
+{
+	char joined[REGEXP_LITERAL_MAX * 2];
+	size_t len = a_len + b_len;
+
+	memcpy(joined, a, a_len);
+	memcpy(joined + a_len, b, b_len);
+	if (len > REGEXP_LITERAL_MAX) {
+		memcpy(out, keep_end ? joined + len - REGEXP_LITERAL_MAX : joined, REGEXP_LITERAL_MAX);
+		return REGEXP_LITERAL_MAX;
+	}
+	memcpy(out, joined, len);
+	return len;
+}
+
+static void literal_best(LiteralInfo* info, const char* text, size_t len)
+{
+	if (len > info->inner_len) {
+		memcpy(info->inner, text, len);
+		info->inner_len = len;
+	}
+}
+
+static void literal_info(Ast* ast, Regexp* re, int index, LiteralInfo* info)
+{
+	int c;
+	int count = 0;
+	int single = 0;
+	char byte;
+	size_t i;
+	LiteralInfo a;
+	LiteralInfo b;
+	Ast* node = &ast[index];
+
+	memset(info, 0, sizeof(LiteralInfo));
+
+	switch (node->type) {
+		case AST_SET:
+			for (c = 0; c < 256 && count < 2; c++) {
+				if (SET_HAS(re->sets[node->set], c)) {
+					single = c;
+					count++;
+				}
+			}
+			if (count == 1) {
+				byte = single;
+				literal_exact(info, &byte, 1);
+			}
+			break;
+		case AST_BOL:
+		case AST_EOL:
+		case AST_EMPTY:
+			literal_exact(info, "", 0);
+			break;
+		case AST_CAT:
+			literal_info(ast, re, node->left, &a);
+			literal_info(ast, re, node->right, &b);
+			if (a.exact && b.exact && a.prefix_len + b.prefix_len <= REGEXP_LITERAL_MAX) {
+				char joined[REGEXP_LITERAL_MAX];
+				literal_exact(info, joined, literal_join(joined, a.prefix, a.prefix_len, b.prefix, b.prefix_len, 0));
+				break;
+			}
+			info->prefix_len = a.exact ? literal_join(info->prefix, a.prefix, a.prefix_len, b.prefix, b.prefix_len, 0)
+				: literal_join(info->prefix, a.prefix, a.prefix_len, "", 0, 0);
+			info->suffix_len = b.exact ? literal_join(info->suffix, a.suffix, a.suffix_len, b.suffix, b.suffix_len, 1)
+				: literal_join(info->suffix, "", 0, b.suffix, b.suffix_len, 1);
+			literal_best(info, a.inner, a.inner_len);
+			literal_best(info, b.inner, b.inner_len);
+			{
+				// the end of a's match runs straight into the start of b's
+				char seam[REGEXP_LITERAL_MAX];
+				size_t seam_len = literal_join(seam, a.suffix, a.suffix_len, b.prefix, b.prefix_len, 0);
+				literal_best(info, seam, seam_len);
+			}
+			break;
+		case AST_ALT:
+			literal_info(ast, re, node->left, &a);
+			literal_info(ast, re, node->right, &b);
+			if (a.exact && b.exact && a.prefix_len == b.prefix_len && memcmp(a.prefix, b.prefix, a.prefix_len) == 0) {
+				*info = a;
+				break;
+			}
+			for (i = 0; i < a.prefix_len && i < b.prefix_len && a.prefix[i] == b.prefix[i]; i++)
+				;
+			memcpy(info->prefix, a.prefix, i);
+			info->prefix_len = i;
+			for (i = 0; i < a.suffix_len && i < b.suffix_len
+					&& a.suffix[a.suffix_len - 1 - i] == b.suffix[b.suffix_len - 1 - i]; i++)
+				;
+			memcpy(info->suffix, a.suffix + a.suffix_len - i, i);
+			info->suffix_len = i;
+			break;
+		case AST_REPEAT:
+			if (node->min == 0) {
+				if (node->max == 0)
+					literal_exact(info, "", 0);
+				break;
+			}
+			literal_info(ast, re, node->left, &a);
+			*info = a;
+			info->exact = a.exact && node->min == node->max && node->min == 1;
+			break;
+	}
+
+	literal_best(info, info->prefix, info->prefix_len);
+	literal_best(info, info->suffix, info->suffix_len);
+}
+
+/*-- COMPILER --*/
+
+static int Regexp_start(Regexp* re, RegexpCache* cache, int state);
+
+static int Regexp_node(Regexp* re, int type, int out, int out1, int set)
+{
+	RegexpNode* node = NULL;
+
+	if (re->node_count == REGEXP_MAX_NODES)
+		return -1;
+	if (re->node_count == 0 || (re->node_count >= 64 && (re->node_count & (re->node_count - 1)) == 0)) {
+		// starts at 64 and doubles each time it fills up
+		RegexpNode* grown = realloc(re->nodes, (re->node_count > 0 ? re->node_count * 2 : 64) * sizeof(RegexpNode));
+		if (grown == NULL)
+			return -1;
+		re->nodes = grown;
+	}
+
+	node = &re->nodes[re->node_count];
+	node->type = type;
+	node->out = out;
+	node->out1 = out1;
+	node->set = set;
+	return re->node_count++;
+}
+
+/* Thompson construction, back to front
+ * Each piece is compiled knowing which node comes after it, so
+ * no patching of dangling arrows is needed.
+ *
+ * Output
+ * 		start: first node of the piece, -1 if the NFA got too big
+ */
+static int Regexp_build(Regexp* re, Ast* ast, int index, int next)
+{
+	int i;
+	int split = -1;
+	int body = -1;
+	Ast node = ast[index];
+
+	if (next < 0)
+		return -1;
+
+	switch (node.type) {
+		case AST_SET:
+			return Regexp_node(re, NODE_SET, next, -1, node.set);
+		case AST_BOL:
+			return Regexp_node(re, NODE_BOL, next, -1, -1);
+		case AST_EOL:
+			return Regexp_node(re, NODE_EOL, next, -1, -1);
+		case AST_EMPTY:
+			return next;
+		case AST_CAT:
+			return Regexp_build(re, ast, node.left, Regexp_build(re, ast, node.right, next));
+		case AST_ALT:
+			body = Regexp_build(re, ast, node.left, next);
+			split = Regexp_build(re, ast, node.right, next);
+			return body < 0 || split < 0 ? -1 : Regexp_node(re, NODE_SPLIT, body, split, -1);
+		case AST_REPEAT:
+			if (node.max == -1) {
+				// the loop: split back into the body or move on
+				split = Regexp_node(re, NODE_SPLIT, -1, next, -1);
+				body = Regexp_build(re, ast, node.left, split);
+				if (split < 0 || body < 0)
+					return -1;
+				re->nodes[split].out = body;
+				next = node.min == 0 ? split : body;
+				node.min = node.min > 0 ? node.min - 1 : 0;
+			} else {
+				// x{0,2} is (x(x)?)?
+				int after = next;
+				for (i = node.min; i < node.max && next >= 0; i++) {
+					body = Regexp_build(re, ast, node.left, next);
+					next = body < 0 ? -1 : Regexp_node(re, NODE_SPLIT, body, after, -1);
+				}
+			}
+			for (i = 0; i < node.min && next >= 0; i++)
+				next = Regexp_build(re, ast, node.left, next);
+			return next;
+	}
+	return -1;
+}
+
+/* Compile a POSIX extended regular expression
+ * Supports literals, ., [] with ranges and [:classes:], \d \w \s and
+ * their negations, ^ $, ( ) grouping, | and the * + ? {n,m}
+ * repetitions. Patterns are matched one line at a time: nothing
+ * matches a newline, and ^ and $ match at the ends of each line. There
+ * are no backreferences, which is what lets matching run as a DFA in
+ * time linear in the input.
+ *
+ * Input
+ * 		pattern: the regular expression
+ * 		error: set to what's wrong with the pattern when NULL is returned
+ * Output
+ * 		re: compiled pattern, NULL on error
+ */
+Regexp* Regexp_compile(const char* pattern, const char** error)
+{
+	int i;
+	int root = -1;
+	int match = -1;
+	int body = -1;
+	int any = -1;
+	LiteralInfo info;
+	RegexpCache* cache = NULL;
+	Parser parser = { .p = pattern };
+	Regexp* re = calloc(1, sizeof(Regexp));
+
+	*error = "out of memory";
+	if (re == NULL)
+		return NULL;
+	parser.re = re;
+
+	if (strlen(pattern) > REGEXP_MAX_LENGTH) {
+		*error = "pattern too long";
+		goto error;
+	}
+	root = parse_alt(&parser);
+	if (root >= 0 && *parser.p == ')')
+		parser.error = "unmatched )";
+	if (root < 0 || parser.error) {
+		*error = parser.error ? parser.error : "out of memory";
+		goto error;
+	}
+
+	// no byte set takes in a newline, lines are matched one at a time
+	for (i = 0; i < re->set_count; i++)
+		re->sets[i]['\n' >> 6] &= ~(1ULL << ('\n' & 63));
+
+	match = Regexp_node(re, NODE_MATCH, -1, -1, -1);
+	body = Regexp_build(re, parser.ast, root, match);
+	// [^\n]* in front, so a match can start at any byte
+	any = Regexp_new_set(re);
+	re->start = Regexp_node(re, NODE_SPLIT, -1, body, -1);
+	if (body < 0 || any < 0 || re->start < 0) {
+		*error = "pattern too big";
+		goto error;
+	}
+	memset(re->sets[any], 0xff, sizeof(re->sets[any]));
+	re->sets[any]['\n' >> 6] &= ~(1ULL << ('\n' & 63));
+	re->nodes[re->start].out = Regexp_node(re, NODE_SET, re->start, -1, any);
+	if (re->nodes[re->start].out < 0) {
+		*error = "pattern too big";
+		goto error;
+	}
+
+	literal_info(parser.ast, re, root, &info);
+	memcpy(re->literal, info.inner, info.inner_len);
+	re->literal_len = info.inner_len;
+	re->literal[re->literal_len] = '\0';
+
+	// a pattern that matches the empty string without ^ or $ matches everywhere
+	cache = RegexpCache_create(re);
+	if (cache == NULL)
+		goto error;
+	re->always = (cache->flags[Regexp_start(re, cache, REGEXP_MID_LINE)] & STATE_MATCH) != 0;
+	RegexpCache_destroy(cache);
+
+	free(parser.ast);
+	*error = NULL;
+	return re;
+
+error:
+	free(parser.ast);
+	Regexp_destroy(re);
+	return NULL;
+}
+
+void Regexp_destroy(Regexp* re)
+{
+	if (re) {
+		free(re->nodes);
+		free(re->sets);
+		free(re);
+	}
+}
+
+/*-- DFA --*/
+
+// a DFA state under construction
+typedef struct StateBuilder {
+	int count;				// NFA SET nodes in cache->list
+	int pending;			// $ nodes reached, in cache->pending
+	int flags;
+	int bol;				// ^ holds where this state starts
+} StateBuilder;
+
+static void RegexpCache_flush(RegexpCache* cache);
+
+RegexpCache* RegexpCache_create(Regexp* re)
+{
+	int n = re->node_count > 0 ? re->node_count : 1;
+	RegexpCache* cache = calloc(1, sizeof(RegexpCache));
+	check_mem(cache);
+
+	cache->list = malloc(n * sizeof(int));
+	cache->stack = malloc(n * sizeof(int));
+	cache->pending = malloc(n * sizeof(int));
+	cache->marks = calloc(n, sizeof(unsigned));
+	check_mem(cache->list);
+	check_mem(cache->stack);
+	check_mem(cache->pending);
+	check_mem(cache->marks);
+	RegexpCache_flush(cache);
+	check(cache->state_count == 2, "Couldn't set up the DFA cache");
+	cache->flushes = 0;
+	return cache;
+
+error:
+	RegexpCache_destroy(cache);
+	return NULL;
+}
+
+void RegexpCache_destroy(RegexpCache* cache)
+{
+	if (cache) {
+		free(cache->trans);
+		free(cache->flags);
+		free(cache->set_start);
+		free(cache->set_len);
+		free(cache->hashes);
+		free(cache->pool);
+		free(cache->table);
+		free(cache->list);
+		free(cache->stack);
+		free(cache->pending);
+		free(cache->marks);
+		free(cache);
+	}
+}
+
+static uint32_t hash_state(const int* list, int count, int flags)
+{
+	// FNV-1a over the node ids
+	int i;
+	uint32_t hash = 2166136261u ^ flags;
+
+	for (i = 0; i < count; i++)
+		hash = (hash ^ (uint32_t)list[i]) * 16777619u;
+	return hash;
+}
+
+static int RegexpCache_find(RegexpCache* cache, const int* list, int count, int flags, uint32_t hash)
+{
+	int s;
+	int mask = cache->table_size - 1;
+	int slot = hash & mask;
+
+	while ((s = cache->table[slot]) != -1) {
+		if (cache->hashes[s] == hash && cache->set_len[s] == count && cache->flags[s] == flags
+				&& (count == 0 || memcmp(cache->pool + cache->set_start[s], list, count * sizeof(int)) == 0))
+			return s;
+		slot = (slot + 1) & mask;
+	}
+	return -1;
+}
+
+/* Add a state known not to be in the cache yet
+ * Output
+ * 		state: its index, -1 if out of memory
+ */
+static int RegexpCache_add(RegexpCache* cache, const int* list, int count, int flags, uint32_t hash)
+{
+	int i;
+	int s = cache->state_count;
+
+	if (s == cache->state_capacity) {
+		int capacity = s > 0 ? s * 2 : 16;
+		int* trans = realloc(cache->trans, (size_t)capacity * 256 * sizeof(int));
+		if (trans == NULL)
+			return -1;
+		cache->trans = trans;
+		unsigned char* state_flags = realloc(cache->flags, capacity);
+		int* set_start = realloc(cache->set_start, capacity * sizeof(int));
+		int* set_len = realloc(cache->set_len, capacity * sizeof(int));
+		uint32_t* hashes = realloc(cache->hashes, capacity * sizeof(uint32_t));
+		if (state_flags) cache->flags = state_flags;
+		if (set_start) cache->set_start = set_start;
+		if (set_len) cache->set_len = set_len;
+		if (hashes) cache->hashes = hashes;
+		if (!state_flags || !set_start || !set_len || !hashes)
+			return -1;
+		cache->state_capacity = capacity;
+	}
+
+	if (cache->pool == NULL || cache->pool_len + count > cache->pool_capacity) {
+		size_t capacity = cache->pool_capacity > 0 ? cache->pool_capacity * 2 : 1024;
+		while (capacity < cache->pool_len + count)
+			capacity *= 2;
+		int* pool = realloc(cache->pool, capacity * sizeof(int));
+		if (pool == NULL)
+			return -1;
+		cache->pool = pool;
+		cache->pool_capacity = capacity;
+	}
+
+	// keep the table at most half full
+	if ((s + 1) * 2 > cache->table_size) {
+		int size = cache->table_size > 0 ? cache->table_size * 2 : 64;
+		int* table = malloc(size * sizeof(int));
+		if (table == NULL)
+			return -1;
+		memset(table, -1, size * sizeof(int));
+		for (i = 0; i < s; i++) {
+			int slot = cache->hashes[i] & (size - 1);
+			while (table[slot] != -1)
+				slot = (slot + 1) & (size - 1);
+			table[slot] = i;
+		}
+		free(cache->table);
+		cache->table = table;
+		cache->table_size = size;
+	}
+
+	memset(cache->trans + (size_t)s * 256, -1, 256 * sizeof(int));
+	cache->flags[s] = flags;
+	cache->hashes[s] = hash;
+	cache->set_start[s] = cache->pool_len;
+	cache->set_len[s] = count;
+	if (count > 0)
+		memcpy(cache->pool + cache->pool_len, list, count * sizeof(int));
+	cache->pool_len += count;
+
+	i = hash & (cache->table_size - 1);
+	while (cache->table[i] != -1)
+		i = (i + 1) & (cache->table_size - 1);
+	cache->table[i] = s;
+	cache->state_count++;
+	return s;
+}
+
+/* Throw every state away, keeping only the two every cache has */
+static void RegexpCache_flush(RegexpCache* cache)
+{
+	cache->state_count = 0;
+	cache->pool_len = 0;
+	cache->line_start = -1;
+	cache->mid_line = -1;
+	if (cache->table != NULL)
+		memset(cache->table, -1, cache->table_size * sizeof(int));
+	cache->flushes++;
+
+	RegexpCache_add(cache, NULL, 0, STATE_MATCH, hash_state(NULL, 0, STATE_MATCH));
+	RegexpCache_add(cache, NULL, 0, 0, hash_state(NULL, 0, 0));
+}
+
+static void StateBuilder_begin(Regexp* re, RegexpCache* cache, StateBuilder* builder, int bol)
+{
+	if (++cache->mark == 0) {
+		// the generation counter wrapped, old marks could look current
+		cache->mark = 1;
+		memset(cache->marks, 0, re->node_count * sizeof(unsigned));
+	}
+	builder->count = 0;
+	builder->pending = 0;
+	builder->flags = 0;
+	builder->bol = bol;
+}
+
+/* Add node and everything it reaches without consuming a byte */
+static void StateBuilder_add(Regexp* re, RegexpCache* cache, StateBuilder* builder, int node)
+{
+	int top = 0;
+
+	if (cache->marks[node] == cache->mark)
+		return;
+	cache->marks[node] = cache->mark;
+	cache->stack[top++] = node;
+
+	while (top > 0) {
+		RegexpNode* n = &re->nodes[cache->stack[--top]];
+		int outs[2] = { -1, -1 };
+
+		switch (n->type) {
+			case NODE_SET:
+				cache->list[builder->count++] = n - re->nodes;
+				break;
+			case NODE_MATCH:
+				builder->flags |= STATE_MATCH | STATE_EOL_MATCH;
+				break;
+			case NODE_SPLIT:
+				outs[0] = n->out;
+				outs[1] = n->out1;
+				break;
+			case NODE_BOL:
+				if (builder->bol)
+					outs[0] = n->out;
+				break;
+			case NODE_EOL:
+				cache->pending[builder->pending++] = n - re->nodes;
+				break;
+		}
+		for (int i = 0; i < 2; i++) {
+			if (outs[i] >= 0 && cache->marks[outs[i]] != cache->mark) {
+				cache->marks[outs[i]] = cache->mark;
+				cache->stack[top++] = outs[i];
+			}
+		}
+	}
+}
+
+/* Can a match finish at the end of the line, through the $ nodes reached? */
+static int StateBuilder_eol(Regexp* re, RegexpCache* cache, StateBuilder* builder)
+{
+	int i;
+	int top = 0;
+
+	StateBuilder_begin(re, cache, &(StateBuilder){ 0 }, builder->bol);
+	for (i = 0; i < builder->pending; i++) {
+		int out = re->nodes[cache->pending[i]].out;
+		if (cache->marks[out] != cache->mark) {
+			cache->marks[out] = cache->mark;
+			cache->stack[top++] = out;
+		}
+	}
+
+	while (top > 0) {
+		RegexpNode* n = &re->nodes[cache->stack[--top]];
+		int outs[2] = { -1, -1 };
+
+		switch (n->type) {
+			case NODE_MATCH:
+				return 1;
+			case NODE_SPLIT:
+				outs[0] = n->out;
+				outs[1] = n->out1;
+				break;
+			case NODE_BOL:
+				if (builder->bol)
+					outs[0] = n->out;
+				break;
+			case NODE_EOL:
+				outs[0] = n->out;
+				break;
+		}
+		for (int j = 0; j < 2; j++) {
+			if (outs[j] >= 0 && cache->marks[outs[j]] != cache->mark) {
+				cache->marks[outs[j]] = cache->mark;
+				cache->stack[top++] = outs[j];
+			}
+		}
+	}
+	return 0;
+}
+
+static int compare_ints(const void* a, const void* b)
+{
+	return *(const int*)a - *(const int*)b;
+}
+
+/* Turn the nodes gathered into a DFA state, finding or adding it
+ * A full cache is flushed first, which invalidates every state index
+ * the caller was holding on to; cache->flushes tells when that happened.
+ */
+static int StateBuilder_end(Regexp* re, RegexpCache* cache, StateBuilder* builder)
+{
+	int s;
+	uint32_t hash;
+
+	if (builder->pending > 0 && StateBuilder_eol(re, cache, builder))
+		builder->flags |= STATE_EOL_MATCH;
+	qsort(cache->list, builder->count, sizeof(int), compare_ints);
+
+	hash = hash_state(cache->list, builder->count, builder->flags);
+	s = RegexpCache_find(cache, cache->list, builder->count, builder->flags, hash);
+	if (s >= 0)
+		return s;
+
+	if (cache->state_count >= REGEXP_CACHE_STATES || cache->pool_len + builder->count > REGEXP_CACHE_POOL)
+		RegexpCache_flush(cache);
+	s = RegexpCache_add(cache, cache->list, builder->count, builder->flags, hash);
+	if (s < 0) {
+		// start over with an empty cache, and if even that fails give up on the line
+		RegexpCache_flush(cache);
+		s = RegexpCache_add(cache, cache->list, builder->count, builder->flags, hash);
+		if (s < 0) {
+			log_err("Out of memory matching a regular expression");
+			return STATE_DEAD;
+		}
+	}
+	return s;
+}
+
+static int Regexp_start(Regexp* re, RegexpCache* cache, int state)
+{
+	StateBuilder builder;
+	int bol = state == REGEXP_LINE_START;
+	int* start = bol ? &cache->line_start : &cache->mid_line;
+
+	if (*start < 0) {
+		StateBuilder_begin(re, cache, &builder, bol);
+		StateBuilder_add(re, cache, &builder, re->start);
+		int s = StateBuilder_end(re, cache, &builder);
+		// a flush while building cleared the other start, never this one
+		start = bol ? &cache->line_start : &cache->mid_line;
+		*start = s;
+	}
+	return *start;
+}
+
+// a transition into a matching state is stored negative, so the scan
+// loop finds both those and the ones not computed yet with one test
+#define REGEXP_TRANS_MATCH(S) (-2 - (S))
+
+/* Work out, and remember, where state s goes on byte c */
+static int Regexp_step(Regexp* re, RegexpCache* cache, int s, unsigned char c)
+{
+	int i;
+	int next;
+	int flushes = cache->flushes;
+	StateBuilder builder;
+
+	if (c == '\n') {
+		next = cache->flags[s] & (STATE_MATCH | STATE_EOL_MATCH) ? STATE_MATCHED
+			: Regexp_start(re, cache, REGEXP_LINE_START);
+	} else {
+		StateBuilder_begin(re, cache, &builder, 0);
+		for (i = 0; i < cache->set_len[s]; i++) {
+			RegexpNode* n = &re->nodes[cache->pool[cache->set_start[s] + i]];
+			if (SET_HAS(re->sets[n->set], c))
+				StateBuilder_add(re, cache, &builder, n->out);
+		}
+		next = StateBuilder_end(re, cache, &builder);
+	}
+
+	// after a flush s means some other state, or nothing at all
+	if (cache->flushes == flushes)
+		cache->trans[s * 256 + c] = cache->flags[next] & STATE_MATCH ? REGEXP_TRANS_MATCH(next) : next;
+	return next;
+}
+
+/* Run the DFA over bytes of one or more lines
+ * Output
+ * 		matched: 1 if a line matched
+ */
+static int Regexp_run(Regexp* re, RegexpCache* cache, int* state, const char* data, const char* end)
+{
+	const unsigned char* p = (const unsigned char*)data;
+	const unsigned char* stop = (const unsigned char*)end;
+	int s = 0;
+
+	if (p == stop)
+		return 0;
+	s = *state < 0 ? Regexp_start(re, cache, *state) : *state;
+	// a pattern like ^ matches each line before its first byte
+	if (cache->flags[s] & STATE_MATCH)
+		return 1;
+
+	// kept in a local so the loop doesn't reload it, only a new state moves it
+	const int* trans = cache->trans;
+	while (p < stop) {
+		int next = trans[s * 256 + *p++];
+		if (next < 0) {
+			next = next == -1 ? Regexp_step(re, cache, s, p[-1]) : REGEXP_TRANS_MATCH(next);
+			if (cache->flags[next] & STATE_MATCH)
+				return 1;
+			trans = cache->trans;
+		}
+		s = next;
+	}
+
+	*state = stop[-1] == '\n' ? REGEXP_LINE_START : s;
+	return 0;
+}
+
+/* Search a block of text for a line the pattern matches
+ * The DFA state is kept in *state so text can come in blocks, and a
+ * line split between two blocks is matched as one. When the pattern has
+ * a literal every match must contain, the literal is searched for with
+ * the SIMD kernel and only lines containing it go through the DFA; the
+ * line running into the block and the one running out of it always do.
+ *
+ * Input
+ * 		re: compiled pattern
+ * 		cache: DFA states, one cache per thread
+ * 		state: REGEXP_LINE_START before the first block, updated in place
+ * 		data: bytes to search
+ * 		size: length of data
+ * Output
+ * 		matched: 1 if a line matched, the rest can be skipped
+ */
+int Regexp_scan(Regexp* re, RegexpCache* cache, int* state, const char* data, size_t size)
+{
+	const char* p = data;
+	const char* end = data + size;
+	const char* tail = NULL;
+	const char* hit = NULL;
+	const char* line = NULL;
+	const char* line_end = NULL;
+	int s = 0;
+
+	if (re->literal_len < REGEXP_LITERAL_MIN)
+		return Regexp_run(re, cache, state, p, end);
+
+	// finish the line that started in an earlier block
+	if (*state != REGEXP_LINE_START) {
+		line_end = memchr(p, '\n', end - p);
+		if (line_end == NULL)
+			return Regexp_run(re, cache, state, p, end);
+		if (Regexp_run(re, cache, state, p, line_end + 1))
+			return 1;
+		p = line_end + 1;
+	}
+
+	// the last line may carry on into the next block
+	tail = memrchr(p, '\n', end - p);
+	tail = tail != NULL ? tail + 1 : p;
+
+	// whole lines in between can only match if they contain the literal
+	while (p < tail && (hit = fs_memmem(p, tail - p, re->literal, re->literal_len)) != NULL) {
+		line = memrchr(p, '\n', hit - p);
+		line = line != NULL ? line + 1 : p;
+		line_end = memchr(hit, '\n', tail - hit);
+		s = REGEXP_LINE_START;
+		if (Regexp_run(re, cache, &s, line, line_end + 1))
+			return 1;
+		p = line_end + 1;
+	}
+
+	*state = REGEXP_LINE_START;
+	return Regexp_run(re, cache, state, tail, end);
+}
+
+/* The input ended: does the last line, if it had no newline, match?
+ * Output
+ * 		matched: 1 if it does
+ */
+int Regexp_finish(Regexp* re, RegexpCache* cache, int* state)
+{
+	int s = 0;
+
+	// ended on a newline, there is no unfinished line
+	if (*state == REGEXP_LINE_START)
+		return 0;
+	s = *state < 0 ? Regexp_start(re, cache, *state) : *state;
+	return (cache->flags[s] & (STATE_MATCH | STATE_EOL_MATCH)) != 0;
+}
+
+/* Feed bytes that come before the part to search without reporting them
+ * The search then picks up partway into a line: from the last newline
+ * in data if there is one, otherwise as if the line started somewhere
+ * before data, so ^ can't match.
+ */
+void Regexp_prime(Regexp* re, RegexpCache* cache, int* state, const char* data, size_t size)
+{
+	const char* newline = memrchr(data, '\n', size);
+	const unsigned char* p = (const unsigned char*)(newline ? newline + 1 : data);
+	const unsigned char* end = (const unsigned char*)data + size;
+	int s = 0;
+
+	if (size == 0)
+		return;
+	*state = newline ? REGEXP_LINE_START : REGEXP_MID_LINE;
+	if (p == end)
+		return;
+
+	s = Regexp_start(re, cache, *state);
+	while (p < end) {
+		int next = cache->trans[s * 256 + *p];
+		if (next < 0)
+			next = next == -1 ? Regexp_step(re, cache, s, *p) : REGEXP_TRANS_MATCH(next);
+		s = next;
+		p++;
+	}
+	*state = s;
+}
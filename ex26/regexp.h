@@ -0,0 +1,70 @@
+#ifndef logfind_regexp_h
+#define logfind_regexp_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+// longest literal kept from a pattern for the prefilter
+#define REGEXP_LITERAL_MAX 64
+
+// scan state at the start of a line, before the DFA has seen a byte of it
+#define REGEXP_LINE_START -1
+// scan state partway into a line whose start wasn't seen
+#define REGEXP_MID_LINE -2
+
+// one NFA node, see Regexp_compile
+typedef struct RegexpNode {
+	int type;
+	int out;
+	int out1;			// second way out of a split
+	int set;			// byte set a SET node consumes
+} RegexpNode;
+
+// a compiled extended regular expression, matched a line at a time
+typedef struct Regexp {
+	RegexpNode* nodes;
+	int node_count;
+	uint64_t (*sets)[4];	// 256 bit byte sets, never containing '\n'
+	int set_count;
+	int start;			// NFA start, behind a [^\n]* loop so a match can start anywhere
+	char literal[REGEXP_LITERAL_MAX + 1];	// every match contains this, "" if nothing useful
+	size_t literal_len;
+	int always;			// matches at any position of any line, so it's in every file
+} Regexp;
+
+// DFA states built so far, each state a set of NFA nodes
+// lazily filled in, and flushed when it grows too big
+typedef struct RegexpCache {
+	int state_count;
+	int state_capacity;
+	int* trans;			// state_capacity rows of 256 next states, -1 until computed, below that matching
+	unsigned char* flags;
+	int* set_start;		// each state's NFA nodes are pool[set_start .. set_start + set_len]
+	int* set_len;
+	uint32_t* hashes;
+	int* pool;
+	size_t pool_len;
+	size_t pool_capacity;
+	int* table;			// open addressed hash of states, -1 for empty
+	int table_size;
+	int line_start;		// -1 until built
+	int mid_line;
+	int* list;			// scratch for building a state
+	int* stack;
+	int* pending;
+	unsigned* marks;
+	unsigned mark;
+	int flushes;
+} RegexpCache;
+
+Regexp* Regexp_compile(const char* pattern, const char** error);
+void Regexp_destroy(Regexp* re);
+
+RegexpCache* RegexpCache_create(Regexp* re);
+void RegexpCache_destroy(RegexpCache* cache);
+
+int Regexp_scan(Regexp* re, RegexpCache* cache, int* state, const char* data, size_t size);
+int Regexp_finish(Regexp* re, RegexpCache* cache, int* state);
+void Regexp_prime(Regexp* re, RegexpCache* cache, int* state, const char* data, size_t size);
+
+#endif
@@ -0,0 +1,230 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>			// unlink
+#include "scanstate.h"
+#include "dbg.h"
+
+// first line of every state file, version 1 files had no device
+#define SCAN_STATE_HEADER "logfind-state 2"
+#define SCAN_STATE_HEADER_V1 "logfind-state 1"
+
+ScanState* ScanState_create()
+{
+	return calloc(1, sizeof(ScanState));
+}
+
+void ScanState_destroy(ScanState* state)
+{
+	size_t i;
+
+	if (state) {
+		for (i = 0; i < state->count; i++)
+			free(state->entries[i].path);
+		free(state->entries);
+		free(state->by_inode);
+		free(state);
+	}
+}
+
+static int compare_entries(const void* a, const void* b)
+{
+	return strcmp(((const ScanStateEntry*)a)->path, ((const ScanStateEntry*)b)->path);
+}
+
+static int compare_inodes(const void* a, const void* b)
+{
+	const ScanStateEntry* x = *(ScanStateEntry* const*)a;
+	const ScanStateEntry* y = *(ScanStateEntry* const*)b;
+
+	if (x->dev != y->dev)
+		return x->dev < y->dev ? -1 : 1;
+	if (x->inode != y->inode)
+		return x->inode < y->inode ? -1 : 1;
+	return 0;
+}
+
+/* Remember how far into path the search got
+ * Entries are appended unsorted, ScanState_save sorts them.
+ *
+ * Output
+ * 		error: 0 on success, -1 if out of memory
+ */
+int ScanState_add(ScanState* state, const char* path, uint64_t dev, uint64_t inode, int64_t size, int64_t offset)
+{
+	ScanStateEntry* entry = NULL;
+
+	if (state->count == state->capacity) {
+		size_t capacity = state->capacity > 0 ? state->capacity * 2 : 64;
+		ScanStateEntry* grown = realloc(state->entries, capacity * sizeof(ScanStateEntry));
+		check_mem(grown);
+		state->entries = grown;
+		state->capacity = capacity;
+	}
+
+	entry = &state->entries[state->count];
+	entry->path = strdup(path);
+	check_mem(entry->path);
+	entry->dev = dev;
+	entry->inode = inode;
+	entry->size = size;
+	entry->offset = offset;
+	state->count++;
+	return 0;
+
+error:
+	return -1;
+}
+
+ScanStateEntry* ScanState_find(ScanState* state, const char* path)
+{
+	ScanStateEntry key = { .path = (char*)path };
+
+	if (state->count == 0)
+		return NULL;
+	return bsearch(&key, state->entries, state->count, sizeof(ScanStateEntry), compare_entries);
+}
+
+/* Find what a loaded state knows about a file by device and inode
+ * A rotated log is renamed, so the path it was stored under now belongs
+ * to a new file while its own offset is under its old name.
+ *
+ * Output
+ * 		entry: the file's entry, NULL if it wasn't searched last time
+ */
+ScanStateEntry* ScanState_find_inode(ScanState* state, uint64_t dev, uint64_t inode)
+{
+	ScanStateEntry key = { .dev = dev, .inode = inode };
+	ScanStateEntry* key_ptr = &key;
+	ScanStateEntry** found = NULL;
+
+	if (state->by_inode == NULL)
+		return NULL;
+	found = bsearch(&key_ptr, state->by_inode, state->count, sizeof(ScanStateEntry*), compare_inodes);
+	return found != NULL ? *found : NULL;
+}
+
+/* Read the state the last --since-last run left behind
+ * One line per file: device, inode, size and offset, then the path to
+ * the end of the line. A missing file means no file has been searched
+ * yet; unreadable lines are skipped, so their files are searched in
+ * full. Version 1 lines have no device and can only be found by path.
+ *
+ * Input
+ * 		path: state file
+ * Output
+ * 		state: loaded state, NULL only if out of memory
+ */
+ScanState* ScanState_load(const char* path)
+{
+	uint64_t dev = 0;
+	uint64_t inode = 0;
+	int64_t size = 0;
+	int64_t offset = 0;
+	int consumed = 0;
+	char* line = NULL;
+	size_t line_size = 0;
+	ssize_t len = 0;
+	size_t i;
+	int v1 = 0;
+	ScanState* state = ScanState_create();
+	FILE* in = fopen(path, "r");
+	check_mem(state);
+
+	if (in == NULL)
+		return state;
+
+	len = getline(&line, &line_size, in);
+	v1 = len >= 0 && strcmp(line, SCAN_STATE_HEADER_V1 "\n") == 0;
+	if (len < 0 || (!v1 && strcmp(line, SCAN_STATE_HEADER "\n") != 0)) {
+		log_warn("%s isn't a logfind state file, ignoring it", path);
+		goto done;
+	}
+
+	while ((len = getline(&line, &line_size, in)) > 0) {
+		if (line[len - 1] == '\n')
+			line[--len] = '\0';
+		if (v1 && sscanf(line, "%" SCNu64 " %" SCNd64 " %" SCNd64 " %n", &inode, &size, &offset, &consumed) != 3)
+			continue;
+		if (!v1 && sscanf(line, "%" SCNu64 " %" SCNu64 " %" SCNd64 " %" SCNd64 " %n",
+					&dev, &inode, &size, &offset, &consumed) != 4)
+			continue;
+		if (consumed >= len || offset < 0 || offset > size)
+			continue;
+		check(ScanState_add(state, line + consumed, dev, inode, size, offset) == 0, "Couldn't load %s", path);
+	}
+	qsort(state->entries, state->count, sizeof(ScanStateEntry), compare_entries);
+
+	// without a device, an inode could be any file's
+	if (!v1 && state->count > 0) {
+		state->by_inode = malloc(state->count * sizeof(ScanStateEntry*));
+		check_mem(state->by_inode);
+		for (i = 0; i < state->count; i++)
+			state->by_inode[i] = &state->entries[i];
+		qsort(state->by_inode, state->count, sizeof(ScanStateEntry*), compare_inodes);
+	}
+
+done:
+	free(line);
+	fclose(in);
+	return state;
+
+error:
+	free(line);
+	fclose(in);
+	ScanState_destroy(state);
+	return NULL;
+}
+
+/* Write the state out, through a temporary file renamed into place
+ *
+ * Input
+ * 		state: entries to write, sorted here
+ * 		path: state file
+ * Output
+ * 		error: 0 on success, -1 on error
+ */
+int ScanState_save(ScanState* state, const char* path)
+{
+	size_t i;
+	size_t tmp_len = strlen(path) + sizeof(".tmp");
+	char* tmp_path = malloc(tmp_len);
+	FILE* out = NULL;
+	check_mem(tmp_path);
+
+	qsort(state->entries, state->count, sizeof(ScanStateEntry), compare_entries);
+
+	snprintf(tmp_path, tmp_len, "%s.tmp", path);
+	out = fopen(tmp_path, "w");
+	check(out != NULL, "Couldn't write %s", tmp_path);
+
+	fprintf(out, "%s\n", SCAN_STATE_HEADER);
+	for (i = 0; i < state->count; i++) {
+		ScanStateEntry* entry = &state->entries[i];
+		// a path with a newline in it couldn't be read back
+		if (strchr(entry->path, '\n') != NULL)
+			continue;
+		// the same file can come from two globs
+		if (i > 0 && strcmp(state->entries[i - 1].path, entry->path) == 0)
+			continue;
+		fprintf(out, "%" PRIu64 " %" PRIu64 " %" PRId64 " %" PRId64 " %s\n",
+				entry->dev, entry->inode, entry->size, entry->offset, entry->path);
+	}
+
+	check(ferror(out) == 0, "Couldn't write %s", tmp_path);
+	check(fclose(out) == 0, "Couldn't write %s", tmp_path);
+	out = NULL;
+	check(rename(tmp_path, path) == 0, "Couldn't replace %s", path);
+
+	free(tmp_path);
+	return 0;
+
+error:
+	if (out != NULL)
+		fclose(out);
+	if (tmp_path != NULL)
+		unlink(tmp_path);
+	free(tmp_path);
+	return -1;
+}
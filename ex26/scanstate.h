@@ -0,0 +1,33 @@
+#ifndef logfind_scanstate_h
+#define logfind_scanstate_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+// how far into a file the last --since-last run got
+typedef struct ScanStateEntry {
+	char* path;
+	uint64_t dev;			// device and inode follow the file when it's renamed
+	uint64_t inode;			// a different inode under the same path means the file was rotated
+	int64_t size;			// size when it was scanned
+	int64_t offset;			// everything before this has been searched
+} ScanStateEntry;
+
+typedef struct ScanState {
+	ScanStateEntry* entries;	// sorted by path once loaded or saved
+	size_t count;
+	size_t capacity;
+	ScanStateEntry** by_inode;	// loaded state: entries sorted by device and inode
+} ScanState;
+
+ScanState* ScanState_create();
+void ScanState_destroy(ScanState* state);
+
+ScanState* ScanState_load(const char* path);
+int ScanState_save(ScanState* state, const char* path);
+
+ScanStateEntry* ScanState_find(ScanState* state, const char* path);
+ScanStateEntry* ScanState_find_inode(ScanState* state, uint64_t dev, uint64_t inode);
+int ScanState_add(ScanState* state, const char* path, uint64_t dev, uint64_t inode, int64_t size, int64_t offset);
+
+#endif
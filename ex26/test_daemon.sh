@@ -0,0 +1,97 @@
+#!/bin/sh
+# Check that logfind --daemon answers queries and that no client can hold
+# the others up: not one that connects and says nothing, not one that
+# sends its request a bit at a time, not one that doesn't read its answer.
+#
+# usage: ./test_daemon.sh
+
+DIR=$(mktemp -d)
+trap 'kill $DAEMON $CLIENTS 2> /dev/null; rm -rf "$DIR"' EXIT
+
+export LOGFIND_CONFIG="$DIR/logfind.conf"
+export LOGFIND_SOCKET="$DIR/logfind.sock"
+export LOGFIND_INDEX="$DIR/logfind.idx"
+CLIENTS=
+failed=0
+
+# client <idle|slow|noread|stall> <args...>: talk to the daemon by hand
+client() {
+	perl -MSocket -e '
+		my ($path, $mode, @args) = @ARGV;
+		socket(my $s, PF_UNIX, SOCK_STREAM, 0) or die;
+		connect($s, pack_sockaddr_un($path)) or die;
+		my $req = join("", map { "$_\0" } ("logfind", @args));
+		$req = pack("L", length $req) . $req;
+		if ($mode eq "idle") {
+			sleep 10;
+		} elsif ($mode eq "slow") {
+			syswrite($s, substr($req, 0, 3));
+			select(undef, undef, undef, 0.3);
+			syswrite($s, substr($req, 3));
+			local $/;
+			print substr(<$s>, 4);
+		} elsif ($mode eq "noread") {
+			syswrite($s, $req);
+			sleep 10;
+		} elsif ($mode eq "stall") {
+			syswrite($s, substr($req, 0, 2));
+			local $SIG{ALRM} = sub { print "still connected\n"; exit };
+			alarm 5;
+			print sysread($s, my $b, 1) ? "answered\n" : "dropped\n";
+		}
+	' "$LOGFIND_SOCKET" "$@"
+}
+
+# check <what> <want> <got>
+check() {
+	if [ "$3" = "$2" ]; then
+		echo "ok      $1"
+	else
+		echo "FAILED  $1: got '$3', wanted '$2'"
+		failed=1
+	fi
+}
+
+# query <term>: ask the daemon and say how many files matched and if it was quick
+query() {
+	start=$(date +%s.%N)
+	count=$(./logfind "$1" 2> /dev/null | grep -c 'matches by')
+	end=$(date +%s.%N)
+	echo "$count" "$start" "$end" | awk '{ print $1, ($3 - $2 < 0.5 ? "quick" : "slow") }'
+}
+
+mkdir "$DIR/logs" "$DIR/many"
+echo "alpha" > "$DIR/logs/a.log"
+echo "alpha beta" > "$DIR/logs/b.log"
+# enough matches with long names that the answer can't all fit in the socket
+LONG=$(printf '%200s' | tr ' ' 'n')
+i=0
+while [ $i -lt 2000 ]; do
+	echo "gamma" > "$DIR/many/$LONG.$i.log"
+	i=$((i + 1))
+done
+printf '%s\n' "$DIR/logs/*.log" "$DIR/many/*.log" > "$LOGFIND_CONFIG"
+
+./logfind --daemon > /dev/null 2>&1 &
+DAEMON=$!
+while [ ! -S "$LOGFIND_SOCKET" ]; do sleep 0.05; done
+# a search done here instead would find no config
+rm "$LOGFIND_CONFIG"
+
+check "the daemon answers" "2 quick" "$(query alpha)"
+
+client idle alpha & CLIENTS="$CLIENTS $!"
+client idle alpha & CLIENTS="$CLIENTS $!"
+client idle alpha & CLIENTS="$CLIENTS $!"
+sleep 0.2
+check "silent clients don't hold up queries" "1 quick" "$(query beta)"
+
+check "a request sent in pieces is answered" "2" "$(client slow alpha | grep -c 'matches by')"
+
+client noread gamma & CLIENTS="$CLIENTS $!"
+sleep 0.5
+check "a client not reading its answer doesn't hold up queries" "1 quick" "$(query beta)"
+
+check "a client that stalls mid request is dropped" "dropped" "$(client stall alpha)"
+
+exit $failed
@@ -0,0 +1,74 @@
+#!/bin/sh
+# Check that -f reports writes to the files the config patterns match,
+# including ones under a ** that only show up, along with their
+# directories, after following started.
+#
+# usage: ./test_follow.sh
+
+DIR=$(mktemp -d)
+trap 'kill $FOLLOWER 2> /dev/null; rm -rf "$DIR"' EXIT
+
+export LOGFIND_CONFIG="$DIR/logfind.conf"
+LOGFIND=$(pwd)/logfind
+failed=0
+
+# follow <patterns...>: start following them from inside $DIR
+follow() {
+	printf '%s\n' "$@" > "$LOGFIND_CONFIG"
+	(cd "$DIR" && exec "$LOGFIND" -f alpha > "$DIR/got.out" 2> /dev/null) &
+	FOLLOWER=$!
+	sleep 0.5
+}
+
+# expect <what> <paths that should have been reported>
+expect() {
+	what=$1
+	shift
+	sleep 0.5
+	kill $FOLLOWER
+	wait $FOLLOWER 2> /dev/null
+	got=$(sed "s|^$DIR/||; s| matches by.*||" "$DIR/got.out" | sort | tr '\n' ' ')
+	want=$(printf '%s\n' "$@" | sort | sed '/^$/d' | tr '\n' ' ')
+	if [ "$got" = "$want" ]; then
+		echo "ok      $what"
+	else
+		echo "FAILED  $what: got '$got', wanted '$want'"
+		failed=1
+	fi
+}
+
+mkdir -p "$DIR/logs/sub/deep"
+echo "alpha, already there" > "$DIR/logs/top.log"
+echo "alpha, already there" > "$DIR/logs/sub/deep/n.log"
+follow "$DIR/logs/**/*.log"
+echo "alpha" >> "$DIR/logs/top.log"
+echo "alpha" >> "$DIR/logs/sub/deep/n.log"
+echo "beta" >> "$DIR/logs/sub/deep/n.log"
+echo "alpha" > "$DIR/logs/sub/new.log"
+mkdir -p "$DIR/logs/made/later"
+echo "alpha" > "$DIR/logs/made/later/x.log"
+sleep 0.2
+echo "alpha" > "$DIR/logs/made/later/y.log"
+echo "alpha" > "$DIR/logs/made/not-a.txt"
+mkdir "$DIR/logs/.hidden"
+echo "alpha" > "$DIR/logs/.hidden/h.log"
+expect "** follows old, new and newly nested files" \
+	logs/top.log logs/sub/deep/n.log logs/sub/new.log logs/made/later/x.log logs/made/later/y.log
+
+rm -rf "$DIR/logs"
+mkdir -p "$DIR/logs/a/app" "$DIR/logs/b"
+follow "$DIR/logs/*/app/*.log" "$DIR/plain.log"
+echo "alpha" > "$DIR/logs/a/app/1.log"
+mkdir "$DIR/logs/b/app"
+echo "alpha" > "$DIR/logs/b/app/2.log"
+echo "alpha" > "$DIR/logs/b/3.log"
+echo "alpha" > "$DIR/plain.log"
+expect "wildcard directories and plain paths" logs/a/app/1.log logs/b/app/2.log plain.log
+
+rm -rf "$DIR/logs" "$DIR/plain.log"
+follow "*.log"
+echo "alpha" > "$DIR/rel.log"
+echo "alpha" > "$DIR/rel.txt"
+expect "relative patterns" "rel.log"
+
+exit $failed
@@ -0,0 +1,67 @@
+#!/bin/sh
+# Check that logfind has no fixed limits left: a term longer than a read
+# block straddling a 64K boundary, more config patterns and search terms
+# than the old 10 and 5, and a config line longer than the old 512 bytes.
+#
+# usage: ./test_limits.sh
+
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+export LOGFIND_CONFIG="$DIR/logfind.conf"
+failed=0
+
+# expect <what> <files that should match, in order> -- <logfind args...>
+expect() {
+	what=$1
+	shift
+	want=
+	while [ "$1" != "--" ]; do
+		want="$want$1 "
+		shift
+	done
+	shift
+	got=$(./logfind "$@" 2> /dev/null | grep 'matches by' | sed "s|^$DIR/||; s| matches by.*||" | sort | tr '\n' ' ')
+	if [ "$got" = "$want" ]; then
+		echo "ok      $what"
+	else
+		echo "FAILED  $what: got '$got', wanted '$want'"
+		failed=1
+	fi
+}
+
+# a 600 byte term starting 300 bytes before the first 64K boundary
+TERM=$(printf '%600s' | tr ' ' 'T')
+MISS=$(printf '%599sX' | tr ' ' 'T')
+awk 'BEGIN { printf "%65236s", ""; for (i = 0; i < 600; i++) printf "T"; print ""; print "tail" }' > "$DIR/long.log"
+
+echo "/dev/stdin" > "$LOGFIND_CONFIG"
+cat "$DIR/long.log" | expect "long term across a read boundary, piped" /dev/stdin -- "$TERM"
+cat "$DIR/long.log" | expect "one byte off is not a match, piped" -- "$MISS"
+echo "$DIR/long.log" > "$LOGFIND_CONFIG"
+expect "long term across a read boundary, mapped" long.log -- "$TERM"
+
+# 26 patterns, files a to m hold all 13 terms, n to z all but the last
+TERMS="t1 t2 t3 t4 t5 t6 t7 t8 t9 t10 t11 t12 t13"
+: > "$LOGFIND_CONFIG"
+for f in a b c d e f g h i j k l m n o p q r s t u v w x y z; do
+	echo "$DIR/$f.log" >> "$LOGFIND_CONFIG"
+	case $f in
+	[a-m]) echo $TERMS > "$DIR/$f.log" ;;
+	*) echo t1 t2 t3 t4 t5 t6 t7 t8 t9 t10 t11 t12 > "$DIR/$f.log" ;;
+	esac
+done
+expect "26 patterns and 13 terms" \
+	a.log b.log c.log d.log e.log f.log g.log h.log i.log j.log k.log l.log m.log -- $TERMS
+expect "13 terms with -o" \
+	a.log b.log c.log d.log e.log f.log g.log h.log i.log j.log k.log l.log m.log \
+	n.log o.log p.log q.log r.log s.log t.log u.log v.log w.log x.log y.log z.log -- -o t13 x1 x2 x3 x4 x5 x6 x7 x8 x9 x10 x11 t1
+
+# a pattern line of about 700 bytes
+DEEP=$(printf '%200s' | tr ' ' 'd')
+mkdir -p "$DIR/$DEEP/$DEEP/$DEEP"
+echo "t1" > "$DIR/$DEEP/$DEEP/$DEEP/deep.log"
+echo "$DIR/$DEEP/$DEEP/$DEEP/*.log" > "$LOGFIND_CONFIG"
+expect "config line longer than 512 bytes" "$DEEP/$DEEP/$DEEP/deep.log" -- t1
+
+exit $failed
@@ -0,0 +1,51 @@
+#!/bin/sh
+# Check that --since-last only reports lines written since the last run
+# as logs are appended to, rotated, replaced and truncated.
+#
+# usage: ./test_since_last.sh
+
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+export LOGFIND_CONFIG="$DIR/logfind.conf"
+export LOGFIND_STATE="$DIR/logfind.state"
+echo "$DIR/*.log*" > "$LOGFIND_CONFIG"
+failed=0
+
+# expect <what> <files that should match, in order>
+expect() {
+	what=$1
+	shift
+	got=$(./logfind --since-last alpha 2> /dev/null | grep 'matches by' | sed "s|^$DIR/||; s| matches by.*||" | tr '\n' ' ')
+	want=$(echo "$@" | tr ' ' '\n' | sed '/^$/d' | tr '\n' ' ')
+	if [ "$got" = "$want" ]; then
+		echo "ok      $what"
+	else
+		echo "FAILED  $what: got '$got', wanted '$want'"
+		failed=1
+	fi
+}
+
+echo "alpha one" > "$DIR/a.log"
+expect "first run searches everything" a.log
+expect "nothing new, nothing reported"
+
+echo "alpha two" >> "$DIR/a.log"
+expect "appended lines are reported" a.log
+
+mv "$DIR/a.log" "$DIR/a.log.1"
+echo "beta" > "$DIR/a.log"
+expect "a rotated log resumes under its new name"
+
+echo "alpha three" >> "$DIR/a.log.1"
+expect "lines written after rotating are reported" a.log.1
+
+mv "$DIR/a.log.1" "$DIR/a.log.2"
+mv "$DIR/a.log" "$DIR/a.log.1"
+echo "alpha four" > "$DIR/a.log"
+expect "a new file under a rotated name starts over" a.log
+
+echo "alpha" > "$DIR/a.log.2"
+expect "a truncated log is searched again" a.log.2
+
+exit $failed
@@ -0,0 +1,727 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>			// open
+#include <unistd.h>			// close
+#include <sys/mman.h>		// mmap
+#include <sys/stat.h>		// fstat
+#include "trigram_index.h"
+#include "decompress.h"
+#include "dbg.h"
+
+// first bytes of every index file, bump the digit when the layout changes
+#define TRIGRAM_MAGIC "LFTRIGR2"
+static TrigramIndex* TrigramIndex_create()
+{
+	return calloc(1, sizeof(TrigramIndex));
+}
+
+void TrigramIndex_destroy(TrigramIndex* index)
+{
+	uint32_t i;
+
+	if (index) {
+		for (i = 0; index->files != NULL && i < index->file_count; i++) {
+			free(index->files[i].path);
+			free(index->files[i].trigrams);
+		}
+		free(index->files);
+		free(index->keys);
+		free(index->starts);
+		free(index->postings);
+		free(index);
+	}
+}
+
+/*-- LOAD / SAVE --*/
+
+typedef struct IndexReader {
+	const char* data;
+	size_t size;
+	size_t pos;
+} IndexReader;
+
+static int IndexReader_read(IndexReader* reader, void* out, size_t size)
+{
+	if (reader->size - reader->pos < size)
+		return -1;
+	memcpy(out, reader->data + reader->pos, size);
+	reader->pos += size;
+	return 0;
+}
+
+/* Read an index written by TrigramIndex_save
+ * A missing file gives an empty index, so the first run builds one.
+ * So does a damaged or foreign file, the next save replaces it.
+ *
+ * Input
+ * 		path: index file
+ * Output
+ * 		index: loaded index, NULL only if out of memory
+ */
+TrigramIndex* TrigramIndex_load(const char* path)
+{
+	uint32_t i;
+	uint32_t path_len = 0;
+	uint32_t posting_count = 0;
+	char magic[sizeof(TRIGRAM_MAGIC) - 1];
+	char* data = NULL;
+	long size = 0;
+	IndexReader reader = { 0 };
+	TrigramIndex* index = TrigramIndex_create();
+	FILE* in = fopen(path, "rb");
+	check_mem(index);
+
+	if (in == NULL)
+		return index;
+
+	check(fseek(in, 0, SEEK_END) == 0 && (size = ftell(in)) >= 0 && fseek(in, 0, SEEK_SET) == 0,
+			"Couldn't size index %s", path);
+	data = malloc(size > 0 ? size : 1);
+	check_mem(data);
+	check(fread(data, 1, size, in) == (size_t)size, "Couldn't read index %s", path);
+	fclose(in);
+	in = NULL;
+
+	reader.data = data;
+	reader.size = size;
+	if (IndexReader_read(&reader, magic, sizeof(magic)) != 0 || memcmp(magic, TRIGRAM_MAGIC, sizeof(magic)) != 0)
+		goto damaged;
+	if (IndexReader_read(&reader, &index->file_count, sizeof(uint32_t)) != 0
+			|| index->file_count > reader.size)
+		goto damaged;
+
+	index->files = calloc(index->file_count > 0 ? index->file_count : 1, sizeof(TrigramFile));
+	check_mem(index->files);
+	for (i = 0; i < index->file_count; i++) {
+		TrigramFile* file = &index->files[i];
+		if (IndexReader_read(&reader, &path_len, sizeof(uint32_t)) != 0 || path_len > reader.size - reader.pos)
+			goto damaged;
+		file->path = malloc(path_len + 1);
+		check_mem(file->path);
+		IndexReader_read(&reader, file->path, path_len);
+		file->path[path_len] = '\0';
+		if (IndexReader_read(&reader, &file->size, sizeof(int64_t)) != 0
+				|| IndexReader_read(&reader, &file->mtime_sec, sizeof(int64_t)) != 0
+				|| IndexReader_read(&reader, &file->mtime_nsec, sizeof(int64_t)) != 0
+				|| IndexReader_read(&reader, &file->inode, sizeof(uint64_t)) != 0)
+			goto damaged;
+		// lookups bsearch the paths
+		if (i > 0 && strcmp(index->files[i - 1].path, file->path) >= 0)
+			goto damaged;
+	}
+
+	if (IndexReader_read(&reader, &index->key_count, sizeof(uint32_t)) != 0
+			|| index->key_count > TRIGRAM_SPACE)
+		goto damaged;
+	index->keys = malloc((index->key_count > 0 ? index->key_count : 1) * sizeof(uint32_t));
+	index->starts = malloc((index->key_count + 1) * sizeof(uint32_t));
+	check_mem(index->keys);
+	check_mem(index->starts);
+	if (IndexReader_read(&reader, index->keys, index->key_count * sizeof(uint32_t)) != 0
+			|| IndexReader_read(&reader, index->starts, (index->key_count + 1) * sizeof(uint32_t)) != 0)
+		goto damaged;
+
+	posting_count = index->starts[index->key_count];
+	if (index->starts[0] != 0 || posting_count > (reader.size - reader.pos) / sizeof(uint32_t))
+		goto damaged;
+	for (i = 0; i < index->key_count; i++) {
+		if (index->starts[i] > index->starts[i + 1] || (i > 0 && index->keys[i - 1] >= index->keys[i]))
+			goto damaged;
+	}
+	index->postings = malloc((posting_count > 0 ? posting_count : 1) * sizeof(uint32_t));
+	check_mem(index->postings);
+	IndexReader_read(&reader, index->postings, posting_count * sizeof(uint32_t));
+	for (i = 0; i < posting_count; i++) {
+		if (index->postings[i] >= index->file_count)
+			goto damaged;
+	}
+
+	free(data);
+	return index;
+
+damaged:
+	log_warn("Index %s is damaged, rebuilding it", path);
+	free(data);
+	TrigramIndex_destroy(index);
+	return TrigramIndex_create();
+
+error:
+	if (in != NULL)
+		fclose(in);
+	free(data);
+	TrigramIndex_destroy(index);
+	return NULL;
+}
+
+/* Write the index next to path and rename it into place
+ * so a run that dies halfway never leaves a torn index behind
+ *
+ * Input
+ * 		index: index to write
+ * 		path: index file
+ * Output
+ * 		error: 0 on success, -1 on error
+ */
+int TrigramIndex_save(TrigramIndex* index, const char* path)
+{
+	uint32_t i;
+	uint32_t path_len = 0;
+	uint32_t posting_count = index->key_count > 0 ? index->starts[index->key_count] : 0;
+	uint32_t zero = 0;
+	size_t tmp_len = strlen(path) + sizeof(".tmp");
+	char* tmp_path = malloc(tmp_len);
+	FILE* out = NULL;
+	check_mem(tmp_path);
+
+	snprintf(tmp_path, tmp_len, "%s.tmp", path);
+	out = fopen(tmp_path, "wb");
+	check(out != NULL, "Couldn't write index %s", tmp_path);
+
+	fwrite(TRIGRAM_MAGIC, 1, sizeof(TRIGRAM_MAGIC) - 1, out);
+	fwrite(&index->file_count, sizeof(uint32_t), 1, out);
+	for (i = 0; i < index->file_count; i++) {
+		TrigramFile* file = &index->files[i];
+		path_len = strlen(file->path);
+		fwrite(&path_len, sizeof(uint32_t), 1, out);
+		fwrite(file->path, 1, path_len, out);
+		fwrite(&file->size, sizeof(int64_t), 1, out);
+		fwrite(&file->mtime_sec, sizeof(int64_t), 1, out);
+		fwrite(&file->mtime_nsec, sizeof(int64_t), 1, out);
+		fwrite(&file->inode, sizeof(uint64_t), 1, out);
+	}
+	fwrite(&index->key_count, sizeof(uint32_t), 1, out);
+	if (index->key_count > 0) {
+		fwrite(index->keys, sizeof(uint32_t), index->key_count, out);
+		fwrite(index->starts, sizeof(uint32_t), index->key_count + 1, out);
+		fwrite(index->postings, sizeof(uint32_t), posting_count, out);
+	} else {
+		fwrite(&zero, sizeof(uint32_t), 1, out);
+	}
+
+	check(ferror(out) == 0, "Couldn't write index %s", tmp_path);
+	check(fclose(out) == 0, "Couldn't write index %s", tmp_path);
+	out = NULL;
+	check(rename(tmp_path, path) == 0, "Couldn't replace index %s", path);
+
+	free(tmp_path);
+	return 0;
+
+error:
+	if (out != NULL)
+		fclose(out);
+	if (tmp_path != NULL)
+		unlink(tmp_path);
+	free(tmp_path);
+	return -1;
+}
+
+/*-- BUILD --*/
+
+static int compare_paths(const void* a, const void* b)
+{
+	return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+static int compare_trigrams(const void* a, const void* b)
+{
+	uint32_t x = *(const uint32_t*)a;
+	uint32_t y = *(const uint32_t*)b;
+	return (x > y) - (x < y);
+}
+
+/* Find a file in the index
+ *
+ * Output
+ * 		id: the file's id, -1 if it isn't indexed
+ */
+int TrigramIndex_find(TrigramIndex* index, const char* path)
+{
+	int low = 0;
+	int high = (int)index->file_count - 1;
+
+	while (low <= high) {
+		int mid = low + (high - low) / 2;
+		int cmp = strcmp(index->files[mid].path, path);
+		if (cmp == 0)
+			return mid;
+		if (cmp < 0)
+			low = mid + 1;
+		else
+			high = mid - 1;
+	}
+
+	return -1;
+}
+
+// distinct trigrams collected so far from one file
+typedef struct TrigramScan {
+	uint64_t* seen;
+	uint32_t* trigrams;
+	uint32_t count;
+	uint32_t capacity;
+	uint32_t t;				// the last bytes seen, carried from block to block
+	size_t length;			// bytes seen so far
+	int error;
+} TrigramScan;
+
+static int TrigramScan_block(void* context, const char* block, size_t size)
+{
+	size_t i;
+	TrigramScan* scan = context;
+	const unsigned char* data = (const unsigned char*)block;
+
+	for (i = 0; i < size; i++) {
+		scan->t = ((scan->t << 8) | data[i]) & (TRIGRAM_SPACE - 1);
+		if (scan->length + i < 2 || (scan->seen[scan->t >> 6] & (1ULL << (scan->t & 63))))
+			continue;
+		scan->seen[scan->t >> 6] |= 1ULL << (scan->t & 63);
+		if (scan->count == scan->capacity) {
+			uint32_t* grown = realloc(scan->trigrams, scan->capacity * 2 * sizeof(uint32_t));
+			if (grown == NULL) {
+				scan->error = 1;
+				return 1;
+			}
+			scan->trigrams = grown;
+			scan->capacity *= 2;
+		}
+		scan->trigrams[scan->count++] = scan->t;
+	}
+	scan->length += size;
+	return 0;
+}
+
+/* Read a file and collect every distinct trigram in it
+ * seen is a TRIGRAM_SPACE bit scratch map, all clear on entry and exit.
+ * The size, mtime and inode recorded are the ones of the bytes read.
+ * Compressed files are indexed by what they decompress to, which is
+ * what the search will look at.
+ *
+ * Output
+ * 		error: 0 on success, -1 if the file can't be indexed
+ */
+int TrigramFile_extract(TrigramFile* file, uint64_t* seen)
+{
+	struct stat sb;
+	uint32_t i;
+	Codec codec = CODEC_NONE;
+	char* data = MAP_FAILED;
+	TrigramScan scan = { .seen = seen, .capacity = 1024 };
+	int fd = open(file->path, O_RDONLY);
+
+	if (fd < 0)
+		return -1;
+	check(fstat(fd, &sb) == 0 && S_ISREG(sb.st_mode), "Can't index %s", file->path);
+
+	scan.trigrams = malloc(scan.capacity * sizeof(uint32_t));
+	check_mem(scan.trigrams);
+
+	if (sb.st_size > 0) {
+		data = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		check(data != MAP_FAILED, "Couldn't map %s", file->path);
+		madvise(data, sb.st_size, MADV_SEQUENTIAL);
+
+		codec = Codec_detect(data, sb.st_size);
+		if (codec != CODEC_NONE) {
+			check(Decompress_run(codec, data, sb.st_size, -1, TrigramScan_block, &scan) == 0,
+					"Couldn't decompress %s", file->path);
+		} else {
+			TrigramScan_block(&scan, data, sb.st_size);
+		}
+		check(scan.error == 0, "Out of memory indexing %s", file->path);
+		munmap(data, sb.st_size);
+		data = MAP_FAILED;
+	}
+
+	for (i = 0; i < scan.count; i++)
+		seen[scan.trigrams[i] >> 6] &= ~(1ULL << (scan.trigrams[i] & 63));
+	qsort(scan.trigrams, scan.count, sizeof(uint32_t), compare_trigrams);
+
+	file->trigrams = scan.trigrams;
+	file->trigram_count = scan.count;
+	file->size = sb.st_size;
+	file->mtime_sec = sb.st_mtim.tv_sec;
+	file->mtime_nsec = sb.st_mtim.tv_nsec;
+	file->inode = sb.st_ino;
+	close(fd);
+	return 0;
+
+error:
+	if (scan.trigrams != NULL) {
+		for (i = 0; i < scan.count; i++)
+			seen[scan.trigrams[i] >> 6] &= ~(1ULL << (scan.trigrams[i] & 63));
+	}
+	if (data != MAP_FAILED)
+		munmap(data, sb.st_size);
+	free(scan.trigrams);
+	close(fd);
+	return -1;
+}
+
+/* Give each kept file of the old index its own sorted trigram list back
+ * Walking the posting lists in key order appends keys in sorted order.
+ */
+static int TrigramIndex_invert(TrigramIndex* index, const char* keep)
+{
+	uint32_t i, k, p;
+
+	for (k = 0; k < index->key_count; k++) {
+		for (p = index->starts[k]; p < index->starts[k + 1]; p++)
+			index->files[index->postings[p]].trigram_count++;
+	}
+	for (i = 0; i < index->file_count; i++) {
+		if (keep[i]) {
+			index->files[i].trigrams = malloc((index->files[i].trigram_count + 1) * sizeof(uint32_t));
+			check_mem(index->files[i].trigrams);
+		}
+		index->files[i].trigram_count = 0;
+	}
+	for (k = 0; k < index->key_count; k++) {
+		for (p = index->starts[k]; p < index->starts[k + 1]; p++) {
+			TrigramFile* file = &index->files[index->postings[p]];
+			if (file->trigrams != NULL)
+				file->trigrams[file->trigram_count++] = index->keys[k];
+		}
+	}
+
+	return 0;
+
+error:
+	return -1;
+}
+
+// one file's place in the k-way merge of trigram lists
+typedef struct MergeHead {
+	uint32_t trigram;
+	uint32_t file;
+	uint32_t pos;
+} MergeHead;
+
+#define merge_less(A, B) ((A).trigram < (B).trigram || ((A).trigram == (B).trigram && (A).file < (B).file))
+
+static void merge_sift_down(MergeHead* heap, uint32_t size, uint32_t i)
+{
+	for (;;) {
+		uint32_t smallest = i;
+		uint32_t left = 2 * i + 1;
+		uint32_t right = left + 1;
+		if (left < size && merge_less(heap[left], heap[smallest]))
+			smallest = left;
+		if (right < size && merge_less(heap[right], heap[smallest]))
+			smallest = right;
+		if (smallest == i)
+			return;
+		MergeHead tmp = heap[i];
+		heap[i] = heap[smallest];
+		heap[smallest] = tmp;
+		i = smallest;
+	}
+}
+
+/* Build the posting lists from every file's sorted trigram list
+ * A heap merge of the lists by (trigram, file) comes out in exactly the
+ * order the postings are stored in, so nothing needs sorting.
+ */
+static int TrigramIndex_build_postings(TrigramIndex* index)
+{
+	uint32_t i;
+	uint64_t total = 0;
+	uint32_t size = 0;
+	uint32_t posting_count = 0;
+	MergeHead* heap = malloc((index->file_count > 0 ? index->file_count : 1) * sizeof(MergeHead));
+	check_mem(heap);
+
+	for (i = 0; i < index->file_count; i++) {
+		total += index->files[i].trigram_count;
+		if (index->files[i].trigram_count > 0)
+			heap[size++] = (MergeHead){ index->files[i].trigrams[0], i, 0 };
+	}
+	check(total < UINT32_MAX, "Index would have too many postings");
+
+	index->postings = malloc((total > 0 ? total : 1) * sizeof(uint32_t));
+	// at most one key per posting, and never more than TRIGRAM_SPACE
+	index->keys = malloc((total > 0 ? (total < TRIGRAM_SPACE ? total : TRIGRAM_SPACE) : 1) * sizeof(uint32_t));
+	index->starts = malloc(((total < TRIGRAM_SPACE ? total : TRIGRAM_SPACE) + 1) * sizeof(uint32_t));
+	check_mem(index->postings);
+	check_mem(index->keys);
+	check_mem(index->starts);
+
+	for (i = size / 2; i-- > 0;)
+		merge_sift_down(heap, size, i);
+
+	index->key_count = 0;
+	while (size > 0) {
+		MergeHead* top = &heap[0];
+		TrigramFile* file = &index->files[top->file];
+
+		if (index->key_count == 0 || index->keys[index->key_count - 1] != top->trigram) {
+			index->keys[index->key_count] = top->trigram;
+			index->starts[index->key_count++] = posting_count;
+		}
+		index->postings[posting_count++] = top->file;
+
+		if (++top->pos < file->trigram_count)
+			top->trigram = file->trigrams[top->pos];
+		else
+			heap[0] = heap[--size];
+		merge_sift_down(heap, size, 0);
+	}
+	index->starts[index->key_count] = posting_count;
+
+	free(heap);
+	return 0;
+
+error:
+	free(heap);
+	return -1;
+}
+
+/* Bring the index up to date with the files the globs expand to now
+ * Files whose size, mtime or inode changed, and new files, are read
+ * and re-indexed. Unchanged files keep what the old index had for them,
+ * and files no longer in the list are dropped. Anything that can't be
+ * indexed (missing, not a regular file) is left out, and queries treat
+ * files missing from the index as possible matches.
+ *
+ * Input
+ * 		index_addr: index to update, replaced with the new one
+ * 		paths: every file the search will look at, duplicates are fine
+ * 		count: length of paths
+ * Output
+ * 		changed: number of files read and re-indexed, -1 on error
+ */
+int TrigramIndex_update(TrigramIndex** index_addr, char** paths, size_t count)
+{
+	size_t i;
+	size_t unique = 0;
+	size_t indexable = 0;
+	int changed = 0;
+	struct stat sb;
+	TrigramIndex* old = *index_addr;
+	TrigramIndex* index = NULL;
+	char** sorted = malloc((count > 0 ? count : 1) * sizeof(char*));
+	int* from = malloc((count > 0 ? count : 1) * sizeof(int));
+	char* keep = calloc(old->file_count > 0 ? old->file_count : 1, sizeof(char));
+	uint64_t* seen = NULL;
+	check_mem(sorted);
+	check_mem(from);
+	check_mem(keep);
+
+	memcpy(sorted, paths, count * sizeof(char*));
+	qsort(sorted, count, sizeof(char*), compare_paths);
+	for (i = 0; i < count; i++) {
+		if (unique == 0 || strcmp(sorted[unique - 1], sorted[i]) != 0)
+			sorted[unique++] = sorted[i];
+	}
+
+	// which old entries still describe the file on disk
+	for (i = 0; i < unique; i++) {
+		int id = TrigramIndex_find(old, sorted[i]);
+		from[i] = -1;
+		if (stat(sorted[i], &sb) != 0 || !S_ISREG(sb.st_mode)) {
+			// never indexed, and not a change worth rewriting the index for
+			from[i] = -2;
+			continue;
+		}
+		indexable++;
+		if (id >= 0
+				&& old->files[id].size == sb.st_size
+				&& old->files[id].mtime_sec == sb.st_mtim.tv_sec
+				&& old->files[id].mtime_nsec == sb.st_mtim.tv_nsec
+				&& old->files[id].inode == sb.st_ino) {
+			from[i] = id;
+			keep[id] = 1;
+		} else {
+			changed++;
+		}
+	}
+
+	if (changed == 0 && indexable == old->file_count)
+		goto done;
+
+	index = TrigramIndex_create();
+	check_mem(index);
+	index->files = calloc(unique > 0 ? unique : 1, sizeof(TrigramFile));
+	seen = calloc(TRIGRAM_SPACE / 64, sizeof(uint64_t));
+	check_mem(index->files);
+	check_mem(seen);
+	check(TrigramIndex_invert(old, keep) == 0, "Couldn't unpack the old index");
+
+	for (i = 0; i < unique; i++) {
+		TrigramFile* file = &index->files[index->file_count];
+		if (from[i] == -2)
+			continue;
+		if (from[i] >= 0) {
+			// take the kept file over, old no longer owns its path or trigrams
+			*file = old->files[from[i]];
+			old->files[from[i]].path = NULL;
+			old->files[from[i]].trigrams = NULL;
+			index->file_count++;
+			continue;
+		}
+		file->path = strdup(sorted[i]);
+		check_mem(file->path);
+		if (TrigramFile_extract(file, seen) != 0) {
+			debug("Not indexing %s", file->path);
+			free(file->path);
+			memset(file, 0, sizeof(TrigramFile));
+			continue;
+		}
+		index->file_count++;
+	}
+
+	check(TrigramIndex_build_postings(index) == 0, "Couldn't build posting lists");
+	for (i = 0; i < index->file_count; i++) {
+		free(index->files[i].trigrams);
+		index->files[i].trigrams = NULL;
+		index->files[i].trigram_count = 0;
+	}
+
+	TrigramIndex_destroy(old);
+	*index_addr = index;
+	// the list changed even if only removals happened, make sure it gets saved
+	if (changed == 0)
+		changed = 1;
+
+done:
+	free(seen);
+	free(keep);
+	free(from);
+	free(sorted);
+	return changed;
+
+error:
+	free(seen);
+	free(keep);
+	free(from);
+	free(sorted);
+	TrigramIndex_destroy(index);
+	return -1;
+}
+
+/*-- QUERY --*/
+
+static int compare_lengths(const void* a, const void* b)
+{
+	const uint32_t* x = a;
+	const uint32_t* y = b;
+	return (x[1] > y[1]) - (x[1] < y[1]);
+}
+
+/* Files that contain every trigram of one term
+ * Posting lists are intersected shortest first, so the running
+ * result only ever shrinks from the smallest list.
+ *
+ * Output
+ * 		count: number of file ids written to out, -1 if the term is too
+ * 			short to narrow anything down, -2 on error
+ */
+static int TrigramIndex_term_files(TrigramIndex* index, const char* term, uint32_t* out)
+{
+	size_t len = strlen(term);
+	size_t i, j;
+	uint32_t count = 0;
+	uint32_t (*lists)[2] = NULL;	// { key index, length } per trigram
+
+	if (len < 3)
+		return -1;
+
+	lists = malloc((len - 2) * sizeof(*lists));
+	check_mem(lists);
+
+	for (i = 0; i + 2 < len; i++) {
+		uint32_t t = trigram_of(term[i], term[i + 1], term[i + 2]);
+		uint32_t* key = bsearch(&t, index->keys, index->key_count, sizeof(uint32_t), compare_trigrams);
+		if (key == NULL) {
+			// no file has this trigram, so none has the term
+			free(lists);
+			return 0;
+		}
+		lists[i][0] = key - index->keys;
+		lists[i][1] = index->starts[lists[i][0] + 1] - index->starts[lists[i][0]];
+	}
+	qsort(lists, len - 2, sizeof(*lists), compare_lengths);
+
+	memcpy(out, index->postings + index->starts[lists[0][0]], lists[0][1] * sizeof(uint32_t));
+	count = lists[0][1];
+	for (i = 1; i < len - 2 && count > 0; i++) {
+		const uint32_t* list = index->postings + index->starts[lists[i][0]];
+		uint32_t list_len = lists[i][1];
+		uint32_t kept = 0;
+		uint32_t p = 0;
+		for (j = 0; j < count; j++) {
+			while (p < list_len && list[p] < out[j])
+				p++;
+			if (p < list_len && list[p] == out[j])
+				out[kept++] = out[j];
+		}
+		count = kept;
+	}
+
+	free(lists);
+	return count;
+
+error:
+	return -2;
+}
+
+/* Mark the indexed files that could match the search
+ * A file is only ruled out if the trigrams prove it lacks a term: for
+ * AND one missing term is enough, for OR all of them have to be missing.
+ * Terms shorter than a trigram can't rule anything out.
+ *
+ * Input
+ * 		index: up to date index
+ * 		terms: search terms
+ * 		term_count: length of terms
+ * 		or_flag: 1 for OR, 0 for AND
+ * 		candidates: one entry per indexed file, set to 1 if it could match
+ * Output
+ * 		error: 0 on success, -1 on error
+ */
+int TrigramIndex_query(TrigramIndex* index, char** terms, int term_count, int or_flag, char* candidates)
+{
+	int i;
+	int found;
+	uint32_t j;
+	uint32_t* files = malloc((index->file_count > 0 ? index->file_count : 1) * sizeof(uint32_t));
+	char* mark = calloc(index->file_count > 0 ? index->file_count : 1, sizeof(char));
+	check_mem(files);
+	check_mem(mark);
+
+	memset(candidates, or_flag ? 0 : 1, index->file_count);
+
+	for (i = 0; i < term_count; i++) {
+		found = TrigramIndex_term_files(index, terms[i], files);
+		check(found != -2, "Couldn't look up %s", terms[i]);
+
+		if (found == -1) {
+			if (or_flag) {
+				// this term could be anywhere, so could the match
+				memset(candidates, 1, index->file_count);
+				break;
+			}
+			continue;
+		}
+
+		if (or_flag) {
+			for (j = 0; j < (uint32_t)found; j++)
+				candidates[files[j]] = 1;
+		} else {
+			memset(mark, 0, index->file_count);
+			for (j = 0; j < (uint32_t)found; j++)
+				mark[files[j]] = 1;
+			for (j = 0; j < index->file_count; j++)
+				candidates[j] &= mark[j];
+		}
+	}
+
+	free(mark);
+	free(files);
+	return 0;
+
+error:
+	free(mark);
+	free(files);
+	return -1;
+}
@@ -0,0 +1,44 @@
+#ifndef logfind_trigram_index_h
+#define logfind_trigram_index_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+// every possible trigram, three bytes packed into the low 24 bits
+#define TRIGRAM_SPACE (1 << 24)
+
+#define trigram_of(A, B, C) (((uint32_t)(unsigned char)(A) << 16) | ((uint32_t)(unsigned char)(B) << 8) | (unsigned char)(C))
+
+// one indexed file and every distinct trigram in it
+typedef struct TrigramFile {
+	char* path;
+	int64_t size;
+	int64_t mtime_sec;
+	int64_t mtime_nsec;
+	uint64_t inode;
+	uint32_t* trigrams;		// sorted, only filled in while the index is being rebuilt
+	uint32_t trigram_count;
+} TrigramFile;
+
+// which files contain each trigram, like codesearch's index
+// files are sorted by path and posting lists by file id
+typedef struct TrigramIndex {
+	TrigramFile* files;
+	uint32_t file_count;
+	uint32_t* keys;			// sorted trigrams that appear anywhere
+	uint32_t* starts;		// posting list of keys[i] is postings[starts[i] .. starts[i + 1]]
+	uint32_t* postings;		// file ids
+	uint32_t key_count;
+} TrigramIndex;
+
+TrigramIndex* TrigramIndex_load(const char* path);
+int TrigramIndex_save(TrigramIndex* index, const char* path);
+void TrigramIndex_destroy(TrigramIndex* index);
+
+int TrigramIndex_update(TrigramIndex** index_addr, char** paths, size_t count);
+int TrigramFile_extract(TrigramFile* file, uint64_t* seen);
+
+int TrigramIndex_find(TrigramIndex* index, const char* path);
+int TrigramIndex_query(TrigramIndex* index, char** terms, int term_count, int or_flag, char* candidates);
+
+#endif
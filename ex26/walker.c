@@ -0,0 +1,739 @@
+#define _GNU_SOURCE			// O_DIRECTORY, O_CLOEXEC
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <limits.h>			// NAME_MAX
+#include <pwd.h>
+#include <unistd.h>
+#include <dirent.h>			// DT_DIR and friends
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include "walker.h"
+#include "dbg.h"
+
+// directories queued with an open fd at once, past this they're reopened by path
+#define WALK_FD_MAX 256
+// getdents64 reads up to this much of a directory per call
+#define WALK_BUFFER_SIZE (32*1024)
+
+// what getdents64 fills the buffer with
+struct linux_dirent64 {
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+// an entry of the directory being listed, its type looked up only if needed
+typedef struct WalkEntry {
+	const char* name;
+	unsigned char type;		// from getdents64, DT_UNKNOWN if it didn't say
+	int resolved;
+	int exists;				// the entry, or what a symlink points to, is there
+	int is_dir;
+	int is_link;
+	struct stat sb;			// filled in when the type needed a stat
+	int stated;
+} WalkEntry;
+
+static int is_literal(const char* part)
+{
+	return strpbrk(part, "*?[\\") == NULL;
+}
+
+/* Join a directory and a name the way they'd be printed */
+static char* join_path(Arena* arena, const char* dir, const char* name)
+{
+	size_t dir_len = strlen(dir);
+	size_t name_len = strlen(name);
+	int slash = dir_len > 0 && dir[dir_len - 1] != '/';
+	char* path = Arena_alloc(arena, dir_len + slash + name_len + 1);
+
+	if (path != NULL) {
+		memcpy(path, dir, dir_len);
+		path[dir_len] = '/';
+		memcpy(path + dir_len + slash, name, name_len + 1);
+	}
+	return path;
+}
+
+/* ~ and ~user at the start of a pattern, like GLOB_TILDE_CHECK
+ * Output
+ * 		expanded: pattern with the home directory in front, NULL if the user doesn't exist
+ */
+static char* expand_tilde(Arena* arena, const char* pattern)
+{
+	const char* rest = NULL;
+	const char* home = NULL;
+	struct passwd* pw = NULL;
+	char* user = NULL;
+
+	if (pattern[0] != '~')
+		return Arena_strdup(arena, pattern);
+
+	rest = strchr(pattern, '/');
+	if (rest == NULL)
+		rest = pattern + strlen(pattern);
+
+	if (rest == pattern + 1) {
+		home = getenv("HOME");
+		if (home == NULL && (pw = getpwuid(getuid())) != NULL)
+			home = pw->pw_dir;
+	} else {
+		user = Arena_strndup(arena, pattern + 1, rest - pattern - 1);
+		if (user != NULL && (pw = getpwnam(user)) != NULL)
+			home = pw->pw_dir;
+	}
+	if (home == NULL)
+		return NULL;
+
+	char* expanded = Arena_alloc(arena, strlen(home) + strlen(rest) + 1);
+	if (expanded != NULL) {
+		strcpy(expanded, home);
+		strcat(expanded, rest);
+	}
+	return expanded;
+}
+
+/* Cut a pattern into a root with no wildcards and the components after it
+ * Output
+ * 		error: 0 on success, 1 if the pattern can't match anything, -1 if out of memory
+ */
+static int Walker_split(Arena* arena, const char* text, WalkPattern* pattern)
+{
+	char* copy = expand_tilde(arena, text);
+	char* part = NULL;
+	char* save = NULL;
+	int count = 0;
+	size_t root_len = 0;
+
+	memset(pattern, 0, sizeof(WalkPattern));
+	if (copy == NULL)
+		return 1;
+
+	pattern->parts = Arena_alloc(arena, (strlen(copy) / 2 + 1) * sizeof(char*));
+	pattern->root = Arena_alloc(arena, strlen(copy) + 2);
+	check_mem(pattern->parts);
+	check_mem(pattern->root);
+	strcpy(pattern->root, copy[0] == '/' ? "/" : "");
+	root_len = strlen(pattern->root);
+
+	// empty components from doubled slashes drop out here
+	for (part = strtok_r(copy, "/", &save); part != NULL; part = strtok_r(NULL, "/", &save)) {
+		if (count == 0 && is_literal(part)) {
+			// still in the root: no wildcards so far, no need to list anything
+			if (root_len > 0 && pattern->root[root_len - 1] != '/')
+				pattern->root[root_len++] = '/';
+			strcpy(pattern->root + root_len, part);
+			root_len += strlen(part);
+			continue;
+		}
+		// **/** is the same as **
+		if (count > 0 && strcmp(part, "**") == 0 && strcmp(pattern->parts[count - 1], "**") == 0)
+			continue;
+		pattern->parts[count++] = part;
+	}
+	pattern->part_count = count;
+	return 0;
+
+error:
+	return -1;
+}
+
+/* Add a state to a directory's list, along with the states it implies
+ * A directory at "**" is also at whatever follows it, since ** can
+ * match no directories at all.
+ */
+static void add_state(Walker* walker, WalkState* states, int* count, int pattern, int part)
+{
+	int i;
+	WalkPattern* pat = &walker->patterns[pattern];
+
+	while (part < pat->part_count) {
+		for (i = 0; i < *count; i++) {
+			if (states[i].pattern == pattern && states[i].part == part)
+				return;
+		}
+		states[*count].pattern = pattern;
+		states[*count].part = part;
+		(*count)++;
+
+		if (strcmp(pat->parts[part], "**") != 0)
+			break;
+		part++;
+	}
+}
+
+/* Work out whether an entry is a directory, following symlinks
+ * getdents64 already says for most entries, the rest cost a stat.
+ */
+static void resolve_entry(int fd, WalkEntry* entry)
+{
+	if (entry->resolved)
+		return;
+	entry->resolved = 1;
+	entry->exists = 1;
+
+	if (entry->type == DT_DIR) {
+		entry->is_dir = 1;
+		return;
+	}
+	if (entry->type != DT_LNK && entry->type != DT_UNKNOWN)
+		return;
+
+	if (entry->type == DT_UNKNOWN) {
+		if (fstatat(fd, entry->name, &entry->sb, AT_SYMLINK_NOFOLLOW) != 0) {
+			entry->exists = 0;
+			return;
+		}
+		entry->is_link = S_ISLNK(entry->sb.st_mode);
+		entry->is_dir = S_ISDIR(entry->sb.st_mode);
+		entry->stated = !entry->is_link;
+		if (!entry->is_link)
+			return;
+	} else {
+		entry->is_link = 1;
+	}
+
+	// a dangling link matches nothing
+	if (fstatat(fd, entry->name, &entry->sb, 0) != 0) {
+		entry->exists = 0;
+		return;
+	}
+	entry->is_dir = S_ISDIR(entry->sb.st_mode);
+	entry->stated = 1;
+}
+
+static int Walker_record(Walker* walker, int worker, WalkDir* dir, int fd, WalkEntry* entry, int pattern)
+{
+	WalkResults* results = &walker->results[worker];
+	WalkMatch* match = NULL;
+
+	// the (dev, inode) pair is what tells two paths to one file apart
+	if (!entry->stated && fstatat(fd, entry->name, &entry->sb, 0) != 0)
+		return 0;
+	entry->stated = 1;
+
+	if (results->count == results->capacity) {
+		size_t capacity = results->capacity > 0 ? results->capacity * 2 : 256;
+		WalkMatch* grown = realloc(results->matches, capacity * sizeof(WalkMatch));
+		check_mem(grown);
+		results->matches = grown;
+		results->capacity = capacity;
+	}
+
+	match = &results->matches[results->count];
+	match->dev = entry->sb.st_dev;
+	match->inode = entry->sb.st_ino;
+	match->pattern = pattern;
+	match->path = join_path(results->arena, dir->path, entry->name);
+	check_mem(match->path);
+	results->count++;
+	return 0;
+
+error:
+	return -1;
+}
+
+/* Match one directory entry against every state its directory is in
+ * Files that complete a pattern are recorded, directories that get
+ * further into one are queued on children with the states they're at.
+ *
+ * Output
+ * 		error: 0 on success, -1 if out of memory
+ */
+static int Walker_entry(Walker* walker, int worker, WalkDir* dir, int fd, WalkEntry* entry, WalkDir** children)
+{
+	int i;
+	int first = -1;
+	int child_count = 0;
+	WalkResults* results = &walker->results[worker];
+	WalkState* child_states = NULL;
+
+	for (i = 0; i < dir->state_count; i++) {
+		WalkPattern* pat = &walker->patterns[dir->states[i].pattern];
+		int part = dir->states[i].part;
+		int last = part + 1 == pat->part_count;
+		int globstar = strcmp(pat->parts[part], "**") == 0;
+
+		if (globstar ? entry->name[0] == '.' : fnmatch(pat->parts[part], entry->name, FNM_PERIOD) != 0)
+			continue;
+		resolve_entry(fd, entry);
+		if (!entry->exists)
+			return 0;
+
+		if (last && !entry->is_dir) {
+			// the earliest pattern decides where the file is printed
+			if (first < 0 || dir->states[i].pattern < first)
+				first = dir->states[i].pattern;
+			__atomic_store_n(&pat->matched, 1, __ATOMIC_RELAXED);
+		}
+		// ** doesn't follow symlinked directories, so it can't go round in circles
+		if (entry->is_dir && (globstar ? !entry->is_link : !last)) {
+			if (child_states == NULL) {
+				// each state adds at most itself and the ones after a **
+				size_t most = 0;
+				int j;
+				for (j = 0; j < dir->state_count; j++)
+					most += walker->patterns[dir->states[j].pattern].part_count;
+				child_states = Arena_alloc(results->arena, most * sizeof(WalkState));
+				check_mem(child_states);
+			}
+			add_state(walker, child_states, &child_count, dir->states[i].pattern, globstar ? part : part + 1);
+		}
+	}
+
+	if (first >= 0)
+		check(Walker_record(walker, worker, dir, fd, entry, first) == 0, "Couldn't record %s", entry->name);
+
+	if (child_count > 0) {
+		WalkDir* child = Arena_alloc(results->arena, sizeof(WalkDir));
+		check_mem(child);
+		child->path = join_path(results->arena, dir->path, entry->name);
+		check_mem(child->path);
+		child->states = child_states;
+		child->state_count = child_count;
+		child->fd = -1;
+		// opening it now, relative to the parent, skips walking the whole path again
+		if (__atomic_add_fetch(&walker->open_fds, 1, __ATOMIC_RELAXED) <= WALK_FD_MAX)
+			child->fd = openat(fd, entry->name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if (child->fd < 0)
+			__atomic_sub_fetch(&walker->open_fds, 1, __ATOMIC_RELAXED);
+		child->next = *children;
+		*children = child;
+	}
+	return 0;
+
+error:
+	return -1;
+}
+
+/* List one directory and match its entries
+ * When every pattern's next component is a plain name there is no
+ * need to read the directory, each name is looked up directly.
+ */
+static void Walker_list(Walker* walker, int worker, WalkDir* dir)
+{
+	int i;
+	int j;
+	long got = 0;
+	long pos = 0;
+	int literal = 1;
+	WalkDir* children = NULL;
+	WalkDir* tail = NULL;
+	char buffer[WALK_BUFFER_SIZE] __attribute__((aligned(8)));
+	int fd = dir->fd;
+
+	if (fd >= 0)
+		__atomic_sub_fetch(&walker->open_fds, 1, __ATOMIC_RELAXED);
+	else
+		fd = open(dir->path[0] != '\0' ? dir->path : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0) {
+		// a root that isn't there just means no matches
+		if (errno != ENOENT && errno != ENOTDIR)
+			fprintf(stderr, "%s: %s\n", dir->path, strerror(errno));
+		return;
+	}
+	if (walker->visit != NULL)
+		walker->visit(walker->context, dir->path);
+
+	for (i = 0; i < dir->state_count && literal; i++)
+		literal = is_literal(walker->patterns[dir->states[i].pattern].parts[dir->states[i].part]);
+
+	if (literal) {
+		for (i = 0; i < dir->state_count; i++) {
+			const char* name = walker->patterns[dir->states[i].pattern].parts[dir->states[i].part];
+			WalkEntry entry = { .name = name, .type = DT_UNKNOWN };
+			// the same name from two patterns is looked at once, for all of them
+			for (j = 0; j < i; j++) {
+				if (strcmp(name, walker->patterns[dir->states[j].pattern].parts[dir->states[j].part]) == 0)
+					break;
+			}
+			if (j == i && Walker_entry(walker, worker, dir, fd, &entry, &children) != 0)
+				break;
+		}
+	} else {
+		while ((got = syscall(SYS_getdents64, fd, buffer, sizeof(buffer))) > 0) {
+			for (pos = 0; pos < got; ) {
+				struct linux_dirent64* d = (struct linux_dirent64*)(buffer + pos);
+				WalkEntry entry = { .name = d->d_name, .type = d->d_type };
+				pos += d->d_reclen;
+				if (strcmp(d->d_name, ".") == 0 || strcmp(d->d_name, "..") == 0)
+					continue;
+				if (Walker_entry(walker, worker, dir, fd, &entry, &children) != 0) {
+					got = 0;
+					break;
+				}
+			}
+			if (got == 0)
+				break;
+		}
+		if (got < 0)
+			fprintf(stderr, "%s: %s\n", dir->path, strerror(errno));
+	}
+	close(fd);
+
+	if (children != NULL) {
+		// hand them all over in one go
+		for (tail = children; tail->next != NULL; tail = tail->next)
+			;
+		pthread_mutex_lock(&walker->lock);
+		tail->next = walker->queue;
+		walker->queue = children;
+		pthread_cond_broadcast(&walker->ready);
+		pthread_mutex_unlock(&walker->lock);
+	}
+}
+
+static void* Walker_worker(void* arg)
+{
+	WalkerThread* thread = arg;
+	Walker* walker = thread->walker;
+	WalkDir* dir = NULL;
+
+	pthread_mutex_lock(&walker->lock);
+	for (;;) {
+		// nothing queued, but a busy worker may still find more
+		while (walker->queue == NULL && walker->busy > 0)
+			pthread_cond_wait(&walker->ready, &walker->lock);
+		if (walker->queue == NULL)
+			break;
+
+		dir = walker->queue;
+		walker->queue = dir->next;
+		walker->busy++;
+		pthread_mutex_unlock(&walker->lock);
+
+		Walker_list(walker, thread->worker, dir);
+
+		pthread_mutex_lock(&walker->lock);
+		walker->busy--;
+		if (walker->queue == NULL && walker->busy == 0)
+			pthread_cond_broadcast(&walker->ready);
+	}
+	pthread_mutex_unlock(&walker->lock);
+
+	return NULL;
+}
+
+static int compare_inodes(const void* a, const void* b)
+{
+	const WalkMatch* x = a;
+	const WalkMatch* y = b;
+
+	if (x->dev != y->dev)
+		return x->dev < y->dev ? -1 : 1;
+	if (x->inode != y->inode)
+		return x->inode < y->inode ? -1 : 1;
+	if (x->pattern != y->pattern)
+		return x->pattern - y->pattern;
+	return strcmp(x->path, y->path);
+}
+
+static int compare_order(const void* a, const void* b)
+{
+	const WalkMatch* x = a;
+	const WalkMatch* y = b;
+
+	if (x->pattern != y->pattern)
+		return x->pattern - y->pattern;
+	return strcmp(x->path, y->path);
+}
+
+/* Start a walk at every distinct root, plain paths are checked right away */
+static int Walker_seed(Walker* walker, char** patterns)
+{
+	int i;
+	WalkDir* dir = NULL;
+	struct stat sb;
+
+	for (i = 0; i < walker->pattern_count; i++) {
+		WalkPattern* pat = &walker->patterns[i];
+		int rc = Walker_split(walker->arena, patterns[i], pat);
+		check(rc >= 0, "Couldn't take apart %s", patterns[i]);
+		if (rc > 0)
+			continue;
+
+		if (pat->part_count == 0) {
+			// no wildcards at all, it either exists or it doesn't
+			if (stat(pat->root, &sb) == 0 && !S_ISDIR(sb.st_mode)) {
+				WalkEntry entry = { .name = pat->root, .resolved = 1, .exists = 1, .stated = 1, .sb = sb };
+				WalkDir none = { .path = "" };
+				check(Walker_record(walker, 0, &none, AT_FDCWD, &entry, i) == 0, "Couldn't record %s", pat->root);
+				pat->matched = 1;
+			}
+			continue;
+		}
+
+		// patterns under the same root share one walk
+		for (dir = walker->queue; dir != NULL && strcmp(dir->path, pat->root) != 0; dir = dir->next)
+			;
+		if (dir == NULL) {
+			dir = Arena_alloc(walker->arena, sizeof(WalkDir));
+			check_mem(dir);
+			dir->path = pat->root;
+			dir->fd = -1;
+			dir->state_count = 0;
+			dir->states = NULL;
+			dir->next = walker->queue;
+			walker->queue = dir;
+		}
+		WalkState* grown = Arena_grow(walker->arena, dir->states, dir->state_count * sizeof(WalkState),
+				(dir->state_count + pat->part_count) * sizeof(WalkState));
+		check_mem(grown);
+		dir->states = grown;
+		add_state(walker, dir->states, &dir->state_count, i, 0);
+	}
+	return 0;
+
+error:
+	return -1;
+}
+
+/* Find every file the patterns match in one parallel walk
+ * Patterns are shell globs as glob() takes them, plus ** for any
+ * number of directories (hidden ones aside, and symlinked ones aren't
+ * followed). The leading part of a pattern without wildcards is used as
+ * is, and all patterns are matched against each directory in the same
+ * listing, so a directory is read once however many patterns reach it.
+ * Directories are read with getdents64 by nthreads workers that share
+ * one stack of directories to do; each one is opened with openat from
+ * its parent. A file reached through several patterns or paths
+ * (symlinks, hard links) is only listed once.
+ *
+ * Input
+ * 		patterns: strings that match file pattern globs
+ * 		pattern_count: length of patterns array
+ * 		nthreads: workers, 1 walks in the calling thread
+ * 		visit: called with each directory listed, from the worker listing it, can be NULL
+ * 		context: passed to visit
+ * 		arena: where the paths and the list of them are kept
+ * 		files_addr: address to store the list of file paths in
+ * Output
+ * 		count: number of files found, sorted by first pattern then path, -1 on error
+ */
+int Walker_find_files(char** patterns, int pattern_count, int nthreads,
+		Walker_visit visit, void* context, Arena* arena, char*** files_addr)
+{
+	int i;
+	int started = 0;
+	int count = -1;
+	size_t j;
+	size_t total = 0;
+	size_t kept = 0;
+	WalkMatch* all = NULL;
+	pthread_t* threads = NULL;
+	WalkerThread* args = NULL;
+	char** files = NULL;
+	Walker walker = { .pattern_count = pattern_count, .nthreads = nthreads > 0 ? nthreads : 1,
+		.visit = visit, .context = context,
+		.lock = PTHREAD_MUTEX_INITIALIZER, .ready = PTHREAD_COND_INITIALIZER };
+
+	walker.arena = Arena_create(0);
+	walker.patterns = calloc(pattern_count > 0 ? pattern_count : 1, sizeof(WalkPattern));
+	walker.results = calloc(walker.nthreads, sizeof(WalkResults));
+	threads = calloc(walker.nthreads, sizeof(pthread_t));
+	args = calloc(walker.nthreads, sizeof(WalkerThread));
+	check_mem(walker.arena);
+	check_mem(walker.patterns);
+	check_mem(walker.results);
+	check_mem(threads);
+	check_mem(args);
+	for (i = 0; i < walker.nthreads; i++) {
+		walker.results[i].arena = Arena_create(0);
+		check_mem(walker.results[i].arena);
+		args[i].walker = &walker;
+		args[i].worker = i;
+	}
+
+	check(Walker_seed(&walker, patterns) == 0, "Couldn't start the walk");
+
+	// the calling thread is worker 0, the others just help if they start
+	if (walker.queue != NULL) {
+		for (i = 1; i < walker.nthreads; i++, started++) {
+			if (pthread_create(&threads[i], NULL, Walker_worker, &args[i]) != 0) {
+				log_warn("Couldn't start walker %d, continuing with %d", i, i);
+				break;
+			}
+		}
+		Walker_worker(&args[0]);
+		for (i = 1; i <= started; i++)
+			pthread_join(threads[i], NULL);
+	}
+
+	for (i = 0; i < pattern_count; i++) {
+		if (!walker.patterns[i].matched)
+			fprintf(stderr, "%s: %s\n", patterns[i], strerror(ENOENT));
+	}
+
+	// drop every path to a file seen before, keeping the earliest pattern's
+	for (i = 0; i < walker.nthreads; i++)
+		total += walker.results[i].count;
+	all = malloc((total > 0 ? total : 1) * sizeof(WalkMatch));
+	check_mem(all);
+	for (i = 0; i < walker.nthreads; i++) {
+		// a worker that never found anything never allocated its list
+		if (walker.results[i].count == 0)
+			continue;
+		memcpy(all + kept, walker.results[i].matches, walker.results[i].count * sizeof(WalkMatch));
+		kept += walker.results[i].count;
+	}
+	qsort(all, total, sizeof(WalkMatch), compare_inodes);
+	for (j = 0, kept = 0; j < total; j++) {
+		if (kept > 0 && all[kept - 1].dev == all[j].dev && all[kept - 1].inode == all[j].inode)
+			continue;
+		all[kept++] = all[j];
+	}
+	qsort(all, kept, sizeof(WalkMatch), compare_order);
+	debug("Walk found %zu paths to %zu files", total, kept);
+
+	files = Arena_alloc(arena, (kept > 0 ? kept : 1) * sizeof(char*));
+	check_mem(files);
+	for (j = 0; j < kept; j++) {
+		files[j] = Arena_strdup(arena, all[j].path);
+		check_mem(files[j]);
+	}
+	*files_addr = files;
+	count = kept;
+
+error:	// fallthrough
+	// anything a failed walk left queued still holds an fd
+	for (WalkDir* dir = walker.queue; dir != NULL; dir = dir->next) {
+		if (dir->fd >= 0)
+			close(dir->fd);
+	}
+	free(all);
+	if (walker.results) {
+		for (i = 0; i < walker.nthreads; i++) {
+			free(walker.results[i].matches);
+			Arena_destroy(walker.results[i].arena);
+		}
+	}
+	free(walker.results);
+	free(walker.patterns);
+	Arena_destroy(walker.arena);
+	free(threads);
+	free(args);
+	pthread_mutex_destroy(&walker.lock);
+	pthread_cond_destroy(&walker.ready);
+	return count;
+}
+
+/* Cut patterns up the way Walker_find_files matches them, for Walker_match
+ *
+ * Input
+ * 		patterns: strings that match file pattern globs
+ * 		pattern_count: length of patterns array
+ * 		arena: where the pieces are kept
+ * Output
+ * 		patterns: pattern_count of them, NULL if out of memory
+ */
+WalkPattern* Walker_compile(char** patterns, int pattern_count, Arena* arena)
+{
+	int i;
+	WalkPattern* compiled = Arena_alloc(arena, (pattern_count > 0 ? pattern_count : 1) * sizeof(WalkPattern));
+	check_mem(compiled);
+
+	// one that can't match anything is left with no root
+	for (i = 0; i < pattern_count; i++)
+		check(Walker_split(arena, patterns[i], &compiled[i]) >= 0, "Couldn't take apart %s", patterns[i]);
+	return compiled;
+
+error:
+	return NULL;
+}
+
+/* Match what's left of a path against a pattern from parts[part] on
+ * Same rules as Walker_entry: ** only crosses directories that aren't
+ * hidden, and as the last part it matches any file that isn't either.
+ */
+static int match_rest(WalkPattern* pat, int part, const char* rest, int is_dir)
+{
+	char name[NAME_MAX + 1];
+	const char* slash = NULL;
+	size_t len = 0;
+	int last = 0;
+
+	while (*rest == '/')
+		rest++;
+	if (*rest == '\0')
+		return is_dir && part < pat->part_count;
+	if (part == pat->part_count)
+		return 0;
+
+	slash = strchr(rest, '/');
+	len = slash != NULL ? (size_t)(slash - rest) : strlen(rest);
+	if (len > NAME_MAX)
+		return 0;
+	memcpy(name, rest, len);
+	name[len] = '\0';
+	last = slash == NULL;
+
+	if (strcmp(pat->parts[part], "**") == 0) {
+		if (match_rest(pat, part + 1, rest, is_dir))
+			return 1;
+		if (name[0] == '.')
+			return 0;
+		if (last && !is_dir)
+			return part + 1 == pat->part_count;
+		return match_rest(pat, part, rest + len, is_dir);
+	}
+
+	if (fnmatch(pat->parts[part], name, FNM_PERIOD) != 0)
+		return 0;
+	if (last && !is_dir)
+		return part + 1 == pat->part_count;
+	return match_rest(pat, part + 1, rest + len, is_dir);
+}
+
+/* Whether a walk would have found a path, for paths that show up later
+ * A file matches if some pattern leads to it. A directory matches if
+ * some pattern leads into it, so files under it could match and it
+ * would have been listed. Paths have to be spelled the way the walk
+ * prints them.
+ *
+ * Input
+ * 		patterns: from Walker_compile
+ * 		pattern_count: length of patterns array
+ * 		path: file or directory to match
+ * 		is_dir: 1 if path is a directory
+ * Output
+ * 		matched: 1 if it matches, 0 if not
+ */
+int Walker_match(WalkPattern* patterns, int pattern_count, const char* path, int is_dir)
+{
+	int i;
+
+	for (i = 0; i < pattern_count; i++) {
+		WalkPattern* pat = &patterns[i];
+		size_t root_len = 0;
+		const char* rest = NULL;
+
+		if (pat->root == NULL)
+			continue;
+		if (pat->part_count == 0) {
+			// a plain path, only ever the one file
+			if (!is_dir && strcmp(path, pat->root) == 0)
+				return 1;
+			continue;
+		}
+
+		root_len = strlen(pat->root);
+		if (root_len == 0)
+			rest = path;
+		else if (strncmp(path, pat->root, root_len) != 0)
+			continue;
+		else if (pat->root[root_len - 1] == '/' || path[root_len] == '\0' || path[root_len] == '/')
+			rest = path + root_len;
+		else
+			continue;
+
+		if (match_rest(pat, 0, rest, is_dir))
+			return 1;
+	}
+	return 0;
+}
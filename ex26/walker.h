@@ -0,0 +1,78 @@
+#ifndef logfind_walker_h
+#define logfind_walker_h
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include "arena.h"
+
+// told about every directory the walk lists, from whichever worker lists it,
+// spelled the way paths under it are printed: "" for the current directory
+typedef void (*Walker_visit)(void* context, const char* dir);
+
+// one config pattern cut into path components
+typedef struct WalkPattern {
+	char** parts;			// after the root, "**" matches any number of directories
+	int part_count;
+	char* root;				// leading components with no wildcards, "" for the current directory
+	int matched;			// some file matched, set by the workers
+} WalkPattern;
+
+// where a directory stands in a pattern: the next component to match is parts[part]
+typedef struct WalkState {
+	int pattern;
+	int part;
+} WalkState;
+
+// a directory waiting to be listed
+typedef struct WalkDir {
+	char* path;				// as printed, "" for the current directory
+	int fd;					// opened by whoever found it, -1 to open by path
+	WalkState* states;
+	int state_count;
+	struct WalkDir* next;
+} WalkDir;
+
+// a file that matched, before duplicates are dropped
+typedef struct WalkMatch {
+	dev_t dev;
+	ino_t inode;
+	int pattern;			// first pattern that matched it, decides the output order
+	char* path;
+} WalkMatch;
+
+// what each worker found, merged once they're all done
+typedef struct WalkResults {
+	WalkMatch* matches;
+	size_t count;
+	size_t capacity;
+	Arena* arena;			// this worker's paths and queued directories
+} WalkResults;
+
+typedef struct Walker {
+	WalkPattern* patterns;
+	int pattern_count;
+	pthread_mutex_t lock;
+	pthread_cond_t ready;
+	WalkDir* queue;			// directories nobody has taken yet, newest first
+	int busy;				// workers listing a directory, which may queue more
+	int open_fds;			// directories queued with an fd already open
+	WalkResults* results;	// one per worker
+	int nthreads;
+	Walker_visit visit;		// NULL if nobody wants to know
+	void* context;
+	Arena* arena;			// patterns and the directories they start from
+} Walker;
+
+typedef struct WalkerThread {
+	Walker* walker;
+	int worker;
+} WalkerThread;
+
+int Walker_find_files(char** patterns, int pattern_count, int nthreads,
+		Walker_visit visit, void* context, Arena* arena, char*** files_addr);
+
+WalkPattern* Walker_compile(char** patterns, int pattern_count, Arena* arena);
+int Walker_match(WalkPattern* patterns, int pattern_count, const char* path, int is_dir);
+
+#endif
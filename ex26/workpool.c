@@ -0,0 +1,141 @@
+#include <stdlib.h>
+#include "workpool.h"
+#include "dbg.h"
+
+/* Take the next index from a worker's own range */
+static int WorkPool_take(WorkRange* range, size_t* index)
+{
+	int got = 0;
+
+	pthread_mutex_lock(&range->lock);
+	if (range->next < range->end) {
+		*index = range->next++;
+		got = 1;
+	}
+	pthread_mutex_unlock(&range->lock);
+
+	return got;
+}
+
+/* Move the back half of some other worker's range into our own
+ * Victims are tried in order starting after ourselves, so thieves
+ * spread out instead of all hitting worker 0.
+ */
+static int WorkPool_steal(WorkPool* pool, int worker)
+{
+	int i;
+
+	for (i = 1; i < pool->nthreads; i++) {
+		WorkRange* victim = &pool->ranges[(worker + i) % pool->nthreads];
+		size_t start = 0;
+		size_t end = 0;
+
+		pthread_mutex_lock(&victim->lock);
+		if (victim->next < victim->end) {
+			// leave the victim the front half, it's already working towards it
+			end = victim->end;
+			start = victim->end - (victim->end - victim->next + 1) / 2;
+			victim->end = start;
+		}
+		pthread_mutex_unlock(&victim->lock);
+
+		if (start < end) {
+			WorkRange* own = &pool->ranges[worker];
+			pthread_mutex_lock(&own->lock);
+			own->next = start;
+			own->end = end;
+			pthread_mutex_unlock(&own->lock);
+			return 1;
+		}
+	}
+
+	// everything is either done or already being worked on
+	return 0;
+}
+
+static void* WorkPool_worker(void* arg)
+{
+	WorkPoolThread* thread = arg;
+	WorkPool* pool = thread->pool;
+	size_t index = 0;
+
+	do {
+		while (WorkPool_take(&pool->ranges[thread->worker], &index))
+			pool->task(pool->context, thread->worker, index);
+	} while (WorkPool_steal(pool, thread->worker));
+
+	return NULL;
+}
+
+/* Run task for every index in 0 .. count - 1 on nthreads threads
+ * Each worker starts with an even slice of the range. A worker that
+ * runs out steals half of what another one has left, so a few slow
+ * items (one huge file among many small ones) don't leave the other
+ * threads idle. Blocks until every index has been handled.
+ *
+ * Input
+ * 		count: number of indexes to hand out
+ * 		nthreads: worker threads, 1 runs everything in the calling thread
+ * 		task: called once per index
+ * 		context: passed to every task call
+ * Output
+ * 		error: 0 on success, -1 if nothing could be run
+ */
+int WorkPool_run(size_t count, int nthreads, WorkPool_task task, void* context)
+{
+	int i;
+	int started = 0;
+	WorkPool pool = { .nthreads = nthreads, .task = task, .context = context };
+	pthread_t* threads = NULL;
+	WorkPoolThread* args = NULL;
+
+	if (nthreads > 1 && (size_t)nthreads > count)
+		pool.nthreads = nthreads = count > 0 ? count : 1;
+
+	if (nthreads <= 1) {
+		size_t index;
+		for (index = 0; index < count; index++)
+			task(context, 0, index);
+		return 0;
+	}
+
+	pool.ranges = aligned_alloc(64, nthreads * sizeof(WorkRange));
+	threads = calloc(nthreads, sizeof(pthread_t));
+	args = calloc(nthreads, sizeof(WorkPoolThread));
+	check_mem(pool.ranges);
+	check_mem(threads);
+	check_mem(args);
+
+	for (i = 0; i < nthreads; i++) {
+		pthread_mutex_init(&pool.ranges[i].lock, NULL);
+		pool.ranges[i].next = count * i / nthreads;
+		pool.ranges[i].end = count * (i + 1) / nthreads;
+		args[i].pool = &pool;
+		args[i].worker = i;
+	}
+
+	// the calling thread is worker 0, and if a thread can't be started
+	// the ones that did steal its range, so the run still completes
+	for (i = 1; i < nthreads; i++, started++) {
+		if (pthread_create(&threads[i], NULL, WorkPool_worker, &args[i]) != 0) {
+			log_warn("Couldn't start worker %d, continuing with %d", i, i);
+			break;
+		}
+	}
+	WorkPool_worker(&args[0]);
+
+	for (i = 1; i <= started; i++)
+		pthread_join(threads[i], NULL);
+	for (i = 0; i < nthreads; i++)
+		pthread_mutex_destroy(&pool.ranges[i].lock);
+	free(pool.ranges);
+	free(threads);
+	free(args);
+	return 0;
+
+error:
+	free(pool.ranges);
+	free(threads);
+	free(args);
+	return -1;
+}
@@ -0,0 +1,32 @@
+#ifndef logfind_workpool_h
+#define logfind_workpool_h
+
+#include <stddef.h>
+#include <pthread.h>
+
+// called once for every index, worker is 0 .. nthreads - 1
+typedef void (*WorkPool_task)(void* context, int worker, size_t index);
+
+// the part of the index range a worker hasn't started yet
+// padded to a cache line so workers don't slow each other down
+typedef struct WorkRange {
+	pthread_mutex_t lock;
+	size_t next;
+	size_t end;
+} __attribute__((aligned(64))) WorkRange;
+
+typedef struct WorkPool {
+	WorkRange* ranges;
+	int nthreads;
+	WorkPool_task task;
+	void* context;
+} WorkPool;
+
+typedef struct WorkPoolThread {
+	WorkPool* pool;
+	int worker;
+} WorkPoolThread;
+
+int WorkPool_run(size_t count, int nthreads, WorkPool_task task, void* context);
+
+#endif
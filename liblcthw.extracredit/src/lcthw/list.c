@@ -160,63 +160,90 @@ error:
 
 List* List_join(List* src, List* dst)
 {
-	// Join two lists together with src becoming the tail of dst
-	check(src->first->value != NULL, "Can't join NULL to list");
-	check(dst->first->value != NULL, "Can't join list to NULL");
+	// Splice src onto the tail of dst, leaving src empty
+	// Only the end links move, so this is O(1) no matter how long either list is
+	check(src, "Can't join NULL to list");
+	check(dst, "Can't join list to NULL");
 
-	List* head = List_duplicate(dst);
-	check(head, "Error duplicating list head");
-	List* tail = List_duplicate(src);
-	check(tail, "Error duplicating list tail");
+	if (src == dst || src->first == NULL)
+		return dst;
 
-	head->last->next = tail->first;
-	tail->first->prev = head->last;
+	if (dst->last == NULL) {
+		// dst is empty, it simply takes over src's nodes
+		dst->first = src->first;
+	} else {
+		dst->last->next = src->first;
+		src->first->prev = dst->last;
+	}
+	dst->last = src->last;
+	dst->count += src->count;
 
-	// manually bump list length up
-	int i = 0;
-	for(i = 0; i < List_count(tail); i++)
-		head->count++;
+	src->first = NULL;
+	src->last = NULL;
+	src->count = 0;
 
-	return head;
+	return dst;
 error:
 	return NULL;
 }
 
 List** List_split(List* list, char* sentinel)
 {
-	// Split the list into several lists at value
-	// Converts sentinel into an integer 
-	check(list, "Can't split a NULL list");
-	List** set;
+	// Split the list into several lists, each one ending at a node matching sentinel
+	// Nodes are cut out of the list in place, nothing is copied, and list is left empty
+	// Returns a NULL terminated array of lists, free it (and the lists) when done
+	List** set = NULL;
+	int pieces = 0;
 	int i = 0;
-	ListNode* node = calloc(1, sizeof(ListNode));
 
+	check(list, "Can't split a NULL list");
+	check(sentinel, "Can't split on a NULL sentinel");
+
+	// first pass: count the pieces so the set can be allocated once
 	LIST_FOREACH(list, first, next, cur) {
-		// still not safe - will fix later
-		if (strncmp(cur->value, sentinel, 20) == 0) {
-			// generate a new list
-			*(set + i) = List_create();
-			// set the current node as the last link in our list
-			// sentinel is the end of our split
-			(*(set + i))->last = cur;
-			// set beginning of current list to temporary node
-			(*(set + i))->first = node;
-			// use a temporary node to save the beginning of our next list
-			node = cur->next;
-			// modify list count and set count
-			(*(set + i))->count++;
+		if (strcmp(cur->value, sentinel) == 0 || cur->next == NULL)
+			pieces++;
+	}
+
+	set = calloc(pieces + 1, sizeof(List*));
+	check_mem(set);
+	for (i = 0; i < pieces; i++) {
+		set[i] = List_create();
+		check_mem(set[i]);
+	}
+
+	// second pass: hand each run of nodes to its list, cutting after every sentinel
+	ListNode* node = list->first;
+	i = 0;
+	while (node != NULL) {
+		ListNode* next = node->next;
+		List* piece = set[i];
+
+		if (piece->first == NULL)
+			piece->first = node;
+		piece->last = node;
+		piece->count++;
+
+		if (strcmp(node->value, sentinel) == 0 || next == NULL) {
+			node->next = NULL;
+			if (next)
+				next->prev = NULL;
 			i++;
 		}
-	}
-	
-	int j = 0;
-	for (j = 0; j < i; j++) {
-		printf("List %d: ", i);
-		List_print(*(set + i));
+		node = next;
 	}
 
+	list->first = NULL;
+	list->last = NULL;
+	list->count = 0;
+
 	return set;
 error:
+	if (set) {
+		for (i = 0; i < pieces; i++)
+			free(set[i]);
+		free(set);
+	}
 	return NULL;
 }
 
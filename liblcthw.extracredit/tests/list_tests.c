@@ -1,6 +1,7 @@
 #include "minunit.h"
 #include <lcthw/list.h>
 #include <assert.h>
+#include <time.h>
 
 static List* list = NULL;
 char* test1 = "test1 data";
@@ -136,12 +137,58 @@ char* test_join()
 
 	List* result = List_join(tail, list);
 
-	int sum = (int)List_count(tail) + (int)List_count(list);
+	mu_assert(result == list, "Join should splice into dst.");
+	mu_assert((int)List_count(result) == 6, "Mismatched lengths");
+	mu_assert(tail->first == NULL && tail->last == NULL && tail->count == 0, "Join should empty src.");
+	mu_assert(List_last(result) == test6, "Wrong last after join.");
+	mu_assert(result->first->next->next->next->value == test4, "Wrong link at the seam.");
+	mu_assert(result->last->prev->prev->prev->value == test3, "Wrong prev link at the seam.");
+
+	// joining an empty list changes nothing, joining into one moves everything
+	List_join(tail, list);
+	mu_assert((int)List_count(list) == 6, "Joining an empty list changed dst.");
+	List_join(list, tail);
+	mu_assert((int)List_count(tail) == 6 && list->count == 0, "Joining into an empty list failed.");
+	mu_assert(List_first(tail) == test1 && List_last(tail) == test6, "Wrong ends after joining into empty.");
+
+	while (List_pop(tail));
+	List_destroy(tail);
 
-	mu_assert((int)List_count(result) == sum, "Mismatched lengths");
+	return NULL;
+}
 
-	List_clear(result);
-	List_destroy(tail);
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+char* test_join_bench()
+{
+	// join cost should not depend on the length of either list
+	int sizes[] = { 1000, 1000000 };
+	int s = 0;
+	int i = 0;
+
+	for (s = 0; s < 2; s++) {
+		List* a = List_create();
+		List* b = List_create();
+		for (i = 0; i < sizes[s]; i++) {
+			List_push(a, test1);
+			List_push(b, test2);
+		}
+
+		double start = now();
+		List_join(b, a);
+		double elapsed = now() - start;
+
+		mu_assert(a->count == sizes[s] * 2 && b->count == 0, "Wrong counts after join.");
+		printf("joining two %d element lists: %.2fus\n", sizes[s], elapsed * 1e6);
+
+		List_destroy(a);
+		List_destroy(b);
+	}
 
 	return NULL;
 }
@@ -155,12 +202,29 @@ char* test_split()
 	List_push(list, test2);
 	List_push(list, test5);
 	List_push(list, test2);
+	List_push(list, test6);
+	ListNode* third = list->first->next->next;
+
+	List** set = List_split(list, "test2 data");
+	mu_assert(set != NULL, "Split failed.");
+	mu_assert(list->count == 0 && list->first == NULL, "Split should empty the list.");
+
+	// [test1 test2] [test3 test4 test2] [test5 test2] [test6]
+	int counts[] = { 2, 3, 2, 1 };
+	int i = 0;
+	for (i = 0; set[i] != NULL; i++) {
+		mu_assert(i < 4, "Too many pieces.");
+		mu_assert(set[i]->count == counts[i], "Wrong piece length.");
+		mu_assert(set[i]->first->prev == NULL && set[i]->last->next == NULL, "Piece not cut loose.");
+	}
+	mu_assert(i == 4, "Wrong number of pieces.");
+	mu_assert(set[1]->first == third, "Split copied nodes instead of moving them.");
+	mu_assert(List_last(set[2]) == test2 && List_first(set[3]) == test6, "Wrong piece ends.");
+
+	for (i = 0; set[i] != NULL; i++)
+		List_destroy(set[i]);
+	free(set);
 
-	char* sent = malloc(11*sizeof(char));
-	sent = "test2 data";
-	List** set = List_split(list, sent);
-	
-//	free(sent);
 	return NULL;
 }
 
@@ -173,7 +237,8 @@ char* all_tests()
 	mu_run_test(test_unshift);
 	mu_run_test(test_remove);
 	mu_run_test(test_shift);
-//	mu_run_test(test_join);
+	mu_run_test(test_join);
+	mu_run_test(test_join_bench);
 //	mu_run_test(test_duplicate);
 	mu_run_test(test_split);
 	mu_run_test(test_print);
@@ -0,0 +1,265 @@
+#include <lcthw/chunked_list.h>
+#include <lcthw/dbg.h>
+
+ChunkedList* ChunkedList_create()
+{
+	return calloc(1, sizeof(ChunkedList));
+}
+
+void ChunkedList_destroy(ChunkedList* list)
+{
+	ChunkNode* chunk = list->first;
+	while (chunk) {
+		ChunkNode* next = chunk->next;
+		free(chunk);
+		chunk = next;
+	}
+	free(list);
+}
+
+void ChunkedList_clear(ChunkedList* list)
+{
+	CHUNKED_LIST_FOREACH(list, first, next, cur) {
+		free(ChunkedList_value(cur));
+	}
+}
+
+void ChunkedList_clear_destroy(ChunkedList* list)
+{
+	ChunkedList_clear(list);
+	ChunkedList_destroy(list);
+}
+
+/* Unlink an empty chunk from the list and free it */
+static void ChunkedList_drop_chunk(ChunkedList* list, ChunkNode* chunk)
+{
+	if (chunk->prev)
+		chunk->prev->next = chunk->next;
+	else
+		list->first = chunk->next;
+
+	if (chunk->next)
+		chunk->next->prev = chunk->prev;
+	else
+		list->last = chunk->prev;
+
+	free(chunk);
+}
+
+void ChunkedList_push(ChunkedList* list, void* value)
+{
+	check(list, "Can't push to a NULL list");
+	check(value != NULL, "ChunkedList_push: value cannot be NULL");
+
+	ChunkNode* chunk = list->last;
+
+	if (chunk == NULL || chunk->start + chunk->count == CHUNKED_LIST_CAPACITY) {
+		// no room at the end of the last chunk, start a new one
+		chunk = calloc(1, sizeof(ChunkNode));
+		check_mem(chunk);
+
+		chunk->prev = list->last;
+		if (list->last)
+			list->last->next = chunk;
+		else
+			list->first = chunk;
+		list->last = chunk;
+	}
+
+	chunk->values[chunk->start + chunk->count] = value;
+	chunk->count++;
+	list->count++;
+
+	// fallthrough
+error:
+	return;
+}
+
+void* ChunkedList_pop(ChunkedList* list)
+{
+	ChunkNode* chunk = list->last;
+	if (chunk == NULL)
+		return NULL;
+
+	chunk->count--;
+	list->count--;
+	void* value = chunk->values[chunk->start + chunk->count];
+
+	if (chunk->count == 0)
+		ChunkedList_drop_chunk(list, chunk);
+
+	return value;
+}
+
+void ChunkedList_unshift(ChunkedList* list, void* value)
+{
+	check(list, "Can't unshift a NULL list");
+	check(value != NULL, "ChunkedList_unshift: value cannot be NULL");
+
+	ChunkNode* chunk = list->first;
+
+	if (chunk == NULL || chunk->start == 0) {
+		// no room at the front of the first chunk, start a new one
+		// filled from the back so further unshifts have room
+		chunk = calloc(1, sizeof(ChunkNode));
+		check_mem(chunk);
+		chunk->start = CHUNKED_LIST_CAPACITY;
+
+		chunk->next = list->first;
+		if (list->first)
+			list->first->prev = chunk;
+		else
+			list->last = chunk;
+		list->first = chunk;
+	}
+
+	chunk->start--;
+	chunk->values[chunk->start] = value;
+	chunk->count++;
+	list->count++;
+
+	// fallthrough
+error:
+	return;
+}
+
+void* ChunkedList_shift(ChunkedList* list)
+{
+	ChunkNode* chunk = list->first;
+	if (chunk == NULL)
+		return NULL;
+
+	void* value = chunk->values[chunk->start];
+	chunk->start++;
+	chunk->count--;
+	list->count--;
+
+	if (chunk->count == 0)
+		ChunkedList_drop_chunk(list, chunk);
+
+	return value;
+}
+
+/* Even out a chunk that fell below half full with its neighbour
+ * If both fit in one chunk they're merged and the later one freed,
+ * otherwise the values are split evenly between the two, so every chunk
+ * but the first and last stays at least half full however values are
+ * removed. The iterator, if it's on one of the two, is moved along with
+ * the value it's on.
+ *
+ * Input
+ * 		list: list the chunk is in
+ * 		chunk: chunk with fewer than CHUNKED_LIST_CAPACITY / 2 values
+ * 		iter: iterator to keep on its value
+ */
+static void ChunkedList_rebalance(ChunkedList* list, ChunkNode* chunk, ChunkedListIter* iter)
+{
+	void* values[CHUNKED_LIST_CAPACITY * 2];
+	ChunkNode* a = NULL;
+	ChunkNode* b = NULL;
+	int position = -1;
+	int total = 0;
+
+	// the emptier neighbour is the likelier merge
+	if (chunk->prev && (chunk->next == NULL || chunk->prev->count < chunk->next->count)) {
+		a = chunk->prev;
+		b = chunk;
+	} else if (chunk->next) {
+		a = chunk;
+		b = chunk->next;
+	} else {
+		return;
+	}
+
+	if (iter->chunk == a)
+		position = iter->index - a->start;
+	else if (iter->chunk == b)
+		position = a->count + iter->index - b->start;
+
+	memcpy(values, &a->values[a->start], a->count * sizeof(void*));
+	memcpy(&values[a->count], &b->values[b->start], b->count * sizeof(void*));
+	total = a->count + b->count;
+
+	if (total <= CHUNKED_LIST_CAPACITY) {
+		memcpy(a->values, values, total * sizeof(void*));
+		a->start = 0;
+		a->count = total;
+		ChunkedList_drop_chunk(list, b);
+		if (position >= 0) {
+			iter->chunk = a;
+			iter->index = position;
+		}
+	} else {
+		a->start = 0;
+		a->count = total / 2;
+		memcpy(a->values, values, a->count * sizeof(void*));
+		b->start = 0;
+		b->count = total - a->count;
+		memcpy(b->values, &values[a->count], b->count * sizeof(void*));
+		if (position >= 0) {
+			iter->chunk = position < a->count ? a : b;
+			iter->index = position < a->count ? position : position - a->count;
+		}
+	}
+}
+
+/* Remove the value under an iterator
+ * A chunk left less than half full is merged with or borrows from a
+ * neighbour, so removing most of a long list gives its memory back
+ * instead of leaving it spread thin over nearly empty chunks.
+ * Afterwards the iterator sits on the value that follows in its walking
+ * direction and is flagged so the next step doesn't skip over it, which
+ * makes removing inside CHUNKED_LIST_FOREACH safe.
+ *
+ * Input
+ * 		list: list to remove from
+ * 		iter: iterator pointing at the value to remove
+ * Output
+ * 		value: the removed value, NULL on error
+ */
+void* ChunkedList_remove(ChunkedList* list, ChunkedListIter* iter)
+{
+	void* result = NULL;
+
+	check(list->first && list->last, "List is empty.");
+	check(iter && iter->chunk, "ChunkedList_remove: iterator isn't on a value");
+
+	ChunkNode* chunk = iter->chunk;
+	int index = iter->index;
+	int end = chunk->start + chunk->count;
+
+	result = chunk->values[index];
+
+	// close the gap by moving the later values down one slot
+	memmove(&chunk->values[index], &chunk->values[index + 1], (end - index - 1) * sizeof(void*));
+	chunk->count--;
+	list->count--;
+	end--;
+	// an empty chunk is dropped below, a thin one evened out at the end
+	int thin = chunk->count > 0 && chunk->count < CHUNKED_LIST_CAPACITY / 2;
+
+	if (chunk->count == 0) {
+		iter->chunk = iter->step > 0 ? chunk->next : chunk->prev;
+		if (iter->chunk)
+			iter->index = iter->step > 0 ? iter->chunk->start : iter->chunk->start + iter->chunk->count - 1;
+		ChunkedList_drop_chunk(list, chunk);
+	} else if (iter->step > 0 && index == end) {
+		// removed the last value of the chunk, carry on in the next one
+		iter->chunk = chunk->next;
+		iter->index = iter->chunk ? iter->chunk->start : 0;
+	} else if (iter->step < 0) {
+		iter->index = index - 1;
+		if (iter->index < chunk->start) {
+			iter->chunk = chunk->prev;
+			iter->index = iter->chunk ? iter->chunk->start + iter->chunk->count - 1 : 0;
+		}
+	}
+	iter->removed = 1;
+
+	if (thin)
+		ChunkedList_rebalance(list, chunk, iter);
+
+	// fallthrough
+error:
+	return result;
+}
@@ -0,0 +1,96 @@
+#ifndef lcthw_ChunkedList_h
+#define lcthw_ChunkedList_h
+
+#include <stdlib.h>
+
+// number of values stored in each chunk
+#define CHUNKED_LIST_CAPACITY 32
+
+// element in the chunked list, holds up to CHUNKED_LIST_CAPACITY values
+typedef struct ChunkNode {
+	struct ChunkNode* next;
+	struct ChunkNode* prev;
+	int start;			// index of the first used slot in values
+	int count;			// used slots, always values[start] .. values[start + count - 1]
+	void* values[CHUNKED_LIST_CAPACITY];
+} ChunkNode;
+
+// container for linked ChunkNode structs
+typedef struct ChunkedList {
+	int count;			// number of values, not chunks
+	ChunkNode* first;	// cannot be NULL when count > 0
+	ChunkNode* last;
+} ChunkedList;
+
+// position of one value inside a ChunkedList
+typedef struct ChunkedListIter {
+	ChunkNode* chunk;	// NULL once the walk is done
+	int index;			// slot inside chunk->values
+	int step;			// 1 walking first to last, -1 walking last to first
+	int removed;		// value under the iterator was removed, don't step past the next one
+} ChunkedListIter;
+
+ChunkedList* ChunkedList_create();
+void ChunkedList_destroy(ChunkedList* list);
+void ChunkedList_clear(ChunkedList* list);
+void ChunkedList_clear_destroy(ChunkedList* list);
+
+#define ChunkedList_count(A) ((A)->count)
+#define ChunkedList_first(A) ((A)->first != NULL ? (A)->first->values[(A)->first->start] : NULL)
+#define ChunkedList_last(A) ((A)->last != NULL ? (A)->last->values[(A)->last->start + (A)->last->count - 1] : NULL)
+#define ChunkedList_value(I) ((I).chunk->values[(I).index])
+
+void ChunkedList_push(ChunkedList* list, void* value);
+void* ChunkedList_pop(ChunkedList* list);
+void ChunkedList_unshift(ChunkedList* list, void* value);
+void* ChunkedList_shift(ChunkedList* list);
+void* ChunkedList_remove(ChunkedList* list, ChunkedListIter* iter);
+
+static inline ChunkedListIter ChunkedList_iter_first(ChunkedList* list)
+{
+	ChunkedListIter iter = { list->first, list->first ? list->first->start : 0, 1, 0 };
+	return iter;
+}
+
+static inline ChunkedListIter ChunkedList_iter_last(ChunkedList* list)
+{
+	ChunkedListIter iter = { list->last, list->last ? list->last->start + list->last->count - 1 : 0, -1, 0 };
+	return iter;
+}
+
+static inline void ChunkedList_iter_next(ChunkedListIter* iter)
+{
+	if (iter->removed) {
+		// remove already moved us onto the next value
+		iter->removed = 0;
+		return;
+	}
+
+	iter->index++;
+	if (iter->index == iter->chunk->start + iter->chunk->count) {
+		iter->chunk = iter->chunk->next;
+		iter->index = iter->chunk ? iter->chunk->start : 0;
+	}
+}
+
+static inline void ChunkedList_iter_prev(ChunkedListIter* iter)
+{
+	if (iter->removed) {
+		iter->removed = 0;
+		return;
+	}
+
+	iter->index--;
+	if (iter->index < iter->chunk->start) {
+		iter->chunk = iter->chunk->prev;
+		iter->index = iter->chunk ? iter->chunk->start + iter->chunk->count - 1 : 0;
+	}
+}
+
+// same shape as LIST_FOREACH: S is first or last, M is next or prev and
+// V is a ChunkedListIter, use ChunkedList_value(V) to get at the value
+#define CHUNKED_LIST_FOREACH(L, S, M, V)\
+			ChunkedListIter V;\
+for(V = ChunkedList_iter_##S(L); V.chunk != NULL; ChunkedList_iter_##M(&V))
+
+#endif
@@ -0,0 +1,358 @@
+#include <lcthw/concurrent_queue.h>
+#include <lcthw/dbg.h>
+#include <pthread.h>
+
+/*-- HAZARD POINTERS --*/
+
+// every thread publishes the nodes it is about to dereference here
+#define HAZARDS_PER_THREAD 2
+// retired nodes are only scanned for once a thread has this many
+#define RETIRE_THRESHOLD 64
+
+// one per thread that has touched a queue, reused after the thread exits
+// and freed once the last queue is destroyed
+typedef struct HazardRecord {
+	_Atomic(CQNode*) hazard[HAZARDS_PER_THREAD];
+	atomic_int active;
+	struct HazardRecord* next;
+	CQNode** retired;			// unlinked nodes waiting to be freed
+	int retired_count;
+	int retired_max;
+} HazardRecord;
+
+static _Atomic(HazardRecord*) hazard_records = NULL;
+static atomic_int hazard_record_count = 0;
+static _Thread_local HazardRecord* my_record = NULL;
+static pthread_key_t hazard_key;
+static pthread_once_t hazard_once = PTHREAD_ONCE_INIT;
+// taken by create, destroy and exiting threads, never by push or shift
+static pthread_mutex_t hazard_lock = PTHREAD_MUTEX_INITIALIZER;
+static int live_queues = 0;
+
+static void hazard_release(void* arg);
+
+static void hazard_init()
+{
+	pthread_key_create(&hazard_key, hazard_release);
+}
+
+static HazardRecord* hazard_acquire()
+{
+	HazardRecord* record = NULL;
+
+	if (my_record)
+		return my_record;
+
+	pthread_once(&hazard_once, hazard_init);
+
+	// try to take over a record left behind by a thread that exited
+	for (record = atomic_load(&hazard_records); record != NULL; record = record->next) {
+		int expected = 0;
+		if (atomic_load(&record->active) == 0 &&
+				atomic_compare_exchange_strong(&record->active, &expected, 1))
+			break;
+	}
+
+	if (record == NULL) {
+		record = calloc(1, sizeof(HazardRecord));
+		check_mem(record);
+		atomic_store(&record->active, 1);
+
+		// count first, so a scan never sees more records than it made room for
+		atomic_fetch_add(&hazard_record_count, 1);
+		HazardRecord* head = atomic_load(&hazard_records);
+		do {
+			record->next = head;
+		} while (!atomic_compare_exchange_weak(&hazard_records, &head, record));
+	}
+
+	pthread_setspecific(hazard_key, record);
+	my_record = record;
+
+	// fallthrough
+error:
+	return record;
+}
+
+static int hazard_contains(CQNode** hazards, int count, CQNode* node)
+{
+	int i = 0;
+	for (i = 0; i < count; i++) {
+		if (hazards[i] == node)
+			return 1;
+	}
+	return 0;
+}
+
+/* Free every retired node that no thread currently has a hazard on */
+static void hazard_scan(HazardRecord* mine)
+{
+	int max = atomic_load(&hazard_record_count) * HAZARDS_PER_THREAD;
+	CQNode** hazards = malloc(max * sizeof(CQNode*));
+	HazardRecord* record = NULL;
+	int count = 0;
+	int i = 0;
+	int kept = 0;
+
+	// try again on the next retire if we can't even get the snapshot
+	if (hazards == NULL)
+		return;
+
+	for (record = atomic_load(&hazard_records); record != NULL; record = record->next) {
+		for (i = 0; i < HAZARDS_PER_THREAD && count < max; i++) {
+			CQNode* node = atomic_load(&record->hazard[i]);
+			if (node)
+				hazards[count++] = node;
+		}
+	}
+
+	for (i = 0; i < mine->retired_count; i++) {
+		if (hazard_contains(hazards, count, mine->retired[i]))
+			mine->retired[kept++] = mine->retired[i];
+		else
+			free(mine->retired[i]);
+	}
+	mine->retired_count = kept;
+
+	free(hazards);
+}
+
+static void hazard_retire(HazardRecord* mine, CQNode* node)
+{
+	if (mine->retired_count == mine->retired_max) {
+		int max = mine->retired_max ? mine->retired_max * 2 : RETIRE_THRESHOLD * 2;
+		CQNode** retired = realloc(mine->retired, max * sizeof(CQNode*));
+		if (retired == NULL) {
+			// leaking one node beats freeing it under someone's feet
+			log_err("Out of memory retiring a queue node.");
+			return;
+		}
+		mine->retired = retired;
+		mine->retired_max = max;
+	}
+
+	mine->retired[mine->retired_count++] = node;
+
+	if (mine->retired_count >= RETIRE_THRESHOLD + atomic_load(&hazard_record_count) * HAZARDS_PER_THREAD)
+		hazard_scan(mine);
+}
+
+/* Publish a hazard on whatever src points to and make sure it stuck */
+static CQNode* hazard_protect(HazardRecord* mine, int slot, _Atomic(CQNode*)* src)
+{
+	CQNode* node = atomic_load(src);
+	CQNode* again = NULL;
+
+	while (1) {
+		atomic_store(&mine->hazard[slot], node);
+		again = atomic_load(src);
+		if (again == node)
+			return node;
+		node = again;
+	}
+}
+
+/* A thread that used a queue is exiting
+ * Whatever it retired that nobody has a hazard on any more is freed
+ * now, the rest stays with the record for the next owner or for the
+ * last ConcurrentQueue_destroy. Runs under hazard_lock so it can't walk
+ * the records while that destroy frees them.
+ */
+static void hazard_release(void* arg)
+{
+	HazardRecord* record = arg;
+	int i = 0;
+
+	pthread_mutex_lock(&hazard_lock);
+	for (i = 0; i < HAZARDS_PER_THREAD; i++)
+		atomic_store(&record->hazard[i], NULL);
+	if (record->retired_count > 0)
+		hazard_scan(record);
+	atomic_store(&record->active, 0);
+	pthread_mutex_unlock(&hazard_lock);
+}
+
+/* Free what the records hold once no queue is left
+ * With no queue alive no thread can be inside a push or shift, so
+ * every retired node is garbage. Records of threads that exited are
+ * freed along with the caller's own, records still owned by other
+ * threads are kept since those threads point at them. Call with
+ * hazard_lock held.
+ */
+static void hazard_reclaim()
+{
+	HazardRecord* record = atomic_load(&hazard_records);
+	HazardRecord* kept = NULL;
+	int i = 0;
+
+	while (record != NULL) {
+		HazardRecord* next = record->next;
+
+		for (i = 0; i < record->retired_count; i++)
+			free(record->retired[i]);
+		record->retired_count = 0;
+
+		if (record == my_record || atomic_load(&record->active) == 0) {
+			free(record->retired);
+			free(record);
+			atomic_fetch_sub(&hazard_record_count, 1);
+		} else {
+			record->next = kept;
+			kept = record;
+		}
+		record = next;
+	}
+	atomic_store(&hazard_records, kept);
+
+	if (my_record != NULL) {
+		// so this thread exiting doesn't release the freed record
+		pthread_setspecific(hazard_key, NULL);
+		my_record = NULL;
+	}
+}
+
+/*-- QUEUE --*/
+
+ConcurrentQueue* ConcurrentQueue_create()
+{
+	ConcurrentQueue* queue = aligned_alloc(CONCURRENT_QUEUE_CACHE_LINE, sizeof(ConcurrentQueue));
+	check_mem(queue);
+
+	// head and tail start out on the same dummy node
+	CQNode* dummy = calloc(1, sizeof(CQNode));
+	check_mem(dummy);
+
+	atomic_init(&queue->head, dummy);
+	atomic_init(&queue->tail, dummy);
+
+	pthread_mutex_lock(&hazard_lock);
+	live_queues++;
+	pthread_mutex_unlock(&hazard_lock);
+
+	return queue;
+error:
+	free(queue);
+	return NULL;
+}
+
+void ConcurrentQueue_destroy(ConcurrentQueue* queue)
+{
+	// no other thread may be using the queue any more
+	CQNode* node = atomic_load(&queue->head);
+	while (node) {
+		CQNode* next = atomic_load(&node->next);
+		free(node);
+		node = next;
+	}
+	free(queue);
+
+	pthread_mutex_lock(&hazard_lock);
+	live_queues--;
+	if (live_queues == 0)
+		hazard_reclaim();
+	pthread_mutex_unlock(&hazard_lock);
+}
+
+void ConcurrentQueue_push(ConcurrentQueue* queue, void* value)
+{
+	CQNode* node = NULL;
+	HazardRecord* mine = NULL;
+
+	check(queue, "Can't push to a NULL queue");
+	check(value != NULL, "ConcurrentQueue_push: value cannot be NULL");
+
+	mine = hazard_acquire();
+	check(mine, "Couldn't get a hazard record.");
+
+	node = calloc(1, sizeof(CQNode));
+	check_mem(node);
+	node->value = value;
+
+	while (1) {
+		CQNode* tail = hazard_protect(mine, 0, &queue->tail);
+		CQNode* next = atomic_load(&tail->next);
+
+		if (tail != atomic_load(&queue->tail))
+			continue;
+
+		if (next != NULL) {
+			// another push linked a node but hasn't moved tail yet, help it
+			atomic_compare_exchange_weak(&queue->tail, &tail, next);
+			continue;
+		}
+
+		if (atomic_compare_exchange_weak(&tail->next, &next, node)) {
+			// linked in, swinging tail is best effort since others will help
+			atomic_compare_exchange_strong(&queue->tail, &tail, node);
+			break;
+		}
+	}
+
+	atomic_store(&mine->hazard[0], NULL);
+
+	// fallthrough
+error:
+	return;
+}
+
+void* ConcurrentQueue_shift(ConcurrentQueue* queue)
+{
+	void* result = NULL;
+	HazardRecord* mine = NULL;
+
+	check(queue, "Can't shift a NULL queue");
+
+	mine = hazard_acquire();
+	check(mine, "Couldn't get a hazard record.");
+
+	while (1) {
+		CQNode* head = hazard_protect(mine, 0, &queue->head);
+		CQNode* tail = atomic_load(&queue->tail);
+		CQNode* next = hazard_protect(mine, 1, &head->next);
+
+		if (head != atomic_load(&queue->head))
+			continue;
+
+		if (next == NULL)
+			break;		// empty
+
+		if (head == tail) {
+			// tail is lagging behind a finished push, help it along
+			atomic_compare_exchange_weak(&queue->tail, &tail, next);
+			continue;
+		}
+
+		// next becomes the new dummy, its value is ours if the swing wins
+		result = next->value;
+		if (atomic_compare_exchange_weak(&queue->head, &head, next)) {
+			atomic_store(&mine->hazard[0], NULL);
+			atomic_store(&mine->hazard[1], NULL);
+			hazard_retire(mine, head);
+			return result;
+		}
+		result = NULL;
+	}
+
+	atomic_store(&mine->hazard[0], NULL);
+	atomic_store(&mine->hazard[1], NULL);
+
+	// fallthrough
+error:
+	return result;
+}
+
+int ConcurrentQueue_empty(ConcurrentQueue* queue)
+{
+	// only a snapshot, another thread may push or shift right after
+	HazardRecord* mine = hazard_acquire();
+	int empty = 1;
+	check(mine, "Couldn't get a hazard record.");
+
+	CQNode* head = hazard_protect(mine, 0, &queue->head);
+	empty = atomic_load(&head->next) == NULL;
+	atomic_store(&mine->hazard[0], NULL);
+
+	// fallthrough
+error:
+	return empty;
+}
@@ -0,0 +1,34 @@
+#ifndef lcthw_ConcurrentQueue_h
+#define lcthw_ConcurrentQueue_h
+
+#include <stdlib.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+
+// keep head and tail on their own cache lines so producers and
+// consumers don't fight over the same line
+#define CONCURRENT_QUEUE_CACHE_LINE 64
+
+// element in the queue, head always points at a dummy node
+typedef struct CQNode {
+	_Atomic(struct CQNode*) next;
+	void* value;
+} CQNode;
+
+// lock-free multi-producer/multi-consumer queue (Michael-Scott)
+// nodes that were unlinked are freed through hazard pointers, so a
+// thread that is still looking at one never sees it disappear
+typedef struct ConcurrentQueue {
+	alignas(CONCURRENT_QUEUE_CACHE_LINE) _Atomic(CQNode*) head;
+	alignas(CONCURRENT_QUEUE_CACHE_LINE) _Atomic(CQNode*) tail;
+} ConcurrentQueue;
+
+ConcurrentQueue* ConcurrentQueue_create();
+void ConcurrentQueue_destroy(ConcurrentQueue* queue);
+
+// same contract as List_push/List_shift, but safe from any thread
+void ConcurrentQueue_push(ConcurrentQueue* queue, void* value);
+void* ConcurrentQueue_shift(ConcurrentQueue* queue);
+int ConcurrentQueue_empty(ConcurrentQueue* queue);
+
+#endif
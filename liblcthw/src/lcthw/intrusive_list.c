@@ -0,0 +1,89 @@
+#include <lcthw/intrusive_list.h>
+#include <lcthw/dbg.h>
+
+void IList_init(IList* list)
+{
+	list->count = 0;
+	list->first = NULL;
+	list->last = NULL;
+}
+
+void IList_push(IList* list, ListLink* link)
+{
+	check(list, "Can't push to a NULL list");
+	check(link != NULL, "IList_push: link cannot be NULL");
+
+	link->next = NULL;
+	link->prev = list->last;
+
+	if (list->last == NULL) {
+		list->first = link;
+	} else {
+		list->last->next = link;
+	}
+	list->last = link;
+	list->count++;
+
+	// fallthrough
+error:
+	return;
+}
+
+ListLink* IList_pop(IList* list)
+{
+	ListLink* link = list->last;
+	return link != NULL ? IList_remove(list, link) : NULL;
+}
+
+void IList_unshift(IList* list, ListLink* link)
+{
+	check(list, "Can't unshift a NULL list");
+	check(link != NULL, "IList_unshift: link cannot be NULL");
+
+	link->prev = NULL;
+	link->next = list->first;
+
+	if (list->first == NULL) {
+		list->last = link;
+	} else {
+		list->first->prev = link;
+	}
+	list->first = link;
+	list->count++;
+
+	// fallthrough
+error:
+	return;
+}
+
+ListLink* IList_shift(IList* list)
+{
+	ListLink* link = list->first;
+	return link != NULL ? IList_remove(list, link) : NULL;
+}
+
+ListLink* IList_remove(IList* list, ListLink* link)
+{
+	check(list->first && list->last, "List is empty.");
+	check(link, "IList_remove: link can't be NULL");
+
+	if (link->prev)
+		link->prev->next = link->next;
+	else
+		list->first = link->next;
+
+	if (link->next)
+		link->next->prev = link->prev;
+	else
+		list->last = link->prev;
+
+	// the caller owns the memory, just detach it
+	link->next = NULL;
+	link->prev = NULL;
+	list->count--;
+
+	return link;
+
+error:
+	return NULL;
+}
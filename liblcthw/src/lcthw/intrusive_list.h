@@ -0,0 +1,40 @@
+#ifndef lcthw_IntrusiveList_h
+#define lcthw_IntrusiveList_h
+
+#include <stddef.h>
+
+// link embedded in the caller's own struct, the list never allocates
+typedef struct ListLink {
+	struct ListLink* next;
+	struct ListLink* prev;
+} ListLink;
+
+// container for linked ListLink structs
+typedef struct IList {
+	int count;			// cannot be < 0
+	ListLink* first;	// cannot be NULL when count > 0
+	ListLink* last;
+} IList;
+
+// get the struct of type T that holds link P in its member M
+#define IList_container_of(P, T, M) ((T*)((char*)(P) - offsetof(T, M)))
+#define IList_entry(P, T, M) ((P) != NULL ? IList_container_of(P, T, M) : NULL)
+
+#define IList_count(A) ((A)->count)
+#define IList_first(A, T, M) IList_entry((A)->first, T, M)
+#define IList_last(A, T, M) IList_entry((A)->last, T, M)
+
+void IList_init(IList* list);
+void IList_push(IList* list, ListLink* link);
+ListLink* IList_pop(IList* list);
+void IList_unshift(IList* list, ListLink* link);
+ListLink* IList_shift(IList* list);
+ListLink* IList_remove(IList* list, ListLink* link);
+
+// same shape as LIST_FOREACH, but V may be removed inside the loop
+#define ILIST_FOREACH(L, S, M, V)\
+			ListLink *_next = NULL;\
+			ListLink *V = NULL;\
+for(V = (L)->S; V != NULL && ((_next = V->M), 1); V = _next)
+
+#endif
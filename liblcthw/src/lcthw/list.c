@@ -1,13 +1,49 @@
 #include <lcthw/list.h>
+#include <lcthw/list_pool.h>
 #include <lcthw/dbg.h>
 
+// pooled lists take nodes from their slab, everything else uses the heap
+static inline ListNode* List_node_alloc(List* list)
+{
+	return list->pool ? ListPool_alloc(list->pool) : calloc(1, sizeof(ListNode));
+}
+
+static inline void List_node_free(List* list, ListNode* node)
+{
+	if (list->pool)
+		ListPool_free(list->pool, node);
+	else
+		free(node);
+}
+
 List* List_create()
 {
 	return calloc(1, sizeof(List));
 }
 
+List* List_create_pooled()
+{
+	List* list = List_create();
+	check_mem(list);
+
+	list->pool = ListPool_create();
+	check_mem(list->pool);
+
+	return list;
+error:
+	free(list);
+	return NULL;
+}
+
 void List_destroy(List* list)
 {
+	if (list->pool) {
+		// every node lives in the pool's chunks, release them all at once
+		ListPool_destroy(list->pool);
+		free(list);
+		return;
+	}
+
 	LIST_FOREACH(list, first, next, cur) {
 		if (cur->prev) {
 			free(cur->prev);
@@ -36,7 +72,7 @@ void List_push(List* list, void* value)
 	check(value != NULL, "List_push: value cannot be NULL");
 
 	// set node to the last element in the list
-	ListNode* node = calloc(1, sizeof(ListNode));
+	ListNode* node = List_node_alloc(list);
 	check_mem(node);
 
 	node->value = value;
@@ -72,7 +108,7 @@ void List_unshift(List* list, void* value)
 	check(value != NULL, "List_unshift: value cannot be NULL");
 
 	// set node to the first element in the list
-	ListNode* node = calloc(1, sizeof(ListNode));
+	ListNode* node = List_node_alloc(list);
 	check_mem(node);
 
 	node->value = value;
@@ -133,7 +169,7 @@ void* List_remove(List* list, ListNode* node)
 
 	list->count--;
 	result = node->value;
-	free(node);
+	List_node_free(list, node);
 
 	// fallthrough
 error:
@@ -4,6 +4,7 @@
 #include <stdlib.h>
 
 struct ListNode;
+struct ListPool;
 
 // element in the linked list
 typedef struct ListNode {
@@ -17,9 +18,11 @@ typedef struct List {
 	int count;			// cannot be < 0
 	ListNode* first;	// cannot be NULL when count > 0
 	ListNode* last;
+	struct ListPool* pool;	// NULL unless created with List_create_pooled
 } List;
 
 List* List_create();
+List* List_create_pooled();
 void List_destroy(List* list);
 void List_clear(List* list);
 void List_clear_destroy(List* list);
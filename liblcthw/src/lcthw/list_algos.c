@@ -1,18 +1,594 @@
 #include "list_algos.h"
+#include "dbg.h"
+#include <pthread.h>
 #include <string.h>
 
-List* List_merge_sort(List* list)
+// below this many nodes per thread the thread start-up costs more than it saves
+#define PARALLEL_SORT_MIN_RUN 4096
+
+/* Bottom-up merge sort of a NULL terminated chain of nodes
+ * Runs of size 1, 2, 4, ... are merged pairwise by relinking nodes,
+ * so there is no allocation and no recursion. Equal elements keep
+ * their original order.
+ *
+ * Input
+ *		head: first node of the chain
+ *		cmp: comparison function, same contract as strcmp
+ *		tail_out: address to store the new last node in
+ * Output
+ *		head: first node of the sorted chain
+ */
+static ListNode* List_sort_nodes(ListNode* head, List_compare cmp, ListNode** tail_out)
+{
+	ListNode* tail = head;
+	int insize = 1;
+	int nmerges = 0;
+
+	if (head == NULL || head->next == NULL) {
+		*tail_out = head;
+		return head;
+	}
+
+	do {
+		ListNode* left = head;
+		head = NULL;
+		tail = NULL;
+		nmerges = 0;
+
+		while (left) {
+			// step over insize nodes to find the start of the right run
+			ListNode* right = left;
+			int lsize = 0;
+			int rsize = insize;
+			nmerges++;
+
+			while (right && lsize < insize) {
+				right = right->next;
+				lsize++;
+			}
+
+			// merge the two runs, taking from the left on ties to stay stable
+			while (lsize > 0 || (rsize > 0 && right)) {
+				ListNode* node = NULL;
+
+				if (lsize == 0) {
+					node = right;
+					right = right->next;
+					rsize--;
+				} else if (rsize == 0 || right == NULL || cmp(left->value, right->value) <= 0) {
+					node = left;
+					left = left->next;
+					lsize--;
+				} else {
+					node = right;
+					right = right->next;
+					rsize--;
+				}
+
+				if (tail)
+					tail->next = node;
+				else
+					head = node;
+				node->prev = tail;
+				tail = node;
+			}
+
+			// the next pair starts right after the run we just consumed
+			left = right;
+		}
+
+		tail->next = NULL;
+		insize *= 2;
+	} while (nmerges > 1);
+
+	*tail_out = tail;
+	return head;
+}
+
+/* Merge two sorted NULL terminated chains, left wins ties */
+static ListNode* List_merge_nodes(ListNode* left, ListNode* right, List_compare cmp, ListNode** tail_out)
+{
+	ListNode* head = NULL;
+	ListNode* tail = NULL;
+
+	while (left || right) {
+		ListNode* node = NULL;
+
+		if (right == NULL || (left && cmp(left->value, right->value) <= 0)) {
+			node = left;
+			left = left->next;
+		} else {
+			node = right;
+			right = right->next;
+		}
+
+		if (tail)
+			tail->next = node;
+		else
+			head = node;
+		node->prev = tail;
+		tail = node;
+	}
+
+	*tail_out = tail;
+	return head;
+}
+
+/* Sort a list in place with a bottom-up merge sort
+ *
+ * Input
+ *		list: list to sort
+ *		cmp: comparison function, same contract as strcmp
+ * Output
+ *		list: the same list, now sorted. NULL on error
+ */
+List* List_merge_sort(List* list, List_compare cmp)
+{
+	check(list, "Can't sort a NULL list");
+	check(cmp, "List_merge_sort: cmp can't be NULL");
+
+	if (List_count(list) < 2)
+		return list;
+
+	list->first = List_sort_nodes(list->first, cmp, &list->last);
+
+	return list;
+
+error:
+	return NULL;
+}
+
+// one contiguous piece of the list being sorted or merged by a thread
+typedef struct SortRun {
+	ListNode* head;
+	ListNode* tail;
+	struct SortRun* right;		// run to merge into this one, NULL to sort it
+	List_compare cmp;
+} SortRun;
+
+static void* List_sort_run(void* arg)
+{
+	SortRun* run = arg;
+
+	if (run->right) {
+		run->head = List_merge_nodes(run->head, run->right->head, run->cmp, &run->tail);
+	} else {
+		run->head = List_sort_nodes(run->head, run->cmp, &run->tail);
+	}
+
+	return NULL;
+}
+
+/* Sort or merge every run, one thread each, the first on the calling thread
+ * Output
+ *		started: number of extra threads used, -1 on error
+ */
+static int List_run_threads(SortRun** runs, int count)
+{
+	pthread_t* threads = calloc(count, sizeof(pthread_t));
+	char* joinable = calloc(count, sizeof(char));
+	int started = 0;
+	int i = 0;
+	check_mem(threads);
+	check_mem(joinable);
+
+	for (i = 1; i < count; i++) {
+		if (pthread_create(&threads[i], NULL, List_sort_run, runs[i]) == 0) {
+			joinable[i] = 1;
+			started++;
+		} else {
+			// out of threads, do this one ourselves
+			List_sort_run(runs[i]);
+		}
+	}
+	List_sort_run(runs[0]);
+
+	for (i = 1; i < count; i++) {
+		if (joinable[i])
+			pthread_join(threads[i], NULL);
+	}
+
+	free(joinable);
+	free(threads);
+	return started;
+
+error:
+	free(joinable);
+	free(threads);
+	return -1;
+}
+
+/* Sort a list in place using several threads
+ * The list is cut into nthreads contiguous runs in one walk, each run is
+ * merge sorted on its own thread, then neighbouring runs are merged in a
+ * tree. The right neighbour is merged into the left one, and ties keep the
+ * left run's element first, so the result is identical to List_merge_sort,
+ * including the order of equal elements.
+ *
+ * Input
+ *		list: list to sort
+ *		cmp: comparison function, same contract as strcmp
+ *		nthreads: maximum number of threads to use
+ * Output
+ *		list: the same list, now sorted. NULL on error
+ */
+List* List_merge_sort_parallel(List* list, List_compare cmp, int nthreads)
 {
+	SortRun* runs = NULL;
+	SortRun** batch = NULL;
+	int nruns = 0;
+	int i = 0;
+
+	check(list, "Can't sort a NULL list");
+	check(cmp, "List_merge_sort_parallel: cmp can't be NULL");
+
+	if (nthreads > List_count(list) / PARALLEL_SORT_MIN_RUN)
+		nthreads = List_count(list) / PARALLEL_SORT_MIN_RUN;
+	if (nthreads <= 1)
+		return List_merge_sort(list, cmp);
+
+	runs = calloc(nthreads, sizeof(SortRun));
+	check_mem(runs);
+	batch = calloc(nthreads, sizeof(SortRun*));
+	check_mem(batch);
+
+	// cut the list into nearly equal runs, walking next only once
+	ListNode* cur = list->first;
+	for (nruns = 0; nruns < nthreads; nruns++) {
+		int size = List_count(list) / nthreads + (nruns < List_count(list) % nthreads);
+		SortRun* run = &runs[nruns];
+
+		run->head = cur;
+		run->cmp = cmp;
+		for (i = 1; i < size; i++)
+			cur = cur->next;
+		run->tail = cur;
+		cur = cur->next;
+
+		run->tail->next = NULL;
+		run->head->prev = NULL;
+		batch[nruns] = run;
+	}
+
+	check(List_run_threads(batch, nruns) >= 0, "Failed to sort runs.");
+
+	// merge neighbours pairwise until a single run is left
+	int stride = 1;
+	while (stride < nruns) {
+		int pairs = 0;
+		for (i = 0; i + stride < nruns; i += stride * 2) {
+			runs[i].right = &runs[i + stride];
+			batch[pairs++] = &runs[i];
+		}
+		check(List_run_threads(batch, pairs) >= 0, "Failed to merge runs.");
+		stride *= 2;
+	}
+
+	list->first = runs[0].head;
+	list->last = runs[0].tail;
+
+	free(batch);
+	free(runs);
 	return list;
+
+error:
+	free(batch);
+	free(runs);
+	return NULL;
+}
+
+// runs this short are insertion sorted before merging starts
+#define ARRAY_SORT_RUN 16
+
+// one value pulled out of the list along with its precomputed key
+typedef struct SortItem {
+	uint64_t key;
+	void* value;
+} SortItem;
+
+static inline int SortItem_compare(const SortItem* a, const SortItem* b, List_compare cmp)
+{
+	if (a->key != b->key)
+		return a->key < b->key ? -1 : 1;
+	return cmp(a->value, b->value);
+}
+
+/* Stable bottom-up merge sort of items, using tmp as scratch space
+ * Output
+ *		items: either the original array or tmp, whichever holds the result
+ */
+static SortItem* SortItem_sort(SortItem* items, SortItem* tmp, int count, List_compare cmp)
+{
+	int i = 0;
+	int j = 0;
+	int width = 0;
+
+	// insertion sort small runs, cheaper than merging tiny pieces
+	for (i = 0; i < count; i += ARRAY_SORT_RUN) {
+		int end = i + ARRAY_SORT_RUN < count ? i + ARRAY_SORT_RUN : count;
+		for (j = i + 1; j < end; j++) {
+			SortItem item = items[j];
+			int k = j;
+			while (k > i && SortItem_compare(&items[k - 1], &item, cmp) > 0) {
+				items[k] = items[k - 1];
+				k--;
+			}
+			items[k] = item;
+		}
+	}
+
+	// then merge runs back and forth between the two arrays
+	for (width = ARRAY_SORT_RUN; width < count; width *= 2) {
+		for (i = 0; i < count; i += width * 2) {
+			int mid = i + width < count ? i + width : count;
+			int end = i + width * 2 < count ? i + width * 2 : count;
+			int l = i;
+			int r = mid;
+			int out = i;
+
+			while (l < mid && r < end) {
+				// take from the left on ties to stay stable
+				if (SortItem_compare(&items[r], &items[l], cmp) < 0)
+					tmp[out++] = items[r++];
+				else
+					tmp[out++] = items[l++];
+			}
+			while (l < mid)
+				tmp[out++] = items[l++];
+			while (r < end)
+				tmp[out++] = items[r++];
+		}
+
+		SortItem* swap = items;
+		items = tmp;
+		tmp = swap;
+	}
+
+	return items;
+}
+
+/* Sort a list by copying its values into an array
+ * Chasing next pointers misses cache on nearly every comparison, so the
+ * values (and optional key prefixes) are gathered into one contiguous
+ * array, merge sorted there, then written back to the nodes in order.
+ * The nodes themselves never move. The sort is stable.
+ *
+ * Input
+ *		list: list to sort
+ *		cmp: comparison function, same contract as strcmp
+ *		prefix: optional key function, NULL to always use cmp
+ * Output
+ *		error: 0 on success, -1 on error
+ */
+int List_sort_via_array(List* list, List_compare cmp, List_key_prefix prefix)
+{
+	SortItem* items = NULL;
+	SortItem* tmp = NULL;
+	int count = 0;
+	int i = 0;
+
+	check(list, "Can't sort a NULL list");
+	check(cmp, "List_sort_via_array: cmp can't be NULL");
+
+	count = List_count(list);
+	if (count < 2)
+		return 0;
+
+	items = malloc(count * sizeof(SortItem));
+	check_mem(items);
+	tmp = malloc(count * sizeof(SortItem));
+	check_mem(tmp);
+
+	LIST_FOREACH(list, first, next, cur) {
+		items[i].key = prefix ? prefix(cur->value) : 0;
+		items[i].value = cur->value;
+		i++;
+	}
+
+	SortItem* sorted = SortItem_sort(items, tmp, count, cmp);
+
+	// one linear pass to put the values back
+	i = 0;
+	ListNode* node = NULL;
+	for (node = list->first; node != NULL; node = node->next) {
+		node->value = sorted[i++].value;
+	}
+
+	free(tmp);
+	free(items);
+	return 0;
+
+error:
+	free(tmp);
+	free(items);
+	return -1;
+}
+
+/* Key prefix for C strings: the first 8 bytes packed big-endian,
+ * which orders exactly like strcmp does on those bytes */
+uint64_t List_string_prefix(const void* value)
+{
+	const unsigned char* str = value;
+	uint64_t key = 0;
+	int i = 0;
+
+	for (i = 0; i < 8; i++) {
+		key <<= 8;
+		if (*str)
+			key |= *str++;
+	}
+
+	return key;
+}
+
+// buckets smaller than this are finished with insertion sort
+#define RADIX_SORT_CUTOFF 32
+
+/* Stable insertion sort of strings that all share their first depth bytes */
+static void radix_insertion_sort(unsigned char** strs, int count, int depth)
+{
+	int i = 0;
+
+	for (i = 1; i < count; i++) {
+		unsigned char* str = strs[i];
+		int j = i;
+		while (j > 0 && strcmp((char*)strs[j - 1] + depth, (char*)str + depth) > 0) {
+			strs[j] = strs[j - 1];
+			j--;
+		}
+		strs[j] = str;
+	}
+}
+
+/* MSD radix sort of strings that all share their first depth bytes
+ * Each pass distributes on the byte at depth (stable, through tmp), then
+ * every bucket but the one for strings that already ended is sorted on
+ * the next byte. A pass where everything lands in one bucket just moves
+ * on to the next byte without copying, so long shared prefixes are cheap.
+ *
+ * Input
+ *		strs: strings to sort
+ *		tmp: scratch space, at least count pointers
+ *		bytes: scratch space, at least count bytes
+ *		count: number of strings
+ *		depth: number of leading bytes known to be equal
+ */
+static void radix_sort(unsigned char** strs, unsigned char** tmp, unsigned char* bytes, int count, int depth)
+{
+	int counts[256];
+	int starts[256];
+	int i = 0;
+
+	while (count >= RADIX_SORT_CUTOFF) {
+		memset(counts, 0, sizeof(counts));
+		// read each byte once, the distribution pass reuses it
+		for (i = 0; i < count; i++) {
+			bytes[i] = strs[i][depth];
+			counts[bytes[i]]++;
+		}
+
+		if (counts[bytes[0]] == count) {
+			// everything shares this byte too, unless they all ended we're done
+			if (bytes[0] == '\0')
+				return;
+			depth++;
+			continue;
+		}
+
+		starts[0] = 0;
+		for (i = 1; i < 256; i++)
+			starts[i] = starts[i - 1] + counts[i - 1];
+		for (i = 0; i < count; i++)
+			tmp[starts[bytes[i]]++] = strs[i];
+		memcpy(strs, tmp, count * sizeof(unsigned char*));
+
+		// bucket 0 holds strings that ended here, they're all equal
+		int start = counts[0];
+		for (i = 1; i < 256; i++) {
+			if (counts[i] > 1)
+				radix_sort(strs + start, tmp, bytes, counts[i], depth + 1);
+			start += counts[i];
+		}
+		return;
+	}
+
+	radix_insertion_sort(strs, count, depth);
 }
 
-int List_bubble_sort(List* list)
+/* Sort a list of C strings with an MSD radix sort
+ * Comparison sorts re-read shared prefixes on every comparison, this reads
+ * each byte of a prefix only once per string. The values are gathered into
+ * an array, sorted and written back like List_sort_via_array, giving the
+ * same order as List_merge_sort with strcmp, ties included.
+ *
+ * Input
+ *		list: list of NUL terminated strings to sort
+ * Output
+ *		error: 0 on success, -1 on error
+ */
+int List_radix_sort_strings(List* list)
 {
+	unsigned char** strs = NULL;
+	unsigned char** tmp = NULL;
+	unsigned char* bytes = NULL;
+	int count = 0;
+	int i = 0;
+
+	check(list, "Can't sort a NULL list");
+
+	count = List_count(list);
+	if (count < 2)
+		return 0;
+
+	strs = malloc(count * sizeof(unsigned char*));
+	check_mem(strs);
+	tmp = malloc(count * sizeof(unsigned char*));
+	check_mem(tmp);
+	bytes = malloc(count);
+	check_mem(bytes);
+
 	LIST_FOREACH(list, first, next, cur) {
-		if (cur->next && strcmp(cur->value, cur->next->value) > 0) {
-			// if current > next
-			// switch list nodes around
+		strs[i++] = cur->value;
+	}
+
+	radix_sort(strs, tmp, bytes, count, 0);
+
+	i = 0;
+	ListNode* node = NULL;
+	for (node = list->first; node != NULL; node = node->next) {
+		node->value = strs[i++];
+	}
+
+	free(bytes);
+	free(tmp);
+	free(strs);
+	return 0;
+
+error:
+	free(bytes);
+	free(tmp);
+	free(strs);
+	return -1;
+}
+
+/* Sort a list in place by swapping neighbouring values
+ *
+ * Input
+ *		list: list to sort
+ *		cmp: comparison function, same contract as strcmp
+ * Output
+ *		error: 0 on success, -1 on error
+ */
+int List_bubble_sort(List* list, List_compare cmp)
+{
+	check(list, "Can't sort a NULL list");
+	check(cmp, "List_bubble_sort: cmp can't be NULL");
+
+	// everything after the last swap of a pass is already in place
+	ListNode* end = NULL;
+	int swapped = 1;
+
+	while (swapped) {
+		swapped = 0;
+		ListNode* last_swap = NULL;
+
+		LIST_FOREACH(list, first, next, cur) {
+			if (cur->next == end)
+				break;
+			if (cmp(cur->value, cur->next->value) > 0) {
+				// if current > next, swap their values
+				void* tmp = cur->value;
+				cur->value = cur->next->value;
+				cur->next->value = tmp;
+				swapped = 1;
+				last_swap = cur->next;
+			}
 		}
+		end = last_swap;
 	}
+
 	return 0;
+
+error:
+	return -1;
 }
@@ -1,4 +1,20 @@
+#ifndef lcthw_List_algos_h
+#define lcthw_List_algos_h
+
 #include "list.h"
+#include <stdint.h>
+
+// same contract as strcmp: < 0, 0 or > 0
+typedef int (*List_compare)(const void* a, const void* b);
+// maps a value to an integer that orders the same way cmp does, ties are
+// settled by cmp so it only has to be consistent, not unique
+typedef uint64_t (*List_key_prefix)(const void* value);
+
+List* List_merge_sort(List* list, List_compare cmp);
+List* List_merge_sort_parallel(List* list, List_compare cmp, int nthreads);
+int List_bubble_sort(List* list, List_compare cmp);
+int List_sort_via_array(List* list, List_compare cmp, List_key_prefix prefix);
+uint64_t List_string_prefix(const void* value);
+int List_radix_sort_strings(List* list);
 
-List* List_merge_sort(List*);
-int List_bubble_sort(List*);
+#endif
@@ -0,0 +1,67 @@
+#include <lcthw/list_pool.h>
+#include <lcthw/dbg.h>
+
+ListPool* ListPool_create()
+{
+	return calloc(1, sizeof(ListPool));
+}
+
+void ListPool_destroy(ListPool* pool)
+{
+	if (pool) {
+		// nodes live inside the chunks, so freeing chunks frees every node
+		ListPoolChunk* chunk = pool->chunks;
+		while (chunk) {
+			ListPoolChunk* next = chunk->next;
+			free(chunk);
+			chunk = next;
+		}
+		free(pool);
+	}
+}
+
+ListNode* ListPool_alloc(ListPool* pool)
+{
+	ListNode* node = NULL;
+
+	check(pool, "Can't allocate from a NULL pool");
+
+	if (pool->free) {
+		// reuse a released node before carving a new one
+		node = pool->free;
+		pool->free = node->next;
+	} else {
+		if (pool->chunks == NULL || pool->used == pool->chunks->size) {
+			// newest chunk is exhausted, grab a bigger one
+			int size = pool->chunks ? pool->chunks->size * 2 : LIST_POOL_CHUNK_MIN;
+			if (size > LIST_POOL_CHUNK_MAX)
+				size = LIST_POOL_CHUNK_MAX;
+
+			ListPoolChunk* chunk = malloc(sizeof(ListPoolChunk) + size * sizeof(ListNode));
+			check_mem(chunk);
+
+			chunk->size = size;
+			chunk->next = pool->chunks;
+			pool->chunks = chunk;
+			pool->used = 0;
+		}
+		node = &pool->chunks->nodes[pool->used++];
+	}
+
+	// callers expect the same zeroed node calloc gives them
+	node->next = NULL;
+	node->prev = NULL;
+	node->value = NULL;
+
+	// fallthrough
+error:
+	return node;
+}
+
+void ListPool_free(ListPool* pool, ListNode* node)
+{
+	if (pool && node) {
+		node->next = pool->free;
+		pool->free = node;
+	}
+}
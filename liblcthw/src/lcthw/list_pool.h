@@ -0,0 +1,29 @@
+#ifndef lcthw_ListPool_h
+#define lcthw_ListPool_h
+
+#include <lcthw/list.h>
+
+// first chunk holds this many nodes, every new chunk doubles up to the max
+#define LIST_POOL_CHUNK_MIN 32
+#define LIST_POOL_CHUNK_MAX 4096
+
+// a single slab of nodes, chained together so they can be released at once
+typedef struct ListPoolChunk {
+	struct ListPoolChunk* next;
+	int size;			// number of nodes in this chunk
+	ListNode nodes[];
+} ListPoolChunk;
+
+// slab allocator handing out ListNodes
+typedef struct ListPool {
+	ListPoolChunk* chunks;	// newest chunk first
+	ListNode* free;			// released nodes, linked through ->next
+	int used;				// nodes carved out of the newest chunk so far
+} ListPool;
+
+ListPool* ListPool_create();
+void ListPool_destroy(ListPool* pool);
+ListNode* ListPool_alloc(ListPool* pool);
+void ListPool_free(ListPool* pool, ListNode* node);
+
+#endif
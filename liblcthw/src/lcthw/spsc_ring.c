@@ -0,0 +1,117 @@
+#include <lcthw/spsc_ring.h>
+#include <lcthw/dbg.h>
+#include <stdint.h>
+
+SpscRing* SpscRing_create(size_t capacity)
+{
+	SpscRing* ring = NULL;
+	size_t size = 1;
+
+	check(capacity > 0, "SpscRing_create: capacity must be > 0");
+	// the largest power of two a size_t holds, rounding past it overflows
+	check(capacity <= SIZE_MAX / 2 + 1, "SpscRing_create: capacity %zu is too large", capacity);
+
+	// round up so indexes wrap with a mask instead of a division
+	while (size < capacity)
+		size <<= 1;
+
+	ring = aligned_alloc(SPSC_RING_CACHE_LINE, sizeof(SpscRing));
+	check_mem(ring);
+	memset(ring, 0, sizeof(SpscRing));
+
+	ring->buffer = calloc(size, sizeof(void*));
+	check_mem(ring->buffer);
+	ring->mask = size - 1;
+	atomic_init(&ring->head, 0);
+	atomic_init(&ring->tail, 0);
+
+	return ring;
+error:
+	free(ring);
+	return NULL;
+}
+
+void SpscRing_destroy(SpscRing* ring)
+{
+	if (ring) {
+		free(ring->buffer);
+		free(ring);
+	}
+}
+
+/* Copy values into the ring
+ * The slots are filled first and published with one release store of
+ * tail, so a batch of N costs the same synchronization as a single push.
+ *
+ * Input
+ * 		ring: ring to push to, only ever from the producer thread
+ * 		values: values to push, none of them NULL
+ * 		count: length of values
+ * Output
+ * 		pushed: how many values fit, 0 when the ring is full
+ */
+size_t SpscRing_push_batch(SpscRing* ring, void** values, size_t count)
+{
+	size_t capacity = ring->mask + 1;
+	size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	size_t i = 0;
+
+	if (capacity - (tail - ring->cached_head) < count) {
+		// only look at the consumer's index when our copy says we're short
+		ring->cached_head = atomic_load_explicit(&ring->head, memory_order_acquire);
+	}
+
+	size_t room = capacity - (tail - ring->cached_head);
+	if (count > room)
+		count = room;
+
+	for (i = 0; i < count; i++)
+		ring->buffer[(tail + i) & ring->mask] = values[i];
+
+	atomic_store_explicit(&ring->tail, tail + count, memory_order_release);
+	return count;
+}
+
+/* Copy up to count values out of the ring
+ *
+ * Input
+ * 		ring: ring to pop from, only ever from the consumer thread
+ * 		values: where to store the popped values
+ * 		count: room in values
+ * Output
+ * 		popped: how many values were popped, 0 when the ring is empty
+ */
+size_t SpscRing_pop_batch(SpscRing* ring, void** values, size_t count)
+{
+	size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	size_t i = 0;
+
+	if (ring->cached_tail - head < count) {
+		ring->cached_tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+	}
+
+	size_t ready = ring->cached_tail - head;
+	if (count > ready)
+		count = ready;
+
+	for (i = 0; i < count; i++)
+		values[i] = ring->buffer[(head + i) & ring->mask];
+
+	atomic_store_explicit(&ring->head, head + count, memory_order_release);
+	return count;
+}
+
+int SpscRing_push(SpscRing* ring, void* value)
+{
+	check(value != NULL, "SpscRing_push: value cannot be NULL");
+	return SpscRing_push_batch(ring, &value, 1) == 1 ? 0 : -1;
+
+error:
+	return -1;
+}
+
+void* SpscRing_pop(SpscRing* ring)
+{
+	void* value = NULL;
+	return SpscRing_pop_batch(ring, &value, 1) == 1 ? value : NULL;
+}
@@ -0,0 +1,41 @@
+#ifndef lcthw_SpscRing_h
+#define lcthw_SpscRing_h
+
+#include <stdlib.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+
+#define SPSC_RING_CACHE_LINE 64
+
+// bounded single-producer/single-consumer ring of void* values
+// the producer only writes tail, the consumer only writes head, and each
+// side keeps a private copy of the other's index so it rarely has to
+// touch the other side's cache line
+typedef struct SpscRing {
+	// read-only after create
+	alignas(SPSC_RING_CACHE_LINE) void** buffer;
+	size_t mask;			// capacity - 1, capacity is a power of two
+
+	// consumer side
+	alignas(SPSC_RING_CACHE_LINE) atomic_size_t head;
+	size_t cached_tail;
+
+	// producer side
+	alignas(SPSC_RING_CACHE_LINE) atomic_size_t tail;
+	size_t cached_head;
+} SpscRing;
+
+SpscRing* SpscRing_create(size_t capacity);
+void SpscRing_destroy(SpscRing* ring);
+
+#define SpscRing_capacity(A) ((A)->mask + 1)
+
+// producer only
+int SpscRing_push(SpscRing* ring, void* value);
+size_t SpscRing_push_batch(SpscRing* ring, void** values, size_t count);
+
+// consumer only
+void* SpscRing_pop(SpscRing* ring);
+size_t SpscRing_pop_batch(SpscRing* ring, void** values, size_t count);
+
+#endif
@@ -0,0 +1,299 @@
+#include "minunit.h"
+#include <lcthw/chunked_list.h>
+#include <lcthw/list.h>
+#include <assert.h>
+#include <time.h>
+
+// element count for the benchmark, override with -DBENCH_N=...
+#ifndef BENCH_N
+#define BENCH_N 1000000
+#endif
+
+static ChunkedList* list = NULL;
+char* test1 = "test1 data";
+char* test2 = "test2 data";
+char* test3 = "test3 data";
+
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+char* test_create()
+{
+	list = ChunkedList_create();
+	mu_assert(list != NULL, "Failed to create list.");
+	return NULL;
+}
+
+char* test_destroy()
+{
+	ChunkedList_clear_destroy(list);
+	return NULL;
+}
+
+char* test_push_pop()
+{
+	ChunkedList_push(list, test1);
+	mu_assert(ChunkedList_last(list) == test1, "Wrong last value.");
+
+	ChunkedList_push(list, test2);
+	mu_assert(ChunkedList_last(list) == test2, "Wrong last value.");
+
+	ChunkedList_push(list, test3);
+	mu_assert(ChunkedList_last(list) == test3, "Wrong last value.");
+
+	mu_assert(ChunkedList_count(list) == 3, "Wrong count on push.");
+
+	mu_assert(ChunkedList_pop(list) == test3, "Wrong value on pop.");
+	mu_assert(ChunkedList_pop(list) == test2, "Wrong value on pop.");
+	mu_assert(ChunkedList_pop(list) == test1, "Wrong value on pop.");
+	mu_assert(ChunkedList_count(list) == 0, "Wrong count after pop.");
+	mu_assert(list->first == NULL && list->last == NULL, "Empty chunk not released.");
+
+	return NULL;
+}
+
+char* test_unshift()
+{
+	ChunkedList_unshift(list, test1);
+	mu_assert(ChunkedList_first(list) == test1, "Wrong first value.");
+
+	ChunkedList_unshift(list, test2);
+	mu_assert(ChunkedList_first(list) == test2, "Wrong first value");
+
+	ChunkedList_unshift(list, test3);
+	mu_assert(ChunkedList_first(list) == test3, "Wrong first value.");
+	mu_assert(ChunkedList_last(list) == test1, "Wrong last value.");
+	mu_assert(ChunkedList_count(list) == 3, "Wrong count on unshift.");
+
+	return NULL;
+}
+
+char* test_remove()
+{
+	ChunkedListIter iter = ChunkedList_iter_first(list);
+	ChunkedList_iter_next(&iter);
+
+	char* val = ChunkedList_remove(list, &iter);
+	mu_assert(val == test2, "Wrong removed element.");
+	mu_assert(ChunkedList_value(iter) == test1, "Iterator not on the next value.");
+	mu_assert(ChunkedList_count(list) == 2, "Wrong count after remove.");
+	mu_assert(ChunkedList_first(list) == test3, "Wrong first after remove.");
+	mu_assert(ChunkedList_last(list) == test1, "Wrong last after remove.");
+
+	return NULL;
+}
+
+char* test_shift()
+{
+	mu_assert(ChunkedList_count(list) != 0, "Wrong count before shift.");
+
+	mu_assert(ChunkedList_shift(list) == test3, "Wrong value on shift.");
+	mu_assert(ChunkedList_shift(list) == test1, "Wrong value on shift.");
+	mu_assert(ChunkedList_count(list) == 0, "Wrong count after shift.");
+
+	return NULL;
+}
+
+char* test_foreach()
+{
+	// enough values to span several chunks from both ends
+	int values[CHUNKED_LIST_CAPACITY * 5];
+	int count = CHUNKED_LIST_CAPACITY * 5;
+	int i = 0;
+	ChunkedList* nums = ChunkedList_create();
+
+	for (i = 0; i < count; i++)
+		values[i] = i;
+	for (i = count / 2; i < count; i++)
+		ChunkedList_push(nums, &values[i]);
+	for (i = count / 2 - 1; i >= 0; i--)
+		ChunkedList_unshift(nums, &values[i]);
+	mu_assert(ChunkedList_count(nums) == count, "Wrong count after filling.");
+
+	i = 0;
+	CHUNKED_LIST_FOREACH(nums, first, next, cur) {
+		mu_assert(*(int*)ChunkedList_value(cur) == i, "Forward walk out of order.");
+		i++;
+	}
+	mu_assert(i == count, "Forward walk missed values.");
+
+	{
+		i = count - 1;
+		CHUNKED_LIST_FOREACH(nums, last, prev, cur) {
+			mu_assert(*(int*)ChunkedList_value(cur) == i, "Backward walk out of order.");
+			i--;
+		}
+		mu_assert(i == -1, "Backward walk missed values.");
+	}
+
+	{
+		// drop the odd values while walking forward
+		CHUNKED_LIST_FOREACH(nums, first, next, cur) {
+			if (*(int*)ChunkedList_value(cur) % 2)
+				ChunkedList_remove(nums, &cur);
+		}
+	}
+	mu_assert(ChunkedList_count(nums) == count / 2, "Wrong count after forward removes.");
+
+	{
+		// then every multiple of 4 walking backward
+		CHUNKED_LIST_FOREACH(nums, last, prev, cur) {
+			if (*(int*)ChunkedList_value(cur) % 4 == 0)
+				ChunkedList_remove(nums, &cur);
+		}
+	}
+	mu_assert(ChunkedList_count(nums) == count / 4, "Wrong count after backward removes.");
+
+	{
+		i = 2;
+		CHUNKED_LIST_FOREACH(nums, first, next, cur) {
+			mu_assert(*(int*)ChunkedList_value(cur) == i, "Wrong value left after removes.");
+			i += 4;
+		}
+	}
+
+	// removing everything releases every chunk
+	{
+		CHUNKED_LIST_FOREACH(nums, first, next, cur) {
+			ChunkedList_remove(nums, &cur);
+		}
+	}
+	mu_assert(ChunkedList_count(nums) == 0, "Wrong count after removing all.");
+	mu_assert(nums->first == NULL && nums->last == NULL, "Chunks left after removing all.");
+
+	ChunkedList_destroy(nums);
+	return NULL;
+}
+
+static int chunk_count(ChunkedList* list)
+{
+	int chunks = 0;
+	ChunkNode* chunk = NULL;
+
+	for (chunk = list->first; chunk != NULL; chunk = chunk->next)
+		chunks++;
+	return chunks;
+}
+
+char* test_remove_rebalances()
+{
+	int values[CHUNKED_LIST_CAPACITY * 40];
+	int count = CHUNKED_LIST_CAPACITY * 40;
+	int i = 0;
+	ChunkedList* nums = ChunkedList_create();
+
+	for (i = 0; i < count; i++) {
+		values[i] = i;
+		ChunkedList_push(nums, &values[i]);
+	}
+
+	{
+		// keep one value in eight, which left one per chunk before
+		CHUNKED_LIST_FOREACH(nums, first, next, cur) {
+			if (*(int*)ChunkedList_value(cur) % 8)
+				ChunkedList_remove(nums, &cur);
+		}
+	}
+	mu_assert(ChunkedList_count(nums) == count / 8, "Wrong count after removes.");
+	// only the first and last chunk may be under half full
+	mu_assert(chunk_count(nums) <= count / 8 / (CHUNKED_LIST_CAPACITY / 2) + 2,
+			"Chunks not merged after removes.");
+
+	{
+		i = 0;
+		CHUNKED_LIST_FOREACH(nums, first, next, cur) {
+			mu_assert(*(int*)ChunkedList_value(cur) == i, "Wrong value left after merging.");
+			i += 8;
+		}
+		mu_assert(i == count, "Values lost while merging.");
+	}
+
+	{
+		// thin it out again walking backward, keeping one in 32
+		CHUNKED_LIST_FOREACH(nums, last, prev, cur) {
+			if (*(int*)ChunkedList_value(cur) % 32)
+				ChunkedList_remove(nums, &cur);
+		}
+	}
+	mu_assert(ChunkedList_count(nums) == count / 32, "Wrong count after backward removes.");
+	mu_assert(chunk_count(nums) <= count / 32 / (CHUNKED_LIST_CAPACITY / 2) + 2,
+			"Chunks not merged after backward removes.");
+
+	{
+		i = count - 32;
+		CHUNKED_LIST_FOREACH(nums, last, prev, cur) {
+			mu_assert(*(int*)ChunkedList_value(cur) == i, "Wrong value left after merging backward.");
+			i -= 32;
+		}
+		mu_assert(i == -32, "Values lost while merging backward.");
+	}
+
+	ChunkedList_destroy(nums);
+	return NULL;
+}
+
+char* test_bench()
+{
+	int i = 0;
+	long sum_list = 0;
+	long sum_chunked = 0;
+	int* values = malloc(BENCH_N * sizeof(int));
+	List* plain = List_create();
+	ChunkedList* chunked = ChunkedList_create();
+
+	for (i = 0; i < BENCH_N; i++) {
+		values[i] = i;
+		List_push(plain, &values[i]);
+		ChunkedList_push(chunked, &values[i]);
+	}
+
+	double start = now();
+	LIST_FOREACH(plain, first, next, cur) {
+		sum_list += *(int*)cur->value;
+	}
+	double t_list = now() - start;
+
+	start = now();
+	{
+		CHUNKED_LIST_FOREACH(chunked, first, next, cur) {
+			sum_chunked += *(int*)ChunkedList_value(cur);
+		}
+	}
+	double t_chunked = now() - start;
+	mu_assert(sum_list == sum_chunked, "Lists don't hold the same values.");
+
+	// per element overhead, not counting the values themselves or malloc headers
+	double per_list = sizeof(ListNode);
+	double per_chunked = (double)sizeof(ChunkNode) / CHUNKED_LIST_CAPACITY;
+	printf("%d values: List %.1f bytes/value, %.4fs to walk; ChunkedList %.1f bytes/value, %.4fs to walk (%.1fx)\n",
+			BENCH_N, per_list, t_list, per_chunked, t_chunked, t_list / t_chunked);
+
+	List_destroy(plain);
+	ChunkedList_destroy(chunked);
+	free(values);
+
+	return NULL;
+}
+
+char* all_tests()
+{
+	mu_suite_start();
+
+	mu_run_test(test_create);
+	mu_run_test(test_push_pop);
+	mu_run_test(test_unshift);
+	mu_run_test(test_remove);
+	mu_run_test(test_shift);
+	mu_run_test(test_destroy);
+	mu_run_test(test_foreach);
+	mu_run_test(test_remove_rebalances);
+	mu_run_test(test_bench);
+
+	return NULL;
+}
+
+RUN_TESTS(all_tests);
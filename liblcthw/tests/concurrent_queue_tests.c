@@ -0,0 +1,257 @@
+#include "minunit.h"
+#include <lcthw/concurrent_queue.h>
+#include <lcthw/list.h>
+#include <assert.h>
+#include <pthread.h>
+#include <time.h>
+
+// total queue operations per benchmark run, override with -DBENCH_N=...
+#ifndef BENCH_N
+#define BENCH_N 2000000
+#endif
+
+#define PRODUCERS 4
+#define CONSUMERS 4
+#define PER_PRODUCER 50000
+
+static ConcurrentQueue* queue = NULL;
+char* test1 = "test1 data";
+char* test2 = "test2 data";
+char* test3 = "test3 data";
+
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+char* test_create()
+{
+	queue = ConcurrentQueue_create();
+	mu_assert(queue != NULL, "Failed to create queue.");
+	mu_assert(ConcurrentQueue_empty(queue), "New queue isn't empty.");
+	return NULL;
+}
+
+char* test_push_shift()
+{
+	ConcurrentQueue_push(queue, test1);
+	ConcurrentQueue_push(queue, test2);
+	ConcurrentQueue_push(queue, test3);
+	mu_assert(!ConcurrentQueue_empty(queue), "Queue empty after push.");
+
+	mu_assert(ConcurrentQueue_shift(queue) == test1, "Wrong value on shift.");
+	mu_assert(ConcurrentQueue_shift(queue) == test2, "Wrong value on shift.");
+	mu_assert(ConcurrentQueue_shift(queue) == test3, "Wrong value on shift.");
+	mu_assert(ConcurrentQueue_shift(queue) == NULL, "Shift on empty queue returned a value.");
+	mu_assert(ConcurrentQueue_empty(queue), "Queue not empty after shifting everything.");
+
+	return NULL;
+}
+
+// every value is the address of its slot, so producer and sequence can be recovered
+static int values[PRODUCERS * PER_PRODUCER];
+static atomic_int seen[PRODUCERS * PER_PRODUCER];
+static atomic_int consumed = 0;
+static atomic_int out_of_order = 0;
+
+static void* producer(void* arg)
+{
+	int id = (int)(long)arg;
+	int i = 0;
+
+	for (i = 0; i < PER_PRODUCER; i++)
+		ConcurrentQueue_push(queue, &values[id * PER_PRODUCER + i]);
+
+	return NULL;
+}
+
+static void* consumer(void* arg)
+{
+	// the last sequence number this consumer saw from each producer
+	int last[PRODUCERS];
+	int i = 0;
+
+	for (i = 0; i < PRODUCERS; i++)
+		last[i] = -1;
+
+	while (atomic_load(&consumed) < PRODUCERS * PER_PRODUCER) {
+		int* value = ConcurrentQueue_shift(queue);
+		if (value == NULL)
+			continue;
+
+		int index = value - values;
+		int from = index / PER_PRODUCER;
+		int seq = index % PER_PRODUCER;
+
+		if (seq <= last[from])
+			atomic_fetch_add(&out_of_order, 1);
+		last[from] = seq;
+
+		atomic_fetch_add(&seen[index], 1);
+		atomic_fetch_add(&consumed, 1);
+	}
+
+	return NULL;
+}
+
+char* test_mpmc()
+{
+	pthread_t producers[PRODUCERS];
+	pthread_t consumers[CONSUMERS];
+	int i = 0;
+
+	for (i = 0; i < CONSUMERS; i++)
+		pthread_create(&consumers[i], NULL, consumer, NULL);
+	for (i = 0; i < PRODUCERS; i++)
+		pthread_create(&producers[i], NULL, producer, (void*)(long)i);
+
+	for (i = 0; i < PRODUCERS; i++)
+		pthread_join(producers[i], NULL);
+	for (i = 0; i < CONSUMERS; i++)
+		pthread_join(consumers[i], NULL);
+
+	for (i = 0; i < PRODUCERS * PER_PRODUCER; i++)
+		mu_assert(atomic_load(&seen[i]) == 1, "Value lost or delivered twice.");
+	mu_assert(atomic_load(&out_of_order) == 0, "Values from one producer arrived out of order.");
+	mu_assert(ConcurrentQueue_empty(queue), "Queue not empty after the run.");
+
+	return NULL;
+}
+
+char* test_destroy()
+{
+	ConcurrentQueue_push(queue, test1);
+	ConcurrentQueue_destroy(queue);
+	return NULL;
+}
+
+static void* push_shift_exit(void* arg)
+{
+	ConcurrentQueue* q = arg;
+	int i = 0;
+
+	// enough shifts to leave retired nodes behind when the thread exits
+	for (i = 0; i < 10000; i++) {
+		ConcurrentQueue_push(q, test1);
+		ConcurrentQueue_shift(q);
+	}
+
+	return NULL;
+}
+
+char* test_threads_exit()
+{
+	pthread_t threads[PRODUCERS];
+	int round = 0;
+	int i = 0;
+
+	for (round = 0; round < 4; round++) {
+		ConcurrentQueue* q = ConcurrentQueue_create();
+		mu_assert(q != NULL, "Failed to create queue.");
+
+		for (i = 0; i < PRODUCERS; i++)
+			pthread_create(&threads[i], NULL, push_shift_exit, q);
+		for (i = 0; i < PRODUCERS; i++)
+			pthread_join(threads[i], NULL);
+
+		// this thread too, so its record has to be let go of
+		ConcurrentQueue_push(q, test2);
+		mu_assert(ConcurrentQueue_shift(q) == test2, "Wrong value on shift.");
+		mu_assert(ConcurrentQueue_empty(q), "Queue not empty after the run.");
+		ConcurrentQueue_destroy(q);
+	}
+
+	return NULL;
+}
+
+// the baseline: a List behind one mutex, the way the work queues use it now
+typedef struct LockedList {
+	pthread_mutex_t lock;
+	List* list;
+} LockedList;
+
+typedef struct BenchArgs {
+	ConcurrentQueue* queue;
+	LockedList* locked;
+	int ops;
+} BenchArgs;
+
+static void* bench_worker(void* arg)
+{
+	BenchArgs* args = arg;
+	int i = 0;
+
+	// every thread both produces and consumes
+	for (i = 0; i < args->ops; i += 2) {
+		if (args->queue) {
+			ConcurrentQueue_push(args->queue, test1);
+			ConcurrentQueue_shift(args->queue);
+		} else {
+			pthread_mutex_lock(&args->locked->lock);
+			List_push(args->locked->list, test1);
+			pthread_mutex_unlock(&args->locked->lock);
+
+			pthread_mutex_lock(&args->locked->lock);
+			List_shift(args->locked->list);
+			pthread_mutex_unlock(&args->locked->lock);
+		}
+	}
+
+	return NULL;
+}
+
+static double bench_run(ConcurrentQueue* lockfree, LockedList* locked, int nthreads)
+{
+	pthread_t threads[16];
+	BenchArgs args = { lockfree, locked, BENCH_N / nthreads };
+	int i = 0;
+
+	double start = now();
+	for (i = 0; i < nthreads; i++)
+		pthread_create(&threads[i], NULL, bench_worker, &args);
+	for (i = 0; i < nthreads; i++)
+		pthread_join(threads[i], NULL);
+
+	return BENCH_N / (now() - start);
+}
+
+char* test_bench()
+{
+	int threads[] = { 1, 2, 4, 8, 16 };
+	int t = 0;
+	ConcurrentQueue* lockfree = ConcurrentQueue_create();
+	LockedList locked = { PTHREAD_MUTEX_INITIALIZER, List_create() };
+
+	for (t = 0; t < 5; t++) {
+		double lf = bench_run(lockfree, NULL, threads[t]);
+		double mx = bench_run(NULL, &locked, threads[t]);
+		printf("%2d thread(s): lock-free %.2f Mops/s, mutex List %.2f Mops/s\n",
+				threads[t], lf / 1e6, mx / 1e6);
+	}
+
+	mu_assert(ConcurrentQueue_empty(lockfree), "Lock-free queue not drained.");
+	mu_assert(List_count(locked.list) == 0, "Locked list not drained.");
+
+	ConcurrentQueue_destroy(lockfree);
+	List_destroy(locked.list);
+
+	return NULL;
+}
+
+char* all_tests()
+{
+	mu_suite_start();
+
+	mu_run_test(test_create);
+	mu_run_test(test_push_shift);
+	mu_run_test(test_mpmc);
+	mu_run_test(test_destroy);
+	mu_run_test(test_threads_exit);
+	mu_run_test(test_bench);
+
+	return NULL;
+}
+
+RUN_TESTS(all_tests);
@@ -0,0 +1,168 @@
+#include "minunit.h"
+#include <lcthw/intrusive_list.h>
+#include <lcthw/list.h>
+#include <assert.h>
+#include <time.h>
+
+// queue operations for the benchmark, override with -DBENCH_N=...
+#ifndef BENCH_N
+#define BENCH_N 1000000
+#endif
+
+// a caller's object with the list link embedded in it
+typedef struct Job {
+	int id;
+	ListLink link;
+} Job;
+
+static IList list;
+static Job jobs[3] = { { .id = 1 }, { .id = 2 }, { .id = 3 } };
+
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+char* test_init()
+{
+	IList_init(&list);
+	mu_assert(IList_count(&list) == 0, "Wrong count after init.");
+	mu_assert(IList_first(&list, Job, link) == NULL, "Empty list has a first.");
+	return NULL;
+}
+
+char* test_push_pop()
+{
+	IList_push(&list, &jobs[0].link);
+	mu_assert(IList_last(&list, Job, link) == &jobs[0], "Wrong last value.");
+
+	IList_push(&list, &jobs[1].link);
+	IList_push(&list, &jobs[2].link);
+	mu_assert(IList_last(&list, Job, link)->id == 3, "Wrong last value.");
+	mu_assert(IList_count(&list) == 3, "Wrong count on push.");
+
+	mu_assert(IList_container_of(IList_pop(&list), Job, link) == &jobs[2], "Wrong value on pop.");
+	mu_assert(IList_container_of(IList_pop(&list), Job, link) == &jobs[1], "Wrong value on pop.");
+	mu_assert(IList_container_of(IList_pop(&list), Job, link) == &jobs[0], "Wrong value on pop.");
+	mu_assert(IList_count(&list) == 0, "Wrong count after pop.");
+	mu_assert(IList_pop(&list) == NULL, "Pop on empty list returned a value.");
+
+	return NULL;
+}
+
+char* test_unshift_shift()
+{
+	IList_unshift(&list, &jobs[0].link);
+	IList_unshift(&list, &jobs[1].link);
+	IList_unshift(&list, &jobs[2].link);
+	mu_assert(IList_first(&list, Job, link) == &jobs[2], "Wrong first value.");
+	mu_assert(IList_count(&list) == 3, "Wrong count on unshift.");
+
+	IList_remove(&list, &jobs[1].link);
+	mu_assert(IList_count(&list) == 2, "Wrong count after remove.");
+	mu_assert(jobs[1].link.next == NULL && jobs[1].link.prev == NULL, "Removed link not detached.");
+
+	mu_assert(IList_container_of(IList_shift(&list), Job, link) == &jobs[2], "Wrong value on shift.");
+	mu_assert(IList_container_of(IList_shift(&list), Job, link) == &jobs[0], "Wrong value on shift.");
+	mu_assert(IList_count(&list) == 0, "Wrong count after shift.");
+
+	return NULL;
+}
+
+char* test_foreach()
+{
+	Job many[10];
+	int i = 0;
+
+	for (i = 0; i < 10; i++) {
+		many[i].id = i;
+		IList_push(&list, &many[i].link);
+	}
+
+	// removing the current link mid-walk is allowed
+	ILIST_FOREACH(&list, first, next, cur) {
+		Job* job = IList_container_of(cur, Job, link);
+		if (job->id % 2)
+			IList_remove(&list, cur);
+	}
+	mu_assert(IList_count(&list) == 5, "Wrong count after removes.");
+
+	{
+		i = 8;
+		ILIST_FOREACH(&list, last, prev, cur) {
+			mu_assert(IList_container_of(cur, Job, link)->id == i, "Wrong order walking back.");
+			i -= 2;
+		}
+	}
+
+	while (IList_shift(&list));
+	return NULL;
+}
+
+char* test_bench()
+{
+	int i = 0;
+	Job* pool = malloc(BENCH_N * sizeof(Job));
+	List* plain = List_create();
+	IList queue;
+	IList_init(&queue);
+
+	// the List path: the caller's object plus a ListNode per element
+	double start = now();
+	for (i = 0; i < BENCH_N; i++) {
+		Job* job = malloc(sizeof(Job));
+		job->id = i;
+		List_push(plain, job);
+	}
+	for (i = 0; i < BENCH_N; i++) {
+		free(List_shift(plain));
+	}
+	double t_list = now() - start;
+
+	// the intrusive path: the object is the node, nothing else is allocated
+	start = now();
+	for (i = 0; i < BENCH_N; i++) {
+		Job* job = malloc(sizeof(Job));
+		job->id = i;
+		IList_push(&queue, &job->link);
+	}
+	for (i = 0; i < BENCH_N; i++) {
+		free(IList_container_of(IList_shift(&queue), Job, link));
+	}
+	double t_intrusive = now() - start;
+
+	// and with objects that already exist, as on a hot path
+	start = now();
+	for (i = 0; i < BENCH_N; i++) {
+		IList_push(&queue, &pool[i].link);
+	}
+	for (i = 0; i < BENCH_N; i++) {
+		IList_shift(&queue);
+	}
+	double t_prealloc = now() - start;
+
+	mu_assert(List_count(plain) == 0 && IList_count(&queue) == 0, "Queues not drained.");
+	printf("%d jobs through a queue: List %.3fs, intrusive %.3fs (%.1fx), intrusive preallocated %.3fs\n",
+			BENCH_N, t_list, t_intrusive, t_list / t_intrusive, t_prealloc);
+
+	List_destroy(plain);
+	free(pool);
+	return NULL;
+}
+
+char* all_tests()
+{
+	mu_suite_start();
+
+	mu_run_test(test_init);
+	mu_run_test(test_push_pop);
+	mu_run_test(test_unshift_shift);
+	mu_run_test(test_foreach);
+	mu_run_test(test_bench);
+
+	return NULL;
+}
+
+RUN_TESTS(all_tests);
@@ -2,6 +2,12 @@
 #include <lcthw/list_algos.h>
 #include <assert.h>
 #include <string.h>
+#include <time.h>
+
+// list size for the sort benchmarks, override with -DBENCH_N=...
+#ifndef BENCH_N
+#define BENCH_N 1000000
+#endif
 
 char* values[] = { "XXXX", "1234", "abcd", "xjvef", "NDSS" };
 
@@ -39,8 +45,7 @@ char* test_bubble_sort()
 	List_print(words);
 
 	// should work on a list that needs sorting
-	int rc = List_bubble_sort(words);
-	//int rc = List_bubble_sort(words, (List_compare) strcmp);
+	int rc = List_bubble_sort(words, (List_compare) strcmp);
 	mu_assert(rc == 0, "Bubble sort failed.");
 	mu_assert(is_sorted(words), "Words are not sorted after bubble sort.");
 
@@ -56,16 +61,313 @@ char* test_merge_sort()
 	List_print(words);
 
 	// should work on a list that needs sorting
-	List* res = List_merge_sort(words);
-	//List* res = List_merge_sort(words, (List_compare) strcmp);
+	List* res = List_merge_sort(words, (List_compare) strcmp);
+	mu_assert(res == words, "Merge sort should sort in place.");
 	mu_assert(is_sorted(res), "Words are not sorted after merge sort.");
+	mu_assert(List_count(res) == NUM_VALUES, "Merge sort lost elements.");
+	mu_assert(List_last(res) == values[3], "Merge sort didn't fix up last.");
+
+	// should work on a list that is already sorted
+	List* res2 = List_merge_sort(res, (List_compare) strcmp);
+	mu_assert(is_sorted(res2), "Words are not sorted after second merge sort.");
+
+	List_destroy(words);
+	return NULL;
+}
+
+static int cmp_first_char(const void* a, const void* b)
+{
+	return *(const char*)a - *(const char*)b;
+}
+
+char* test_merge_sort_large()
+{
+	// big enough for many passes, with lots of equal keys to check stability
+	int count = 100000;
+	int i = 0;
+	char* keys = malloc(count * 2);
+	List* list = List_create_pooled();
+
+	srand(1234);
+	for (i = 0; i < count; i++) {
+		keys[i * 2] = 'a' + rand() % 26;
+		keys[i * 2 + 1] = '\0';
+		List_push(list, &keys[i * 2]);
+	}
+
+	List_merge_sort(list, cmp_first_char);
+	mu_assert(List_count(list) == count, "Merge sort lost elements.");
+	mu_assert(list->first->prev == NULL, "First node has a prev.");
+
+	ListNode* prev = NULL;
+	LIST_FOREACH(list, first, next, cur) {
+		mu_assert(cur->prev == prev, "Broken prev link after merge sort.");
+		if (prev) {
+			int diff = cmp_first_char(prev->value, cur->value);
+			mu_assert(diff <= 0, "Large list is not sorted.");
+			// equal keys must keep their insertion order (addresses increase)
+			mu_assert(diff < 0 || (char*)prev->value < (char*)cur->value, "Merge sort is not stable.");
+		}
+		prev = cur;
+	}
+	mu_assert(list->last == prev, "Last doesn't point at the final node.");
+
+	List_destroy(list);
+	free(keys);
+
+	return NULL;
+}
+
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// fill a list with pointers into keys, each key a random one or two letter string
+static List* create_keys(char* keys, int count, unsigned int seed)
+{
+	int i = 0;
+	List* list = List_create_pooled();
+
+	srand(seed);
+	for (i = 0; i < count; i++) {
+		keys[i * 3] = 'a' + rand() % 26;
+		keys[i * 3 + 1] = rand() % 2 ? 'a' + rand() % 26 : '\0';
+		keys[i * 3 + 2] = '\0';
+		List_push(list, &keys[i * 3]);
+	}
+
+	return list;
+}
+
+char* test_merge_sort_parallel()
+{
+	int count = 100000;
+	int threads[] = { 1, 2, 3, 4, 8 };
+	int t = 0;
+	char* keys = malloc(count * 3);
+
+	for (t = 0; t < 5; t++) {
+		List* serial = create_keys(keys, count, 42);
+		List* parallel = create_keys(keys, count, 42);
+
+		List_merge_sort(serial, (List_compare) strcmp);
+		mu_assert(List_merge_sort_parallel(parallel, (List_compare) strcmp, threads[t]) == parallel,
+				"Parallel sort should sort in place.");
+		mu_assert(List_count(parallel) == count, "Parallel sort lost elements.");
+
+		// same pointers in the same order means equal keys kept their order too
+		ListNode* other = serial->first;
+		ListNode* prev = NULL;
+		LIST_FOREACH(parallel, first, next, cur) {
+			mu_assert(cur->value == other->value, "Parallel sort differs from serial sort.");
+			mu_assert(cur->prev == prev, "Broken prev link after parallel sort.");
+			other = other->next;
+			prev = cur;
+		}
+		mu_assert(parallel->last == prev, "Last doesn't point at the final node.");
+
+		List_destroy(serial);
+		List_destroy(parallel);
+	}
+
+	free(keys);
+	return NULL;
+}
+
+char* test_merge_sort_parallel_bench()
+{
+	int threads[] = { 1, 2, 4, 8 };
+	int t = 0;
+	char* keys = malloc(BENCH_N * 3);
+
+	for (t = 0; t < 4; t++) {
+		List* list = create_keys(keys, BENCH_N, 7);
+
+		double start = now();
+		List_merge_sort_parallel(list, (List_compare) strcmp, threads[t]);
+		double elapsed = now() - start;
+
+		mu_assert(is_sorted(list), "Benchmark list is not sorted.");
+		printf("merge sort %d nodes, %d thread(s): %.3fs\n", BENCH_N, threads[t], elapsed);
+		List_destroy(list);
+	}
+
+	free(keys);
+	return NULL;
+}
 
-	List* res2 = List_merge_sort(res);
-	//List* res2 = List_merge_sort(res, (List_compare) strcmp);
-	List_destroy(res2);
-	List_destroy(res);
+char* test_sort_via_array()
+{
+	int count = 100000;
+	char* keys = malloc(count * 3);
+	List* expect = create_keys(keys, count, 99);
+	List_merge_sort(expect, (List_compare) strcmp);
+
+	List* words = create_words();
+	mu_assert(List_sort_via_array(words, (List_compare) strcmp, NULL) == 0, "Array sort failed.");
+	mu_assert(is_sorted(words), "Words are not sorted after array sort.");
+	List_destroy(words);
+
+	// with and without key prefixes the result must match the stable list sort
+	List_key_prefix prefixes[] = { NULL, List_string_prefix };
+	int p = 0;
+	for (p = 0; p < 2; p++) {
+		List* list = create_keys(keys, count, 99);
+		ListNode* first = list->first;
+
+		mu_assert(List_sort_via_array(list, (List_compare) strcmp, prefixes[p]) == 0, "Array sort failed.");
+		mu_assert(list->first == first, "Array sort shouldn't move nodes.");
+
+		ListNode* other = expect->first;
+		LIST_FOREACH(list, first, next, cur) {
+			mu_assert(cur->value == other->value, "Array sort differs from merge sort.");
+			other = other->next;
+		}
+		List_destroy(list);
+	}
+
+	List_destroy(expect);
+	free(keys);
+	return NULL;
+}
+
+char* test_sort_via_array_bench()
+{
+	int sizes[] = { 1000, 100000, BENCH_N };
+	int s = 0;
+	char* keys = malloc(BENCH_N * 3);
+
+	for (s = 0; s < 3; s++) {
+		List* list = create_keys(keys, sizes[s], 11);
+		double start = now();
+		List_merge_sort(list, (List_compare) strcmp);
+		double t_list = now() - start;
+		List_destroy(list);
+
+		list = create_keys(keys, sizes[s], 11);
+		start = now();
+		List_sort_via_array(list, (List_compare) strcmp, NULL);
+		double t_array = now() - start;
+		List_destroy(list);
+
+		list = create_keys(keys, sizes[s], 11);
+		start = now();
+		List_sort_via_array(list, (List_compare) strcmp, List_string_prefix);
+		double t_prefix = now() - start;
+		mu_assert(is_sorted(list), "Benchmark list is not sorted.");
+		List_destroy(list);
+
+		printf("sort %d nodes: list merge %.4fs, array %.4fs, array+prefix %.4fs\n",
+				sizes[s], t_list, t_array, t_prefix);
+	}
+
+	free(keys);
+	return NULL;
+}
+
+// log-path style keys: long shared prefixes, differing near the end
+static List* create_paths(char* paths, int count, unsigned int seed)
+{
+	int i = 0;
+	List* list = List_create_pooled();
+
+	srand(seed);
+	for (i = 0; i < count; i++) {
+		char* path = &paths[i * 64];
+		snprintf(path, 64, "/var/log/cluster/node%04d.rack%02d.dc1.example.com/app-%d.log",
+				rand() % 5000, rand() % 40, rand() % 10);
+		List_push(list, path);
+	}
+
+	return list;
+}
 
+static int same_order(List* a, List* b)
+{
+	ListNode* other = b->first;
+	LIST_FOREACH(a, first, next, cur) {
+		if (other == NULL || cur->value != other->value)
+			return 0;
+		other = other->next;
+	}
+	return other == NULL;
+}
+
+char* test_radix_sort_strings()
+{
+	int count = 100000;
+	char* keys = malloc(count * 64);
+
+	List* words = create_words();
+	mu_assert(List_radix_sort_strings(words) == 0, "Radix sort failed.");
+	mu_assert(is_sorted(words), "Words are not sorted after radix sort.");
 	List_destroy(words);
+
+	// bytes above 127, empty strings and prefixes of each other
+	char* odd[] = { "\xff", "abc", "", "ab", "\x80z", "abc", "", "a\xe9", "a" };
+	List* list = List_create();
+	List* expect = List_create();
+	int i = 0;
+	for (i = 0; i < 9; i++) {
+		List_push(list, odd[i]);
+		List_push(expect, odd[i]);
+	}
+	List_radix_sort_strings(list);
+	List_merge_sort(expect, (List_compare) strcmp);
+	mu_assert(same_order(list, expect), "Radix sort differs from strcmp order on odd keys.");
+	List_destroy(list);
+	List_destroy(expect);
+
+	list = create_keys(keys, count, 5);
+	expect = create_keys(keys, count, 5);
+	List_radix_sort_strings(list);
+	List_merge_sort(expect, (List_compare) strcmp);
+	mu_assert(same_order(list, expect), "Radix sort differs from merge sort on short keys.");
+	List_destroy(list);
+	List_destroy(expect);
+
+	list = create_paths(keys, count, 5);
+	expect = create_paths(keys, count, 5);
+	List_radix_sort_strings(list);
+	List_merge_sort(expect, (List_compare) strcmp);
+	mu_assert(same_order(list, expect), "Radix sort differs from merge sort on paths.");
+	List_destroy(list);
+	List_destroy(expect);
+
+	free(keys);
+	return NULL;
+}
+
+char* test_radix_sort_strings_bench()
+{
+	char* paths = malloc(BENCH_N * 64);
+
+	List* list = create_paths(paths, BENCH_N, 3);
+	double start = now();
+	List_merge_sort(list, (List_compare) strcmp);
+	double t_merge = now() - start;
+	List_destroy(list);
+
+	list = create_paths(paths, BENCH_N, 3);
+	start = now();
+	List_sort_via_array(list, (List_compare) strcmp, List_string_prefix);
+	double t_array = now() - start;
+	List_destroy(list);
+
+	list = create_paths(paths, BENCH_N, 3);
+	start = now();
+	List_radix_sort_strings(list);
+	double t_radix = now() - start;
+	mu_assert(is_sorted(list), "Benchmark list is not sorted.");
+	List_destroy(list);
+
+	printf("sort %d paths: list merge %.3fs, array+prefix %.3fs, radix %.3fs (%.1fx vs merge)\n",
+			BENCH_N, t_merge, t_array, t_radix, t_merge / t_radix);
+
+	free(paths);
 	return NULL;
 }
 
@@ -74,6 +376,13 @@ char* all_tests()
 	mu_suite_start();
 	mu_run_test(test_bubble_sort);
 	mu_run_test(test_merge_sort);
+	mu_run_test(test_merge_sort_large);
+	mu_run_test(test_merge_sort_parallel);
+	mu_run_test(test_merge_sort_parallel_bench);
+	mu_run_test(test_sort_via_array);
+	mu_run_test(test_sort_via_array_bench);
+	mu_run_test(test_radix_sort_strings);
+	mu_run_test(test_radix_sort_strings_bench);
 
 	return NULL;
 }
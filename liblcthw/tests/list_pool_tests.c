@@ -0,0 +1,132 @@
+#include "minunit.h"
+#include <lcthw/list.h>
+#include <lcthw/list_pool.h>
+#include <assert.h>
+#include <time.h>
+
+// number of push/shift pairs for the benchmark, override with -DBENCH_N=...
+#ifndef BENCH_N
+#define BENCH_N 1000000
+#endif
+
+static List* list = NULL;
+char* test1 = "test1 data";
+char* test2 = "test2 data";
+char* test3 = "test3 data";
+
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+char* test_create()
+{
+	list = List_create_pooled();
+	mu_assert(list != NULL, "Failed to create pooled list.");
+	mu_assert(list->pool != NULL, "Pooled list has no pool.");
+	return NULL;
+}
+
+char* test_push_pop()
+{
+	List_push(list, test1);
+	List_push(list, test2);
+	List_unshift(list, test3);
+	mu_assert(List_count(list) == 3, "Wrong count on push.");
+	mu_assert(List_first(list) == test3, "Wrong first value.");
+	mu_assert(List_last(list) == test2, "Wrong last value.");
+
+	mu_assert(List_remove(list, list->first->next) == test1, "Wrong removed element.");
+	mu_assert(List_pop(list) == test2, "Wrong value on pop.");
+	mu_assert(List_shift(list) == test3, "Wrong value on shift.");
+	mu_assert(List_count(list) == 0, "Wrong count after pop.");
+
+	return NULL;
+}
+
+char* test_reuse()
+{
+	// released nodes should come back from the freelist, not a new chunk
+	List_push(list, test1);
+	ListNode* node = list->last;
+	List_pop(list);
+
+	List_push(list, test2);
+	mu_assert(list->last == node, "Freed node was not reused.");
+	mu_assert(list->last->prev == NULL && list->last->next == NULL, "Reused node not cleared.");
+	List_pop(list);
+
+	// filling past the first chunk should chain a bigger one
+	int i = 0;
+	for (i = 0; i < LIST_POOL_CHUNK_MIN * 3; i++) {
+		List_push(list, test1);
+	}
+	mu_assert(list->pool->chunks->next != NULL, "Pool never grew a second chunk.");
+	mu_assert(List_count(list) == LIST_POOL_CHUNK_MIN * 3, "Wrong count after growing.");
+
+	return NULL;
+}
+
+char* test_destroy()
+{
+	// nodes are still on the list, destroy releases them with the chunks
+	List_destroy(list);
+	return NULL;
+}
+
+static double bench_queue(List* queue)
+{
+	int i = 0;
+	double start = now();
+
+	// fill, drain, then run as a steady state queue
+	for (i = 0; i < BENCH_N; i++) {
+		List_push(queue, test1);
+	}
+	for (i = 0; i < BENCH_N; i++) {
+		List_shift(queue);
+	}
+	for (i = 0; i < BENCH_N; i++) {
+		List_push(queue, test1);
+		List_shift(queue);
+	}
+
+	return now() - start;
+}
+
+char* test_bench()
+{
+	List* plain = List_create();
+	List* pooled = List_create_pooled();
+
+	double t_plain = bench_queue(plain);
+	double t_pooled = bench_queue(pooled);
+	mu_assert(List_count(plain) == 0 && List_count(pooled) == 0, "Queues not drained.");
+
+	// 2 * BENCH_N pushes and as many shifts
+	printf("%d pushes and shifts: calloc %.3fs (%.1f Mops/s), pooled %.3fs (%.1f Mops/s), %.2fx\n",
+			BENCH_N * 4, t_plain, BENCH_N * 4 / t_plain / 1e6,
+			t_pooled, BENCH_N * 4 / t_pooled / 1e6, t_plain / t_pooled);
+
+	List_destroy(plain);
+	List_destroy(pooled);
+
+	return NULL;
+}
+
+char* all_tests()
+{
+	mu_suite_start();
+
+	mu_run_test(test_create);
+	mu_run_test(test_push_pop);
+	mu_run_test(test_reuse);
+	mu_run_test(test_destroy);
+	mu_run_test(test_bench);
+
+	return NULL;
+}
+
+RUN_TESTS(all_tests);
@@ -0,0 +1,229 @@
+#include "minunit.h"
+#include <lcthw/spsc_ring.h>
+#include <lcthw/list.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <time.h>
+
+// values moved per throughput run, override with -DBENCH_N=...
+#ifndef BENCH_N
+#define BENCH_N 2000000
+#endif
+// round trips for the latency run
+#define PING_PONGS 20000
+#define RING_SIZE 1024
+
+static SpscRing* ring = NULL;
+char* test1 = "test1 data";
+char* test2 = "test2 data";
+char* test3 = "test3 data";
+
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+char* test_create()
+{
+	ring = SpscRing_create(5);
+	mu_assert(ring != NULL, "Failed to create ring.");
+	mu_assert(SpscRing_capacity(ring) == 8, "Capacity not rounded to a power of two.");
+	mu_assert(SpscRing_create(SIZE_MAX / 2 + 2) == NULL, "Capacity past the largest power of two accepted.");
+	mu_assert(SpscRing_create(SIZE_MAX) == NULL, "Capacity past the largest power of two accepted.");
+	return NULL;
+}
+
+char* test_push_pop()
+{
+	mu_assert(SpscRing_pop(ring) == NULL, "Pop on empty ring returned a value.");
+
+	mu_assert(SpscRing_push(ring, test1) == 0, "Push failed.");
+	mu_assert(SpscRing_push(ring, test2) == 0, "Push failed.");
+	mu_assert(SpscRing_pop(ring) == test1, "Wrong value on pop.");
+	mu_assert(SpscRing_pop(ring) == test2, "Wrong value on pop.");
+	mu_assert(SpscRing_pop(ring) == NULL, "Pop on drained ring returned a value.");
+
+	return NULL;
+}
+
+char* test_batch()
+{
+	void* in[10] = { test1, test2, test3, test1, test2, test3, test1, test2, test3, test1 };
+	void* out[10] = { NULL };
+	int i = 0;
+
+	// only 8 fit, and they wrap around the end of the buffer
+	mu_assert(SpscRing_push_batch(ring, in, 10) == 8, "Batch push should stop when full.");
+	mu_assert(SpscRing_push(ring, test1) == -1, "Push into a full ring succeeded.");
+
+	mu_assert(SpscRing_pop_batch(ring, out, 3) == 3, "Wrong partial batch pop.");
+	mu_assert(SpscRing_pop_batch(ring, out + 3, 10) == 5, "Batch pop should stop when empty.");
+	for (i = 0; i < 8; i++)
+		mu_assert(out[i] == in[i], "Batch came out in the wrong order.");
+
+	mu_assert(SpscRing_pop_batch(ring, out, 10) == 0, "Pop from empty ring returned values.");
+	return NULL;
+}
+
+char* test_destroy()
+{
+	SpscRing_destroy(ring);
+	return NULL;
+}
+
+typedef struct PipeArgs {
+	SpscRing* ring;
+	size_t batch;
+	long* values;
+} PipeArgs;
+
+static void* pipe_producer(void* arg)
+{
+	PipeArgs* args = arg;
+	void* batch[64];
+	long next = 0;
+	size_t i = 0;
+
+	while (next < BENCH_N) {
+		size_t count = args->batch;
+		if (count > (size_t)(BENCH_N - next))
+			count = BENCH_N - next;
+		for (i = 0; i < count; i++)
+			batch[i] = &args->values[next + i];
+
+		size_t sent = 0;
+		while (sent < count) {
+			size_t n = SpscRing_push_batch(args->ring, batch + sent, count - sent);
+			if (n == 0)
+				sched_yield();
+			sent += n;
+		}
+		next += count;
+	}
+
+	return NULL;
+}
+
+static int pipe_consume(PipeArgs* args)
+{
+	void* batch[64];
+	long expect = 0;
+	size_t i = 0;
+
+	while (expect < BENCH_N) {
+		size_t n = SpscRing_pop_batch(args->ring, batch, args->batch);
+		if (n == 0)
+			sched_yield();
+		for (i = 0; i < n; i++) {
+			if (*(long*)batch[i] != expect++)
+				return -1;
+		}
+	}
+
+	return 0;
+}
+
+char* test_throughput_bench()
+{
+	size_t batches[] = { 1, 16, 64 };
+	long* values = malloc(BENCH_N * sizeof(long));
+	int b = 0;
+	long i = 0;
+
+	for (i = 0; i < BENCH_N; i++)
+		values[i] = i;
+
+	for (b = 0; b < 3; b++) {
+		PipeArgs args = { SpscRing_create(RING_SIZE), batches[b], values };
+		pthread_t thread;
+
+		double start = now();
+		pthread_create(&thread, NULL, pipe_producer, &args);
+		int rc = pipe_consume(&args);
+		pthread_join(thread, NULL);
+		double elapsed = now() - start;
+
+		mu_assert(rc == 0, "Values arrived out of order.");
+		printf("SpscRing batch %2zu: %.2f Mvalues/s\n", batches[b], BENCH_N / elapsed / 1e6);
+		SpscRing_destroy(args.ring);
+	}
+
+	// the same pipe through a List behind a mutex
+	List* list = List_create();
+	pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+	double start = now();
+	for (i = 0; i < BENCH_N; i++) {
+		pthread_mutex_lock(&lock);
+		List_push(list, &values[i]);
+		pthread_mutex_unlock(&lock);
+		pthread_mutex_lock(&lock);
+		List_shift(list);
+		pthread_mutex_unlock(&lock);
+	}
+	printf("mutex List (uncontended): %.2f Mvalues/s\n", BENCH_N / (now() - start) / 1e6);
+	List_destroy(list);
+
+	free(values);
+	return NULL;
+}
+
+static void* ping_ponger(void* arg)
+{
+	SpscRing** rings = arg;
+	int i = 0;
+
+	// bounce every value straight back
+	for (i = 0; i < PING_PONGS; i++) {
+		void* value = NULL;
+		while ((value = SpscRing_pop(rings[0])) == NULL)
+			sched_yield();
+		while (SpscRing_push(rings[1], value) != 0)
+			sched_yield();
+	}
+
+	return NULL;
+}
+
+char* test_latency_bench()
+{
+	SpscRing* rings[2] = { SpscRing_create(RING_SIZE), SpscRing_create(RING_SIZE) };
+	pthread_t thread;
+	int i = 0;
+
+	pthread_create(&thread, NULL, ping_ponger, rings);
+
+	double start = now();
+	for (i = 0; i < PING_PONGS; i++) {
+		SpscRing_push(rings[0], test1);
+		while (SpscRing_pop(rings[1]) == NULL)
+			sched_yield();
+	}
+	double elapsed = now() - start;
+	pthread_join(thread, NULL);
+
+	printf("SpscRing one-way latency: %.2fus\n", elapsed / PING_PONGS / 2 * 1e6);
+
+	SpscRing_destroy(rings[0]);
+	SpscRing_destroy(rings[1]);
+	return NULL;
+}
+
+char* all_tests()
+{
+	mu_suite_start();
+
+	mu_run_test(test_create);
+	mu_run_test(test_push_pop);
+	mu_run_test(test_batch);
+	mu_run_test(test_destroy);
+	mu_run_test(test_throughput_bench);
+	mu_run_test(test_latency_bench);
+
+	return NULL;
+}
+
+RUN_TESTS(all_tests);